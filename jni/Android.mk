@@ -3,7 +3,7 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_MODULE    := mediaplayer
-LOCAL_SRC_FILES := mediaplayer.c nativelayer.c media-player-marshal.c rtspstreamer.c windowrenderer.c rtspviewer.c
+LOCAL_SRC_FILES := mediaplayer.c nativelayer.c media-player-marshal.c rtspstreamer.c windowrenderer.c rtspviewer.c mosaicrenderer.c streamregistry.c sharedbufferpool.c nativewindowsink.c presentscheduler.c playerwall.c admissionscheduler.c cameratour.c transportpolicy.c tlssessioncache.c batchudpsrc.c syncgroup.c diskwriter.c rtsprecorder.c segmentstorage.c keyframeindex.c segmentsrc.c clipexport.c thumbnailcache.c sharedsrc.c
 LOCAL_SHARED_LIBRARIES := gstreamer_android
 LOCAL_LDLIBS := -llog -landroid
 include $(BUILD_SHARED_LIBRARY)
@@ -17,7 +17,15 @@ endif
 GSTREAMER_NDK_BUILD_PATH  := $(GSTREAMER_ROOT)/share/gst-android/ndk-build/
 include $(GSTREAMER_NDK_BUILD_PATH)/plugins.mk
 
-GSTREAMER_PLUGINS         := $(GSTREAMER_PLUGINS_CORE) $(GSTREAMER_PLUGINS_PLAYBACK) $(GSTREAMER_PLUGINS_CODECS) $(GSTREAMER_PLUGINS_NET) $(GSTREAMER_PLUGINS_SYS) $(GSTREAMER_PLUGINS_CODECS_RESTRICTED)
+# Only what the viewing pipelines use, every plugin listed here is registered
+# on each start. Cameras commonly send G.711 audio (alaw, mulaw) and MJPEG
+# video (jpeg).
+GSTREAMER_PLUGINS         := coreelements typefindfunctions playback app \
+                             videoconvert videoscale compositor opengl \
+                             audioconvert audioresample volume autodetect opensles \
+                             rtsp rtp rtpmanager udp tcp soup \
+                             androidmedia libav videoparsersbad audioparsers isomp4 multifile \
+                             alaw mulaw jpeg
 G_IO_MODULES              := gnutls
-GSTREAMER_EXTRA_DEPS      := gstreamer-video-1.0
+GSTREAMER_EXTRA_DEPS      := gstreamer-video-1.0 gstreamer-app-1.0 gstreamer-rtsp-1.0 gstreamer-sdp-1.0 gstreamer-net-1.0 gstreamer-base-1.0
 include $(GSTREAMER_NDK_BUILD_PATH)/gstreamer-1.0.mk
@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstAdmissionScheduler: Limits and orders the connection attempts of all
+ * players.
+ *
+ * Players queue a ticket instead of connecting right away. Tickets are
+ * admitted in priority order as long as there are fewer than MAX_PER_HOST
+ * attempts in flight to the same host and fewer than MAX_ACTIVE overall, and
+ * attempts to the same host are spread by at least STAGGER_INTERVAL. An
+ * attempt holds its slot until the player reports it done, or for at most
+ * ADMISSION_TIMEOUT. Failed attempts are queued again after an exponential
+ * backoff, so a camera rejecting sessions under load is retried once the
+ * others are through instead of failing the tile.
+ */
+#include <string.h>
+#include <pthread.h>
+
+#include "admissionscheduler.h"
+
+#define MAX_PER_HOST 2
+#define MAX_ACTIVE 6
+#define STAGGER_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+#define ADMISSION_TIMEOUT 8000  /* milliseconds */
+#define MAX_ATTEMPTS 5
+#define BACKOFF_MIN 500         /* milliseconds */
+#define BACKOFF_MAX 8000
+
+typedef enum
+{
+  TICKET_QUEUED,                /* Waiting for a slot */
+  TICKET_ADMITTED,              /* Connecting, holds a slot */
+  TICKET_BACKOFF,               /* Waiting to be queued again */
+  TICKET_IDLE                   /* Holds no slot and is not queued */
+} GstTicketState;
+
+struct _GstAdmissionTicket
+{
+  gint ref_count;
+  gchar *host;
+  gint priority;
+  guint64 seq;                  /* Orders tickets of the same priority */
+  GstAdmitFunc func;
+  gpointer user_data;
+  GstTicketState state;
+  guint attempts;               /* Failed attempts so far */
+  GSource *timer;               /* Admission timeout or backoff */
+  gint64 queued_time;           /* Monotonic time, microseconds */
+  gint64 admitted_time;
+
+  GMutex run_lock;              /* Held while calling func */
+  gboolean cancelled;
+};
+
+typedef struct
+{
+  guint active;                 /* Admitted tickets */
+  gint64 last_start;            /* Monotonic time of the last admission */
+} GstAdmissionHost;
+
+struct _GstAdmissionScheduler
+{
+  GMutex lock;                  /* Protects everything below and the tickets */
+  GList *queue;                 /* Queued tickets, in admission order */
+  GHashTable *hosts;            /* Host name -> GstAdmissionHost */
+  guint active;
+  guint64 seq;
+  GSource *dispatch;            /* Pending dispatch, if any */
+
+  GMainContext *context;
+  GMainLoop *main_loop;
+  pthread_t thread;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GstAdmissionTicket *
+ticket_ref (GstAdmissionTicket * ticket)
+{
+  g_atomic_int_inc (&ticket->ref_count);
+
+  return ticket;
+}
+
+static void
+ticket_unref (gpointer user_data)
+{
+  GstAdmissionTicket *ticket = (GstAdmissionTicket *) user_data;
+
+  if (!g_atomic_int_dec_and_test (&ticket->ref_count))
+    return;
+
+  g_mutex_clear (&ticket->run_lock);
+  g_free (ticket->host);
+  g_free (ticket);
+}
+
+/* Higher priority first, then first come first served */
+static gint
+compare_tickets (gconstpointer a, gconstpointer b)
+{
+  const GstAdmissionTicket *ticket_a = a;
+  const GstAdmissionTicket *ticket_b = b;
+
+  if (ticket_a->priority != ticket_b->priority)
+    return ticket_b->priority - ticket_a->priority;
+
+  return ticket_a->seq < ticket_b->seq ? -1 : 1;
+}
+
+/* Must be called with the lock held */
+static GstAdmissionHost *
+get_host_unlocked (GstAdmissionScheduler * scheduler, const gchar * name)
+{
+  GstAdmissionHost *host;
+
+  host = g_hash_table_lookup (scheduler->hosts, name);
+  if (host == NULL) {
+    host = g_new0 (GstAdmissionHost, 1);
+    host->last_start = G_MININT64 / 2;
+    g_hash_table_insert (scheduler->hosts, g_strdup (name), host);
+  }
+
+  return host;
+}
+
+/* Must be called with the lock held */
+static void
+release_slot_unlocked (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket)
+{
+  GstAdmissionHost *host;
+
+  if (ticket->state != TICKET_ADMITTED)
+    return;
+
+  host = get_host_unlocked (scheduler, ticket->host);
+  host->active--;
+  scheduler->active--;
+  ticket->state = TICKET_IDLE;
+}
+
+/* Must be called with the lock held */
+static void
+clear_timer_unlocked (GstAdmissionTicket * ticket)
+{
+  if (ticket->timer == NULL)
+    return;
+
+  g_source_destroy (ticket->timer);
+  g_source_unref (ticket->timer);
+  ticket->timer = NULL;
+}
+
+/* Must be called with the lock held */
+static void
+set_timer_unlocked (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket, guint delay, GSourceFunc func)
+{
+  clear_timer_unlocked (ticket);
+
+  ticket->timer = g_timeout_source_new (delay);
+  g_source_set_callback (ticket->timer, func, ticket_ref (ticket),
+      ticket_unref);
+  g_source_attach (ticket->timer, scheduler->context);
+}
+
+static gboolean dispatch_cb (gpointer user_data);
+
+/* Must be called with the lock held */
+static void
+schedule_dispatch_unlocked (GstAdmissionScheduler * scheduler, guint delay)
+{
+  if (scheduler->dispatch != NULL) {
+    g_source_destroy (scheduler->dispatch);
+    g_source_unref (scheduler->dispatch);
+  }
+
+  scheduler->dispatch = g_timeout_source_new (delay);
+  g_source_set_callback (scheduler->dispatch, dispatch_cb, scheduler, NULL);
+  g_source_attach (scheduler->dispatch, scheduler->context);
+}
+
+static gboolean
+admission_timeout_cb (gpointer user_data)
+{
+  GstAdmissionTicket *ticket = (GstAdmissionTicket *) user_data;
+  GstAdmissionScheduler *scheduler = gst_admission_scheduler_get_default ();
+
+  g_mutex_lock (&scheduler->lock);
+  if (ticket->state == TICKET_ADMITTED) {
+    GST_WARNING ("Connection to %s still not done, giving back its slot",
+        ticket->host);
+    release_slot_unlocked (scheduler, ticket);
+    schedule_dispatch_unlocked (scheduler, 0);
+  }
+  clear_timer_unlocked (ticket);
+  g_mutex_unlock (&scheduler->lock);
+
+  return FALSE;
+}
+
+static gboolean
+backoff_cb (gpointer user_data)
+{
+  GstAdmissionTicket *ticket = (GstAdmissionTicket *) user_data;
+  GstAdmissionScheduler *scheduler = gst_admission_scheduler_get_default ();
+
+  g_mutex_lock (&scheduler->lock);
+  if (ticket->state == TICKET_BACKOFF) {
+    GST_DEBUG ("Queueing attempt %u to %s", ticket->attempts + 1,
+        ticket->host);
+    ticket->state = TICKET_QUEUED;
+    scheduler->queue = g_list_insert_sorted (scheduler->queue, ticket,
+        compare_tickets);
+    schedule_dispatch_unlocked (scheduler, 0);
+  }
+  clear_timer_unlocked (ticket);
+  g_mutex_unlock (&scheduler->lock);
+
+  return FALSE;
+}
+
+/* Admit as many queued tickets as the limits allow */
+static gboolean
+dispatch_cb (gpointer user_data)
+{
+  GstAdmissionScheduler *scheduler = (GstAdmissionScheduler *) user_data;
+  GList *admitted = NULL;
+  GList *walk;
+  GList *next;
+  gint64 now;
+  gint64 wakeup = -1;
+
+  g_mutex_lock (&scheduler->lock);
+
+  if (scheduler->dispatch == g_main_current_source ()) {
+    g_source_unref (scheduler->dispatch);
+    scheduler->dispatch = NULL;
+  }
+
+  now = g_get_monotonic_time ();
+  for (walk = scheduler->queue; walk != NULL; walk = next) {
+    GstAdmissionTicket *ticket = walk->data;
+    GstAdmissionHost *host;
+
+    next = walk->next;
+
+    if (scheduler->active >= MAX_ACTIVE)
+      break;
+
+    host = get_host_unlocked (scheduler, ticket->host);
+    if (host->active >= MAX_PER_HOST)
+      continue;
+
+    if (now - host->last_start < STAGGER_INTERVAL) {
+      gint64 wait = host->last_start + STAGGER_INTERVAL - now;
+
+      if (wakeup < 0 || wait < wakeup)
+        wakeup = wait;
+      continue;
+    }
+
+    GST_DEBUG ("Admitting connection to %s after %" G_GINT64_FORMAT " ms, "
+        "attempt %u, %u in flight", ticket->host,
+        (now - ticket->queued_time) / G_TIME_SPAN_MILLISECOND,
+        ticket->attempts + 1, scheduler->active + 1);
+
+    scheduler->queue = g_list_delete_link (scheduler->queue, walk);
+    ticket->state = TICKET_ADMITTED;
+    ticket->admitted_time = now;
+    host->active++;
+    host->last_start = now;
+    scheduler->active++;
+    set_timer_unlocked (scheduler, ticket, ADMISSION_TIMEOUT,
+        admission_timeout_cb);
+
+    admitted = g_list_append (admitted, ticket_ref (ticket));
+  }
+
+  if (wakeup >= 0)
+    schedule_dispatch_unlocked (scheduler,
+        (wakeup + G_TIME_SPAN_MILLISECOND - 1) / G_TIME_SPAN_MILLISECOND);
+
+  g_mutex_unlock (&scheduler->lock);
+
+  /* Start the attempts without the lock, the players may call back */
+  for (walk = admitted; walk != NULL; walk = walk->next) {
+    GstAdmissionTicket *ticket = walk->data;
+
+    g_mutex_lock (&ticket->run_lock);
+    if (!ticket->cancelled)
+      ticket->func (ticket->user_data);
+    g_mutex_unlock (&ticket->run_lock);
+
+    ticket_unref (ticket);
+  }
+  g_list_free (admitted);
+
+  return FALSE;
+}
+
+/* Drop the reference of the owner once no attempt can be started anymore */
+static void
+ticket_finish (GstAdmissionTicket * ticket)
+{
+  g_mutex_lock (&ticket->run_lock);
+  ticket->cancelled = TRUE;
+  g_mutex_unlock (&ticket->run_lock);
+
+  ticket_unref (ticket);
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstAdmissionScheduler *scheduler = (GstAdmissionScheduler *) user_data;
+
+  g_main_context_push_thread_default (scheduler->context);
+  g_main_loop_run (scheduler->main_loop);
+  g_main_context_pop_thread_default (scheduler->context);
+
+  return NULL;
+}
+
+/**
+ * gst_admission_scheduler_get_default:
+ *
+ * Returns: (transfer none): the scheduler shared by all players.
+ */
+GstAdmissionScheduler *
+gst_admission_scheduler_get_default (void)
+{
+  static gsize initialized = 0;
+  static GstAdmissionScheduler *scheduler;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "admissionscheduler", 0,
+        "Admission Scheduler");
+    gst_debug_set_threshold_for_name ("admissionscheduler", GST_LEVEL_DEBUG);
+
+    scheduler = g_new0 (GstAdmissionScheduler, 1);
+    g_mutex_init (&scheduler->lock);
+    scheduler->hosts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        g_free);
+    scheduler->context = g_main_context_new ();
+    scheduler->main_loop = g_main_loop_new (scheduler->context, FALSE);
+    pthread_create (&scheduler->thread, NULL, &thread_function, scheduler);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return scheduler;
+}
+
+/**
+ * gst_admission_scheduler_get_host:
+ * @uri: uri
+ *
+ * Returns: (transfer full): the host @uri connects to, NULL if it is not a
+ * network uri.
+ */
+gchar *
+gst_admission_scheduler_get_host (const gchar * uri)
+{
+  const gchar *start;
+  const gchar *end;
+  const gchar *p;
+
+  if (uri == NULL || (!g_str_has_prefix (uri, "rtsp") &&
+          !g_str_has_prefix (uri, "http")))
+    return NULL;
+
+  start = strstr (uri, "://");
+  if (start == NULL)
+    return NULL;
+  start += 3;
+  end = start + strcspn (start, "/?#");
+
+  /* Skip the credentials */
+  for (p = start; p < end; p++)
+    if (*p == '@')
+      start = p + 1;
+
+  if (*start == '[') {
+    p = memchr (start, ']', end - start);
+    if (p != NULL)
+      end = p + 1;
+  } else {
+    p = memchr (start, ':', end - start);
+    if (p != NULL)
+      end = p;
+  }
+
+  if (end == start)
+    return NULL;
+
+  return g_ascii_strdown (start, end - start);
+}
+
+/**
+ * gst_admission_scheduler_enqueue:
+ * @scheduler: a #GstAdmissionScheduler
+ * @host: host to connect to
+ * @priority: tickets with higher priority are admitted first
+ * @func: starts the connection attempt
+ * @user_data: passed to @func
+ *
+ * Queues a connection attempt. @func is called from the scheduler thread once
+ * admitted; the attempt must then be reported with
+ * gst_admission_scheduler_done() or abandoned with
+ * gst_admission_scheduler_cancel().
+ *
+ * Returns: the ticket of the attempt.
+ */
+GstAdmissionTicket *
+gst_admission_scheduler_enqueue (GstAdmissionScheduler * scheduler,
+    const gchar * host, gint priority, GstAdmitFunc func, gpointer user_data)
+{
+  GstAdmissionTicket *ticket;
+
+  ticket = g_new0 (GstAdmissionTicket, 1);
+  ticket->ref_count = 1;
+  ticket->host = g_strdup (host);
+  ticket->priority = priority;
+  ticket->func = func;
+  ticket->user_data = user_data;
+  ticket->queued_time = g_get_monotonic_time ();
+  g_mutex_init (&ticket->run_lock);
+
+  g_mutex_lock (&scheduler->lock);
+  ticket->seq = scheduler->seq++;
+  ticket->state = TICKET_QUEUED;
+  scheduler->queue = g_list_insert_sorted (scheduler->queue, ticket,
+      compare_tickets);
+  schedule_dispatch_unlocked (scheduler, 0);
+  g_mutex_unlock (&scheduler->lock);
+
+  GST_DEBUG ("Queued connection to %s, priority %d", host, priority);
+
+  return ticket;
+}
+
+/**
+ * gst_admission_scheduler_set_priority:
+ * @scheduler: a #GstAdmissionScheduler
+ * @ticket: a #GstAdmissionTicket
+ * @priority: tickets with higher priority are admitted first
+ *
+ * Changes the priority of a queued, or later retried, attempt.
+ */
+void
+gst_admission_scheduler_set_priority (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket, gint priority)
+{
+  g_mutex_lock (&scheduler->lock);
+  ticket->priority = priority;
+  if (ticket->state == TICKET_QUEUED) {
+    scheduler->queue = g_list_remove (scheduler->queue, ticket);
+    scheduler->queue = g_list_insert_sorted (scheduler->queue, ticket,
+        compare_tickets);
+  }
+  g_mutex_unlock (&scheduler->lock);
+}
+
+/**
+ * gst_admission_scheduler_done:
+ * @scheduler: a #GstAdmissionScheduler
+ * @ticket: a #GstAdmissionTicket
+ * @success: whether the connection was established
+ *
+ * Reports the outcome of an admitted attempt, giving back its slot. A failed
+ * attempt is retried after a backoff, unless it failed too often already.
+ *
+ * Returns: TRUE if the attempt will be retried and @ticket is still valid,
+ * FALSE if @ticket was freed.
+ */
+gboolean
+gst_admission_scheduler_done (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket, gboolean success)
+{
+  gboolean attempted;
+
+  g_mutex_lock (&scheduler->lock);
+
+  attempted = ticket->state == TICKET_ADMITTED || ticket->state == TICKET_IDLE;
+  if (ticket->state == TICKET_ADMITTED)
+    GST_DEBUG ("Connection to %s %s after %" G_GINT64_FORMAT " ms",
+        ticket->host, success ? "established" : "failed",
+        (g_get_monotonic_time () - ticket->admitted_time) /
+        G_TIME_SPAN_MILLISECOND);
+
+  release_slot_unlocked (scheduler, ticket);
+  clear_timer_unlocked (ticket);
+  scheduler->queue = g_list_remove (scheduler->queue, ticket);
+  schedule_dispatch_unlocked (scheduler, 0);
+
+  if (!success && attempted && ticket->attempts + 1 < MAX_ATTEMPTS) {
+    guint delay;
+
+    ticket->attempts++;
+    delay = MIN (BACKOFF_MIN << (ticket->attempts - 1), BACKOFF_MAX);
+    /* Jitter, so tiles rejected together do not come back together */
+    delay += g_random_int_range (0, delay / 4 + 1);
+
+    GST_DEBUG ("Retrying connection to %s in %u ms", ticket->host, delay);
+
+    ticket->state = TICKET_BACKOFF;
+    ticket->queued_time = g_get_monotonic_time () + delay * 1000;
+    set_timer_unlocked (scheduler, ticket, delay, backoff_cb);
+    g_mutex_unlock (&scheduler->lock);
+
+    return TRUE;
+  }
+
+  ticket->state = TICKET_IDLE;
+  g_mutex_unlock (&scheduler->lock);
+
+  ticket_finish (ticket);
+
+  return FALSE;
+}
+
+/**
+ * gst_admission_scheduler_cancel:
+ * @scheduler: a #GstAdmissionScheduler
+ * @ticket: a #GstAdmissionTicket
+ *
+ * Abandons the attempt and frees @ticket. Waits for its #GstAdmitFunc if it is
+ * running, so it must not be called from it.
+ */
+void
+gst_admission_scheduler_cancel (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket)
+{
+  g_mutex_lock (&scheduler->lock);
+  release_slot_unlocked (scheduler, ticket);
+  clear_timer_unlocked (ticket);
+  scheduler->queue = g_list_remove (scheduler->queue, ticket);
+  ticket->state = TICKET_IDLE;
+  schedule_dispatch_unlocked (scheduler, 0);
+  g_mutex_unlock (&scheduler->lock);
+
+  ticket_finish (ticket);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstAdmissionScheduler: Limits and orders the connection attempts of all
+ * players.
+ */
+#ifndef __GST_ADMISSION_SCHEDULER_H__
+#define __GST_ADMISSION_SCHEDULER_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstAdmissionScheduler GstAdmissionScheduler;
+typedef struct _GstAdmissionTicket GstAdmissionTicket;
+
+/* Starts the connection attempt, called from the scheduler thread */
+typedef void (*GstAdmitFunc) (gpointer user_data);
+
+GstAdmissionScheduler * gst_admission_scheduler_get_default (void);
+gchar * gst_admission_scheduler_get_host (const gchar * uri);
+GstAdmissionTicket * gst_admission_scheduler_enqueue (
+    GstAdmissionScheduler * scheduler, const gchar * host, gint priority,
+    GstAdmitFunc func, gpointer user_data);
+void gst_admission_scheduler_set_priority (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket, gint priority);
+gboolean gst_admission_scheduler_done (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket, gboolean success);
+void gst_admission_scheduler_cancel (GstAdmissionScheduler * scheduler,
+    GstAdmissionTicket * ticket);
+
+G_END_DECLS
+
+#endif /* __GST_ADMISSION_SCHEDULER_H__ */
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstBatchUdpSrc: udpsrc receiving all queued datagrams with one syscall and
+ * pushing them as a buffer list.
+ *
+ * rtspsrc creates its unicast RTP and RTCP sources by the factory name
+ * "udpsrc", and multicast ones from udp:// URIs, so neither would ever pick
+ * an element of a different name, whatever its rank. The element therefore
+ * takes over the "udpsrc" factory of the registry: every udpsrc created
+ * afterwards, by rtspsrc or anybody else, is a GstBatchUdpSrc. It derives
+ * from the udpsrc of the udp plugin, whose type is only known at run time,
+ * keeping all of its properties, and lets it wait for the first datagram:
+ * timeouts, flushing
+ * and the socket setup stay exactly as rtspsrc expects them. Whatever else is
+ * queued on the socket by then is picked up with a single non-blocking
+ * recvmmsg() into buffers that are kept mapped and ready, taken from a pool
+ * of packet sized buffers, and everything is pushed downstream at once.
+ *
+ * Datagrams larger than a pool buffer are rare for RTP; if one shows up the
+ * element falls back to receiving one datagram at a time.
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <gio/gio.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/net/gstnetaddressmeta.h>
+
+#include "batchudpsrc.h"
+
+#define BATCH_SIZE 32
+#define PACKET_SIZE 2048
+#define MIN_PACKETS (4 * BATCH_SIZE)
+
+typedef struct _GstBatchUdpSrcPrivate GstBatchUdpSrcPrivate;
+
+struct _GstBatchUdpSrcPrivate
+{
+  gint fd;                      /* Socket of the parent, -1 until known */
+  gboolean batching;            /* FALSE once a datagram was truncated */
+  GstBufferPool *pool;
+  GstBuffer *slots[BATCH_SIZE]; /* Ready to receive into, mapped */
+  GstMapInfo maps[BATCH_SIZE];
+  struct iovec iov[BATCH_SIZE];
+  struct sockaddr_storage addrs[BATCH_SIZE];
+  struct mmsghdr msgs[BATCH_SIZE];
+
+  /* Statistics */
+  guint64 syscalls;
+  guint64 packets;
+};
+
+#define GST_BATCH_UDP_SRC_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_BATCH_UDP_SRC, GstBatchUdpSrcPrivate))
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GstElementClass *parent_class;
+static GstFlowReturn (*parent_create) (GstPushSrc * src, GstBuffer ** buf);
+static gboolean (*parent_stop) (GstBaseSrc * src);
+
+static gboolean
+fill_slot (GstBatchUdpSrcPrivate * priv, guint i)
+{
+  GstBuffer *buffer = NULL;
+
+  if (gst_buffer_pool_acquire_buffer (priv->pool, &buffer, NULL) !=
+      GST_FLOW_OK)
+    return FALSE;
+
+  /* Released buffers come back with the size of the packet they held */
+  gst_buffer_set_size (buffer, PACKET_SIZE);
+  if (!gst_buffer_map (buffer, &priv->maps[i], GST_MAP_WRITE)) {
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+
+  priv->slots[i] = buffer;
+  priv->iov[i].iov_base = priv->maps[i].data;
+  priv->iov[i].iov_len = priv->maps[i].size;
+
+  return TRUE;
+}
+
+static void
+clear_slots (GstBatchUdpSrcPrivate * priv)
+{
+  guint i;
+
+  for (i = 0; i < BATCH_SIZE; i++) {
+    if (priv->slots[i] == NULL)
+      continue;
+    gst_buffer_unmap (priv->slots[i], &priv->maps[i]);
+    gst_buffer_unref (priv->slots[i]);
+    priv->slots[i] = NULL;
+  }
+}
+
+static gboolean
+prepare (GstBatchUdpSrc * self, GstBatchUdpSrcPrivate * priv)
+{
+  GSocket *socket = NULL;
+  GstStructure *config;
+  guint i;
+
+  g_object_get (self, "used-socket", &socket, NULL);
+  if (socket == NULL)
+    return FALSE;
+  priv->fd = g_socket_get_fd (socket);
+  g_object_unref (socket);
+
+  priv->pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (priv->pool);
+  gst_buffer_pool_config_set_params (config, NULL, PACKET_SIZE, MIN_PACKETS,
+      0);
+  gst_buffer_pool_set_config (priv->pool, config);
+  gst_buffer_pool_set_active (priv->pool, TRUE);
+
+  for (i = 0; i < BATCH_SIZE; i++) {
+    if (!fill_slot (priv, i))
+      return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Batching on socket %d", priv->fd);
+
+  return TRUE;
+}
+
+/* Takes whatever is queued on the socket without waiting, and adds it to
+ * @list */
+static void
+receive_batch (GstBatchUdpSrc * self, GstBatchUdpSrcPrivate * priv,
+    GstBufferList * list, GstClockTime timestamp)
+{
+  gint n, i;
+
+  for (i = 0; i < BATCH_SIZE; i++) {
+    memset (&priv->msgs[i], 0, sizeof (struct mmsghdr));
+    priv->msgs[i].msg_hdr.msg_iov = &priv->iov[i];
+    priv->msgs[i].msg_hdr.msg_iovlen = 1;
+    priv->msgs[i].msg_hdr.msg_name = &priv->addrs[i];
+    priv->msgs[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_storage);
+  }
+
+  /* Called directly, older Android C libraries lack the wrapper */
+  n = syscall (__NR_recvmmsg, priv->fd, priv->msgs, BATCH_SIZE,
+      MSG_DONTWAIT, NULL);
+  priv->syscalls++;
+  if (n <= 0) {
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      GST_WARNING_OBJECT (self, "recvmmsg failed: %s", g_strerror (errno));
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    GstBuffer *buffer = priv->slots[i];
+    GSocketAddress *addr;
+
+    gst_buffer_unmap (buffer, &priv->maps[i]);
+    priv->slots[i] = NULL;
+
+    if (priv->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      GST_WARNING_OBJECT (self, "Datagram larger than %d bytes, not batching "
+          "anymore", PACKET_SIZE);
+      priv->batching = FALSE;
+      gst_buffer_unref (buffer);
+      continue;
+    }
+
+    gst_buffer_set_size (buffer, priv->msgs[i].msg_len);
+    GST_BUFFER_DTS (buffer) = timestamp;
+
+    addr = g_socket_address_new_from_native (&priv->addrs[i],
+        priv->msgs[i].msg_hdr.msg_namelen);
+    if (addr != NULL) {
+      gst_buffer_add_net_address_meta (buffer, addr);
+      g_object_unref (addr);
+    }
+
+    gst_buffer_list_add (list, buffer);
+    priv->packets++;
+  }
+
+  /* Get the consumed slots ready for the next batch */
+  for (i = 0; i < n; i++) {
+    if (!fill_slot (priv, i)) {
+      priv->batching = FALSE;
+      break;
+    }
+  }
+}
+
+static GstFlowReturn
+gst_batch_udp_src_create (GstPushSrc * psrc, GstBuffer ** buf)
+{
+  GstBatchUdpSrc *self = GST_BATCH_UDP_SRC (psrc);
+  GstBatchUdpSrcPrivate *priv = GST_BATCH_UDP_SRC_GET_PRIVATE (self);
+  GstBufferList *list;
+  GstBuffer *first = NULL;
+  GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+  GstClock *clock;
+  GstFlowReturn ret;
+
+  /* The parent waits for the first datagram, and handles timeouts and
+   * flushing */
+  ret = parent_create (psrc, &first);
+  if (ret != GST_FLOW_OK || first == NULL || !priv->batching) {
+    *buf = first;
+    return ret;
+  }
+
+  if (priv->fd < 0 && !prepare (self, priv)) {
+    GST_WARNING_OBJECT (self, "Could not prepare batching");
+    priv->batching = FALSE;
+    clear_slots (priv);
+    *buf = first;
+    return ret;
+  }
+
+  /* Buffer lists are not timestamped by the base class, do it like it would
+   * with the arrival running time */
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (clock != NULL) {
+    timestamp = gst_clock_get_time (clock) -
+        gst_element_get_base_time (GST_ELEMENT (self));
+    gst_object_unref (clock);
+  }
+  if (!GST_BUFFER_DTS_IS_VALID (first))
+    GST_BUFFER_DTS (first) = timestamp;
+
+  list = gst_buffer_list_new_sized (BATCH_SIZE + 1);
+  gst_buffer_list_add (list, first);
+  receive_batch (self, priv, list, timestamp);
+
+  if (gst_buffer_list_length (list) == 1) {
+    *buf = gst_buffer_ref (first);
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+
+  gst_base_src_submit_buffer_list (GST_BASE_SRC (self), list);
+  *buf = NULL;
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_batch_udp_src_stop (GstBaseSrc * bsrc)
+{
+  GstBatchUdpSrcPrivate *priv = GST_BATCH_UDP_SRC_GET_PRIVATE (bsrc);
+
+  GST_DEBUG_OBJECT (bsrc, "%" G_GUINT64_FORMAT " packets batched in %"
+      G_GUINT64_FORMAT " syscalls", priv->packets, priv->syscalls);
+
+  clear_slots (priv);
+  if (priv->pool != NULL) {
+    gst_buffer_pool_set_active (priv->pool, FALSE);
+    gst_object_unref (priv->pool);
+    priv->pool = NULL;
+  }
+  priv->fd = -1;
+  priv->batching = TRUE;
+
+  return parent_stop (bsrc);
+}
+
+static void
+gst_batch_udp_src_class_init (gpointer klass, gpointer class_data)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  parent_class = g_type_class_peek_parent (klass);
+
+  g_type_class_add_private (klass, sizeof (GstBatchUdpSrcPrivate));
+
+  parent_create = pushsrc_class->create;
+  pushsrc_class->create = gst_batch_udp_src_create;
+  parent_stop = basesrc_class->stop;
+  basesrc_class->stop = gst_batch_udp_src_stop;
+
+  gst_element_class_set_static_metadata (element_class,
+      "Batching UDP packet receiver", "Source/Network",
+      "Receive data over the network via UDP, in batches",
+      "Ognyan Tonchev <otonchev at gmail.com>");
+}
+
+static void
+gst_batch_udp_src_init (GTypeInstance * instance, gpointer g_class)
+{
+  GstBatchUdpSrcPrivate *priv = GST_BATCH_UDP_SRC_GET_PRIVATE (instance);
+
+  priv->fd = -1;
+  priv->batching = TRUE;
+}
+
+/**
+ * gst_batch_udp_src_get_type:
+ *
+ * Returns: the type, or 0 if the udp plugin is not registered.
+ */
+GType
+gst_batch_udp_src_get_type (void)
+{
+  static gsize initialized = 0;
+  static GType type = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    GstElement *udpsrc;
+    GType parent;
+
+    GST_DEBUG_CATEGORY_INIT (debug_category, "batchudpsrc", 0,
+        "Batching UDP source");
+    gst_debug_set_threshold_for_name ("batchudpsrc", GST_LEVEL_DEBUG);
+
+    /* Make sure the udp plugin registered its types */
+    udpsrc = gst_element_factory_make ("udpsrc", NULL);
+    if (udpsrc != NULL)
+      gst_object_unref (udpsrc);
+
+    parent = g_type_from_name ("GstUDPSrc");
+    if (parent != 0 && g_type_is_a (parent, GST_TYPE_PUSH_SRC)) {
+      GTypeQuery query;
+      GTypeInfo info;
+
+      g_type_query (parent, &query);
+      memset (&info, 0, sizeof (info));
+      info.class_size = query.class_size;
+      info.class_init = gst_batch_udp_src_class_init;
+      info.instance_size = query.instance_size;
+      info.instance_init = gst_batch_udp_src_init;
+
+      type = g_type_register_static (parent, "GstBatchUdpSrc", &info, 0);
+    } else {
+      GST_WARNING ("udpsrc not available");
+    }
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return type;
+}
+
+/**
+ * gst_batch_udp_src_register:
+ *
+ * Registers the element as "udpsrc", replacing the factory of the udp
+ * plugin, so that it is used instead of udpsrc from then on.
+ *
+ * Returns: TRUE on success.
+ */
+gboolean
+gst_batch_udp_src_register (void)
+{
+  static gsize registered = 0;
+
+  if (g_once_init_enter (&registered)) {
+    GType type = gst_batch_udp_src_get_type ();
+    gboolean ok = FALSE;
+
+    /* The udp plugin is not the owner of the new feature, so the registry
+     * replaces its factory instead of updating it */
+    if (type != 0)
+      ok = gst_element_register (NULL, "udpsrc", GST_RANK_PRIMARY, type);
+    if (ok)
+      GST_DEBUG ("udpsrc is now batching");
+
+    g_once_init_leave (&registered, ok ? 1 : 2);
+  }
+
+  return registered == 1;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstBatchUdpSrc: udpsrc receiving all queued datagrams with one syscall and
+ * pushing them as a buffer list.
+ */
+#ifndef __GST_BATCH_UDP_SRC_H__
+#define __GST_BATCH_UDP_SRC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_BATCH_UDP_SRC (gst_batch_udp_src_get_type ())
+#define GST_BATCH_UDP_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_BATCH_UDP_SRC, GstBatchUdpSrc))
+#define GST_IS_BATCH_UDP_SRC(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_BATCH_UDP_SRC))
+
+typedef struct _GstBatchUdpSrc GstBatchUdpSrc;
+
+GType gst_batch_udp_src_get_type (void);
+
+gboolean gst_batch_udp_src_register (void);
+
+G_END_DECLS
+
+#endif /* __GST_BATCH_UDP_SRC_H__ */
@@ -0,0 +1,592 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstCameraTour: GstWindowRenderer cycling through a list of cameras, the
+ * next camera being prepared in the background before its turn.
+ *
+ * Every camera gets a player of its own, rendering with a native window sink
+ * the tour controls directly. "prefetch" seconds before the end of a step the
+ * next camera starts playing without a window, its sink dropping the frames.
+ * At the switch the window is taken from the current sink and handed to the
+ * next one, which renders its last frame right away, so the surface always
+ * shows a picture. The switch is postponed for a while if the next camera
+ * has not delivered a frame yet.
+ *
+ * The "keep-warm" most recently shown cameras keep playing in the
+ * background, the others are stopped as soon as they are left.
+ */
+#include <pthread.h>
+#include <gst/video/videooverlay.h>
+
+#include "cameratour.h"
+#include "windowrenderer.h"
+#include "mediaplayer.h"
+#include "rtspstreamer.h"
+#include "rtspviewer.h"
+#include "nativewindowsink.h"
+
+#define GST_CAMERA_TOUR_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_CAMERA_TOUR, GstCameraTourPrivate))
+
+/* How often and how long to wait for a late camera at the switch */
+#define SWITCH_RETRY 250        /* milliseconds */
+#define MAX_SWITCH_DELAY 5000
+
+typedef struct
+{
+  gchar *uri;
+  gchar *user;
+  gchar *pass;
+  GstMediaPlayer *player;       /* Created on first use */
+  GstElement *sink;
+} GstTourCamera;
+
+struct _GstCameraTourPrivate
+{
+  GMutex lock;                  /* Protects everything below */
+  guint dwell;                  /* Seconds per camera */
+  guint prefetch;               /* Seconds the next camera is started early */
+  guint keep_warm;
+  GPtrArray *cameras;           /* List of GstTourCamera */
+  gint current;                 /* Camera shown, -1 if stopped */
+  gint next;                    /* Camera prepared, -1 if none */
+  GList *warm;                  /* Cameras left but still playing, oldest first */
+  guint switch_delay;           /* How long the switch has been postponed */
+  ANativeWindow *native_window;
+
+  GMainContext *context;        /* Runs the dwell timers */
+  GMainLoop *main_loop;
+  pthread_t thread;
+  GSource *timer;
+};
+
+/* object properties */
+enum
+{
+  PROP_0,
+  PROP_DWELL,
+  PROP_PREFETCH,
+  PROP_KEEP_WARM
+};
+
+#define DEFAULT_DWELL 10
+#define DEFAULT_PREFETCH 3
+#define DEFAULT_KEEP_WARM 0
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static void gst_camera_tour_finalize (GObject * obj);
+static void gst_camera_tour_get_property (GObject *object,
+    guint property_id, GValue *value, GParamSpec *pspec);
+static void gst_camera_tour_set_property (GObject *object,
+    guint property_id, const GValue *value, GParamSpec *pspec);
+static void gst_camera_tour_window_renderer_interface_init (
+    GstWindowRendererInterface * iface);
+static void gst_camera_tour_set_window (GstWindowRenderer * renderer,
+    ANativeWindow * native_window);
+static void gst_camera_tour_release_window (GstWindowRenderer * renderer);
+
+G_DEFINE_TYPE_WITH_CODE (GstCameraTour, gst_camera_tour, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_WINDOW_RENDERER,
+        gst_camera_tour_window_renderer_interface_init));
+
+static void
+gst_camera_tour_class_init (GstCameraTourClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  g_type_class_add_private (klass, sizeof (GstCameraTourPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_camera_tour_finalize;
+  gobject_class->get_property = gst_camera_tour_get_property;
+  gobject_class->set_property = gst_camera_tour_set_property;
+
+  g_object_class_install_property (gobject_class,
+      PROP_DWELL, g_param_spec_uint ("dwell", "Dwell",
+      "Seconds each camera is shown", 1, G_MAXUINT, DEFAULT_DWELL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class,
+      PROP_PREFETCH, g_param_spec_uint ("prefetch", "Prefetch",
+      "Seconds the next camera is started before its turn", 0, G_MAXUINT,
+      DEFAULT_PREFETCH, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEEP_WARM, g_param_spec_uint ("keep-warm", "KeepWarm",
+      "Number of cameras left that keep playing in the background", 0,
+      G_MAXUINT, DEFAULT_KEEP_WARM, G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "cameratour", 0, "Camera Tour");
+  gst_debug_set_threshold_for_name ("cameratour", GST_LEVEL_DEBUG);
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstCameraTourPrivate *priv = (GstCameraTourPrivate *) user_data;
+
+  g_main_context_push_thread_default (priv->context);
+  g_main_loop_run (priv->main_loop);
+  g_main_context_pop_thread_default (priv->context);
+
+  return NULL;
+}
+
+static void
+gst_camera_tour_init (GstCameraTour * self)
+{
+  GstCameraTourPrivate *priv;
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (self);
+
+  g_mutex_init (&priv->lock);
+  priv->cameras = g_ptr_array_new ();
+  priv->current = -1;
+  priv->next = -1;
+
+  priv->context = g_main_context_new ();
+  priv->main_loop = g_main_loop_new (priv->context, FALSE);
+  pthread_create (&priv->thread, NULL, &thread_function, priv);
+}
+
+static void
+gst_camera_tour_window_renderer_interface_init (
+    GstWindowRendererInterface * iface)
+{
+  iface->set_window = gst_camera_tour_set_window;
+  iface->release_window = gst_camera_tour_release_window;
+}
+
+static void
+camera_free (GstTourCamera * camera)
+{
+  if (camera->player != NULL) {
+    g_object_unref (camera->player);
+    gst_object_unref (camera->sink);
+  }
+  g_free (camera->uri);
+  g_free (camera->user);
+  g_free (camera->pass);
+  g_free (camera);
+}
+
+/* Must be called with the lock held */
+static GstTourCamera *
+get_camera_unlocked (GstCameraTourPrivate * priv, gint index)
+{
+  return g_ptr_array_index (priv->cameras, index);
+}
+
+/* Start the camera without a window, its sink drops the frames until it gets
+ * one. Must be called with the lock held. */
+static void
+camera_play_unlocked (GstCameraTourPrivate * priv, GstTourCamera * camera)
+{
+  priv->warm = g_list_remove (priv->warm, camera);
+
+  if (camera->player == NULL) {
+    GObject *viewer;
+
+    camera->sink = gst_native_window_sink_new ();
+    gst_object_ref_sink (camera->sink);
+    g_object_set (camera->sink, "scheduled", TRUE, NULL);
+
+    viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "video-sink", camera->sink,
+        "share-stream", TRUE, NULL);
+    camera->player = gst_media_player_new (GST_RTSP_STREAMER (viewer), NULL);
+    if (!gst_media_player_setup_thread (camera->player, NULL))
+      GST_ERROR ("Could not configure player for %s", camera->uri);
+    gst_media_player_set_uri (camera->player, camera->uri, camera->user,
+        camera->pass);
+  }
+
+  GST_DEBUG ("Starting %s", camera->uri);
+  gst_media_player_set_state (camera->player, GST_STATE_PLAYING);
+}
+
+/* Whether the camera delivered a frame yet */
+static gboolean
+camera_ready (GstTourCamera * camera)
+{
+  GstSample *sample = NULL;
+
+  if (camera->sink == NULL)
+    return FALSE;
+
+  g_object_get (camera->sink, "last-sample", &sample, NULL);
+  if (sample == NULL)
+    return FALSE;
+
+  gst_sample_unref (sample);
+
+  return TRUE;
+}
+
+/* Must be called with the lock held */
+static void
+camera_show_unlocked (GstCameraTourPrivate * priv, GstTourCamera * camera)
+{
+  if (priv->native_window == NULL || camera->sink == NULL)
+    return;
+
+  gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (camera->sink),
+      (guintptr) priv->native_window);
+  /* Render the frame prerolled in the background right away */
+  gst_video_overlay_expose (GST_VIDEO_OVERLAY (camera->sink));
+}
+
+/* Must be called with the lock held */
+static void
+camera_hide_unlocked (GstCameraTourPrivate * priv, GstTourCamera * camera)
+{
+  if (camera->sink == NULL)
+    return;
+
+  gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (camera->sink),
+      (guintptr) NULL);
+}
+
+/* Keep the camera playing or stop it, according to the policy. Must be
+ * called with the lock held. */
+static void
+camera_retire_unlocked (GstCameraTourPrivate * priv, GstTourCamera * camera)
+{
+  priv->warm = g_list_append (priv->warm, camera);
+
+  while (g_list_length (priv->warm) > priv->keep_warm) {
+    GstTourCamera *oldest = priv->warm->data;
+
+    priv->warm = g_list_delete_link (priv->warm, priv->warm);
+    GST_DEBUG ("Stopping %s", oldest->uri);
+    gst_media_player_set_state (oldest->player, GST_STATE_READY);
+  }
+}
+
+/* Must be called with the lock held */
+static void
+schedule_unlocked (GstCameraTour * tour, guint delay, GSourceFunc func)
+{
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  if (priv->timer != NULL) {
+    g_source_destroy (priv->timer);
+    g_source_unref (priv->timer);
+  }
+
+  priv->timer = g_timeout_source_new (delay);
+  g_source_set_callback (priv->timer, func, tour, NULL);
+  g_source_attach (priv->timer, priv->context);
+}
+
+static gboolean prefetch_cb (gpointer user_data);
+
+/* Must be called with the lock held */
+static void
+schedule_step_unlocked (GstCameraTour * tour)
+{
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  if (priv->cameras->len < 2)
+    return;
+
+  schedule_unlocked (tour,
+      (priv->dwell - MIN (priv->prefetch, priv->dwell)) * 1000, prefetch_cb);
+}
+
+static gboolean
+switch_cb (gpointer user_data)
+{
+  GstCameraTour *tour = GST_CAMERA_TOUR (user_data);
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+  GstTourCamera *current;
+  GstTourCamera *next;
+
+  g_mutex_lock (&priv->lock);
+
+  if (priv->current < 0 || priv->next < 0)
+    goto done;
+
+  current = get_camera_unlocked (priv, priv->current);
+  next = get_camera_unlocked (priv, priv->next);
+
+  if (!camera_ready (next) && priv->switch_delay < MAX_SWITCH_DELAY) {
+    GST_DEBUG ("%s not ready yet, postponing the switch", next->uri);
+    priv->switch_delay += SWITCH_RETRY;
+    schedule_unlocked (tour, SWITCH_RETRY, switch_cb);
+    goto done;
+  }
+
+  GST_DEBUG ("Switching from %s to %s after %u ms delay", current->uri,
+      next->uri, priv->switch_delay);
+
+  /* The surface keeps showing the last frame of the current camera until
+   * the next one posts its own */
+  camera_hide_unlocked (priv, current);
+  camera_show_unlocked (priv, next);
+  camera_retire_unlocked (priv, current);
+
+  priv->current = priv->next;
+  priv->next = -1;
+  schedule_step_unlocked (tour);
+
+done:
+  g_mutex_unlock (&priv->lock);
+
+  return FALSE;
+}
+
+static gboolean
+prefetch_cb (gpointer user_data)
+{
+  GstCameraTour *tour = GST_CAMERA_TOUR (user_data);
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  g_mutex_lock (&priv->lock);
+
+  if (priv->current >= 0) {
+    priv->next = (priv->current + 1) % priv->cameras->len;
+    priv->switch_delay = 0;
+    camera_play_unlocked (priv, get_camera_unlocked (priv, priv->next));
+    schedule_unlocked (tour, MIN (priv->prefetch, priv->dwell) * 1000,
+        switch_cb);
+  }
+
+  g_mutex_unlock (&priv->lock);
+
+  return FALSE;
+}
+
+static void
+gst_camera_tour_finalize (GObject * obj)
+{
+  GstCameraTour *tour = GST_CAMERA_TOUR (obj);
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  gst_camera_tour_stop (tour);
+
+  g_main_loop_quit (priv->main_loop);
+  pthread_join (priv->thread, NULL);
+  g_main_loop_unref (priv->main_loop);
+  g_main_context_unref (priv->context);
+
+  g_ptr_array_foreach (priv->cameras, (GFunc) camera_free, NULL);
+  g_ptr_array_free (priv->cameras, TRUE);
+
+  if (priv->native_window != NULL)
+    ANativeWindow_release (priv->native_window);
+
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_camera_tour_parent_class)->finalize (obj);
+}
+
+static void
+gst_camera_tour_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstCameraTour *tour = GST_CAMERA_TOUR (object);
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  switch (property_id)
+  {
+    case PROP_DWELL:
+      g_value_set_uint (value, priv->dwell);
+      break;
+    case PROP_PREFETCH:
+      g_value_set_uint (value, priv->prefetch);
+      break;
+    case PROP_KEEP_WARM:
+      g_value_set_uint (value, priv->keep_warm);
+      break;
+  }
+}
+
+static void
+gst_camera_tour_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstCameraTour *tour = GST_CAMERA_TOUR (object);
+  GstCameraTourPrivate *priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  /* Takes effect from the next step on */
+  g_mutex_lock (&priv->lock);
+  switch (property_id)
+  {
+    case PROP_DWELL:
+      priv->dwell = g_value_get_uint (value);
+      break;
+    case PROP_PREFETCH:
+      priv->prefetch = g_value_get_uint (value);
+      break;
+    case PROP_KEEP_WARM:
+      priv->keep_warm = g_value_get_uint (value);
+      break;
+  }
+  g_mutex_unlock (&priv->lock);
+}
+
+GstCameraTour *
+gst_camera_tour_new (guint dwell, guint keep_warm)
+{
+  return g_object_new (GST_TYPE_CAMERA_TOUR, "dwell", dwell, "keep-warm",
+      keep_warm, NULL);
+}
+
+/**
+ * gst_camera_tour_add_camera:
+ * @tour: a #GstCameraTour
+ * @uri: uri
+ * @user: user id for the RTSP authentication
+ * @pass: password for the RTSP authentication
+ *
+ * Appends a camera to the tour.
+ */
+void
+gst_camera_tour_add_camera (GstCameraTour * tour, const gchar * uri,
+    const gchar * user, const gchar * pass)
+{
+  GstCameraTourPrivate *priv;
+  GstTourCamera *camera;
+
+  g_return_if_fail (GST_IS_CAMERA_TOUR (tour));
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  camera = g_new0 (GstTourCamera, 1);
+  camera->uri = g_strdup (uri);
+  camera->user = g_strdup (user);
+  camera->pass = g_strdup (pass);
+
+  g_mutex_lock (&priv->lock);
+  g_ptr_array_add (priv->cameras, camera);
+  /* A tour of a single camera had nothing to schedule */
+  if (priv->current >= 0 && priv->cameras->len == 2)
+    schedule_step_unlocked (tour);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_camera_tour_start:
+ * @tour: a #GstCameraTour
+ *
+ * Shows the first camera and starts cycling.
+ */
+void
+gst_camera_tour_start (GstCameraTour * tour)
+{
+  GstCameraTourPrivate *priv;
+  GstTourCamera *camera;
+
+  g_return_if_fail (GST_IS_CAMERA_TOUR (tour));
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->current < 0 && priv->cameras->len > 0) {
+    GST_DEBUG ("Starting tour of %u cameras", priv->cameras->len);
+
+    priv->current = 0;
+    camera = get_camera_unlocked (priv, 0);
+    camera_play_unlocked (priv, camera);
+    camera_show_unlocked (priv, camera);
+    schedule_step_unlocked (tour);
+  }
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_camera_tour_stop:
+ * @tour: a #GstCameraTour
+ *
+ * Stops cycling and all the cameras.
+ */
+void
+gst_camera_tour_stop (GstCameraTour * tour)
+{
+  GstCameraTourPrivate *priv;
+  guint i;
+
+  g_return_if_fail (GST_IS_CAMERA_TOUR (tour));
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (tour);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->timer != NULL) {
+    g_source_destroy (priv->timer);
+    g_source_unref (priv->timer);
+    priv->timer = NULL;
+  }
+
+  for (i = 0; i < priv->cameras->len; i++) {
+    GstTourCamera *camera = get_camera_unlocked (priv, i);
+
+    if (camera->player == NULL)
+      continue;
+
+    camera_hide_unlocked (priv, camera);
+    gst_media_player_set_state (camera->player, GST_STATE_READY);
+  }
+
+  g_list_free (priv->warm);
+  priv->warm = NULL;
+  priv->current = -1;
+  priv->next = -1;
+  g_mutex_unlock (&priv->lock);
+}
+
+static void
+gst_camera_tour_set_window (GstWindowRenderer * renderer,
+    ANativeWindow * native_window)
+{
+  GstCameraTourPrivate *priv;
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (renderer);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->native_window != NULL)
+    ANativeWindow_release (priv->native_window);
+  priv->native_window = native_window;
+
+  if (priv->current >= 0)
+    camera_show_unlocked (priv, get_camera_unlocked (priv, priv->current));
+  g_mutex_unlock (&priv->lock);
+}
+
+/* The cameras keep playing without a window */
+static void
+gst_camera_tour_release_window (GstWindowRenderer * renderer)
+{
+  GstCameraTourPrivate *priv;
+
+  priv = GST_CAMERA_TOUR_GET_PRIVATE (renderer);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->current >= 0)
+    camera_hide_unlocked (priv, get_camera_unlocked (priv, priv->current));
+
+  if (priv->native_window != NULL) {
+    ANativeWindow_release (priv->native_window);
+    priv->native_window = NULL;
+  }
+  g_mutex_unlock (&priv->lock);
+}
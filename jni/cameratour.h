@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstCameraTour: GstWindowRenderer cycling through a list of cameras, the
+ * next camera being prepared in the background before its turn.
+ */
+#ifndef _GST_CAMERA_TOUR_H_
+#define _GST_CAMERA_TOUR_H_
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CAMERA_TOUR (gst_camera_tour_get_type ())
+#define GST_CAMERA_TOUR(object) (G_TYPE_CHECK_INSTANCE_CAST ((object), GST_TYPE_CAMERA_TOUR, GstCameraTour))
+#define GST_CAMERA_TOUR_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_CAMERA_TOUR, GstCameraTourClass))
+#define GST_IS_CAMERA_TOUR(object) (G_TYPE_CHECK_INSTANCE_TYPE ((object), GST_TYPE_CAMERA_TOUR))
+#define GST_IS_CAMERA_TOUR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_CAMERA_TOUR))
+#define GST_CAMERA_TOUR_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_CAMERA_TOUR, GstCameraTourClass))
+
+typedef struct _GstCameraTour GstCameraTour;
+typedef struct _GstCameraTourClass GstCameraTourClass;
+typedef struct _GstCameraTourPrivate GstCameraTourPrivate;
+
+struct _GstCameraTour {
+  GObject parent;
+
+  /*< protected >*/
+
+  /*< private >*/
+};
+
+struct _GstCameraTourClass {
+  GObjectClass parent_class;
+
+  /*< private >*/
+};
+
+GType gst_camera_tour_get_type (void);
+
+GstCameraTour * gst_camera_tour_new (guint dwell, guint keep_warm);
+void gst_camera_tour_add_camera (GstCameraTour * tour, const gchar * uri,
+    const gchar * user, const gchar * pass);
+void gst_camera_tour_start (GstCameraTour * tour);
+void gst_camera_tour_stop (GstCameraTour * tour);
+
+G_END_DECLS
+
+#endif /* _GST_CAMERA_TOUR_H_ */
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstClipExport: Copies a time range of a recording into a clip of its own,
+ * without transcoding.
+ *
+ * The segments recorded in the range (see segmentstorage.c) are read by
+ * splitmuxsrc as one timeline and the compressed frames are muxed again into
+ * a regular MP4 file, nothing is decoded. The clip starts at the keyframe at
+ * or before the start of the range, so that it plays from its first frame,
+ * and ends before the first keyframe after the range, so that the frames
+ * decoded ahead of the last one of the range make it into the clip too.
+ *
+ * The export runs on a thread of its own and the pipeline is not synced to a
+ * clock, it goes as fast as the output is allowed to. Writing is throttled to
+ * MAX_WRITE_RATE so that the recorders and players sharing the flash do not
+ * notice the export.
+ */
+#include <string.h>
+#include <pthread.h>
+#include <glib/gstdio.h>
+
+#include "clipexport.h"
+#include "segmentstorage.h"
+
+/* Bytes per second written at most */
+#define MAX_WRITE_RATE (8 * 1024 * 1024)
+/* Longest a throttled write waits before checking for cancellation */
+#define MAX_THROTTLE_SLEEP (50 * 1000)
+/* Progress is reported at most this often */
+#define PROGRESS_INTERVAL (200 * GST_MSECOND)
+
+struct _GstClipExport
+{
+  gchar *directory;
+  gint64 start;                 /* Wall clock time, milliseconds */
+  gint64 end;
+  gchar *location;
+  GstClipExportFunc func;
+  gpointer user_data;
+
+  gchar **segments;             /* Oldest first */
+  GstClockTime first;           /* The range on the timeline of the segments */
+  GstClockTime last;
+  GstElement *pipeline;
+  GstElement *mux;
+  gboolean linked;              /* The video is going into the muxer */
+  gint cancelled;               /* Atomic */
+  gint progress;                /* Atomic, per mille */
+  pthread_t thread;
+
+  /* Streaming thread */
+  GQueue gop;                   /* Frames from the last keyframe before the
+                                 * range */
+  gboolean started;
+  gboolean ended;
+  gint64 write_start;           /* Monotonic time of the first write */
+  guint64 written;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Position of wall clock @time on the timeline of the segments, a time
+ * between two segments is where the later one starts */
+static GstClockTime
+to_timeline (GstClockTime * offsets, gint64 * starts, guint n, gint64 time)
+{
+  GstClockTime position = 0;
+  guint i = n - 1;
+
+  while (i > 0 && starts[i] > time)
+    i--;
+
+  if (time > starts[i])
+    position = (time - starts[i]) * GST_MSECOND;
+  if (i + 1 < n)
+    position = MIN (position, offsets[i + 1] - offsets[i]);
+
+  return offsets[i] + position;
+}
+
+static gchar **
+format_location_cb (GstElement * splitmuxsrc, gpointer user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+
+  return g_strdupv (export->segments);
+}
+
+static void
+clear_gop (GstClipExport * export)
+{
+  g_queue_foreach (&export->gop, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&export->gop);
+}
+
+/* Lets the frames of the range through, starting with the GOP of its first
+ * frame, and ends the clip with the GOP of its last. Frames come in decoding
+ * order, so they are cut by DTS. */
+static GstPadProbeReturn
+cut_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gboolean keyframe =
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  GstClockTime timestamp;
+
+  if (export->ended)
+    return GST_PAD_PROBE_DROP;
+
+  timestamp = GST_BUFFER_DTS_IS_VALID (buffer) ? GST_BUFFER_DTS (buffer) :
+      GST_BUFFER_PTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+    return export->started ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+
+  /* Frames after the range up to the next keyframe complete its last GOP */
+  if (timestamp > export->last && (keyframe || !export->started)) {
+    GST_DEBUG ("End of the range at %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (timestamp));
+    export->ended = TRUE;
+    clear_gop (export);
+    gst_pad_push_event (pad, gst_event_new_eos ());
+    return GST_PAD_PROBE_DROP;
+  }
+
+  if (!export->started) {
+    GstBuffer *frame;
+
+    if (timestamp < export->first) {
+      if (keyframe)
+        clear_gop (export);
+      if (keyframe || !g_queue_is_empty (&export->gop))
+        g_queue_push_tail (&export->gop, gst_buffer_ref (buffer));
+      return GST_PAD_PROBE_DROP;
+    }
+
+    /* Nothing to decode from yet */
+    if (g_queue_is_empty (&export->gop) && !keyframe)
+      return GST_PAD_PROBE_DROP;
+
+    GST_DEBUG ("Clip starts %u frames before the range",
+        g_queue_get_length (&export->gop));
+    export->started = TRUE;
+
+    /* Passes this probe again */
+    while ((frame = g_queue_pop_head (&export->gop)) != NULL) {
+      if (gst_pad_push (pad, frame) != GST_FLOW_OK) {
+        clear_gop (export);
+        return GST_PAD_PROBE_DROP;
+      }
+    }
+  }
+
+  if (export->last > export->first && timestamp > export->first)
+    g_atomic_int_set (&export->progress, (gint) (1000 *
+            (MIN (timestamp, export->last) - export->first) /
+            (export->last - export->first)));
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Keeps the writes under MAX_WRITE_RATE */
+static GstPadProbeReturn
+throttle_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+  gint64 now = g_get_monotonic_time ();
+  gint64 due;
+
+  if (export->write_start == 0)
+    export->write_start = now;
+  export->written += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+
+  due = export->write_start +
+      (gint64) (export->written * G_USEC_PER_SEC / MAX_WRITE_RATE);
+  while (now < due && !g_atomic_int_get (&export->cancelled)) {
+    g_usleep (MIN (due - now, MAX_THROTTLE_SLEEP));
+    now = g_get_monotonic_time ();
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Only the video goes into the clip, like it is the only stream recorded */
+static GstPadProbeReturn
+drop_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  return GST_PAD_PROBE_DROP;
+}
+
+static void
+pad_added_cb (GstElement * splitmuxsrc, GstPad * pad, gpointer user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+  GstPad *muxpad;
+
+  if (export->linked || !g_str_has_prefix (GST_PAD_NAME (pad), "video")) {
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_DATA_DOWNSTREAM,
+        drop_probe_cb, NULL, NULL);
+    return;
+  }
+
+  muxpad = gst_element_get_request_pad (export->mux, "video_%u");
+  if (muxpad == NULL || gst_pad_link (pad, muxpad) != GST_PAD_LINK_OK) {
+    GST_WARNING ("Could not link %s to the muxer", GST_PAD_NAME (pad));
+    if (muxpad != NULL) {
+      gst_element_release_request_pad (export->mux, muxpad);
+      gst_object_unref (muxpad);
+    }
+    return;
+  }
+  gst_object_unref (muxpad);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, cut_probe_cb, export,
+      NULL);
+  export->linked = TRUE;
+}
+
+static void
+no_more_pads_cb (GstElement * splitmuxsrc, gpointer user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+
+  if (!export->linked)
+    GST_ELEMENT_ERROR (splitmuxsrc, STREAM, WRONG_TYPE,
+        ("No video recorded in the range"), (NULL));
+}
+
+/* Returns an error message on failure */
+static gchar *
+create_pipeline (GstClipExport * export)
+{
+  GstElement *splitmuxsrc;
+  GstElement *filesink;
+  GstClockTime *offsets;
+  gint64 *starts = NULL;
+  guint n;
+  GstPad *sinkpad;
+
+  export->segments = gst_segment_storage_find_segments (export->directory,
+      export->start, export->end, &starts);
+  n = g_strv_length (export->segments);
+  if (n == 0) {
+    g_free (starts);
+    return g_strdup ("Nothing recorded in the range");
+  }
+
+  offsets = gst_segment_storage_get_timeline (export->segments, starts);
+  export->first = to_timeline (offsets, starts, n, export->start);
+  export->last = to_timeline (offsets, starts, n, export->end);
+  g_free (offsets);
+  g_free (starts);
+
+  GST_DEBUG ("Exporting %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT " of %u "
+      "segments to %s", GST_TIME_ARGS (export->first),
+      GST_TIME_ARGS (export->last), n, export->location);
+
+  export->pipeline = gst_pipeline_new (NULL);
+  gst_object_ref_sink (export->pipeline);
+  splitmuxsrc = gst_element_factory_make ("splitmuxsrc", NULL);
+  export->mux = gst_element_factory_make ("mp4mux", NULL);
+  filesink = gst_element_factory_make ("filesink", NULL);
+  if (splitmuxsrc == NULL || export->mux == NULL || filesink == NULL) {
+    if (splitmuxsrc != NULL)
+      gst_object_unref (splitmuxsrc);
+    if (export->mux != NULL)
+      gst_object_unref (export->mux);
+    if (filesink != NULL)
+      gst_object_unref (filesink);
+    export->mux = NULL;
+    return g_strdup ("Could not create export pipeline");
+  }
+
+  g_object_set (filesink, "location", export->location, NULL);
+  g_signal_connect (splitmuxsrc, "format-location",
+      G_CALLBACK (format_location_cb), export);
+  g_signal_connect (splitmuxsrc, "pad-added", G_CALLBACK (pad_added_cb),
+      export);
+  g_signal_connect (splitmuxsrc, "no-more-pads",
+      G_CALLBACK (no_more_pads_cb), export);
+
+  gst_bin_add_many (GST_BIN (export->pipeline), splitmuxsrc, export->mux,
+      filesink, NULL);
+  gst_element_link (export->mux, filesink);
+
+  sinkpad = gst_element_get_static_pad (filesink, "sink");
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, throttle_probe_cb,
+      export, NULL);
+  gst_object_unref (sinkpad);
+
+  return NULL;
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstClipExport *export = (GstClipExport *) user_data;
+  gchar *error;
+  GstBus *bus;
+  gint reported = -1;
+  gint64 start_time = g_get_monotonic_time ();
+
+  error = create_pipeline (export);
+  if (error != NULL)
+    goto done;
+
+  bus = gst_element_get_bus (export->pipeline);
+  gst_element_set_state (export->pipeline, GST_STATE_PLAYING);
+
+  while (error == NULL) {
+    GstMessage *msg;
+    gint progress;
+
+    msg = gst_bus_timed_pop_filtered (bus, PROGRESS_INTERVAL,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    if (g_atomic_int_get (&export->cancelled)) {
+      error = g_strdup ("Cancelled");
+    } else if (msg != NULL && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+      GError *err = NULL;
+
+      gst_message_parse_error (msg, &err, NULL);
+      error = g_strdup (err != NULL ? err->message : "Export failed");
+      g_clear_error (&err);
+    } else if (msg != NULL) {
+      gst_message_unref (msg);
+      break;
+    }
+
+    if (msg != NULL)
+      gst_message_unref (msg);
+
+    progress = g_atomic_int_get (&export->progress);
+    if (error == NULL && progress != reported && export->func != NULL) {
+      export->func (export, progress / 1000.0, FALSE, NULL,
+          export->user_data);
+      reported = progress;
+    }
+  }
+
+  gst_element_set_state (export->pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+
+done:
+  clear_gop (export);
+
+  if (error != NULL) {
+    GST_WARNING ("Could not export %s: %s", export->location, error);
+    g_unlink (export->location);
+  } else {
+    GST_DEBUG ("Exported %s in %" G_GINT64_FORMAT " ms, %" G_GUINT64_FORMAT
+        " bytes", export->location, (g_get_monotonic_time () - start_time) /
+        1000, export->written);
+  }
+
+  if (export->func != NULL)
+    export->func (export, error != NULL ?
+        g_atomic_int_get (&export->progress) / 1000.0 : 1.0, TRUE, error,
+        export->user_data);
+  g_free (error);
+
+  return NULL;
+}
+
+/**
+ * gst_clip_export_new:
+ * @directory: storage area of the camera
+ * @start: wall clock time, milliseconds since the epoch
+ * @end: wall clock time, milliseconds since the epoch
+ * @location: the clip to write
+ * @func: reports the progress
+ * @user_data: passed to @func
+ *
+ * Starts exporting what was recorded in @directory between @start and @end.
+ *
+ * Returns: (transfer full): the export, free with gst_clip_export_free(),
+ * which must not be called from @func.
+ */
+GstClipExport *
+gst_clip_export_new (const gchar * directory, gint64 start, gint64 end,
+    const gchar * location, GstClipExportFunc func, gpointer user_data)
+{
+  static gsize initialized = 0;
+  GstClipExport *export;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "clipexport", 0, "Clip Export");
+    gst_debug_set_threshold_for_name ("clipexport", GST_LEVEL_DEBUG);
+    g_once_init_leave (&initialized, 1);
+  }
+
+  export = g_new0 (GstClipExport, 1);
+  export->directory = g_strdup (directory);
+  export->start = start;
+  export->end = end;
+  export->location = g_strdup (location);
+  export->func = func;
+  export->user_data = user_data;
+  g_queue_init (&export->gop);
+
+  pthread_create (&export->thread, NULL, &thread_function, export);
+
+  return export;
+}
+
+/**
+ * gst_clip_export_cancel:
+ * @export: a #GstClipExport
+ *
+ * Stops the export and deletes what was written of the clip. The last call
+ * of the #GstClipExportFunc reports it.
+ */
+void
+gst_clip_export_cancel (GstClipExport * export)
+{
+  g_atomic_int_set (&export->cancelled, 1);
+}
+
+/**
+ * gst_clip_export_free:
+ * @export: a #GstClipExport
+ *
+ * Cancels the export unless it is done, and waits for it.
+ */
+void
+gst_clip_export_free (GstClipExport * export)
+{
+  gst_clip_export_cancel (export);
+  pthread_join (export->thread, NULL);
+
+  if (export->pipeline != NULL)
+    gst_object_unref (export->pipeline);
+  g_strfreev (export->segments);
+  g_free (export->directory);
+  g_free (export->location);
+  g_free (export);
+}
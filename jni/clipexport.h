@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstClipExport: Copies a time range of a recording into a clip of its own,
+ * without transcoding.
+ */
+#ifndef __GST_CLIP_EXPORT_H__
+#define __GST_CLIP_EXPORT_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstClipExport GstClipExport;
+
+/* Reports @progress between 0 and 1 from the worker thread. Called a last
+ * time with @done set, and @error unless the clip was written. */
+typedef void (*GstClipExportFunc) (GstClipExport * export, gdouble progress,
+    gboolean done, const gchar * error, gpointer user_data);
+
+GstClipExport * gst_clip_export_new (const gchar * directory, gint64 start,
+    gint64 end, const gchar * location, GstClipExportFunc func,
+    gpointer user_data);
+void gst_clip_export_cancel (GstClipExport * export);
+void gst_clip_export_free (GstClipExport * export);
+
+G_END_DECLS
+
+#endif /* __GST_CLIP_EXPORT_H__ */
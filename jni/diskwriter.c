@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstDiskWriter: Interface for writing the media to disk.
+ */
+#include "diskwriter.h"
+
+G_DEFINE_INTERFACE (GstDiskWriter, gst_disk_writer, G_TYPE_OBJECT);
+
+void
+gst_disk_writer_set_location (GstDiskWriter * writer, const gchar * location)
+{
+  GST_DISK_WRITER_GET_INTERFACE (writer)->set_location (writer, location);
+}
+
+static void
+gst_disk_writer_default_init (GstDiskWriterInterface * writer)
+{
+}
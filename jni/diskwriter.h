@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstDiskWriter: Interface for writing the media to disk.
+ */
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+
+#ifndef __GST_DISK_WRITER_H__
+#define __GST_DISK_WRITER_H__
+
+typedef struct _GstDiskWriter GstDiskWriter; /* dummy object */
+typedef struct _GstDiskWriterInterface GstDiskWriterInterface;
+
+#define GST_TYPE_DISK_WRITER    (gst_disk_writer_get_type ())
+#define GST_DISK_WRITER(obj)    (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_DISK_WRITER, GstDiskWriter))
+#define GST_IS_DISK_WRITER(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_DISK_WRITER))
+#define GST_DISK_WRITER_GET_INTERFACE(inst) (G_TYPE_INSTANCE_GET_INTERFACE ((inst), GST_TYPE_DISK_WRITER, GstDiskWriterInterface))
+
+struct _GstDiskWriterInterface {
+  GTypeInterface iface;
+
+  /*< methods >*/
+  void (*set_location) (GstDiskWriter * writer, const gchar * location);
+};
+
+GType         gst_disk_writer_get_type   (void);
+
+void gst_disk_writer_set_location (GstDiskWriter * writer,
+    const gchar * location);
+
+#endif /* __GST_DISK_WRITER_H__ */
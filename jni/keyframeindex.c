@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstKeyframeIndex: Sidecar index of a recording, mapping the time of every
+ * frame to where it is in the file.
+ *
+ * The index of "<file>" is "<file>.idx": a header followed by one fixed size
+ * record per frame, in the order the frames were recorded, holding the time
+ * of the frame on the timeline of the file, the byte offset of the fragment
+ * holding it and whether it is a keyframe. A frame is only added once the
+ * muxer has written its fragment.
+ *
+ * Records are only ever appended, an index cut short by a crash is still
+ * valid up to its last complete record. Readers map the file and look
+ * positions up with a binary search, without touching the recording.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "keyframeindex.h"
+
+#define INDEX_SUFFIX ".idx"
+#define INDEX_MAGIC "KFIX"
+#define INDEX_VERSION 2
+
+#define FLAG_KEYFRAME (1 << 0)
+
+typedef struct
+{
+  gchar magic[4];
+  guint32 version;              /* Little endian, like the records */
+  guint32 record_size;
+  guint32 reserved;
+} GstKeyframeIndexHeader;
+
+typedef struct
+{
+  guint64 timestamp;
+  guint64 offset;
+  guint32 flags;
+  guint32 reserved;
+} GstKeyframeIndexRecord;
+
+struct _GstKeyframeIndexWriter
+{
+  FILE *file;
+};
+
+struct _GstKeyframeIndex
+{
+  GMappedFile *mapped;
+  const GstKeyframeIndexRecord *records;
+  guint size;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static void
+init_debug (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "keyframeindex", 0,
+        "Keyframe Index");
+    gst_debug_set_threshold_for_name ("keyframeindex", GST_LEVEL_DEBUG);
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+/**
+ * gst_keyframe_index_get_path:
+ * @location: a recording
+ *
+ * Returns: (transfer full): the path of the index of @location, free with
+ * g_free().
+ */
+gchar *
+gst_keyframe_index_get_path (const gchar * location)
+{
+  return g_strconcat (location, INDEX_SUFFIX, NULL);
+}
+
+/**
+ * gst_keyframe_index_writer_new:
+ * @location: the recording being written
+ *
+ * Returns: (transfer full): a writer for the index of @location, replacing
+ * any previous one, or NULL if it can not be created. Free with
+ * gst_keyframe_index_writer_free().
+ */
+GstKeyframeIndexWriter *
+gst_keyframe_index_writer_new (const gchar * location)
+{
+  GstKeyframeIndexWriter *writer;
+  GstKeyframeIndexHeader header = { INDEX_MAGIC, };
+  gchar *path;
+  FILE *file;
+
+  init_debug ();
+
+  path = gst_keyframe_index_get_path (location);
+  file = g_fopen (path, "wb");
+  if (file == NULL) {
+    GST_WARNING ("Could not create %s", path);
+    g_free (path);
+    return NULL;
+  }
+  GST_DEBUG ("Writing index %s", path);
+  g_free (path);
+
+  header.version = GUINT32_TO_LE (INDEX_VERSION);
+  header.record_size = GUINT32_TO_LE (sizeof (GstKeyframeIndexRecord));
+  fwrite (&header, sizeof (header), 1, file);
+
+  writer = g_new0 (GstKeyframeIndexWriter, 1);
+  writer->file = file;
+
+  return writer;
+}
+
+/**
+ * gst_keyframe_index_writer_add:
+ * @writer: a #GstKeyframeIndexWriter
+ * @timestamp: time of the frame on the timeline of the file
+ * @offset: offset of the fragment holding the frame
+ * @keyframe: whether the frame is a keyframe
+ *
+ * Appends the next frame. The index is flushed on keyframes, so readers see
+ * every complete GOP.
+ */
+void
+gst_keyframe_index_writer_add (GstKeyframeIndexWriter * writer,
+    GstClockTime timestamp, guint64 offset, gboolean keyframe)
+{
+  GstKeyframeIndexRecord record = { 0, };
+
+  record.timestamp = GUINT64_TO_LE (timestamp);
+  record.offset = GUINT64_TO_LE (offset);
+  record.flags = GUINT32_TO_LE (keyframe ? FLAG_KEYFRAME : 0);
+
+  fwrite (&record, sizeof (record), 1, writer->file);
+  if (keyframe)
+    fflush (writer->file);
+}
+
+/**
+ * gst_keyframe_index_writer_free:
+ * @writer: a #GstKeyframeIndexWriter
+ *
+ * Closes the index.
+ */
+void
+gst_keyframe_index_writer_free (GstKeyframeIndexWriter * writer)
+{
+  fclose (writer->file);
+  g_free (writer);
+}
+
+/**
+ * gst_keyframe_index_open:
+ * @location: a recording
+ *
+ * Maps the index of @location, which may still be written to. Records added
+ * afterwards are not seen.
+ *
+ * Returns: (transfer full): the index, or NULL if @location has none. Free
+ * with gst_keyframe_index_free().
+ */
+GstKeyframeIndex *
+gst_keyframe_index_open (const gchar * location)
+{
+  GstKeyframeIndex *index;
+  const GstKeyframeIndexHeader *header;
+  GMappedFile *mapped;
+  gchar *path;
+  gsize length;
+
+  init_debug ();
+
+  path = gst_keyframe_index_get_path (location);
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  if (mapped == NULL) {
+    g_free (path);
+    return NULL;
+  }
+
+  length = g_mapped_file_get_length (mapped);
+  header = (const GstKeyframeIndexHeader *) g_mapped_file_get_contents (mapped);
+  if (length < sizeof (GstKeyframeIndexHeader) ||
+      memcmp (header->magic, INDEX_MAGIC, 4) != 0 ||
+      GUINT32_FROM_LE (header->version) != INDEX_VERSION ||
+      GUINT32_FROM_LE (header->record_size) !=
+      sizeof (GstKeyframeIndexRecord)) {
+    GST_WARNING ("Ignoring invalid index %s", path);
+    g_mapped_file_unref (mapped);
+    g_free (path);
+    return NULL;
+  }
+
+  index = g_new0 (GstKeyframeIndex, 1);
+  index->mapped = mapped;
+  index->records = (const GstKeyframeIndexRecord *) (header + 1);
+  index->size = (length - sizeof (GstKeyframeIndexHeader)) /
+      sizeof (GstKeyframeIndexRecord);
+
+  GST_DEBUG ("Mapped index %s, %u frames", path, index->size);
+  g_free (path);
+
+  return index;
+}
+
+/**
+ * gst_keyframe_index_free:
+ * @index: a #GstKeyframeIndex
+ *
+ * Unmaps the index.
+ */
+void
+gst_keyframe_index_free (GstKeyframeIndex * index)
+{
+  g_mapped_file_unref (index->mapped);
+  g_free (index);
+}
+
+/**
+ * gst_keyframe_index_get_size:
+ * @index: a #GstKeyframeIndex
+ *
+ * Returns: the number of frames in @index.
+ */
+guint
+gst_keyframe_index_get_size (GstKeyframeIndex * index)
+{
+  return index->size;
+}
+
+/**
+ * gst_keyframe_index_get_entry:
+ * @index: a #GstKeyframeIndex
+ * @i: frame number, less than gst_keyframe_index_get_size()
+ * @timestamp: (out) (allow-none): time of the frame
+ * @offset: (out) (allow-none): offset of the fragment holding the frame
+ * @keyframe: (out) (allow-none): whether the frame is a keyframe
+ */
+void
+gst_keyframe_index_get_entry (GstKeyframeIndex * index, guint i,
+    GstClockTime * timestamp, guint64 * offset, gboolean * keyframe)
+{
+  const GstKeyframeIndexRecord *record;
+
+  g_return_if_fail (i < index->size);
+
+  record = &index->records[i];
+  if (timestamp != NULL)
+    *timestamp = GUINT64_FROM_LE (record->timestamp);
+  if (offset != NULL)
+    *offset = GUINT64_FROM_LE (record->offset);
+  if (keyframe != NULL)
+    *keyframe = (GUINT32_FROM_LE (record->flags) & FLAG_KEYFRAME) != 0;
+}
+
+/**
+ * gst_keyframe_index_lookup:
+ * @index: a #GstKeyframeIndex
+ * @position: time on the timeline of the file
+ *
+ * Finds the keyframe decoding has to start at to show @position.
+ *
+ * Returns: the number of the last keyframe at or before @position, the first
+ * keyframe if there is none before it, or -1 if @index has no keyframes.
+ */
+gint
+gst_keyframe_index_lookup (GstKeyframeIndex * index, GstClockTime position)
+{
+  guint low = 0;
+  guint high = index->size;
+  gint i;
+
+  /* Last frame at or before position */
+  while (low < high) {
+    guint middle = low + (high - low) / 2;
+
+    if (GUINT64_FROM_LE (index->records[middle].timestamp) <= position)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  for (i = (gint) low - 1; i >= 0; i--) {
+    if (GUINT32_FROM_LE (index->records[i].flags) & FLAG_KEYFRAME)
+      return i;
+  }
+  for (i = low; i < (gint) index->size; i++) {
+    if (GUINT32_FROM_LE (index->records[i].flags) & FLAG_KEYFRAME)
+      return i;
+  }
+
+  return -1;
+}
+
+/**
+ * gst_keyframe_index_get_duration:
+ * @index: a #GstKeyframeIndex
+ *
+ * Returns: the time of the last frame in @index, or GST_CLOCK_TIME_NONE if
+ * it is empty.
+ */
+GstClockTime
+gst_keyframe_index_get_duration (GstKeyframeIndex * index)
+{
+  if (index->size == 0)
+    return GST_CLOCK_TIME_NONE;
+
+  return GUINT64_FROM_LE (index->records[index->size - 1].timestamp);
+}
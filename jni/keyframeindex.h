@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstKeyframeIndex: Sidecar index of a recording, mapping the time of every
+ * frame to where it is in the file.
+ */
+#ifndef __GST_KEYFRAME_INDEX_H__
+#define __GST_KEYFRAME_INDEX_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstKeyframeIndex GstKeyframeIndex;
+typedef struct _GstKeyframeIndexWriter GstKeyframeIndexWriter;
+
+gchar * gst_keyframe_index_get_path (const gchar * location);
+
+GstKeyframeIndexWriter * gst_keyframe_index_writer_new (
+    const gchar * location);
+void gst_keyframe_index_writer_add (GstKeyframeIndexWriter * writer,
+    GstClockTime timestamp, guint64 offset, gboolean keyframe);
+void gst_keyframe_index_writer_free (GstKeyframeIndexWriter * writer);
+
+GstKeyframeIndex * gst_keyframe_index_open (const gchar * location);
+void gst_keyframe_index_free (GstKeyframeIndex * index);
+guint gst_keyframe_index_get_size (GstKeyframeIndex * index);
+void gst_keyframe_index_get_entry (GstKeyframeIndex * index, guint i,
+    GstClockTime * timestamp, guint64 * offset, gboolean * keyframe);
+gint gst_keyframe_index_lookup (GstKeyframeIndex * index,
+    GstClockTime position);
+GstClockTime gst_keyframe_index_get_duration (GstKeyframeIndex * index);
+
+G_END_DECLS
+
+#endif /* __GST_KEYFRAME_INDEX_H__ */
@@ -16,6 +16,8 @@
  * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
  * Boston, MA 02110-1301, USA.
  */
+#include <string.h>
+
 #include <gst/video/video.h>
 #include <gst/video/videooverlay.h>
 
@@ -23,6 +25,11 @@
 #include "media-player-marshal.h"
 #include "rtspstreamer.h"
 #include "windowrenderer.h"
+#include "diskwriter.h"
+#include "admissionscheduler.h"
+#include "syncgroup.h"
+#include "keyframeindex.h"
+#include "segmentsrc.h"
 
 #define GST_MEDIA_PLAYER_GET_PRIVATE(obj)  \
    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_MEDIA_PLAYER, GstMediaPlayerPrivate))
@@ -35,26 +42,60 @@ struct _GstMediaPlayerPrivate
   GstState state;               /* Current pipeline state */
   GstState target_state;        /* Desired pipeline state, to be set once buffering is complete */
   gint64 duration;              /* Cached clip duration */
+  gchar *uri;                   /* Set last, with the credentials below */
   gchar *user;                  /* User id for RTSP authentication */
   gchar *pass;                  /* Password for RTSP authentication */
   gboolean is_live;             /* Is media live */
+  gboolean is_playback;         /* Live, but a recording served by a NVR */
+  GstClockTime range_start;     /* Of the recording on the NVR */
+  GstClockTime range_end;
+  gboolean seek_in_flight;      /* The NVR did not answer the last seek yet */
+  GSource *seek_timeout;        /* Gives up waiting for the answer */
   GstClockTime last_seek_time;  /* For seeking overflow prevention (throttling) */
   gint64 desired_position;      /* Position to seek to, once the pipeline is running */
   pthread_t gst_app_thread;     /* The thread running the main loop */
   GstRTSPStreamer *streamer;
   GstWindowRenderer *renderer;
+  GstDiskWriter *writer;
+  GMutex lock;                  /* Protects the admission ticket, uri,
+                                 * index, rate and trick interval */
+  gchar *host;                  /* Host the uri connects to, NULL if local
+                                 * or recording */
+  gint priority;                /* Admission priority */
+  GstAdmissionTicket *ticket;   /* Pending connection attempt */
+  gint admitted;                /* The attempt was started */
+  GstSyncGroup *sync_group;     /* Group presenting in sync, or NULL */
+  GstKeyframeIndex *index;      /* Of the recording played, or NULL */
+  gint last_keyframe;           /* Where the last seek landed, -1 if moved */
+  gdouble rate;                 /* Playback rate, negative for reverse */
+  GstClockTime trick_interval;  /* Least media time between decoded keyframes,
+                                 * 0 when all frames are decoded */
 };
 
 /* Do not allow seeks to be performed closer than this distance. It is visually useless, and will probably
  * confuse some demuxers. */
 #define SEEK_MIN_DELAY (500 * GST_MSECOND)
+/* Seeks resolved by the keyframe index land on a keyframe without the demuxer
+ * searching the file, they can follow each other closer */
+#define SEEK_MIN_DELAY_INDEXED (100 * GST_MSECOND)
+/* A seek the NVR did not answer in this time is taken as lost */
+#define SEEK_ANSWER_TIMEOUT 5
+
+/* Up to this rate forward every frame is decoded, beyond it and in reverse
+ * only keyframes */
+#define MAX_FULL_DECODE_RATE 2.0
+#define MAX_RATE 64.0
+/* Keyframes decoded per second of trick play, the others are dropped before
+ * the decoder */
+#define MAX_TRICK_FPS 8
 
 /* object properties */
 enum
 {
   PROP_0,
   PROP_RTSP_STREAMER,
-  PROP_WINDOW_RENDERER
+  PROP_WINDOW_RENDERER,
+  PROP_DISK_WRITER
 };
 
 enum
@@ -103,6 +144,11 @@ gst_media_player_class_init (GstMediaPlayerClass * klass)
       "WindowRenderer", "Window Renderer", GST_TYPE_WINDOW_RENDERER,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
 
+  g_object_class_install_property (gobject_class,
+      PROP_DISK_WRITER, g_param_spec_object ("disk-writer", "DiskWriter",
+      "Disk Writer", GST_TYPE_DISK_WRITER, G_PARAM_READWRITE |
+      G_PARAM_CONSTRUCT_ONLY));
+
   gst_media_player_signals[SIGNAL_NEW_STATUS] =
       g_signal_new ("new-status", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
       G_STRUCT_OFFSET (GstMediaPlayerClass, new_status), NULL, NULL,
@@ -123,6 +169,12 @@ gst_media_player_class_init (GstMediaPlayerClass * klass)
 static void
 gst_media_player_init (GstMediaPlayer * player)
 {
+  GstMediaPlayerPrivate *priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  g_mutex_init (&priv->lock);
+  priv->last_keyframe = -1;
+  priv->rate = 1.0;
+  priv->range_end = GST_CLOCK_TIME_NONE;
 }
 
 static void
@@ -140,6 +192,9 @@ gst_media_player_get_property (GObject *object, guint property_id,
     case PROP_WINDOW_RENDERER:
       g_value_set_object (value, priv->renderer);
       break;
+    case PROP_DISK_WRITER:
+      g_value_set_object (value, priv->writer);
+      break;
   }
 }
 
@@ -158,6 +213,9 @@ gst_media_player_set_property (GObject *object, guint property_id,
     case PROP_WINDOW_RENDERER:
       priv->renderer = g_value_get_object (value);
       break;
+    case PROP_DISK_WRITER:
+      priv->writer = g_value_dup_object (value);
+      break;
   }
 }
 
@@ -172,6 +230,64 @@ gst_media_player_new (GstRTSPStreamer * streamer, GstWindowRenderer * renderer)
   return player;
 }
 
+/* Seek to @position at the current rate. Forward the segment plays from
+ * @position on, in reverse it plays from @position back to the start. A NVR
+ * gets the seek as a PLAY request with the position in Range and the rate in
+ * Scale. */
+static gboolean
+seek_at_rate (GstMediaPlayer * player, GstSeekFlags flags, gint64 position)
+{
+  GstMediaPlayerPrivate *priv;
+  gdouble rate;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+  g_mutex_lock (&priv->lock);
+  rate = priv->rate;
+  g_mutex_unlock (&priv->lock);
+
+  if (rate < 0 || rate > MAX_FULL_DECODE_RATE)
+    flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS |
+        GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+
+  if (rate > 0)
+    return gst_element_seek (priv->pipeline, rate, GST_FORMAT_TIME, flags,
+        GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+
+  return gst_element_seek (priv->pipeline, rate, GST_FORMAT_TIME, flags,
+      GST_SEEK_TYPE_SET, priv->range_start, GST_SEEK_TYPE_SET, position);
+}
+
+static gboolean seek_timeout_cb (gpointer user_data);
+
+/* The seek just sent waits for the answer of the NVR, if there is one */
+static void
+set_seek_in_flight (GstMediaPlayer * player)
+{
+  GstMediaPlayerPrivate *priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  priv->seek_in_flight = priv->is_playback;
+  if (!priv->seek_in_flight || priv->seek_timeout != NULL)
+    return;
+
+  priv->seek_timeout = g_timeout_source_new_seconds (SEEK_ANSWER_TIMEOUT);
+  g_source_set_callback (priv->seek_timeout, seek_timeout_cb, player, NULL);
+  g_source_attach (priv->seek_timeout, priv->context);
+}
+
+/* No answer is coming anymore, a seek asked for meanwhile stays pending */
+static void
+clear_seek_in_flight (GstMediaPlayer * player)
+{
+  GstMediaPlayerPrivate *priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  priv->seek_in_flight = FALSE;
+  if (priv->seek_timeout != NULL) {
+    g_source_destroy (priv->seek_timeout);
+    g_source_unref (priv->seek_timeout);
+    priv->seek_timeout = NULL;
+  }
+}
+
 /* Perform seek, if we are not too close to the previous seek. Otherwise,
  * schedule the seek for some time in the future. */
 static void
@@ -179,6 +295,10 @@ execute_seek (GstMediaPlayer * player, gint64 desired_position)
 {
   gint64 diff;
   GstMediaPlayerPrivate *priv;
+  GstClockTime target = desired_position;
+  GstSeekFlags flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+  gint64 min_delay = SEEK_MIN_DELAY;
+  gint keyframe = -1;
 
   GST_DEBUG ("new seek");
 
@@ -187,9 +307,44 @@ execute_seek (GstMediaPlayer * player, gint64 desired_position)
   if (desired_position == GST_CLOCK_TIME_NONE)
     return;
 
+  /* Every seek is a PLAY round trip to a NVR, the positions asked for
+   * meanwhile collapse into one seek once it answered */
+  if (priv->seek_in_flight) {
+    GST_DEBUG ("Waiting for the NVR, seek to %" GST_TIME_FORMAT " deferred",
+        GST_TIME_ARGS (desired_position));
+    priv->desired_position = desired_position;
+    return;
+  }
+
+  /* The index resolves the keyframe the seek lands on, on the timeline of
+   * the file. Seeking right to its time spares the demuxer the search. */
+  g_mutex_lock (&priv->lock);
+  if (priv->index != NULL) {
+    keyframe = gst_keyframe_index_lookup (priv->index, desired_position);
+    if (keyframe >= 0) {
+      gst_keyframe_index_get_entry (priv->index, keyframe, &target, NULL,
+          NULL);
+      flags = GST_SEEK_FLAG_FLUSH;
+      min_delay = SEEK_MIN_DELAY_INDEXED;
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  /* Positions are relative to the start of the recording on the NVR */
+  if (priv->is_playback)
+    target += priv->range_start;
+
+  /* Scrubbing within a GOP would show the same keyframe again */
+  if (keyframe >= 0 && keyframe == priv->last_keyframe &&
+      priv->desired_position == GST_CLOCK_TIME_NONE) {
+    GST_DEBUG ("Already at the keyframe of %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (desired_position));
+    return;
+  }
+
   diff = gst_util_get_timestamp () - priv->last_seek_time;
 
-  if (GST_CLOCK_TIME_IS_VALID (priv->last_seek_time) && diff < SEEK_MIN_DELAY) {
+  if (GST_CLOCK_TIME_IS_VALID (priv->last_seek_time) && diff < min_delay) {
     /* The previous seek was too close, delay this one */
     GSource *timeout_source;
 
@@ -197,7 +352,7 @@ execute_seek (GstMediaPlayer * player, gint64 desired_position)
       /* There was no previous seek scheduled. Setup a timer for some time in
        * the future */
       timeout_source =
-          g_timeout_source_new ((SEEK_MIN_DELAY - diff) / GST_MSECOND);
+          g_timeout_source_new ((min_delay - diff) / GST_MSECOND);
       g_source_set_callback (timeout_source, (GSourceFunc)delayed_seek_cb,
           player, NULL);
       g_source_attach (timeout_source, priv->context);
@@ -208,18 +363,43 @@ execute_seek (GstMediaPlayer * player, gint64 desired_position)
     priv->desired_position = desired_position;
     GST_DEBUG ("Throttling seek to %" GST_TIME_FORMAT
         ", will be in %" GST_TIME_FORMAT, GST_TIME_ARGS (desired_position),
-        GST_TIME_ARGS (SEEK_MIN_DELAY - diff));
+        GST_TIME_ARGS (min_delay - diff));
   } else {
     /* Perform the seek now */
-    GST_DEBUG ("Seeking to %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (desired_position));
+    GST_DEBUG ("Seeking to %" GST_TIME_FORMAT " for %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (target), GST_TIME_ARGS (desired_position));
     priv->last_seek_time = gst_util_get_timestamp ();
-    gst_element_seek_simple (priv->pipeline, GST_FORMAT_TIME,
-        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, desired_position);
+    seek_at_rate (player, flags, target);
     priv->desired_position = GST_CLOCK_TIME_NONE;
+    set_seek_in_flight (player);
+    priv->last_keyframe = keyframe;
   }
 }
 
+/* Goes on with the latest position asked for once the NVR answered the last
+ * seek, or did not in time */
+static void
+seek_answered (GstMediaPlayer * player)
+{
+  GstMediaPlayerPrivate *priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+  gint64 position = priv->desired_position;
+
+  clear_seek_in_flight (player);
+  priv->desired_position = GST_CLOCK_TIME_NONE;
+  execute_seek (player, position);
+}
+
+static gboolean
+seek_timeout_cb (gpointer user_data)
+{
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+
+  GST_WARNING ("The NVR did not answer the last seek");
+  seek_answered (player);
+
+  return FALSE;
+}
+
 /* Delayed seek callback. This gets called by the timer setup in the above
  * function. */
 static gboolean
@@ -237,6 +417,294 @@ delayed_seek_cb (gpointer user_data)
   return FALSE;
 }
 
+/* Decoder input state in trick play, kept on the sink pad of the decoder */
+typedef struct
+{
+  GstClockTime last;            /* Keyframe decoded last */
+  gboolean dropping;            /* The current GOP is dropped */
+} TrickState;
+
+/* Drops keyframes in trick play until enough media time has passed since the
+ * last one decoded, so that the decoding cost does not grow with the rate. A
+ * NVR sends whole GOPs, which are dropped along with their keyframe. */
+static GstPadProbeReturn
+trick_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+  TrickState *state;
+  GstBuffer *buffer;
+  GstClockTime interval;
+  GstClockTime pts;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+  state = g_object_get_data (G_OBJECT (pad), "mediaplayer-trick-state");
+
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+        GST_EVENT_FLUSH_STOP) {
+      state->last = GST_CLOCK_TIME_NONE;
+      state->dropping = FALSE;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  g_mutex_lock (&priv->lock);
+  interval = priv->trick_interval;
+  g_mutex_unlock (&priv->lock);
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (interval == 0) {
+    state->dropping = FALSE;
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return state->dropping ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+
+  pts = GST_BUFFER_PTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (pts))
+    return GST_PAD_PROBE_OK;
+
+  /* Timestamps decrease in reverse */
+  state->dropping = GST_CLOCK_TIME_IS_VALID (state->last) &&
+      (pts > state->last ? pts - state->last : state->last - pts) < interval;
+  if (state->dropping) {
+    GST_LOG ("Skipping keyframe at %" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
+    return GST_PAD_PROBE_DROP;
+  }
+
+  state->last = pts;
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+element_added_cb (GstBin * pipeline, GstBin * bin, GstElement * element,
+    gpointer user_data)
+{
+  const gchar *klass;
+  GstPad *sinkpad;
+  TrickState *state;
+
+  klass = gst_element_class_get_metadata (GST_ELEMENT_GET_CLASS (element),
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL || strstr (klass, "Video") == NULL ||
+      strstr (klass, "Decoder") == NULL)
+    return;
+
+  sinkpad = gst_element_get_static_pad (element, "sink");
+  if (sinkpad == NULL)
+    return;
+
+  state = g_new0 (TrickState, 1);
+  state->last = GST_CLOCK_TIME_NONE;
+  g_object_set_data_full (G_OBJECT (sinkpad), "mediaplayer-trick-state",
+      state, g_free);
+
+  GST_DEBUG ("Bounding trick play decoding of %s", GST_ELEMENT_NAME (element));
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH, trick_probe_cb, user_data, NULL);
+  gst_object_unref (sinkpad);
+}
+
+/* Runs on the player thread, like the bus callbacks */
+static gboolean
+admitted_cb (gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  /* The attempt may have been cancelled meanwhile */
+  if (!g_atomic_int_get (&priv->admitted))
+    return G_SOURCE_REMOVE;
+
+  priv->is_live = (gst_element_set_state (priv->pipeline, priv->target_state)
+      == GST_STATE_CHANGE_NO_PREROLL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the admission scheduler thread once the player may connect.
+ * The state is changed on the player thread, the context goes away with the
+ * player together with the pending call. */
+static void
+admit_cb (gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  GST_DEBUG ("Connection to %s admitted", priv->host);
+
+  g_atomic_int_set (&priv->admitted, TRUE);
+  g_main_context_invoke (priv->context, admitted_cb, player);
+}
+
+/* Must be called with the lock held */
+static void
+cancel_admission_unlocked (GstMediaPlayerPrivate * priv)
+{
+  if (priv->ticket == NULL)
+    return;
+
+  gst_admission_scheduler_cancel (gst_admission_scheduler_get_default (),
+      priv->ticket);
+  priv->ticket = NULL;
+  g_atomic_int_set (&priv->admitted, FALSE);
+}
+
+/* Move the pipeline to the target state. Connecting to a network source goes
+ * through the admission scheduler, the state is then applied once admitted. */
+static void
+apply_target_state (GstMediaPlayer * player)
+{
+  GstMediaPlayerPrivate *priv;
+  GstState current = GST_STATE_NULL;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  gst_element_get_state (priv->pipeline, &current, NULL, 0);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->target_state >= GST_STATE_PAUSED && priv->host != NULL &&
+      current < GST_STATE_PAUSED) {
+    if (priv->ticket == NULL) {
+      priv->ticket =
+          gst_admission_scheduler_enqueue (gst_admission_scheduler_get_default
+          (), priv->host, priv->priority, admit_cb, player);
+      g_mutex_unlock (&priv->lock);
+
+      g_signal_emit (player, gst_media_player_signals[SIGNAL_NEW_STATUS], 0,
+          "QUEUED", NULL);
+      return;
+    }
+
+    if (!g_atomic_int_get (&priv->admitted)) {
+      /* Still queued, the latest target state is applied once admitted */
+      g_mutex_unlock (&priv->lock);
+      return;
+    }
+  } else if (priv->target_state < GST_STATE_PAUSED) {
+    cancel_admission_unlocked (priv);
+  }
+  g_mutex_unlock (&priv->lock);
+
+  priv->is_live = (gst_element_set_state (priv->pipeline, priv->target_state)
+      == GST_STATE_CHANGE_NO_PREROLL);
+}
+
+/* Whether the streamer was told to play recordings from a NVR, see
+ * gst_media_player_set_playback() */
+static gboolean
+streamer_plays_back (GstMediaPlayerPrivate * priv)
+{
+  gboolean playback = FALSE;
+
+  if (priv->streamer != NULL &&
+      g_object_class_find_property (G_OBJECT_GET_CLASS (priv->streamer),
+          "playback") != NULL)
+    g_object_get (priv->streamer, "playback", &playback, NULL);
+
+  return playback;
+}
+
+/* A live RTSP session may be a recording served by a NVR, which can seek and
+ * change the rate on the server */
+static void
+update_playback (GstMediaPlayer * player)
+{
+  GstMediaPlayerPrivate *priv;
+  GstQuery *query;
+  gboolean seekable = FALSE;
+  gint64 start = GST_CLOCK_TIME_NONE;
+  gint64 end = GST_CLOCK_TIME_NONE;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  query = gst_query_new_seeking (GST_FORMAT_TIME);
+  if (gst_element_query (priv->pipeline, query))
+    gst_query_parse_seeking (query, NULL, &seekable, &start, &end);
+  gst_query_unref (query);
+
+  if (!seekable) {
+    priv->is_playback = FALSE;
+    return;
+  }
+
+  if (!priv->is_playback)
+    GST_DEBUG ("Playing a recording from %" GST_TIME_FORMAT " to %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (start), GST_TIME_ARGS (end));
+
+  priv->is_playback = TRUE;
+  priv->range_start = GST_CLOCK_TIME_IS_VALID (start) ? start : 0;
+  priv->range_end = end;
+}
+
+/* The streamer asks to be set up again with the same uri */
+static void
+element_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+  const GstStructure *structure;
+  gchar *uri;
+  gchar *user;
+  gchar *pass;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  structure = gst_message_get_structure (msg);
+  if (!gst_structure_has_name (structure, GST_RTSP_STREAMER_RESTART_MESSAGE))
+    return;
+
+  g_mutex_lock (&priv->lock);
+  uri = g_strdup (priv->uri);
+  user = g_strdup (priv->user);
+  pass = g_strdup (priv->pass);
+  g_mutex_unlock (&priv->lock);
+
+  /* Not posted before the uri was replaced */
+  if (uri != NULL &&
+      g_strcmp0 (gst_structure_get_string (structure, "uri"), uri) == 0) {
+    GST_DEBUG ("Restarting %s", uri);
+    gst_media_player_set_uri (player, uri, user, pass);
+  }
+
+  g_free (uri);
+  g_free (user);
+  g_free (pass);
+}
+
+/* The pipeline prerolled, the connection attempt succeeded */
+static void
+async_done_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->ticket != NULL && g_atomic_int_get (&priv->admitted)) {
+    gst_admission_scheduler_done (gst_admission_scheduler_get_default (),
+        priv->ticket, TRUE);
+    priv->ticket = NULL;
+    g_atomic_int_set (&priv->admitted, FALSE);
+  }
+  g_mutex_unlock (&priv->lock);
+
+  /* Cameras are live too, only ask sessions meant to be recordings */
+  if (priv->is_live && streamer_plays_back (priv))
+    update_playback (player);
+
+  /* The NVR answered, go on with the latest position asked for */
+  if (priv->seek_in_flight)
+    seek_answered (player);
+}
+
 static void
 error_cb (GstBus *bus, GstMessage *msg, gpointer userdata)
 {
@@ -256,6 +724,31 @@ error_cb (GstBus *bus, GstMessage *msg, gpointer userdata)
   g_clear_error (&err);
   g_free (debug_info);
 
+  /* Whatever was sent is not answered anymore, a pending seek is performed
+   * once the session is up again */
+  clear_seek_in_flight (player);
+
+  /* A failed connection attempt is retried by the admission scheduler, the
+   * error is only reported once it gives up */
+  g_mutex_lock (&priv->lock);
+  if (priv->ticket != NULL && g_atomic_int_get (&priv->admitted)) {
+    g_atomic_int_set (&priv->admitted, FALSE);
+    if (gst_admission_scheduler_done (gst_admission_scheduler_get_default (),
+            priv->ticket, FALSE)) {
+      g_mutex_unlock (&priv->lock);
+
+      GST_DEBUG ("Will retry: %s", message_string);
+      g_free (message_string);
+      gst_element_set_state (priv->pipeline, GST_STATE_READY);
+
+      g_signal_emit (player, gst_media_player_signals[SIGNAL_NEW_STATUS], 0,
+          "RETRYING", NULL);
+      return;
+    }
+    priv->ticket = NULL;
+  }
+  g_mutex_unlock (&priv->lock);
+
   g_signal_emit (player, gst_media_player_signals[SIGNAL_ERROR], 0,
       message_string, NULL);
 
@@ -277,6 +770,13 @@ eos_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
 
   priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
 
+  /* Trick play ends with the media, in reverse a seek to the start would
+   * end right away again */
+  g_mutex_lock (&priv->lock);
+  priv->rate = 1.0;
+  priv->trick_interval = 0;
+  g_mutex_unlock (&priv->lock);
+
   priv->target_state = GST_STATE_PAUSED;
   priv->is_live = (gst_element_set_state (priv->pipeline, GST_STATE_PAUSED) ==
       GST_STATE_CHANGE_NO_PREROLL);
@@ -309,12 +809,42 @@ state_changed_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
 
     g_free (message);
 
+    /* Playback moves away from the keyframe of the last seek */
+    if (new_state == GST_STATE_PLAYING)
+      priv->last_keyframe = -1;
+
+    /* No answer comes to seeks of a stopped session */
+    if (new_state <= GST_STATE_READY)
+      clear_seek_in_flight (player);
+
     /* The Ready to Paused state change is particularly interesting: */
     if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED) {
+      gdouble rate;
+      gint64 duration;
+
+      g_mutex_lock (&priv->lock);
+      rate = priv->rate;
+      g_mutex_unlock (&priv->lock);
+
        /* If there was a scheduled seek, perform it now that we have moved to
         * the Paused state */
-      if (GST_CLOCK_TIME_IS_VALID (priv->desired_position))
+      if (GST_CLOCK_TIME_IS_VALID (priv->desired_position)) {
         execute_seek (player, priv->desired_position);
+      } else if (rate > 0 && rate != 1.0) {
+        seek_at_rate (player, GST_SEEK_FLAG_FLUSH, 0);
+      } else if (rate < 0) {
+        /* Reverse from the start would end right away, go back from the end
+         * or not at all */
+        if (gst_element_query_duration (priv->pipeline, GST_FORMAT_TIME,
+                &duration) && duration > 0) {
+          seek_at_rate (player, GST_SEEK_FLAG_FLUSH, duration);
+        } else {
+          g_mutex_lock (&priv->lock);
+          priv->rate = 1.0;
+          priv->trick_interval = 0;
+          g_mutex_unlock (&priv->lock);
+        }
+      }
     }
   }
 }
@@ -420,6 +950,14 @@ check_position (gpointer user_data)
     position = 0;
   }
 
+  /* Positions within the recording on the NVR */
+  if (priv->is_playback) {
+    position = position > priv->range_start ? position - priv->range_start :
+        0;
+    if (GST_CLOCK_TIME_IS_VALID (priv->range_end))
+      priv->duration = priv->range_end - priv->range_start;
+  }
+
   /* Java expects these values in milliseconds, and GStreamer provides
    * nanoseconds */
   g_signal_emit (player, gst_media_player_signals[SIGNAL_NEW_POSITION], 0,
@@ -491,6 +1029,9 @@ gst_media_player_setup_thread (GstMediaPlayer *player, GError ** error)
       NULL, NULL);
   g_source_attach (bus_source, priv->context);
   g_source_unref (bus_source);
+  if (priv->sync_group != NULL)
+    gst_sync_group_join (priv->sync_group, priv->pipeline);
+
   g_signal_connect (G_OBJECT (bus), "message::error", (GCallback)error_cb,
       player);
   g_signal_connect (G_OBJECT (bus), "message::eos", (GCallback)eos_cb, player);
@@ -502,8 +1043,15 @@ gst_media_player_setup_thread (GstMediaPlayer *player, GError ** error)
       (GCallback)buffering_cb, player);
   g_signal_connect (G_OBJECT (bus), "message::clock-lost",
       (GCallback)clock_lost_cb, player);
+  g_signal_connect (G_OBJECT (bus), "message::async-done",
+      (GCallback)async_done_cb, player);
+  g_signal_connect (G_OBJECT (bus), "message::element",
+      (GCallback)element_cb, player);
   gst_object_unref (bus);
 
+  g_signal_connect (priv->pipeline, "deep-element-added",
+      G_CALLBACK (element_added_cb), player);
+
   /* Create a GLib Main Loop */
   GST_DEBUG ("Creating main loop... (GstMediaPlayer: %p)", player);
   priv->main_loop = g_main_loop_new (priv->context, FALSE);
@@ -535,6 +1083,10 @@ gst_media_player_finalize (GObject * obj)
   player = GST_MEDIA_PLAYER (obj);
   priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
 
+  g_mutex_lock (&priv->lock);
+  cancel_admission_unlocked (priv);
+  g_mutex_unlock (&priv->lock);
+
   if (priv->main_loop != NULL) {
     GST_DEBUG ("Quitting main loop...");
     g_main_loop_quit (priv->main_loop);
@@ -551,6 +1103,8 @@ gst_media_player_finalize (GObject * obj)
     priv->main_loop = NULL;
   }
 
+  clear_seek_in_flight (player);
+
   if (priv->context != NULL) {
     g_main_context_unref (priv->context);
     priv->context = NULL;
@@ -561,10 +1115,14 @@ gst_media_player_finalize (GObject * obj)
   if (priv->pipeline != NULL) {
     GST_DEBUG ("Stopping pipeline");
     gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+    if (priv->sync_group != NULL)
+      gst_sync_group_leave (priv->sync_group, priv->pipeline);
     gst_object_unref (priv->pipeline);
     priv->pipeline = NULL;
   }
 
+  g_free (priv->uri);
+  priv->uri = NULL;
   if (priv->user != NULL) {
     g_free (priv->user);
     priv->user = NULL;
@@ -573,12 +1131,30 @@ gst_media_player_finalize (GObject * obj)
     g_free (priv->pass);
     priv->pass = NULL;
   }
+  if (priv->host != NULL) {
+    g_free (priv->host);
+    priv->host = NULL;
+  }
+  if (priv->sync_group != NULL) {
+    gst_sync_group_unref (priv->sync_group);
+    priv->sync_group = NULL;
+  }
+  if (priv->index != NULL) {
+    gst_keyframe_index_free (priv->index);
+    priv->index = NULL;
+  }
+  g_mutex_clear (&priv->lock);
 
   if (priv->renderer != NULL) {
     g_object_unref (priv->renderer);
     priv->renderer = NULL;
   }
 
+  if (priv->writer != NULL) {
+    g_object_unref (priv->writer);
+    priv->writer = NULL;
+  }
+
   if (priv->streamer != NULL) {
     g_object_unref (priv->streamer);
     priv->streamer = NULL;
@@ -607,38 +1183,261 @@ gst_media_player_set_state (GstMediaPlayer * player, GstState state)
   GST_DEBUG ("Setting state to %d", state);
   priv->duration = GST_CLOCK_TIME_NONE;
   priv->target_state = state;
-  priv->is_live = (gst_element_set_state (priv->pipeline, state) ==
-      GST_STATE_CHANGE_NO_PREROLL);
+  apply_target_state (player);
 
   return TRUE;
 }
 
+/**
+ * gst_media_player_set_priority:
+ * @player: a #GstMediaPlayer
+ * @priority: admission priority, higher connects first
+ *
+ * Sets the priority of the connection attempts of the player, e.g. higher for
+ * the focused or visible players.
+ */
+void
+gst_media_player_set_priority (GstMediaPlayer * player, gint priority)
+{
+  GstMediaPlayerPrivate *priv;
+
+  g_return_if_fail (GST_IS_MEDIA_PLAYER (player));
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  g_mutex_lock (&priv->lock);
+  priv->priority = priority;
+  if (priv->ticket != NULL)
+    gst_admission_scheduler_set_priority (gst_admission_scheduler_get_default
+        (), priv->ticket, priority);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_media_player_set_sync_group:
+ * @player: a #GstMediaPlayer
+ * @group: (allow-none): a #GstSyncGroup, or NULL to leave the current one
+ *
+ * Presents the frames of the player aligned with the other players of @group,
+ * by the time the camera captured them. Takes effect with the next uri, the
+ * player then opens its own connection to the camera.
+ */
+void
+gst_media_player_set_sync_group (GstMediaPlayer * player,
+    GstSyncGroup * group)
+{
+  GstMediaPlayerPrivate *priv;
+
+  g_return_if_fail (GST_IS_MEDIA_PLAYER (player));
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  if (priv->sync_group == group)
+    return;
+
+  if (priv->sync_group != NULL) {
+    if (priv->pipeline != NULL)
+      gst_sync_group_leave (priv->sync_group, priv->pipeline);
+    gst_sync_group_unref (priv->sync_group);
+  }
+
+  priv->sync_group = group != NULL ? gst_sync_group_ref (group) : NULL;
+  if (priv->sync_group != NULL && priv->pipeline != NULL)
+    gst_sync_group_join (priv->sync_group, priv->pipeline);
+
+  if (priv->streamer != NULL &&
+      g_object_class_find_property (G_OBJECT_GET_CLASS (priv->streamer),
+          "ntp-sync") != NULL)
+    g_object_set (priv->streamer, "ntp-sync", group != NULL, NULL);
+}
+
+/**
+ * gst_media_player_set_playback:
+ * @player: a #GstMediaPlayer
+ * @playback: whether the RTSP uris are recordings served by a NVR
+ *
+ * Plays recordings from a NVR without downloading them: positions and rates
+ * are sent to the server, see gst_media_player_set_position() and
+ * gst_media_player_set_rate(). Takes effect with the next uri.
+ */
+void
+gst_media_player_set_playback (GstMediaPlayer * player, gboolean playback)
+{
+  GstMediaPlayerPrivate *priv;
+
+  g_return_if_fail (GST_IS_MEDIA_PLAYER (player));
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  if (priv->streamer != NULL &&
+      g_object_class_find_property (G_OBJECT_GET_CLASS (priv->streamer),
+          "playback") != NULL)
+    g_object_set (priv->streamer, "playback", playback, NULL);
+}
+
+/* A position handed over to the player thread */
+typedef struct
+{
+  GstMediaPlayer *player;
+  gint64 position;
+} PositionRequest;
+
+static gboolean
+set_position_cb (gpointer user_data)
+{
+  PositionRequest *request = (PositionRequest *)user_data;
+  GstMediaPlayerPrivate *priv;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (request->player);
+
+  if (priv->state >= GST_STATE_PAUSED) {
+    execute_seek (request->player, request->position);
+  } else {
+    GST_DEBUG ("Scheduling seek to %" GST_TIME_FORMAT " for later",
+        GST_TIME_ARGS (request->position));
+    priv->desired_position = request->position;
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
 /**
  * gst_media_player_set_position:
  * @player: a #GstMediaPlayer
  *
- * Sets a new position in the media.
+ * Sets a new position in the media. The seek is done on the player thread.
  */
 gboolean
 gst_media_player_set_position (GstMediaPlayer * player, gint64 position)
 {
   GstMediaPlayerPrivate *priv;
+  PositionRequest *request;
 
   g_return_val_if_fail (GST_IS_MEDIA_PLAYER (player), FALSE);
 
   priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
 
-  if (priv->state >= GST_STATE_PAUSED) {
-    execute_seek (player, position);
-  } else {
-    GST_DEBUG ("Scheduling seek to %" GST_TIME_FORMAT " for later",
-        GST_TIME_ARGS (position));
-    priv->desired_position = position;
+  request = g_new (PositionRequest, 1);
+  request->player = player;
+  request->position = position;
+  g_main_context_invoke_full (priv->context, G_PRIORITY_DEFAULT,
+      set_position_cb, request, g_free);
+
+  return TRUE;
+}
+
+/* Continues the playback at the rate just set, on the player thread where
+ * the seek state is kept */
+static gboolean
+rate_changed_cb (gpointer user_data)
+{
+  GstMediaPlayerPrivate *priv;
+  GstMediaPlayer *player = (GstMediaPlayer *)user_data;
+  gint64 position;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  if (priv->state < GST_STATE_PAUSED)
+    return G_SOURCE_REMOVE;
+
+  /* A pending seek carries the new rate with it */
+  if (GST_CLOCK_TIME_IS_VALID (priv->desired_position))
+    return G_SOURCE_REMOVE;
+
+  if (priv->seek_in_flight) {
+    /* Sent with the next PLAY, from where the NVR is now */
+    if (gst_element_query_position (priv->pipeline, GST_FORMAT_TIME,
+            &position))
+      priv->desired_position = position > priv->range_start ?
+          position - priv->range_start : 0;
+    return G_SOURCE_REMOVE;
   }
 
+  if (!gst_element_query_position (priv->pipeline, GST_FORMAT_TIME,
+          &position))
+    position = 0;
+
+  priv->last_seek_time = gst_util_get_timestamp ();
+  priv->last_keyframe = -1;
+  set_seek_in_flight (player);
+
+  if (!seek_at_rate (player, GST_SEEK_FLAG_FLUSH, position))
+    GST_WARNING ("Could not change the rate");
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gst_media_player_set_rate:
+ * @player: a #GstMediaPlayer
+ * @rate: playback rate, 1.0 is normal and negative plays in reverse
+ *
+ * Changes the playback rate of recordings, continuing from the current
+ * position. Beyond 2x forward, and in reverse, only keyframes are shown.
+ * Recordings served by a NVR change the rate on the server.
+ *
+ * Returns: FALSE if @rate is out of range or the media is live, or if @rate
+ * is reverse and there is no position to go back from yet.
+ */
+gboolean
+gst_media_player_set_rate (GstMediaPlayer * player, gdouble rate)
+{
+  GstMediaPlayerPrivate *priv;
+  gint64 position;
+
+  g_return_val_if_fail (GST_IS_MEDIA_PLAYER (player), FALSE);
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  if ((priv->is_live && !priv->is_playback) || ABS (rate) < 1.0 ||
+      ABS (rate) > MAX_RATE)
+    return FALSE;
+
+  /* Reverse goes back from the current position, which is only known once
+   * prerolled */
+  if (rate < 0 && (priv->state < GST_STATE_PAUSED ||
+          !gst_element_query_position (priv->pipeline, GST_FORMAT_TIME,
+              &position)))
+    return FALSE;
+
+  GST_DEBUG ("Setting rate to %.1f", rate);
+
+  g_mutex_lock (&priv->lock);
+  priv->rate = rate;
+  if (rate < 0 || rate > MAX_FULL_DECODE_RATE)
+    priv->trick_interval = ABS (rate) * GST_SECOND / MAX_TRICK_FPS;
+  else
+    priv->trick_interval = 0;
+  g_mutex_unlock (&priv->lock);
+
+  g_main_context_invoke (priv->context, rate_changed_cb, player);
+
   return TRUE;
 }
 
+/* Forgets the seeks of the previous uri on the player thread, the request
+ * holds where the new one starts. The pipeline only starts afterwards, so it
+ * never sees the old seek state. */
+static gboolean
+uri_changed_cb (gpointer user_data)
+{
+  PositionRequest *request = (PositionRequest *)user_data;
+  GstMediaPlayerPrivate *priv;
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (request->player);
+
+  priv->is_playback = FALSE;
+  priv->range_start = 0;
+  priv->range_end = GST_CLOCK_TIME_NONE;
+  clear_seek_in_flight (request->player);
+  if (GST_CLOCK_TIME_IS_VALID (request->position))
+    priv->desired_position = request->position;
+
+  apply_target_state (request->player);
+
+  return G_SOURCE_REMOVE;
+}
+
 /**
  * gst_media_player_set_uri:
  * @player: a #GstMediaPlayer
@@ -653,6 +1452,8 @@ gst_media_player_set_uri (GstMediaPlayer * player, const gchar * uri,
     const gchar * user, const gchar * pass)
 {
   GstMediaPlayerPrivate *priv;
+  PositionRequest *request;
+  gchar *location = NULL;
 
   g_return_if_fail (GST_IS_MEDIA_PLAYER (player));
 
@@ -666,8 +1467,74 @@ gst_media_player_set_uri (GstMediaPlayer * player, const gchar * uri,
 
   gst_rtsp_streamer_set_uri (priv->streamer, uri, user, pass);
 
-  priv->is_live = (gst_element_set_state (priv->pipeline, priv->target_state) ==
-      GST_STATE_CHANGE_NO_PREROLL);
+  /* Kept for restarts asked for by the streamer */
+  g_mutex_lock (&priv->lock);
+  g_free (priv->uri);
+  g_free (priv->user);
+  g_free (priv->pass);
+  priv->uri = g_strdup (uri);
+  priv->user = g_strdup (user);
+  priv->pass = g_strdup (pass);
+  g_mutex_unlock (&priv->lock);
+
+  /* Recordings come with a keyframe index */
+  if (g_str_has_prefix (uri, "file://"))
+    location = g_filename_from_uri (uri, NULL, NULL);
+
+  /* Any pending attempt was for the previous uri */
+  g_mutex_lock (&priv->lock);
+  cancel_admission_unlocked (priv);
+  g_free (priv->host);
+  /* A recorder takes the frames of a shared stream and connects to
+   * nothing itself, its pipeline does not even report ASYNC_DONE */
+  priv->host = priv->writer == NULL ?
+      gst_admission_scheduler_get_host (uri) : NULL;
+  if (priv->index != NULL)
+    gst_keyframe_index_free (priv->index);
+  priv->index = location != NULL ? gst_keyframe_index_open (location) : NULL;
+  priv->last_keyframe = -1;
+  priv->rate = 1.0;
+  priv->trick_interval = 0;
+  g_mutex_unlock (&priv->lock);
+
+  g_free (location);
+
+  /* The timeline of a range of a storage area begins with the first segment
+   * in it, go to the start of the range once prerolled */
+  request = g_new (PositionRequest, 1);
+  request->player = player;
+  request->position = GST_CLOCK_TIME_NONE;
+  if (g_str_has_prefix (uri, "segments://")) {
+    GstClockTime offset = gst_segment_src_get_start_offset (uri);
+
+    if (offset > 0)
+      request->position = offset;
+  }
+  g_main_context_invoke_full (priv->context, G_PRIORITY_DEFAULT,
+      uri_changed_cb, request, g_free);
+}
+
+/**
+ * gst_media_player_set_location:
+ * @player: a #GstMediaPlayer
+ * @location: file to write to
+ *
+ * Sets the file the disk writer of the player writes to, if it has one.
+ */
+void
+gst_media_player_set_location (GstMediaPlayer * player,
+    const gchar * location)
+{
+  GstMediaPlayerPrivate *priv;
+
+  g_return_if_fail (GST_IS_MEDIA_PLAYER (player));
+
+  priv = GST_MEDIA_PLAYER_GET_PRIVATE (player);
+
+  if (priv->writer == NULL)
+    return;
+
+  gst_disk_writer_set_location (priv->writer, location);
 }
 
 /**
@@ -26,6 +26,8 @@
 
 #include "rtspstreamer.h"
 #include "windowrenderer.h"
+#include "diskwriter.h"
+#include "syncgroup.h"
 
 G_BEGIN_DECLS
 
@@ -75,7 +77,12 @@ GstMediaPlayer *gst_media_player_new(GstRTSPStreamer * streamer, GstWindowRender
 gboolean gst_media_player_setup_thread (GstMediaPlayer *player, GError ** error);
 gboolean gst_media_player_set_state (GstMediaPlayer * player, GstState state);
 gboolean gst_media_player_set_position (GstMediaPlayer * player, gint64 position);
+gboolean gst_media_player_set_rate (GstMediaPlayer * player, gdouble rate);
+void gst_media_player_set_priority (GstMediaPlayer * player, gint priority);
+void gst_media_player_set_sync_group (GstMediaPlayer * player, GstSyncGroup * group);
+void gst_media_player_set_playback (GstMediaPlayer * player, gboolean playback);
 void gst_media_player_set_uri (GstMediaPlayer * player, const gchar * url, const gchar * user, const gchar * pass);
+void gst_media_player_set_location (GstMediaPlayer * player, const gchar * location);
 void gst_media_player_set_native_window (GstMediaPlayer * player, ANativeWindow * native_window);
 void gst_media_player_release_native_window (GstMediaPlayer * player);
 
@@ -0,0 +1,645 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstMosaicRenderer: GstWindowRenderer compositing the video of several
+ * players into a single window.
+ *
+ * Every player keeps its own pipeline (and so its own control API), but
+ * instead of rendering into a window of its own it gets an appsink from
+ * gst_mosaic_renderer_request_sink(). Decoded frames are handed over to the
+ * mosaic pipeline, where a single compositor scales each input straight into
+ * its cell and a single video sink renders the result:
+ *
+ *   appsrc (cell 0) --\
+ *   appsrc (cell 1) ---> compositor ! capsfilter ! glimagesink
+ *   appsrc (cell N) --/
+ *
+ * The wall of the activity (see playerwall.c) shows all configured cameras
+ * this way on a single surface, through the nativeWall* and nativeMosaic*
+ * calls of the native layer.
+ */
+#include <gst/video/video.h>
+#include <gst/video/videooverlay.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <android/native_window.h>
+#include <android/native_window_jni.h>
+
+#include "mosaicrenderer.h"
+#include "windowrenderer.h"
+
+#define GST_MOSAIC_RENDERER_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_MOSAIC_RENDERER, GstMosaicRendererPrivate))
+
+/* Raw formats the compositor blends without an extra conversion */
+#define MOSAIC_TILE_CAPS \
+    "video/x-raw, format = (string) { I420, YV12, NV12, NV21, RGBA, BGRA }"
+
+typedef struct
+{
+  GstMosaicRenderer *mosaic;
+  guint cell;                   /* Cell index, row major */
+  GstElement *appsink;          /* Video sink of the player owning the cell */
+  GstElement *appsrc;           /* Feeds the compositor */
+  GstPad *mixer_pad;            /* Compositor request pad */
+  GstCaps *caps;                /* Caps last configured on the appsrc */
+  gint media_width;             /* Media size, PAR corrected */
+  gint media_height;
+} GstMosaicTile;
+
+struct _GstMosaicRendererPrivate
+{
+  GMutex lock;                  /* Protects the layout and the tiles */
+  GstElement *pipeline;
+  GstElement *mixer;
+  GstElement *capsfilter;
+  GstElement *sink;
+  ANativeWindow *native_window;
+  guint columns;
+  guint rows;
+  gint width;                   /* Size of the native window */
+  gint height;
+  GList *tiles;                 /* List of GstMosaicTile */
+};
+
+/* object properties */
+enum
+{
+  PROP_0,
+  PROP_COLUMNS,
+  PROP_ROWS
+};
+
+#define DEFAULT_COLUMNS 2
+#define DEFAULT_ROWS 2
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static void gst_mosaic_renderer_finalize (GObject * obj);
+static void gst_mosaic_renderer_get_property (GObject *object,
+    guint property_id, GValue *value, GParamSpec *pspec);
+static void gst_mosaic_renderer_set_property (GObject *object,
+    guint property_id, const GValue *value, GParamSpec *pspec);
+static void gst_mosaic_renderer_window_renderer_interface_init (
+    GstWindowRendererInterface * iface);
+static void gst_mosaic_renderer_set_window (GstWindowRenderer * renderer,
+    ANativeWindow * native_window);
+static void gst_mosaic_renderer_release_window (GstWindowRenderer * renderer);
+
+G_DEFINE_TYPE_WITH_CODE (GstMosaicRenderer, gst_mosaic_renderer,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_WINDOW_RENDERER,
+        gst_mosaic_renderer_window_renderer_interface_init));
+
+static void
+gst_mosaic_renderer_class_init (GstMosaicRendererClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  g_type_class_add_private (klass, sizeof (GstMosaicRendererPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_mosaic_renderer_finalize;
+  gobject_class->get_property = gst_mosaic_renderer_get_property;
+  gobject_class->set_property = gst_mosaic_renderer_set_property;
+
+  g_object_class_install_property (gobject_class,
+      PROP_COLUMNS, g_param_spec_uint ("columns", "Columns",
+      "Number of cells per row", 1, G_MAXUINT, DEFAULT_COLUMNS,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class,
+      PROP_ROWS, g_param_spec_uint ("rows", "Rows",
+      "Number of cells per column", 1, G_MAXUINT, DEFAULT_ROWS,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "mosaicrenderer", 0,
+      "Mosaic Renderer");
+  gst_debug_set_threshold_for_name ("mosaicrenderer", GST_LEVEL_DEBUG);
+}
+
+/* Nobody runs a main loop for the mosaic pipeline, log what is interesting
+ * and drop everything so that messages do not pile up on the bus */
+static GstBusSyncReply
+bus_sync_handler (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GError *err;
+  gchar *debug_info;
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error (msg, &err, &debug_info);
+      GST_ERROR ("Error received from element %s: %s",
+          GST_OBJECT_NAME (msg->src), err->message);
+      g_clear_error (&err);
+      g_free (debug_info);
+      break;
+    case GST_MESSAGE_WARNING:
+      gst_message_parse_warning (msg, &err, &debug_info);
+      GST_WARNING ("Warning received from element %s: %s",
+          GST_OBJECT_NAME (msg->src), err->message);
+      g_clear_error (&err);
+      g_free (debug_info);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BUS_DROP;
+}
+
+static void
+gst_mosaic_renderer_init (GstMosaicRenderer * self)
+{
+  GstMosaicRendererPrivate *priv;
+  GstBus *bus;
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (self);
+
+  g_mutex_init (&priv->lock);
+
+  priv->pipeline = gst_pipeline_new ("mosaic");
+  priv->mixer = gst_element_factory_make ("compositor", NULL);
+  priv->capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  priv->sink = gst_element_factory_make ("glimagesink", NULL);
+
+  /* Black background for empty cells and letterboxing */
+  g_object_set (priv->mixer, "background", 1, NULL);
+  /* Every tile was already synchronised by its own pipeline, render the
+   * composited frame as soon as it is ready */
+  g_object_set (priv->sink, "sync", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (priv->pipeline), priv->mixer, priv->capsfilter,
+      priv->sink, NULL);
+  gst_element_link_many (priv->mixer, priv->capsfilter, priv->sink, NULL);
+
+  bus = gst_element_get_bus (priv->pipeline);
+  gst_bus_set_sync_handler (bus, bus_sync_handler, self, NULL);
+  gst_object_unref (bus);
+}
+
+static void
+gst_mosaic_renderer_window_renderer_interface_init (
+    GstWindowRendererInterface * iface)
+{
+  iface->set_window = gst_mosaic_renderer_set_window;
+  iface->release_window = gst_mosaic_renderer_release_window;
+}
+
+/* Place the tile in its cell, preserving the aspect ratio of the media.
+ * Must be called with the lock held. */
+static void
+update_tile_unlocked (GstMosaicRendererPrivate * priv, GstMosaicTile * tile)
+{
+  gint cell_width;
+  gint cell_height;
+  gint width;
+  gint height;
+  guint column;
+  guint row;
+
+  column = tile->cell % priv->columns;
+  row = tile->cell / priv->columns;
+
+  if (row >= priv->rows || priv->width <= 0 || priv->height <= 0) {
+    /* The cell is not part of the current layout */
+    g_object_set (tile->mixer_pad, "alpha", 0.0, NULL);
+    return;
+  }
+
+  cell_width = priv->width / priv->columns;
+  cell_height = priv->height / priv->rows;
+
+  width = cell_width;
+  height = cell_height;
+  if (tile->media_width > 0 && tile->media_height > 0) {
+    height = cell_width * tile->media_height / tile->media_width;
+    if (height > cell_height) {
+      height = cell_height;
+      width = cell_height * tile->media_width / tile->media_height;
+    }
+  }
+
+  GST_DEBUG ("Cell %u at %dx%d+%d+%d", tile->cell, width, height,
+      column * cell_width + (cell_width - width) / 2,
+      row * cell_height + (cell_height - height) / 2);
+
+  g_object_set (tile->mixer_pad,
+      "xpos", (gint) (column * cell_width + (cell_width - width) / 2),
+      "ypos", (gint) (row * cell_height + (cell_height - height) / 2),
+      "width", width, "height", height, "alpha", 1.0, NULL);
+}
+
+/* Must be called with the lock held */
+static void
+update_layout_unlocked (GstMosaicRendererPrivate * priv)
+{
+  GList *walk;
+
+  if (priv->width > 0 && priv->height > 0) {
+    GstCaps *caps;
+
+    /* Composite straight at the size of the window so the sink does not
+     * have to scale again */
+    caps = gst_caps_new_simple ("video/x-raw",
+        "format", G_TYPE_STRING, "RGBA",
+        "width", G_TYPE_INT, priv->width,
+        "height", G_TYPE_INT, priv->height, NULL);
+    g_object_set (priv->capsfilter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+  }
+
+  for (walk = priv->tiles; walk != NULL; walk = walk->next)
+    update_tile_unlocked (priv, walk->data);
+}
+
+/* Configures the appsrc of @tile for @caps, unless they did not change */
+static void
+tile_set_caps (GstMosaicTile * tile, GstCaps * caps)
+{
+  GstMosaicRendererPrivate *priv;
+  GstVideoInfo vinfo;
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (tile->mosaic);
+
+  g_mutex_lock (&priv->lock);
+  if (tile->caps != NULL && gst_caps_is_equal (caps, tile->caps)) {
+    g_mutex_unlock (&priv->lock);
+    return;
+  }
+
+  GST_DEBUG ("New caps for cell %u: %" GST_PTR_FORMAT, tile->cell, caps);
+
+  gst_app_src_set_caps (GST_APP_SRC (tile->appsrc), caps);
+  gst_caps_replace (&tile->caps, caps);
+  if (gst_video_info_from_caps (&vinfo, caps)) {
+    tile->media_width = vinfo.width * vinfo.par_n / vinfo.par_d;
+    tile->media_height = vinfo.height;
+  }
+  update_tile_unlocked (priv, tile);
+  g_mutex_unlock (&priv->lock);
+}
+
+/* Called from the streaming thread of the player owning the cell */
+static GstFlowReturn
+new_sample_cb (GstAppSink * appsink, gpointer user_data)
+{
+  GstMosaicTile *tile = (GstMosaicTile *) user_data;
+  GstSample *sample;
+  GstCaps *caps;
+  GstBuffer *buffer;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL)
+    return GST_FLOW_EOS;
+
+  caps = gst_sample_get_caps (sample);
+  if (caps != NULL)
+    tile_set_caps (tile, caps);
+
+  buffer = gst_sample_get_buffer (sample);
+
+  /* Do not let a slow mosaic build up latency, one frame in flight is
+   * enough */
+  if (gst_app_src_get_current_level_bytes (GST_APP_SRC (tile->appsrc)) >
+      gst_buffer_get_size (buffer)) {
+    GST_LOG ("Mosaic is late, dropping frame for cell %u", tile->cell);
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+  }
+
+  /* The frame was already synchronised against the clock of its own
+   * pipeline. Only the metadata is copied here, appsrc restamps it with the
+   * running time of the mosaic pipeline. */
+  buffer = gst_buffer_make_writable (gst_buffer_ref (buffer));
+  GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  gst_sample_unref (sample);
+
+  gst_app_src_push_buffer (GST_APP_SRC (tile->appsrc), buffer);
+
+  return GST_FLOW_OK;
+}
+
+static void
+tile_free (GstMosaicRendererPrivate * priv, GstMosaicTile * tile)
+{
+  GstAppSinkCallbacks callbacks = { NULL, };
+  GstPad *srcpad;
+
+  gst_app_sink_set_callbacks (GST_APP_SINK (tile->appsink), &callbacks, NULL,
+      NULL);
+
+  gst_element_set_state (tile->appsrc, GST_STATE_NULL);
+  srcpad = gst_element_get_static_pad (tile->appsrc, "src");
+  gst_pad_unlink (srcpad, tile->mixer_pad);
+  gst_object_unref (srcpad);
+  gst_element_release_request_pad (priv->mixer, tile->mixer_pad);
+  gst_object_unref (tile->mixer_pad);
+  gst_bin_remove (GST_BIN (priv->pipeline), tile->appsrc);
+
+  gst_object_unref (tile->appsink);
+  if (tile->caps != NULL)
+    gst_caps_unref (tile->caps);
+
+  g_free (tile);
+}
+
+static void
+gst_mosaic_renderer_finalize (GObject * obj)
+{
+  GstMosaicRenderer *mosaic;
+  GstMosaicRendererPrivate *priv;
+  GList *walk;
+
+  mosaic = GST_MOSAIC_RENDERER (obj);
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  gst_mosaic_renderer_release_window (GST_WINDOW_RENDERER (mosaic));
+
+  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+
+  for (walk = priv->tiles; walk != NULL; walk = walk->next)
+    tile_free (priv, walk->data);
+  g_list_free (priv->tiles);
+  priv->tiles = NULL;
+
+  gst_object_unref (priv->pipeline);
+  priv->pipeline = NULL;
+
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_mosaic_renderer_parent_class)->finalize (obj);
+}
+
+static void
+gst_mosaic_renderer_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstMosaicRenderer *mosaic = GST_MOSAIC_RENDERER (object);
+  GstMosaicRendererPrivate *priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  switch (property_id)
+  {
+    case PROP_COLUMNS:
+      g_value_set_uint (value, priv->columns);
+      break;
+    case PROP_ROWS:
+      g_value_set_uint (value, priv->rows);
+      break;
+  }
+}
+
+static void
+gst_mosaic_renderer_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstMosaicRenderer *mosaic = GST_MOSAIC_RENDERER (object);
+  GstMosaicRendererPrivate *priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  g_mutex_lock (&priv->lock);
+  switch (property_id)
+  {
+    case PROP_COLUMNS:
+      priv->columns = g_value_get_uint (value);
+      break;
+    case PROP_ROWS:
+      priv->rows = g_value_get_uint (value);
+      break;
+  }
+  update_layout_unlocked (priv);
+  g_mutex_unlock (&priv->lock);
+}
+
+GstMosaicRenderer *
+gst_mosaic_renderer_new (guint columns, guint rows)
+{
+  return g_object_new (GST_TYPE_MOSAIC_RENDERER, "columns", columns, "rows",
+      rows, NULL);
+}
+
+/**
+ * gst_mosaic_renderer_set_layout:
+ * @mosaic: a #GstMosaicRenderer
+ * @columns: number of cells per row
+ * @rows: number of cells per column
+ *
+ * Changes the grid. Tiles whose cell falls outside the new grid are hidden.
+ */
+void
+gst_mosaic_renderer_set_layout (GstMosaicRenderer * mosaic, guint columns,
+    guint rows)
+{
+  g_return_if_fail (GST_IS_MOSAIC_RENDERER (mosaic));
+
+  g_object_set (mosaic, "columns", columns, "rows", rows, NULL);
+}
+
+/**
+ * gst_mosaic_renderer_request_sink:
+ * @mosaic: a #GstMosaicRenderer
+ * @cell: cell index, row major
+ *
+ * Creates a video sink rendering into @cell. The returned element is meant
+ * to be used as the video sink of a player pipeline and must be given back
+ * with gst_mosaic_renderer_release_sink() once that pipeline is shut down.
+ *
+ * Returns: (transfer none): the video sink.
+ */
+GstElement *
+gst_mosaic_renderer_request_sink (GstMosaicRenderer * mosaic, guint cell)
+{
+  GstMosaicRendererPrivate *priv;
+  GstMosaicTile *tile;
+  GstAppSinkCallbacks callbacks = { NULL, };
+  GstCaps *caps;
+  GstPad *srcpad;
+
+  g_return_val_if_fail (GST_IS_MOSAIC_RENDERER (mosaic), NULL);
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  GST_DEBUG ("Requesting sink for cell %u", cell);
+
+  tile = g_new0 (GstMosaicTile, 1);
+  tile->mosaic = mosaic;
+  tile->cell = cell;
+
+  tile->appsrc = gst_element_factory_make ("appsrc", NULL);
+  g_object_set (tile->appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME,
+      "do-timestamp", TRUE, NULL);
+
+  tile->appsink = gst_element_factory_make ("appsink", NULL);
+  gst_object_ref_sink (tile->appsink);
+  caps = gst_caps_from_string (MOSAIC_TILE_CAPS);
+  g_object_set (tile->appsink, "caps", caps, "max-buffers", 1, "drop", TRUE,
+      NULL);
+  gst_caps_unref (caps);
+  callbacks.new_sample = new_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (tile->appsink), &callbacks, tile,
+      NULL);
+
+  gst_bin_add (GST_BIN (priv->pipeline), tile->appsrc);
+  tile->mixer_pad = gst_element_get_request_pad (priv->mixer, "sink_%u");
+  srcpad = gst_element_get_static_pad (tile->appsrc, "src");
+  gst_pad_link (srcpad, tile->mixer_pad);
+  gst_object_unref (srcpad);
+  gst_element_sync_state_with_parent (tile->appsrc);
+
+  g_mutex_lock (&priv->lock);
+  priv->tiles = g_list_append (priv->tiles, tile);
+  update_tile_unlocked (priv, tile);
+  g_mutex_unlock (&priv->lock);
+
+  return tile->appsink;
+}
+
+/**
+ * gst_mosaic_renderer_release_sink:
+ * @mosaic: a #GstMosaicRenderer
+ * @sink: sink returned by gst_mosaic_renderer_request_sink()
+ *
+ * Frees the cell occupied by @sink.
+ */
+void
+gst_mosaic_renderer_release_sink (GstMosaicRenderer * mosaic,
+    GstElement * sink)
+{
+  GstMosaicRendererPrivate *priv;
+  GstMosaicTile *tile = NULL;
+  GList *walk;
+
+  g_return_if_fail (GST_IS_MOSAIC_RENDERER (mosaic));
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  g_mutex_lock (&priv->lock);
+  for (walk = priv->tiles; walk != NULL; walk = walk->next) {
+    if (((GstMosaicTile *) walk->data)->appsink == sink) {
+      tile = walk->data;
+      priv->tiles = g_list_delete_link (priv->tiles, walk);
+      break;
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  if (tile == NULL) {
+    GST_WARNING ("Sink %p does not belong to mosaic %p", sink, mosaic);
+    return;
+  }
+
+  GST_DEBUG ("Releasing sink for cell %u", tile->cell);
+
+  tile_free (priv, tile);
+}
+
+/**
+ * gst_mosaic_renderer_move_sink:
+ * @mosaic: a #GstMosaicRenderer
+ * @sink: sink returned by gst_mosaic_renderer_request_sink()
+ * @cell: cell index, row major
+ *
+ * Moves the tile of @sink to @cell, the player feeding it is not affected.
+ */
+void
+gst_mosaic_renderer_move_sink (GstMosaicRenderer * mosaic, GstElement * sink,
+    guint cell)
+{
+  GstMosaicRendererPrivate *priv;
+  GList *walk;
+
+  g_return_if_fail (GST_IS_MOSAIC_RENDERER (mosaic));
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (mosaic);
+
+  g_mutex_lock (&priv->lock);
+  for (walk = priv->tiles; walk != NULL; walk = walk->next) {
+    GstMosaicTile *tile = walk->data;
+
+    if (tile->appsink == sink) {
+      GST_DEBUG ("Moving sink from cell %u to %u", tile->cell, cell);
+      tile->cell = cell;
+      update_tile_unlocked (priv, tile);
+      break;
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  if (walk == NULL)
+    GST_WARNING ("Sink %p does not belong to mosaic %p", sink, mosaic);
+}
+
+static void
+gst_mosaic_renderer_set_window (GstWindowRenderer * renderer,
+    ANativeWindow * native_window)
+{
+  GstMosaicRendererPrivate *priv;
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (renderer);
+
+  if (priv->native_window != NULL) {
+    if (priv->native_window == native_window) {
+      /* Same surface, but its size might have changed */
+      g_mutex_lock (&priv->lock);
+      priv->width = ANativeWindow_getWidth (native_window);
+      priv->height = ANativeWindow_getHeight (native_window);
+      update_layout_unlocked (priv);
+      g_mutex_unlock (&priv->lock);
+      gst_video_overlay_expose (GST_VIDEO_OVERLAY (priv->sink));
+      return;
+    } else {
+      gst_mosaic_renderer_release_window (renderer);
+    }
+  }
+
+  priv->native_window = native_window;
+
+  g_mutex_lock (&priv->lock);
+  priv->width = ANativeWindow_getWidth (native_window);
+  priv->height = ANativeWindow_getHeight (native_window);
+  GST_DEBUG ("Rendering mosaic into %dx%d window", priv->width, priv->height);
+  update_layout_unlocked (priv);
+  g_mutex_unlock (&priv->lock);
+
+  gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (priv->sink),
+      (guintptr)priv->native_window);
+  gst_element_set_state (priv->pipeline, GST_STATE_PLAYING);
+}
+
+static void
+gst_mosaic_renderer_release_window (GstWindowRenderer * renderer)
+{
+  GstMosaicRendererPrivate *priv;
+
+  priv = GST_MOSAIC_RENDERER_GET_PRIVATE (renderer);
+
+  if (priv->pipeline != NULL) {
+    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (priv->sink),
+        (guintptr)NULL);
+    gst_element_set_state (priv->pipeline, GST_STATE_READY);
+  }
+
+  if (priv->native_window != NULL) {
+    ANativeWindow_release (priv->native_window);
+    priv->native_window = NULL;
+  }
+}
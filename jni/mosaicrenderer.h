@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstMosaicRenderer: GstWindowRenderer compositing the video of several
+ * players into a single window.
+ */
+#ifndef _GST_MOSAIC_RENDERER_H_
+#define _GST_MOSAIC_RENDERER_H_
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MOSAIC_RENDERER (gst_mosaic_renderer_get_type ())
+#define GST_MOSAIC_RENDERER(object) (G_TYPE_CHECK_INSTANCE_CAST ((object), GST_TYPE_MOSAIC_RENDERER, GstMosaicRenderer))
+#define GST_MOSAIC_RENDERER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_MOSAIC_RENDERER, GstMosaicRendererClass))
+#define GST_IS_MOSAIC_RENDERER(object) (G_TYPE_CHECK_INSTANCE_TYPE ((object), GST_TYPE_MOSAIC_RENDERER))
+#define GST_IS_MOSAIC_RENDERER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_MOSAIC_RENDERER))
+#define GST_MOSAIC_RENDERER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_MOSAIC_RENDERER, GstMosaicRendererClass))
+
+typedef struct _GstMosaicRenderer GstMosaicRenderer;
+typedef struct _GstMosaicRendererClass GstMosaicRendererClass;
+typedef struct _GstMosaicRendererPrivate GstMosaicRendererPrivate;
+
+struct _GstMosaicRenderer {
+  GObject parent;
+
+  /*< protected >*/
+
+  /*< private >*/
+};
+
+struct _GstMosaicRendererClass {
+  GObjectClass parent_class;
+
+  /*< private >*/
+};
+
+GType gst_mosaic_renderer_get_type (void);
+
+GstMosaicRenderer * gst_mosaic_renderer_new (guint columns, guint rows);
+void gst_mosaic_renderer_set_layout (GstMosaicRenderer * mosaic, guint columns,
+    guint rows);
+GstElement * gst_mosaic_renderer_request_sink (GstMosaicRenderer * mosaic,
+    guint cell);
+void gst_mosaic_renderer_release_sink (GstMosaicRenderer * mosaic,
+    GstElement * sink);
+void gst_mosaic_renderer_move_sink (GstMosaicRenderer * mosaic,
+    GstElement * sink, guint cell);
+
+G_END_DECLS
+
+#endif /* _GST_MOSAIC_RENDERER_H_ */
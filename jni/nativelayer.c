@@ -29,6 +29,18 @@
 #include "mediaplayer.h"
 #include "rtspstreamer.h"
 #include "rtspviewer.h"
+#include "rtsprecorder.h"
+#include "segmentstorage.h"
+#include "mosaicrenderer.h"
+#include "sharedbufferpool.h"
+#include "presentscheduler.h"
+#include "playerwall.h"
+#include "cameratour.h"
+#include "syncgroup.h"
+#include "clipexport.h"
+#include "thumbnailcache.h"
+#include "transportpolicy.h"
+#include "tlssessioncache.h"
 
 GST_DEBUG_CATEGORY_STATIC (debug_category);
 #define GST_CAT_DEFAULT debug_category
@@ -49,9 +61,16 @@ GST_DEBUG_CATEGORY_STATIC (debug_category);
 /* Structure to contain all our information, so we can pass it to callbacks */
 typedef struct _CustomData
 {
+  GMutex lock;                  /* Protects app and state */
   jobject app;                  /* Application instance, used to call its methods.
-                                 * A global reference is kept. */
+                                 * A global reference is kept. NULL while the
+                                 * session is detached. */
   GstMediaPlayer *player;       /* GstMediaPlayer instance, this is the pipeline */
+  GstElement *mosaic_sink;      /* Video sink of the mosaic cell, if any */
+  gint session;                 /* Id in the session registry */
+  GSource *expiry;              /* Finalizes the detached player, protected
+                                 * by sessions_lock */
+  gchar *state;                 /* Last state reported */
 } CustomData;
 
 /* These global variables cache values which are not changing during
@@ -62,11 +81,80 @@ static jmethodID set_error_method_id;
 static jmethodID set_state_method_id;
 static jmethodID set_current_position_method_id;
 static jmethodID on_media_size_changed_method_id;
+static jmethodID on_player_created_method_id;
+static jmethodID on_export_progress_method_id;
+
+/* Players requested with nativePlayerCreateAsync are built in parallel by
+ * these threads, off the UI thread */
+#define MAX_CREATION_THREADS 4
+static GThreadPool *creation_pool;
+
+typedef struct _CreationRequest
+{
+  jobject app;                  /* Global reference, to report back to */
+  jint tag;                     /* Passed back along with the new player */
+  gint64 queued_time;
+} CreationRequest;
+
+/* Startup phases in the order they were reached, timed from the moment the
+ * library was loaded. Every phase is only recorded the first time. */
+static GMutex startup_lock;
+static gint64 startup_time;
+static GHashTable *startup_seen;
+static GString *startup_phases;
+
+/* Every player by session id, so that a recreated Activity can reattach to the
+ * players of its predecessor instead of reconnecting */
+static GMutex sessions_lock;
+static GHashTable *sessions;
+static gint next_session = 1;
+
+/* A detached player nobody reattaches to in time is finalized, from the
+ * thread running this context */
+#define DETACHED_SESSION_TIMEOUT 30
+static GMainContext *sessions_context;
+static pthread_t sessions_thread;
+
+/* A clip being exported and the application it reports to */
+typedef struct _ExportData
+{
+  jobject app;                  /* Global reference */
+  GstClipExport *export;
+} ExportData;
+
+/* Thumbnail caches by recording, mapped by nativeThumbnailGet */
+static GMutex thumbnails_lock;
+static GHashTable *thumbnails;
+
+/* Renderer shared by all the players created with nativeMosaicPlayerCreate */
+static GstMosaicRenderer *mosaic;
+
+/* Players of the mosaic managed by the wall, and the application they
+ * report to */
+static GstPlayerWall *wall;
+static jobject wall_app;
 
 /*
  * Private methods
  */
 
+static void
+startup_phase (const gchar * name)
+{
+  g_mutex_lock (&startup_lock);
+  if (startup_seen == NULL) {
+    startup_seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+    startup_phases = g_string_new (NULL);
+  }
+  if (!g_hash_table_contains (startup_seen, name)) {
+    g_hash_table_add (startup_seen, g_strdup (name));
+    g_string_append_printf (startup_phases, "%s: %" G_GINT64_FORMAT " ms\n",
+        name, (g_get_monotonic_time () - startup_time) / 1000);
+  }
+  g_mutex_unlock (&startup_lock);
+}
+
 /* Register this thread with the VM */
 static JNIEnv *
 attach_current_thread (void)
@@ -109,6 +197,22 @@ get_jni_env (void)
   return env;
 }
 
+/* Local reference to the Activity of the player, NULL while detached. Java
+ * is called without holding the lock, the reference keeps the Activity alive
+ * meanwhile even if the player gets detached. */
+static jobject
+get_app (JNIEnv * env, CustomData * data)
+{
+  jobject app = NULL;
+
+  g_mutex_lock (&data->lock);
+  if (data->app != NULL)
+    app = (*env)->NewLocalRef (env, data->app);
+  g_mutex_unlock (&data->lock);
+
+  return app;
+}
+
 /*
  * Callbacks
  */
@@ -118,19 +222,32 @@ new_status (GstMediaPlayer * player, gchar * state, gpointer user_data)
   CustomData *data = (CustomData *) user_data;
   JNIEnv *env = get_jni_env ();
   jstring jmessage;
+  jobject app;
 
   GST_DEBUG ("Setting state to: %s", state);
 
-  jmessage = (*env)->NewStringUTF (env, state);
+  if (g_strcmp0 (state, "PLAYING") == 0)
+    startup_phase ("first player playing");
 
-  (*env)->CallVoidMethod (env, data->app, set_state_method_id,
-      NATIVEP_TO_J (data), jmessage);
-  if ((*env)->ExceptionCheck (env)) {
-    GST_ERROR ("Failed to call Java method");
-    (*env)->ExceptionClear (env);
-  }
+  g_mutex_lock (&data->lock);
+  g_free (data->state);
+  data->state = g_strdup (state);
+  g_mutex_unlock (&data->lock);
+
+  app = get_app (env, data);
+  if (app != NULL) {
+    jmessage = (*env)->NewStringUTF (env, state);
+
+    (*env)->CallVoidMethod (env, app, set_state_method_id,
+        NATIVEP_TO_J (data), jmessage);
+    if ((*env)->ExceptionCheck (env)) {
+      GST_ERROR ("Failed to call Java method");
+      (*env)->ExceptionClear (env);
+    }
 
-  (*env)->DeleteLocalRef (env, jmessage);
+    (*env)->DeleteLocalRef (env, jmessage);
+    (*env)->DeleteLocalRef (env, app);
+  }
 }
 
 static void
@@ -139,19 +256,24 @@ error (GstMediaPlayer * player, gchar * error, gpointer user_data)
   CustomData *data = (CustomData *) user_data;
   JNIEnv *env = get_jni_env ();
   jstring jmessage;
+  jobject app;
 
   GST_DEBUG ("Setting error to: %s", error);
 
-  jmessage = (*env)->NewStringUTF (env, error);
+  app = get_app (env, data);
+  if (app != NULL) {
+    jmessage = (*env)->NewStringUTF (env, error);
 
-  (*env)->CallVoidMethod (env, data->app, set_error_method_id,
-      NATIVEP_TO_J (data), jmessage);
-  if ((*env)->ExceptionCheck (env)) {
-    GST_ERROR ("Failed to call Java method");
-    (*env)->ExceptionClear (env);
-  }
+    (*env)->CallVoidMethod (env, app, set_error_method_id,
+        NATIVEP_TO_J (data), jmessage);
+    if ((*env)->ExceptionCheck (env)) {
+      GST_ERROR ("Failed to call Java method");
+      (*env)->ExceptionClear (env);
+    }
 
-  (*env)->DeleteLocalRef (env, jmessage);
+    (*env)->DeleteLocalRef (env, jmessage);
+    (*env)->DeleteLocalRef (env, app);
+  }
 }
 
 static void
@@ -160,12 +282,17 @@ size_changed (GstMediaPlayer * player, gint width, gint height,
 {
   CustomData *data = (CustomData *) user_data;
   JNIEnv *env = get_jni_env ();
-
-  (*env)->CallVoidMethod (env, data->app, on_media_size_changed_method_id,
-      NATIVEP_TO_J (data), (jint) width, (jint) height);
-  if ((*env)->ExceptionCheck (env)) {
-    GST_ERROR ("Failed to call Java method");
-    (*env)->ExceptionClear (env);
+  jobject app;
+
+  app = get_app (env, data);
+  if (app != NULL) {
+    (*env)->CallVoidMethod (env, app, on_media_size_changed_method_id,
+        NATIVEP_TO_J (data), (jint) width, (jint) height);
+    if ((*env)->ExceptionCheck (env)) {
+      GST_ERROR ("Failed to call Java method");
+      (*env)->ExceptionClear (env);
+    }
+    (*env)->DeleteLocalRef (env, app);
   }
 }
 
@@ -175,12 +302,17 @@ new_position (GstMediaPlayer * player, gint position, gint duration,
 {
   CustomData *data = (CustomData *) user_data;
   JNIEnv *env = get_jni_env ();
-
-  (*env)->CallVoidMethod (env, data->app, set_current_position_method_id,
-      NATIVEP_TO_J (data), position, duration);
-  if ((*env)->ExceptionCheck (env)) {
-    GST_ERROR ("Failed to call Java method");
-    (*env)->ExceptionClear (env);
+  jobject app;
+
+  app = get_app (env, data);
+  if (app != NULL) {
+    (*env)->CallVoidMethod (env, app, set_current_position_method_id,
+        NATIVEP_TO_J (data), position, duration);
+    if ((*env)->ExceptionCheck (env)) {
+      GST_ERROR ("Failed to call Java method");
+      (*env)->ExceptionClear (env);
+    }
+    (*env)->DeleteLocalRef (env, app);
   }
 }
 
@@ -188,206 +320,371 @@ new_position (GstMediaPlayer * player, gint position, gint duration,
  * Java Bindings
  */
 
-/* Instruct the native code to create its internal data structure and
- * pipeline */
-static jlong
-gst_native_player_create (JNIEnv * env, jobject thiz)
+/* Hook up the callbacks of the player */
+static CustomData *
+custom_data_new (JNIEnv * env, jobject thiz, GstMediaPlayer * player)
 {
-  GstMediaPlayer *player;
-  GObject *viewer;
   CustomData *data;
-  jlong result;
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "nativelayer", 0, "Native layer");
+  gst_debug_set_threshold_for_name ("nativelayer", GST_LEVEL_DEBUG);
 
   data = g_new0 (CustomData, 1);
+  g_mutex_init (&data->lock);
   GST_DEBUG ("Created CustomData at %p", data);
 
-  viewer = g_object_new (GST_TYPE_RTSP_VIEWER, NULL);
-
-  player = gst_media_player_new (GST_RTSP_STREAMER (viewer), GST_WINDOW_RENDERER (viewer));
-
-  g_signal_connect (viewer, "size-changed", (GCallback) size_changed,
-      data);
-
   g_signal_connect (G_OBJECT (player), "new-status", (GCallback) new_status,
       data);
   g_signal_connect (G_OBJECT (player), "error", (GCallback) error, data);
   g_signal_connect (G_OBJECT (player), "new-position", (GCallback) new_position,
       data);
 
+  data->player = player;
+  data->app = (*env)->NewGlobalRef (env, thiz);
+  GST_DEBUG ("Created GlobalRef for app object at %p", data->app);
+
+  g_mutex_lock (&sessions_lock);
+  if (sessions == NULL)
+    sessions = g_hash_table_new (g_direct_hash, g_direct_equal);
+  data->session = next_session++;
+  g_hash_table_insert (sessions, GINT_TO_POINTER (data->session), data);
+  g_mutex_unlock (&sessions_lock);
+
+  return data;
+}
+
+/* Counterpart of custom_data_new, once the player is gone */
+static void
+custom_data_free (JNIEnv * env, CustomData * data)
+{
+  g_mutex_lock (&sessions_lock);
+  g_hash_table_remove (sessions, GINT_TO_POINTER (data->session));
+  if (data->expiry != NULL) {
+    g_source_destroy (data->expiry);
+    g_source_unref (data->expiry);
+    data->expiry = NULL;
+  }
+  g_mutex_unlock (&sessions_lock);
+
+  if (data->app != NULL)
+    (*env)->DeleteGlobalRef (env, data->app);
+  g_free (data->state);
+  g_mutex_clear (&data->lock);
+  GST_DEBUG ("Freeing CustomData at %p", data);
+  g_free (data);
+}
+
+/* Create the player around the viewer and hook up the callbacks */
+static CustomData *
+create_player (JNIEnv * env, jobject thiz, GObject * viewer,
+    GstWindowRenderer * renderer)
+{
+  GstMediaPlayer *player;
+  CustomData *data;
+
+  player = gst_media_player_new (GST_RTSP_STREAMER (viewer), renderer);
+  data = custom_data_new (env, thiz, player);
+
+  /* Players in a mosaic have no surface of their own to resize */
+  if (renderer != NULL)
+    g_signal_connect (viewer, "size-changed", (GCallback) size_changed,
+        data);
+
   if (!gst_media_player_setup_thread (player, NULL)) {
     GST_ERROR ("Could not configure player");
   }
   GST_DEBUG ("Created GstMediaPlayer at %p", player);
+  startup_phase ("first player created");
 
-  data->player = player;
-  data->app = (*env)->NewGlobalRef (env, thiz);
-  GST_DEBUG ("Created GlobalRef for app object at %p", data->app);
+  return data;
+}
 
-  GST_DEBUG_CATEGORY_INIT (debug_category, "nativelayer", 0, "Native layer");
-  gst_debug_set_threshold_for_name ("nativelayer", GST_LEVEL_DEBUG);
+/* Players of the wall are owned by it, their CustomData goes with them */
+static void
+wall_custom_data_free (gpointer user_data)
+{
+  custom_data_free (get_jni_env (), (CustomData *) user_data);
+}
+
+static void
+wall_player_created (GstPlayerWall * wall, GstMediaPlayer * player,
+    gpointer user_data)
+{
+  CustomData *data;
+
+  data = custom_data_new (get_jni_env (), wall_app, player);
+  g_object_set_data_full (G_OBJECT (player), "custom-data", data,
+      wall_custom_data_free);
+}
+
+/* Instruct the native code to create its internal data structure and
+ * pipeline */
+static jlong
+gst_native_player_create (JNIEnv * env, jobject thiz)
+{
+  GObject *viewer;
+  CustomData *data;
+
+  viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "share-stream", TRUE, NULL);
+
+  data = create_player (env, thiz, viewer, GST_WINDOW_RENDERER (viewer));
 
   return NATIVEP_TO_J (data);
 }
 
-/* Free resources */
+/* Builds the player of a CreationRequest on a thread of the creation pool */
 static void
-gst_native_player_finalize (JNIEnv * env, jobject thiz, jlong datap)
+create_player_func (gpointer task_data, gpointer user_data)
 {
+  CreationRequest *request = (CreationRequest *) task_data;
+  JNIEnv *env = get_jni_env ();
+  GObject *viewer;
   CustomData *data;
 
-  data = J_TO_NATIVEP (datap);
-  if (!data)
-    return;
+  viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "share-stream", TRUE, NULL);
+  data = create_player (env, request->app, viewer,
+      GST_WINDOW_RENDERER (viewer));
 
-  GST_DEBUG ("Finalizing...");
-  g_object_unref (data->player);
-  data->player = NULL;
-  (*env)->DeleteGlobalRef (env, data->app);
-  data->app = NULL;
-  GST_DEBUG ("Freeing CustomData at %p", data);
-  g_free (data);
+  GST_DEBUG ("Player %d ready after %" G_GINT64_FORMAT " ms", request->tag,
+      (g_get_monotonic_time () - request->queued_time) / 1000);
 
-  GST_DEBUG ("Done finalizing");
+  (*env)->CallVoidMethod (env, request->app, on_player_created_method_id,
+      request->tag, NATIVEP_TO_J (data));
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
+  }
+
+  (*env)->DeleteGlobalRef (env, request->app);
+  g_free (request);
 }
 
-/* Set pipelines's URI */
-void
-gst_native_set_uri (JNIEnv * env, jobject thiz, jlong datap, jstring uri,
-    jstring user, jstring pass)
+/* Like gst_native_player_create, but returns at once. The player is built on
+ * a worker thread and handed to nativePlayerCreated along with @tag, from that
+ * thread. */
+static void
+gst_native_player_create_async (JNIEnv * env, jobject thiz, jint tag)
 {
-  const jbyte *char_uri;
-  const jbyte *char_user = NULL;
-  const jbyte *char_pass = NULL;
+  CreationRequest *request;
+
+  if (creation_pool == NULL)
+    creation_pool = g_thread_pool_new (create_player_func, NULL,
+        MAX_CREATION_THREADS, FALSE, NULL);
+
+  request = g_new0 (CreationRequest, 1);
+  request->app = (*env)->NewGlobalRef (env, thiz);
+  request->tag = tag;
+  request->queued_time = g_get_monotonic_time ();
+
+  g_thread_pool_push (creation_pool, request, NULL);
+}
+
+/* Same as gst_native_player_create but the player renders into a cell of the
+ * mosaic instead of a surface of its own */
+static jlong
+gst_native_mosaic_player_create (JNIEnv * env, jobject thiz, jint cell)
+{
+  GstElement *sink;
+  GObject *viewer;
   CustomData *data;
 
-  data = J_TO_NATIVEP (datap);
-  if (!data)
-    return;
+  if (mosaic == NULL) {
+    GST_ERROR ("Mosaic not initialized");
+    return 0;
+  }
 
-  char_uri = (*env)->GetStringUTFChars (env, uri, NULL);
-  if (user != NULL)
-    char_user = (*env)->GetStringUTFChars (env, user, NULL);
-  if (pass != NULL)
-    char_pass = (*env)->GetStringUTFChars (env, pass, NULL);
+  sink = gst_mosaic_renderer_request_sink (mosaic, cell);
+  viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "video-sink", sink,
+      "share-stream", TRUE, NULL);
 
-  GST_DEBUG ("Setting URI to %s for player %p", char_uri, data);
-  gst_media_player_set_uri (data->player, char_uri, char_user, char_pass);
+  data = create_player (env, thiz, viewer, NULL);
+  data->mosaic_sink = sink;
 
-  (*env)->ReleaseStringUTFChars (env, uri, char_uri);
-  if (char_user != NULL)
-    (*env)->ReleaseStringUTFChars (env, user, char_user);
-  if (char_pass != NULL)
-    (*env)->ReleaseStringUTFChars (env, pass, char_pass);
+  return NATIVEP_TO_J (data);
 }
 
-/* Set pipeline to PLAYING state */
-static void
-gst_native_play (JNIEnv * env, jobject thiz, jlong datap)
+/* Create the player around the recorder and hook up the callbacks. The
+ * recorder is the disk writer of the player as well. */
+static CustomData *
+create_recorder (JNIEnv * env, jobject thiz, GObject * recorder)
 {
+  GstMediaPlayer *player;
   CustomData *data;
 
-  data = J_TO_NATIVEP (datap);
-  if (!data)
-    return;
+  player = g_object_new (GST_TYPE_MEDIA_PLAYER, "rtsp-streamer", recorder,
+      "disk-writer", recorder, NULL);
+  data = custom_data_new (env, thiz, player);
 
-  GST_DEBUG ("Setting state to PLAYING");
-  gst_media_player_set_state (data->player, GST_STATE_PLAYING);
+  if (!gst_media_player_setup_thread (player, NULL)) {
+    GST_ERROR ("Could not configure recorder");
+  }
+  GST_DEBUG ("Created recording GstMediaPlayer at %p", player);
+
+  return data;
 }
 
-/* Set pipeline to PAUSED state */
+/* Same as gst_native_player_create but the player records the camera to
+ * disk, sharing the connection of its viewers. Set the location before the
+ * URI. With @pre_event seconds the recorder keeps that much in memory and
+ * only writes once triggered. */
+static jlong
+gst_native_recorder_create (JNIEnv * env, jobject thiz, jint pre_event)
+{
+  GObject *recorder;
+
+  recorder = g_object_new (GST_TYPE_RTSP_RECORDER, "pre-event-time",
+      (guint64) pre_event * GST_SECOND, NULL);
+
+  return NATIVEP_TO_J (create_recorder (env, thiz, recorder));
+}
+
+/* Same as gst_native_recorder_create but the recording goes into segments of
+ * @segment_duration seconds, kept within @max_size bytes and @max_age seconds
+ * (0 for no limit). The location is the directory of the storage area. */
+static jlong
+gst_native_storage_recorder_create (JNIEnv * env, jobject thiz,
+    jint segment_duration, jlong max_size, jint max_age, jint pre_event)
+{
+  GObject *recorder;
+  GstElement *storage;
+
+  storage = gst_segment_storage_new (segment_duration * GST_SECOND, max_size,
+      max_age);
+  recorder = g_object_new (GST_TYPE_RTSP_RECORDER, "storage", storage,
+      "pre-event-time", (guint64) pre_event * GST_SECOND, NULL);
+
+  return NATIVEP_TO_J (create_recorder (env, thiz, recorder));
+}
+
+/* Start writing a recorder created with pre-event seconds, e.g. on motion
+ * or a button press */
 static void
-gst_native_pause (JNIEnv * env, jobject thiz, jlong datap)
+gst_native_recorder_trigger (JNIEnv * env, jobject thiz, jlong datap)
 {
   CustomData *data;
+  GObject *recorder = NULL;
 
   data = J_TO_NATIVEP (datap);
   if (!data)
     return;
 
-  GST_DEBUG ("Setting state to PAUSED");
-  gst_media_player_set_state (data->player, GST_STATE_PAUSED);
+  g_object_get (data->player, "rtsp-streamer", &recorder, NULL);
+  if (recorder != NULL && GST_IS_RTSP_RECORDER (recorder))
+    gst_rtsp_recorder_trigger (GST_RTSP_RECORDER (recorder));
+  if (recorder != NULL)
+    g_object_unref (recorder);
 }
 
-/* Set pipeline to READY state */
-static void
-gst_native_ready (JNIEnv * env, jobject thiz, jlong datap)
+/* Memory held by a recorder and usage of its storage area */
+static jstring
+gst_native_recorder_stats (JNIEnv * env, jobject thiz, jlong datap)
 {
   CustomData *data;
+  GObject *recorder = NULL;
+  gchar *stats = NULL;
+  jstring jstats;
 
   data = J_TO_NATIVEP (datap);
-  if (!data)
-    return;
+  if (data != NULL)
+    g_object_get (data->player, "rtsp-streamer", &recorder, NULL);
+  if (recorder != NULL && GST_IS_RTSP_RECORDER (recorder))
+    stats = gst_rtsp_recorder_get_stats (GST_RTSP_RECORDER (recorder));
 
-  GST_DEBUG ("Setting state to READY");
-  gst_media_player_set_state (data->player, GST_STATE_READY);
+  jstats = (*env)->NewStringUTF (env, stats != NULL ? stats : "");
+
+  g_free (stats);
+  if (recorder != NULL)
+    g_object_unref (recorder);
+
+  return jstats;
 }
 
-/* Instruct the pipeline to seek to a different position */
-void
-gst_native_set_position (JNIEnv * env, jobject thiz, jlong datap,
-    int milliseconds)
+static void
+player_free (JNIEnv * env, CustomData * data)
+{
+  GST_DEBUG ("Finalizing...");
+  g_object_unref (data->player);
+  data->player = NULL;
+  if (data->mosaic_sink != NULL) {
+    gst_mosaic_renderer_release_sink (mosaic, data->mosaic_sink);
+    data->mosaic_sink = NULL;
+  }
+  custom_data_free (env, data);
+
+  GST_DEBUG ("Done finalizing");
+}
+
+/* Free resources */
+static void
+gst_native_player_finalize (JNIEnv * env, jobject thiz, jlong datap)
 {
-  gint64 desired_position;
   CustomData *data;
 
   data = J_TO_NATIVEP (datap);
   if (!data)
     return;
 
-  desired_position = (gint64) (milliseconds * GST_MSECOND);
-  gst_media_player_set_position (data->player, desired_position);
+  player_free (env, data);
 }
 
-/* Native layer initializer: retrieve method and field IDs */
-static jboolean
-gst_native_layer_init (JNIEnv * env, jobject obj)
+static void *
+sessions_thread_function (void *user_data)
 {
-  guint i;
+  GMainLoop *main_loop;
 
-  set_state_method_id =
-      (*env)->GetMethodID (env, obj, "nativeStateChanged",
-      "(JLjava/lang/String;)V");
-  set_error_method_id =
-      (*env)->GetMethodID (env, obj, "nativeErrorOccured",
-      "(JLjava/lang/String;)V");
-  set_current_position_method_id =
-      (*env)->GetMethodID (env, obj, "nativePositionUpdated", "(JII)V");
-  on_media_size_changed_method_id =
-      (*env)->GetMethodID (env, obj, "nativeMediaSizeChanged", "(JII)V");
+  main_loop = g_main_loop_new (sessions_context, FALSE);
+  g_main_loop_run (main_loop);
+  g_main_loop_unref (main_loop);
 
-  if (!set_state_method_id || !set_error_method_id ||
-      !on_media_size_changed_method_id || !set_current_position_method_id) {
-    /* We emit this message through the Android log instead of the GStreamer log
-     * because the later has not been initialized yet.
-     */
-    __android_log_print (ANDROID_LOG_ERROR, "nativelayer", "The calling class "
-        "does not implement all necessary interface methods");
-    return JNI_FALSE;
+  return NULL;
+}
+
+/* Nobody reattached to the session in time */
+static gboolean
+session_expired_cb (gpointer user_data)
+{
+  CustomData *data = NULL;
+  gint session = GPOINTER_TO_INT (user_data);
+
+  /* Taken out of the registry under the lock, nativePlayerAttach can not
+   * pick it up anymore */
+  g_mutex_lock (&sessions_lock);
+  data = g_hash_table_lookup (sessions, GINT_TO_POINTER (session));
+  if (data != NULL && data->expiry == g_main_current_source ()) {
+    g_source_unref (data->expiry);
+    data->expiry = NULL;
+    g_hash_table_remove (sessions, GINT_TO_POINTER (session));
+  } else {
+    data = NULL;
   }
-  return JNI_TRUE;
+  g_mutex_unlock (&sessions_lock);
+
+  if (data != NULL) {
+    GST_DEBUG ("Session %d expired", session);
+    player_free (get_jni_env (), data);
+  }
+
+  return G_SOURCE_REMOVE;
 }
 
-static void
-gst_native_surface_init (JNIEnv * env, jobject thiz, jlong datap,
-    jobject surface)
+/* Id the player can be reattached with after the Activity is recreated */
+static jint
+gst_native_player_get_session (JNIEnv * env, jobject thiz, jlong datap)
 {
-  ANativeWindow *new_native_window;
   CustomData *data;
 
   data = J_TO_NATIVEP (datap);
   if (!data)
-    return;
-
-  new_native_window = ANativeWindow_fromSurface (env, surface);
-
-  GST_DEBUG ("Received surface %p (native window %p) %p", surface,
-      new_native_window, data);
+    return 0;
 
-  gst_media_player_set_native_window (data->player, new_native_window);
+  return data->session;
 }
 
+/* Keep the player running without an Activity, callbacks are dropped until
+ * it is reattached. It is finalized if that does not happen in time, e.g.
+ * because the Activity was not recreated after all. */
 static void
-gst_native_surface_finalize (JNIEnv * env, jobject thiz, jlong datap)
+gst_native_player_detach (JNIEnv * env, jobject thiz, jlong datap)
 {
   CustomData *data;
 
@@ -395,25 +692,923 @@ gst_native_surface_finalize (JNIEnv * env, jobject thiz, jlong datap)
   if (!data)
     return;
 
-  GST_DEBUG ("Releasing Native Window %p", data);
+  GST_DEBUG ("Detaching session %d", data->session);
 
-  gst_media_player_release_native_window (data->player);
+  g_mutex_lock (&data->lock);
+  if (data->app != NULL) {
+    (*env)->DeleteGlobalRef (env, data->app);
+    data->app = NULL;
+  }
+  g_mutex_unlock (&data->lock);
+
+  g_mutex_lock (&sessions_lock);
+  if (sessions_context == NULL) {
+    sessions_context = g_main_context_new ();
+    pthread_create (&sessions_thread, NULL, &sessions_thread_function, NULL);
+  }
+  if (data->expiry != NULL) {
+    g_source_destroy (data->expiry);
+    g_source_unref (data->expiry);
+  }
+  data->expiry = g_timeout_source_new_seconds (DETACHED_SESSION_TIMEOUT);
+  g_source_set_callback (data->expiry, session_expired_cb,
+      GINT_TO_POINTER (data->session), NULL);
+  g_source_attach (data->expiry, sessions_context);
+  g_mutex_unlock (&sessions_lock);
 }
 
-/* List of implemented native methods */
+/* Hand a detached player over to this Activity, 0 if the session is gone */
+static jlong
+gst_native_player_attach (JNIEnv * env, jobject thiz, jint session)
+{
+  CustomData *data = NULL;
+
+  /* The session lock is held throughout, so that it can not expire
+   * meanwhile */
+  g_mutex_lock (&sessions_lock);
+  if (sessions != NULL)
+    data = g_hash_table_lookup (sessions, GINT_TO_POINTER (session));
+
+  if (data == NULL) {
+    g_mutex_unlock (&sessions_lock);
+    GST_DEBUG ("Session %d is gone", session);
+    return 0;
+  }
+
+  g_mutex_lock (&data->lock);
+  if (data->app != NULL) {
+    /* Still attached to another Activity */
+    g_mutex_unlock (&data->lock);
+    g_mutex_unlock (&sessions_lock);
+    GST_WARNING ("Session %d is in use", session);
+    return 0;
+  }
+  data->app = (*env)->NewGlobalRef (env, thiz);
+  g_mutex_unlock (&data->lock);
+
+  if (data->expiry != NULL) {
+    g_source_destroy (data->expiry);
+    g_source_unref (data->expiry);
+    data->expiry = NULL;
+  }
+  g_mutex_unlock (&sessions_lock);
+
+  GST_DEBUG ("Reattached session %d", session);
+
+  return NATIVEP_TO_J (data);
+}
+
+/* Last state reported by the player, for a reattached Activity */
+static jstring
+gst_native_player_get_state (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+  jstring jstate = NULL;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return NULL;
+
+  g_mutex_lock (&data->lock);
+  if (data->state != NULL)
+    jstate = (*env)->NewStringUTF (env, data->state);
+  g_mutex_unlock (&data->lock);
+
+  return jstate;
+}
+
+/* Set pipelines's URI */
+void
+gst_native_set_uri (JNIEnv * env, jobject thiz, jlong datap, jstring uri,
+    jstring user, jstring pass)
+{
+  const jbyte *char_uri;
+  const jbyte *char_user = NULL;
+  const jbyte *char_pass = NULL;
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  char_uri = (*env)->GetStringUTFChars (env, uri, NULL);
+  if (user != NULL)
+    char_user = (*env)->GetStringUTFChars (env, user, NULL);
+  if (pass != NULL)
+    char_pass = (*env)->GetStringUTFChars (env, pass, NULL);
+
+  GST_DEBUG ("Setting URI to %s for player %p", char_uri, data);
+  gst_media_player_set_uri (data->player, char_uri, char_user, char_pass);
+
+  (*env)->ReleaseStringUTFChars (env, uri, char_uri);
+  if (char_user != NULL)
+    (*env)->ReleaseStringUTFChars (env, user, char_user);
+  if (char_pass != NULL)
+    (*env)->ReleaseStringUTFChars (env, pass, char_pass);
+}
+
+/* Set the file a recorder writes to */
+static void
+gst_native_set_location (JNIEnv * env, jobject thiz, jlong datap,
+    jstring location)
+{
+  const gchar *char_location;
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  char_location = (*env)->GetStringUTFChars (env, location, NULL);
+  gst_media_player_set_location (data->player, char_location);
+  (*env)->ReleaseStringUTFChars (env, location, char_location);
+}
+
+/* Set pipeline to PLAYING state */
+static void
+gst_native_play (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  GST_DEBUG ("Setting state to PLAYING");
+  gst_media_player_set_state (data->player, GST_STATE_PLAYING);
+}
+
+/* Set pipeline to PAUSED state */
+static void
+gst_native_pause (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  GST_DEBUG ("Setting state to PAUSED");
+  gst_media_player_set_state (data->player, GST_STATE_PAUSED);
+}
+
+/* Set pipeline to READY state */
+static void
+gst_native_ready (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  GST_DEBUG ("Setting state to READY");
+  gst_media_player_set_state (data->player, GST_STATE_READY);
+}
+
+/* Instruct the pipeline to seek to a different position */
+void
+gst_native_set_position (JNIEnv * env, jobject thiz, jlong datap,
+    int milliseconds)
+{
+  gint64 desired_position;
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  desired_position = (gint64) (milliseconds * GST_MSECOND);
+  gst_media_player_set_position (data->player, desired_position);
+}
+
+/* Fast forward and reverse of recordings, FALSE if the rate is not possible */
+static jboolean
+gst_native_set_rate (JNIEnv * env, jobject thiz, jlong datap, jdouble rate)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return JNI_FALSE;
+
+  return gst_media_player_set_rate (data->player, rate) ? JNI_TRUE :
+      JNI_FALSE;
+}
+
+/* RTSP uris are recordings on a NVR, seeks are done by the server */
+static void
+gst_native_set_playback (JNIEnv * env, jobject thiz, jlong datap,
+    jboolean playback)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  gst_media_player_set_playback (data->player, playback);
+}
+
+/* Players with a higher priority connect first */
+static void
+gst_native_set_priority (JNIEnv * env, jobject thiz, jlong datap,
+    jint priority)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  gst_media_player_set_priority (data->player, priority);
+}
+
+/* Native layer initializer: retrieve method and field IDs */
+static jboolean
+gst_native_layer_init (JNIEnv * env, jobject obj)
+{
+  guint i;
+
+  set_state_method_id =
+      (*env)->GetMethodID (env, obj, "nativeStateChanged",
+      "(JLjava/lang/String;)V");
+  set_error_method_id =
+      (*env)->GetMethodID (env, obj, "nativeErrorOccured",
+      "(JLjava/lang/String;)V");
+  set_current_position_method_id =
+      (*env)->GetMethodID (env, obj, "nativePositionUpdated", "(JII)V");
+  on_media_size_changed_method_id =
+      (*env)->GetMethodID (env, obj, "nativeMediaSizeChanged", "(JII)V");
+  on_player_created_method_id =
+      (*env)->GetMethodID (env, obj, "nativePlayerCreated", "(IJ)V");
+  on_export_progress_method_id =
+      (*env)->GetMethodID (env, obj, "nativeExportProgress",
+      "(JIZLjava/lang/String;)V");
+
+  if (!set_state_method_id || !set_error_method_id ||
+      !on_media_size_changed_method_id || !set_current_position_method_id ||
+      !on_player_created_method_id || !on_export_progress_method_id) {
+    /* We emit this message through the Android log instead of the GStreamer log
+     * because the later has not been initialized yet.
+     */
+    __android_log_print (ANDROID_LOG_ERROR, "nativelayer", "The calling class "
+        "does not implement all necessary interface methods");
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+static void
+gst_native_surface_init (JNIEnv * env, jobject thiz, jlong datap,
+    jobject surface)
+{
+  ANativeWindow *new_native_window;
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  new_native_window = ANativeWindow_fromSurface (env, surface);
+
+  GST_DEBUG ("Received surface %p (native window %p) %p", surface,
+      new_native_window, data);
+
+  gst_media_player_set_native_window (data->player, new_native_window);
+}
+
+static void
+gst_native_surface_finalize (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  GST_DEBUG ("Releasing Native Window %p", data);
+
+  gst_media_player_release_native_window (data->player);
+}
+
+/* Create the mosaic renderer all mosaic players draw into */
+static void
+gst_native_mosaic_init (JNIEnv * env, jobject thiz, jint columns, jint rows)
+{
+  if (mosaic != NULL) {
+    gst_mosaic_renderer_set_layout (mosaic, columns, rows);
+    return;
+  }
+
+  mosaic = gst_mosaic_renderer_new (columns, rows);
+  GST_DEBUG ("Created GstMosaicRenderer at %p (%dx%d)", mosaic, columns,
+      rows);
+}
+
+static void
+gst_native_mosaic_finalize (JNIEnv * env, jobject thiz)
+{
+  if (mosaic == NULL)
+    return;
+
+  GST_DEBUG ("Finalizing mosaic %p", mosaic);
+  g_object_unref (mosaic);
+  mosaic = NULL;
+}
+
+static void
+gst_native_mosaic_surface_init (JNIEnv * env, jobject thiz, jobject surface)
+{
+  ANativeWindow *new_native_window;
+
+  if (mosaic == NULL)
+    return;
+
+  new_native_window = ANativeWindow_fromSurface (env, surface);
+
+  GST_DEBUG ("Received mosaic surface %p (native window %p)", surface,
+      new_native_window);
+
+  gst_window_renderer_set_window (GST_WINDOW_RENDERER (mosaic),
+      new_native_window);
+}
+
+static void
+gst_native_mosaic_surface_finalize (JNIEnv * env, jobject thiz)
+{
+  if (mosaic == NULL)
+    return;
+
+  GST_DEBUG ("Releasing mosaic Native Window");
+
+  gst_window_renderer_release_window (GST_WINDOW_RENDERER (mosaic));
+}
+
+/* Usage of the buffer pools shared by all players */
+static jstring
+gst_native_buffer_pool_stats (JNIEnv * env, jobject thiz)
+{
+  gchar *stats;
+  jstring jstats;
+
+  stats = gst_shared_buffer_pool_get_stats ();
+  jstats = (*env)->NewStringUTF (env, stats);
+  g_free (stats);
+
+  return jstats;
+}
+
+/* Create the wall on top of the mosaic, or change its layout. Players of
+ * cells kept by the new layout are not touched. */
+static void
+gst_native_wall_set_layout (JNIEnv * env, jobject thiz, jint columns,
+    jint rows)
+{
+  if (mosaic == NULL)
+    mosaic = gst_mosaic_renderer_new (columns, rows);
+
+  if (wall == NULL) {
+    wall = gst_player_wall_new (mosaic);
+    wall_app = (*env)->NewGlobalRef (env, thiz);
+    g_signal_connect (wall, "player-created",
+        (GCallback) wall_player_created, NULL);
+    GST_DEBUG ("Created GstPlayerWall at %p", wall);
+  }
+
+  gst_player_wall_set_layout (wall, columns, rows);
+}
+
+/* Player of a cell of the wall, to be used with the per-player methods but
+ * never finalized by the application */
+static jlong
+gst_native_wall_get_player (JNIEnv * env, jobject thiz, jint cell)
+{
+  GstMediaPlayer *player;
+
+  if (wall == NULL)
+    return 0;
+
+  player = gst_player_wall_get_player (wall, cell);
+  if (player == NULL)
+    return 0;
+
+  return NATIVEP_TO_J (g_object_get_data (G_OBJECT (player), "custom-data"));
+}
+
+/* Set the URI of a cell, a no-op if it already plays it */
+static void
+gst_native_wall_set_uri (JNIEnv * env, jobject thiz, jint cell, jstring uri,
+    jstring user, jstring pass)
+{
+  const jbyte *char_uri;
+  const jbyte *char_user = NULL;
+  const jbyte *char_pass = NULL;
+
+  if (wall == NULL)
+    return;
+
+  char_uri = (*env)->GetStringUTFChars (env, uri, NULL);
+  if (user != NULL)
+    char_user = (*env)->GetStringUTFChars (env, user, NULL);
+  if (pass != NULL)
+    char_pass = (*env)->GetStringUTFChars (env, pass, NULL);
+
+  gst_player_wall_set_uri (wall, cell, char_uri, char_user, char_pass);
+
+  (*env)->ReleaseStringUTFChars (env, uri, char_uri);
+  if (char_user != NULL)
+    (*env)->ReleaseStringUTFChars (env, user, char_user);
+  if (char_pass != NULL)
+    (*env)->ReleaseStringUTFChars (env, pass, char_pass);
+}
+
+static void
+gst_native_wall_swap (JNIEnv * env, jobject thiz, jint cell, jint other)
+{
+  if (wall == NULL)
+    return;
+
+  gst_player_wall_swap (wall, cell, other);
+}
+
+static void
+gst_native_wall_finalize (JNIEnv * env, jobject thiz)
+{
+  if (wall == NULL)
+    return;
+
+  GST_DEBUG ("Finalizing wall %p", wall);
+  g_object_unref (wall);
+  wall = NULL;
+  (*env)->DeleteGlobalRef (env, wall_app);
+  wall_app = NULL;
+}
+
+/* Create a tour showing one camera at a time in a surface of its own */
+static jlong
+gst_native_tour_create (JNIEnv * env, jobject thiz, jint dwell,
+    jint keep_warm)
+{
+  GstCameraTour *tour;
+
+  tour = gst_camera_tour_new (dwell, keep_warm);
+  GST_DEBUG ("Created GstCameraTour at %p", tour);
+
+  return NATIVEP_TO_J (tour);
+}
+
+static void
+gst_native_tour_add_camera (JNIEnv * env, jobject thiz, jlong tourp,
+    jstring uri, jstring user, jstring pass)
+{
+  GstCameraTour *tour = (GstCameraTour *) J_TO_NATIVEP (tourp);
+  const jbyte *char_uri;
+  const jbyte *char_user = NULL;
+  const jbyte *char_pass = NULL;
+
+  if (!tour)
+    return;
+
+  char_uri = (*env)->GetStringUTFChars (env, uri, NULL);
+  if (user != NULL)
+    char_user = (*env)->GetStringUTFChars (env, user, NULL);
+  if (pass != NULL)
+    char_pass = (*env)->GetStringUTFChars (env, pass, NULL);
+
+  gst_camera_tour_add_camera (tour, char_uri, char_user, char_pass);
+
+  (*env)->ReleaseStringUTFChars (env, uri, char_uri);
+  if (char_user != NULL)
+    (*env)->ReleaseStringUTFChars (env, user, char_user);
+  if (char_pass != NULL)
+    (*env)->ReleaseStringUTFChars (env, pass, char_pass);
+}
+
+static void
+gst_native_tour_start (JNIEnv * env, jobject thiz, jlong tourp)
+{
+  GstCameraTour *tour = (GstCameraTour *) J_TO_NATIVEP (tourp);
+
+  if (!tour)
+    return;
+
+  gst_camera_tour_start (tour);
+}
+
+static void
+gst_native_tour_surface_init (JNIEnv * env, jobject thiz, jlong tourp,
+    jobject surface)
+{
+  GstCameraTour *tour = (GstCameraTour *) J_TO_NATIVEP (tourp);
+
+  if (!tour)
+    return;
+
+  gst_window_renderer_set_window (GST_WINDOW_RENDERER (tour),
+      ANativeWindow_fromSurface (env, surface));
+}
+
+static void
+gst_native_tour_surface_finalize (JNIEnv * env, jobject thiz, jlong tourp)
+{
+  GstCameraTour *tour = (GstCameraTour *) J_TO_NATIVEP (tourp);
+
+  if (!tour)
+    return;
+
+  gst_window_renderer_release_window (GST_WINDOW_RENDERER (tour));
+}
+
+static void
+gst_native_tour_finalize (JNIEnv * env, jobject thiz, jlong tourp)
+{
+  GstCameraTour *tour = (GstCameraTour *) J_TO_NATIVEP (tourp);
+
+  if (!tour)
+    return;
+
+  GST_DEBUG ("Finalizing tour %p", tour);
+  g_object_unref (tour);
+}
+
+/* Create a group of players presenting the frames of their cameras aligned,
+ * bound is the latency of the group in milliseconds */
+static jlong
+gst_native_sync_group_create (JNIEnv * env, jobject thiz, jint bound)
+{
+  GstSyncGroup *group;
+
+  group = gst_sync_group_new (bound * GST_MSECOND);
+  GST_DEBUG ("Created GstSyncGroup at %p", group);
+
+  return NATIVEP_TO_J (group);
+}
+
+/* Takes effect with the next uri of the player */
+static void
+gst_native_sync_group_add (JNIEnv * env, jobject thiz, jlong groupp,
+    jlong datap)
+{
+  GstSyncGroup *group = (GstSyncGroup *) J_TO_NATIVEP (groupp);
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!group || !data)
+    return;
+
+  gst_media_player_set_sync_group (data->player, group);
+}
+
+static void
+gst_native_sync_group_remove (JNIEnv * env, jobject thiz, jlong datap)
+{
+  CustomData *data;
+
+  data = J_TO_NATIVEP (datap);
+  if (!data)
+    return;
+
+  gst_media_player_set_sync_group (data->player, NULL);
+}
+
+/* Lateness of every player of the group and the residual skew */
+static jstring
+gst_native_sync_group_stats (JNIEnv * env, jobject thiz, jlong groupp)
+{
+  GstSyncGroup *group = (GstSyncGroup *) J_TO_NATIVEP (groupp);
+  gchar *stats;
+  jstring jstats;
+
+  if (!group)
+    return (*env)->NewStringUTF (env, "");
+
+  stats = gst_sync_group_get_stats (group);
+  jstats = (*env)->NewStringUTF (env, stats);
+  g_free (stats);
+
+  return jstats;
+}
+
+/* Players keep the group alive until they are finalized or removed */
+static void
+gst_native_sync_group_finalize (JNIEnv * env, jobject thiz, jlong groupp)
+{
+  GstSyncGroup *group = (GstSyncGroup *) J_TO_NATIVEP (groupp);
+
+  if (!group)
+    return;
+
+  GST_DEBUG ("Finalizing sync group %p", group);
+  gst_sync_group_unref (group);
+}
+
+/* Called on the worker thread of the export */
+static void
+export_progress (GstClipExport * export, gdouble progress, gboolean done,
+    const gchar * error, gpointer user_data)
+{
+  ExportData *data = (ExportData *) user_data;
+  JNIEnv *env = get_jni_env ();
+  jstring jerror = NULL;
+
+  if (error != NULL)
+    jerror = (*env)->NewStringUTF (env, error);
+
+  (*env)->CallVoidMethod (env, data->app, on_export_progress_method_id,
+      NATIVEP_TO_J (data), (jint) (progress * 100), (jboolean) done,
+      jerror);
+  if ((*env)->ExceptionCheck (env)) {
+    GST_ERROR ("Failed to call Java method");
+    (*env)->ExceptionClear (env);
+  }
+
+  if (jerror != NULL)
+    (*env)->DeleteLocalRef (env, jerror);
+}
+
+/* Export what a storage recorder wrote between start and end, wall clock
+ * times in milliseconds, into a clip. Progress is reported to
+ * nativeExportProgress. */
+static jlong
+gst_native_export_clip (JNIEnv * env, jobject thiz, jstring directory,
+    jlong start, jlong end, jstring location)
+{
+  const gchar *char_directory;
+  const gchar *char_location;
+  ExportData *data;
+
+  data = g_new0 (ExportData, 1);
+  data->app = (*env)->NewGlobalRef (env, thiz);
+
+  char_directory = (*env)->GetStringUTFChars (env, directory, NULL);
+  char_location = (*env)->GetStringUTFChars (env, location, NULL);
+  data->export = gst_clip_export_new (char_directory, start, end,
+      char_location, export_progress, data);
+  (*env)->ReleaseStringUTFChars (env, directory, char_directory);
+  (*env)->ReleaseStringUTFChars (env, location, char_location);
+
+  GST_DEBUG ("Started clip export %p", data->export);
+
+  return NATIVEP_TO_J (data);
+}
+
+static void
+gst_native_export_cancel (JNIEnv * env, jobject thiz, jlong exportp)
+{
+  ExportData *data = (ExportData *) J_TO_NATIVEP (exportp);
+
+  if (!data)
+    return;
+
+  gst_clip_export_cancel (data->export);
+}
+
+/* Waits for the export, must not be called from nativeExportProgress */
+static void
+gst_native_export_finalize (JNIEnv * env, jobject thiz, jlong exportp)
+{
+  ExportData *data = (ExportData *) J_TO_NATIVEP (exportp);
+
+  if (!data)
+    return;
+
+  GST_DEBUG ("Finalizing clip export %p", data->export);
+  gst_clip_export_free (data->export);
+  (*env)->DeleteGlobalRef (env, data->app);
+  g_free (data);
+}
+
+/* Generate the thumbnails of a recording in the background, if not done
+ * already */
+static void
+gst_native_thumbnail_generate (JNIEnv * env, jobject thiz, jstring location)
+{
+  const gchar *char_location;
+
+  char_location = (*env)->GetStringUTFChars (env, location, NULL);
+  gst_thumbnail_cache_generate (char_location);
+  (*env)->ReleaseStringUTFChars (env, location, char_location);
+}
+
+/* RGB565 pixels of the thumbnail of a recording nearest to a position in
+ * milliseconds, null if there is none yet */
+static jbyteArray
+gst_native_thumbnail_get (JNIEnv * env, jobject thiz, jstring location,
+    jint milliseconds)
+{
+  const gchar *char_location;
+  GstThumbnailCache *cache;
+  const guint8 *pixels;
+  jbyteArray jpixels = NULL;
+
+  char_location = (*env)->GetStringUTFChars (env, location, NULL);
+
+  g_mutex_lock (&thumbnails_lock);
+  if (thumbnails == NULL)
+    thumbnails = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) gst_thumbnail_cache_free);
+
+  /* Pick up what was generated since */
+  cache = g_hash_table_lookup (thumbnails, char_location);
+  if (cache == NULL || !gst_thumbnail_cache_is_complete (cache)) {
+    cache = gst_thumbnail_cache_open (char_location);
+    if (cache != NULL)
+      g_hash_table_insert (thumbnails, g_strdup (char_location), cache);
+    else
+      g_hash_table_remove (thumbnails, char_location);
+  }
+
+  pixels = cache != NULL ? gst_thumbnail_cache_lookup (cache,
+      (GstClockTime) milliseconds * GST_MSECOND, NULL) : NULL;
+  if (pixels != NULL) {
+    jpixels = (*env)->NewByteArray (env, GST_THUMBNAIL_SIZE);
+    if (jpixels != NULL)
+      (*env)->SetByteArrayRegion (env, jpixels, 0, GST_THUMBNAIL_SIZE,
+          (const jbyte *) pixels);
+  }
+  g_mutex_unlock (&thumbnails_lock);
+
+  (*env)->ReleaseStringUTFChars (env, location, char_location);
+
+  return jpixels;
+}
+
+/* Unmap the thumbnails of a recording, once done scrubbing it */
+static void
+gst_native_thumbnail_release (JNIEnv * env, jobject thiz, jstring location)
+{
+  const gchar *char_location;
+
+  char_location = (*env)->GetStringUTFChars (env, location, NULL);
+  g_mutex_lock (&thumbnails_lock);
+  if (thumbnails != NULL)
+    g_hash_table_remove (thumbnails, char_location);
+  g_mutex_unlock (&thumbnails_lock);
+  (*env)->ReleaseStringUTFChars (env, location, char_location);
+}
+
+/* Display refresh, frame_time is CLOCK_MONOTONIC in nanoseconds */
+static void
+gst_native_vsync (JNIEnv * env, jobject thiz, jlong frame_time)
+{
+  gst_present_scheduler_vsync (gst_present_scheduler_get_default (),
+      frame_time / 1000);
+}
+
+/* Record a startup phase reached by the application */
+static void
+gst_native_startup_phase (JNIEnv * env, jobject thiz, jstring phase)
+{
+  const gchar *name;
+
+  name = (*env)->GetStringUTFChars (env, phase, NULL);
+  startup_phase (name);
+  (*env)->ReleaseStringUTFChars (env, phase, name);
+}
+
+/* Time each startup phase was reached at, one line each */
+static jstring
+gst_native_startup_stats (JNIEnv * env, jobject thiz)
+{
+  jstring jstats;
+
+  g_mutex_lock (&startup_lock);
+  jstats = (*env)->NewStringUTF (env,
+      startup_phases != NULL ? startup_phases->str : "");
+  g_mutex_unlock (&startup_lock);
+
+  return jstats;
+}
+
+/* The device moved to another network, cameras not known on it are probed
+ * again */
+static void
+gst_native_set_network (JNIEnv * env, jobject thiz, jstring network)
+{
+  const gchar *name = NULL;
+
+  if (network != NULL)
+    name = (*env)->GetStringUTFChars (env, network, NULL);
+  gst_transport_policy_set_network (gst_transport_policy_get_default (), name);
+  if (network != NULL)
+    (*env)->ReleaseStringUTFChars (env, network, name);
+}
+
+/* TLS handshakes and resumed sessions per player */
+static jstring
+gst_native_tls_stats (JNIEnv * env, jobject thiz)
+{
+  gchar *stats;
+  jstring jstats;
+
+  stats =
+      gst_tls_session_cache_get_stats (gst_tls_session_cache_get_default ());
+  jstats = (*env)->NewStringUTF (env, stats);
+  g_free (stats);
+
+  return jstats;
+}
+
+/* Presentation statistics of all players */
+static jstring
+gst_native_present_stats (JNIEnv * env, jobject thiz)
+{
+  gchar *stats;
+  jstring jstats;
+
+  stats =
+      gst_present_scheduler_get_stats (gst_present_scheduler_get_default ());
+  jstats = (*env)->NewStringUTF (env, stats);
+  g_free (stats);
+
+  return jstats;
+}
+
+/* List of implemented native methods */
 static JNINativeMethod native_methods[] = {
   {"nativePlayerCreate", "()J", (void *) gst_native_player_create},
+  {"nativePlayerCreateAsync", "(I)V", (void *) gst_native_player_create_async},
   {"nativePlayerFinalize", "(J)V", (void *) gst_native_player_finalize},
+  {"nativePlayerGetSession", "(J)I", (void *) gst_native_player_get_session},
+  {"nativePlayerDetach", "(J)V", (void *) gst_native_player_detach},
+  {"nativePlayerAttach", "(I)J", (void *) gst_native_player_attach},
+  {"nativePlayerGetState", "(J)Ljava/lang/String;",
+        (void *) gst_native_player_get_state},
   {"nativeSetUri", "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;)V",
         (void *) gst_native_set_uri},
+  {"nativeRecorderCreate", "(I)J", (void *) gst_native_recorder_create},
+  {"nativeStorageRecorderCreate", "(IJII)J",
+        (void *) gst_native_storage_recorder_create},
+  {"nativeRecorderTrigger", "(J)V", (void *) gst_native_recorder_trigger},
+  {"nativeRecorderStats", "(J)Ljava/lang/String;",
+        (void *) gst_native_recorder_stats},
+  {"nativeSetLocation", "(JLjava/lang/String;)V",
+        (void *) gst_native_set_location},
   {"nativePlay", "(J)V", (void *) gst_native_play},
   {"nativePause", "(J)V", (void *) gst_native_pause},
   {"nativeReady", "(J)V", (void *) gst_native_ready},
   {"nativeSetPosition", "(JI)V", (void *) gst_native_set_position},
+  {"nativeSetRate", "(JD)Z", (void *) gst_native_set_rate},
+  {"nativeSetPlayback", "(JZ)V", (void *) gst_native_set_playback},
+  {"nativeSetPriority", "(JI)V", (void *) gst_native_set_priority},
   {"nativeSurfaceInit", "(JLjava/lang/Object;)V",
         (void *) gst_native_surface_init},
   {"nativeSurfaceFinalize", "(J)V", (void *) gst_native_surface_finalize},
-  {"nativeLayerInit", "()Z", (void *) gst_native_layer_init}
+  {"nativeLayerInit", "()Z", (void *) gst_native_layer_init},
+  {"nativeMosaicInit", "(II)V", (void *) gst_native_mosaic_init},
+  {"nativeMosaicFinalize", "()V", (void *) gst_native_mosaic_finalize},
+  {"nativeMosaicPlayerCreate", "(I)J",
+        (void *) gst_native_mosaic_player_create},
+  {"nativeMosaicSurfaceInit", "(Ljava/lang/Object;)V",
+        (void *) gst_native_mosaic_surface_init},
+  {"nativeMosaicSurfaceFinalize", "()V",
+        (void *) gst_native_mosaic_surface_finalize},
+  {"nativeBufferPoolStats", "()Ljava/lang/String;",
+        (void *) gst_native_buffer_pool_stats},
+  {"nativeVsync", "(J)V", (void *) gst_native_vsync},
+  {"nativeStartupPhase", "(Ljava/lang/String;)V",
+        (void *) gst_native_startup_phase},
+  {"nativeStartupStats", "()Ljava/lang/String;",
+        (void *) gst_native_startup_stats},
+  {"nativeSetNetwork", "(Ljava/lang/String;)V",
+        (void *) gst_native_set_network},
+  {"nativeTlsStats", "()Ljava/lang/String;", (void *) gst_native_tls_stats},
+  {"nativePresentStats", "()Ljava/lang/String;",
+        (void *) gst_native_present_stats},
+  {"nativeWallSetLayout", "(II)V", (void *) gst_native_wall_set_layout},
+  {"nativeWallGetPlayer", "(I)J", (void *) gst_native_wall_get_player},
+  {"nativeWallSetUri", "(ILjava/lang/String;Ljava/lang/String;Ljava/lang/String;)V",
+        (void *) gst_native_wall_set_uri},
+  {"nativeWallSwap", "(II)V", (void *) gst_native_wall_swap},
+  {"nativeWallFinalize", "()V", (void *) gst_native_wall_finalize},
+  {"nativeTourCreate", "(II)J", (void *) gst_native_tour_create},
+  {"nativeTourAddCamera",
+        "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;)V",
+        (void *) gst_native_tour_add_camera},
+  {"nativeTourStart", "(J)V", (void *) gst_native_tour_start},
+  {"nativeTourSurfaceInit", "(JLjava/lang/Object;)V",
+        (void *) gst_native_tour_surface_init},
+  {"nativeTourSurfaceFinalize", "(J)V",
+        (void *) gst_native_tour_surface_finalize},
+  {"nativeTourFinalize", "(J)V", (void *) gst_native_tour_finalize},
+  {"nativeSyncGroupCreate", "(I)J", (void *) gst_native_sync_group_create},
+  {"nativeSyncGroupAdd", "(JJ)V", (void *) gst_native_sync_group_add},
+  {"nativeSyncGroupRemove", "(J)V", (void *) gst_native_sync_group_remove},
+  {"nativeSyncGroupStats", "(J)Ljava/lang/String;",
+        (void *) gst_native_sync_group_stats},
+  {"nativeSyncGroupFinalize", "(J)V",
+        (void *) gst_native_sync_group_finalize},
+  {"nativeExportClip", "(Ljava/lang/String;JJLjava/lang/String;)J",
+        (void *) gst_native_export_clip},
+  {"nativeExportCancel", "(J)V", (void *) gst_native_export_cancel},
+  {"nativeExportFinalize", "(J)V", (void *) gst_native_export_finalize},
+  {"nativeThumbnailGenerate", "(Ljava/lang/String;)V",
+        (void *) gst_native_thumbnail_generate},
+  {"nativeThumbnailGet", "(Ljava/lang/String;I)[B",
+        (void *) gst_native_thumbnail_get},
+  {"nativeThumbnailRelease", "(Ljava/lang/String;)V",
+        (void *) gst_native_thumbnail_release}
 };
 
 /* Library initializer */
@@ -423,6 +1618,13 @@ JNI_OnLoad (JavaVM * vm, void *reserved)
   JNIEnv *env = NULL;
 
   java_vm = vm;
+  startup_time = g_get_monotonic_time ();
+
+  /* The plugins are linked in statically and registered on every start, so
+   * scanning the plugin paths and rewriting the registry cache only costs
+   * time. Keep whatever registry is cached, and never fork a scanner. */
+  g_setenv ("GST_REGISTRY_UPDATE", "no", FALSE);
+  g_setenv ("GST_REGISTRY_FORK", "no", FALSE);
 
   if ((*vm)->GetEnv (vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK) {
     __android_log_print (ANDROID_LOG_ERROR, "nativelayer",
@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstNativeWindowSink: Video sink writing decoded frames straight into the
+ * buffers of an ANativeWindow.
+ *
+ * The sink accepts whatever raw format the decoder produces so that playbin
+ * does not need a videoconvert/videoscale in front of it. I420 and YV12 frames
+ * are copied plane by plane into YV12 window buffers, which every Android
+ * device supports, and scaled by the compositor. Any other format is
+ * converted and scaled down to the surface size in a single pass, writing
+ * directly into the RGBA window buffer.
+ *
+ * With the "scheduled" property set frames are not posted from the streaming
+ * thread, they are handed to the GstPresentScheduler which posts the latest
+ * frame of every sink on the next vsync.
+ */
+#include <string.h>
+#include <gst/video/videooverlay.h>
+#include <android/native_window.h>
+#include <android/native_window_jni.h>
+
+#include "nativewindowsink.h"
+#include "presentscheduler.h"
+
+/* Not exported by the NDK headers, but supported by every gralloc */
+#define HAL_PIXEL_FORMAT_YV12 0x32315659
+
+struct _GstNativeWindowSink
+{
+  GstVideoSink parent;
+
+  GMutex lock;                  /* Protects everything below */
+  ANativeWindow *window;
+  gint window_width;            /* Size of the surface */
+  gint window_height;
+  GstVideoInfo info;            /* Negotiated input */
+  gboolean native;              /* Window buffers can take the input as is */
+  GstVideoConverter *convert;   /* Fused convert and scale, if not native */
+  GstVideoInfo out_info;        /* Output of the converter */
+  gint32 geometry_width;        /* Buffer geometry set on the window */
+  gint32 geometry_height;
+  gint32 geometry_format;
+
+  gboolean scheduled;
+  GstPresentTile *tile;         /* Set while started, if scheduled */
+};
+
+struct _GstNativeWindowSinkClass
+{
+  GstVideoSinkClass parent_class;
+};
+
+enum
+{
+  PROP_0,
+  PROP_SCHEDULED
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL)));
+
+static void gst_native_window_sink_finalize (GObject * obj);
+static void gst_native_window_sink_get_property (GObject * object,
+    guint propid, GValue * value, GParamSpec * pspec);
+static void gst_native_window_sink_set_property (GObject * object,
+    guint propid, const GValue * value, GParamSpec * pspec);
+static gboolean gst_native_window_sink_set_caps (GstBaseSink * bsink,
+    GstCaps * caps);
+static gboolean gst_native_window_sink_start (GstBaseSink * bsink);
+static gboolean gst_native_window_sink_stop (GstBaseSink * bsink);
+static GstFlowReturn gst_native_window_sink_show_frame (GstVideoSink * vsink,
+    GstBuffer * buffer);
+static void gst_native_window_sink_video_overlay_init (
+    GstVideoOverlayInterface * iface);
+
+G_DEFINE_TYPE_WITH_CODE (GstNativeWindowSink, gst_native_window_sink,
+    GST_TYPE_VIDEO_SINK,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_VIDEO_OVERLAY,
+        gst_native_window_sink_video_overlay_init));
+
+static void
+gst_native_window_sink_class_init (GstNativeWindowSinkClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseSinkClass *basesink_class;
+  GstVideoSinkClass *videosink_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+  basesink_class = GST_BASE_SINK_CLASS (klass);
+  videosink_class = GST_VIDEO_SINK_CLASS (klass);
+
+  gobject_class->finalize = gst_native_window_sink_finalize;
+  gobject_class->get_property = gst_native_window_sink_get_property;
+  gobject_class->set_property = gst_native_window_sink_set_property;
+
+  g_object_class_install_property (gobject_class, PROP_SCHEDULED,
+      g_param_spec_boolean ("scheduled", "Scheduled",
+          "Post frames on vsync through the present scheduler", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  basesink_class->set_caps = gst_native_window_sink_set_caps;
+  basesink_class->start = gst_native_window_sink_start;
+  basesink_class->stop = gst_native_window_sink_stop;
+
+  videosink_class->show_frame = gst_native_window_sink_show_frame;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_set_static_metadata (element_class,
+      "Native window sink", "Sink/Video",
+      "Renders video into an Android native window",
+      "Ognyan Tonchev <otonchev at gmail.com>");
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "nativewindowsink", 0,
+      "Native Window Sink");
+  gst_debug_set_threshold_for_name ("nativewindowsink", GST_LEVEL_DEBUG);
+}
+
+static void
+gst_native_window_sink_init (GstNativeWindowSink * self)
+{
+  g_mutex_init (&self->lock);
+  gst_video_info_init (&self->info);
+}
+
+static void
+gst_native_window_sink_finalize (GObject * obj)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (obj);
+
+  if (self->convert != NULL) {
+    gst_video_converter_free (self->convert);
+    self->convert = NULL;
+  }
+
+  if (self->window != NULL) {
+    ANativeWindow_release (self->window);
+    self->window = NULL;
+  }
+
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_native_window_sink_parent_class)->finalize (obj);
+}
+
+static void
+gst_native_window_sink_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (object);
+
+  switch (propid) {
+    case PROP_SCHEDULED:
+      g_value_set_boolean (value, self->scheduled);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+static void
+gst_native_window_sink_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (object);
+
+  switch (propid) {
+    case PROP_SCHEDULED:
+      /* Takes effect on the next start */
+      self->scheduled = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+/* Must be called with the lock held */
+static void
+reset_output_unlocked (GstNativeWindowSink * self)
+{
+  if (self->convert != NULL) {
+    gst_video_converter_free (self->convert);
+    self->convert = NULL;
+  }
+  self->geometry_format = 0;
+}
+
+/* Must be called with the lock held */
+static void
+update_window_size_unlocked (GstNativeWindowSink * self)
+{
+  /* Once a buffer geometry is set the window reports that instead, go back
+   * to the default to learn the size of the surface */
+  ANativeWindow_setBuffersGeometry (self->window, 0, 0, 0);
+  self->window_width = ANativeWindow_getWidth (self->window);
+  self->window_height = ANativeWindow_getHeight (self->window);
+
+  GST_DEBUG_OBJECT (self, "Window size is %dx%d", self->window_width,
+      self->window_height);
+
+  reset_output_unlocked (self);
+}
+
+static gboolean
+gst_native_window_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (bsink);
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  g_mutex_lock (&self->lock);
+  self->info = info;
+  self->native = GST_VIDEO_INFO_FORMAT (&info) == GST_VIDEO_FORMAT_I420 ||
+      GST_VIDEO_INFO_FORMAT (&info) == GST_VIDEO_FORMAT_YV12;
+  reset_output_unlocked (self);
+  g_mutex_unlock (&self->lock);
+
+  GST_DEBUG_OBJECT (self, "Rendering %s frames %s",
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&info)),
+      self->native ? "natively" : "through the converter");
+
+  GST_VIDEO_SINK_WIDTH (self) = GST_VIDEO_INFO_WIDTH (&info);
+  GST_VIDEO_SINK_HEIGHT (self) = GST_VIDEO_INFO_HEIGHT (&info);
+
+  return TRUE;
+}
+
+static void present_cb (GstBuffer * buffer, gpointer user_data);
+
+static gboolean
+gst_native_window_sink_start (GstBaseSink * bsink)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (bsink);
+
+  if (self->scheduled)
+    self->tile = gst_present_scheduler_add_tile (
+        gst_present_scheduler_get_default (), GST_OBJECT_NAME (self),
+        present_cb, self);
+
+  return TRUE;
+}
+
+static gboolean
+gst_native_window_sink_stop (GstBaseSink * bsink)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (bsink);
+
+  /* Not under the lock, the scheduler might be presenting a frame */
+  if (self->tile != NULL) {
+    gst_present_scheduler_remove_tile (gst_present_scheduler_get_default (),
+        self->tile);
+    self->tile = NULL;
+  }
+
+  g_mutex_lock (&self->lock);
+  reset_output_unlocked (self);
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static void
+copy_plane (guint8 * dest, gint dest_stride, const guint8 * src,
+    gint src_stride, gint width, gint height)
+{
+  gint i;
+
+  if (dest_stride == src_stride && src_stride == width) {
+    memcpy (dest, src, width * height);
+    return;
+  }
+
+  for (i = 0; i < height; i++) {
+    memcpy (dest, src, width);
+    dest += dest_stride;
+    src += src_stride;
+  }
+}
+
+/* Copy the planes of an I420 or YV12 frame into a YV12 window buffer, whose
+ * chroma planes are 16 byte aligned and in V, U order */
+static void
+copy_yv12 (GstVideoFrame * frame, ANativeWindow_Buffer * abuf)
+{
+  guint8 *y = abuf->bits;
+  gint y_stride = abuf->stride;
+  gint c_stride = GST_ROUND_UP_16 (y_stride / 2);
+  guint8 *v = y + y_stride * abuf->height;
+  guint8 *u = v + c_stride * (abuf->height / 2);
+  gint width = MIN (abuf->width, GST_VIDEO_FRAME_WIDTH (frame));
+  gint height = MIN (abuf->height, GST_VIDEO_FRAME_HEIGHT (frame));
+
+  copy_plane (y, y_stride, GST_VIDEO_FRAME_COMP_DATA (frame, GST_VIDEO_COMP_Y),
+      GST_VIDEO_FRAME_COMP_STRIDE (frame, GST_VIDEO_COMP_Y), width, height);
+  copy_plane (v, c_stride, GST_VIDEO_FRAME_COMP_DATA (frame, GST_VIDEO_COMP_V),
+      GST_VIDEO_FRAME_COMP_STRIDE (frame, GST_VIDEO_COMP_V), width / 2,
+      height / 2);
+  copy_plane (u, c_stride, GST_VIDEO_FRAME_COMP_DATA (frame, GST_VIDEO_COMP_U),
+      GST_VIDEO_FRAME_COMP_STRIDE (frame, GST_VIDEO_COMP_U), width / 2,
+      height / 2);
+}
+
+/* Convert and scale straight into the RGBA window buffer */
+static void
+convert_rgba (GstNativeWindowSink * self, GstVideoFrame * frame,
+    ANativeWindow_Buffer * abuf)
+{
+  GstVideoInfo dest_info;
+  GstVideoFrame dest;
+  GstBuffer *wrapped;
+
+  if (self->convert == NULL)
+    self->convert = gst_video_converter_new (&self->info, &self->out_info,
+        NULL);
+
+  dest_info = self->out_info;
+  dest_info.stride[0] = abuf->stride * 4;
+  dest_info.size = dest_info.stride[0] * abuf->height;
+
+  wrapped = gst_buffer_new_wrapped_full (0, abuf->bits, dest_info.size, 0,
+      dest_info.size, NULL, NULL);
+  if (gst_video_frame_map (&dest, &dest_info, wrapped, GST_MAP_WRITE)) {
+    gst_video_converter_frame (self->convert, frame, &dest);
+    gst_video_frame_unmap (&dest);
+  }
+  gst_buffer_unref (wrapped);
+}
+
+/* Must be called with the lock held */
+static void
+update_geometry_unlocked (GstNativeWindowSink * self)
+{
+  gint32 width;
+  gint32 height;
+  gint32 format;
+
+  if (self->native) {
+    /* The compositor scales for free */
+    width = GST_VIDEO_INFO_WIDTH (&self->info) & ~1;
+    height = GST_VIDEO_INFO_HEIGHT (&self->info) & ~1;
+    format = HAL_PIXEL_FORMAT_YV12;
+  } else {
+    gint par_width;
+    gdouble scale = 1.0;
+
+    /* Never convert more pixels than the surface shows */
+    par_width = GST_VIDEO_INFO_WIDTH (&self->info) *
+        GST_VIDEO_INFO_PAR_N (&self->info) / GST_VIDEO_INFO_PAR_D (&self->info);
+    if (self->window_width > 0 && self->window_height > 0)
+      scale = MIN (1.0, MIN ((gdouble) self->window_width / par_width,
+              (gdouble) self->window_height /
+              GST_VIDEO_INFO_HEIGHT (&self->info)));
+    width = MAX (2, (gint32) (par_width * scale)) & ~1;
+    height = MAX (2, (gint32) (GST_VIDEO_INFO_HEIGHT (&self->info) * scale))
+        & ~1;
+    format = WINDOW_FORMAT_RGBA_8888;
+  }
+
+  if (width == self->geometry_width && height == self->geometry_height &&
+      format == self->geometry_format)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Window buffers are %dx%d, format 0x%x", width,
+      height, format);
+
+  ANativeWindow_setBuffersGeometry (self->window, width, height, format);
+  self->geometry_width = width;
+  self->geometry_height = height;
+  self->geometry_format = format;
+
+  if (!self->native) {
+    if (self->convert != NULL) {
+      gst_video_converter_free (self->convert);
+      self->convert = NULL;
+    }
+    gst_video_info_set_format (&self->out_info, GST_VIDEO_FORMAT_RGBA, width,
+        height);
+  }
+}
+
+/* Must be called with the lock held */
+static GstFlowReturn
+render_unlocked (GstNativeWindowSink * self, GstBuffer * buffer)
+{
+  ANativeWindow_Buffer abuf;
+  GstVideoFrame frame;
+
+  if (self->window == NULL) {
+    GST_LOG_OBJECT (self, "No window, dropping frame");
+    return GST_FLOW_OK;
+  }
+
+  if (GST_VIDEO_INFO_FORMAT (&self->info) == GST_VIDEO_FORMAT_UNKNOWN)
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  update_geometry_unlocked (self);
+
+  if (!gst_video_frame_map (&frame, &self->info, buffer, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (self, "Could not map frame");
+    return GST_FLOW_OK;
+  }
+
+  if (ANativeWindow_lock (self->window, &abuf, NULL) < 0) {
+    GST_WARNING_OBJECT (self, "Could not lock window");
+    gst_video_frame_unmap (&frame);
+    return GST_FLOW_OK;
+  }
+
+  if (self->native)
+    copy_yv12 (&frame, &abuf);
+  else
+    convert_rgba (self, &frame, &abuf);
+
+  ANativeWindow_unlockAndPost (self->window);
+  gst_video_frame_unmap (&frame);
+
+  return GST_FLOW_OK;
+}
+
+/* Called from the scheduler pool on vsync, one frame at a time */
+static void
+present_cb (GstBuffer * buffer, gpointer user_data)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (user_data);
+
+  g_mutex_lock (&self->lock);
+  render_unlocked (self, buffer);
+  g_mutex_unlock (&self->lock);
+}
+
+static GstFlowReturn
+gst_native_window_sink_show_frame (GstVideoSink * vsink, GstBuffer * buffer)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (vsink);
+  GstFlowReturn ret;
+
+  if (self->tile != NULL) {
+    if (GST_VIDEO_INFO_FORMAT (&self->info) == GST_VIDEO_FORMAT_UNKNOWN)
+      return GST_FLOW_NOT_NEGOTIATED;
+
+    gst_present_scheduler_submit (gst_present_scheduler_get_default (),
+        self->tile, buffer);
+    return GST_FLOW_OK;
+  }
+
+  g_mutex_lock (&self->lock);
+  ret = render_unlocked (self, buffer);
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+static void
+gst_native_window_sink_set_window_handle (GstVideoOverlay * overlay,
+    guintptr handle)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (overlay);
+  ANativeWindow *window = (ANativeWindow *) handle;
+
+  GST_DEBUG_OBJECT (self, "Setting window %p", window);
+
+  g_mutex_lock (&self->lock);
+  if (self->window != NULL)
+    ANativeWindow_release (self->window);
+  self->window = window;
+  if (self->window != NULL) {
+    ANativeWindow_acquire (self->window);
+    update_window_size_unlocked (self);
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_native_window_sink_expose (GstVideoOverlay * overlay)
+{
+  GstNativeWindowSink *self = GST_NATIVE_WINDOW_SINK (overlay);
+  GstSample *sample;
+
+  sample = gst_base_sink_get_last_sample (GST_BASE_SINK (self));
+
+  g_mutex_lock (&self->lock);
+  if (self->window != NULL) {
+    update_window_size_unlocked (self);
+    if (sample != NULL)
+      render_unlocked (self, gst_sample_get_buffer (sample));
+  }
+  g_mutex_unlock (&self->lock);
+
+  if (sample != NULL)
+    gst_sample_unref (sample);
+}
+
+static void
+gst_native_window_sink_video_overlay_init (GstVideoOverlayInterface * iface)
+{
+  iface->set_window_handle = gst_native_window_sink_set_window_handle;
+  iface->expose = gst_native_window_sink_expose;
+}
+
+GstElement *
+gst_native_window_sink_new (void)
+{
+  return g_object_new (GST_TYPE_NATIVE_WINDOW_SINK, NULL);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstNativeWindowSink: Video sink writing decoded frames straight into the
+ * buffers of an ANativeWindow.
+ */
+#ifndef __GST_NATIVE_WINDOW_SINK_H__
+#define __GST_NATIVE_WINDOW_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideosink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_NATIVE_WINDOW_SINK (gst_native_window_sink_get_type ())
+#define GST_NATIVE_WINDOW_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_NATIVE_WINDOW_SINK, GstNativeWindowSink))
+#define GST_IS_NATIVE_WINDOW_SINK(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_NATIVE_WINDOW_SINK))
+
+typedef struct _GstNativeWindowSink GstNativeWindowSink;
+typedef struct _GstNativeWindowSinkClass GstNativeWindowSinkClass;
+
+GType gst_native_window_sink_get_type (void);
+
+GstElement * gst_native_window_sink_new (void);
+
+G_END_DECLS
+
+#endif /* __GST_NATIVE_WINDOW_SINK_H__ */
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstPlayerWall: Keeps one player per cell of a mosaic, adding and removing
+ * players as the layout changes.
+ *
+ * Changing the layout only touches the cells that appear or disappear: the
+ * players of the cells kept keep streaming and are just moved by the mosaic.
+ * Players of removed cells are stopped and parked, a few of them are kept
+ * around and handed to new cells before new players are created. A parked
+ * player forgets its URI and starts playing again once its new cell gets
+ * one. Setting the URI a cell already plays is a no-op, so the application
+ * can simply apply its whole configuration after every layout change.
+ *
+ * The wall is not thread safe, it is meant to be driven from the UI thread.
+ */
+#include "playerwall.h"
+#include "rtspstreamer.h"
+#include "rtspviewer.h"
+
+#define GST_PLAYER_WALL_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_PLAYER_WALL, GstPlayerWallPrivate))
+
+/* Parked players kept for reuse, the rest is destroyed */
+#define MAX_SPARE_PLAYERS 4
+
+/* Cell outside of any layout, the mosaic hides tiles placed there */
+#define PARKED_CELL G_MAXUINT
+
+typedef struct
+{
+  GstMediaPlayer *player;
+  GstElement *sink;             /* Mosaic sink the player renders into */
+  gchar *uri;                   /* Last configuration set */
+  gchar *user;
+  gchar *pass;
+  gboolean parked;              /* Stopped by the wall, not yet restarted */
+} GstWallSlot;
+
+struct _GstPlayerWallPrivate
+{
+  GstMosaicRenderer *mosaic;
+  GPtrArray *cells;             /* GstWallSlot per cell, NULL if empty */
+  GQueue spare;                 /* Parked GstWallSlot, oldest first */
+};
+
+/* object properties */
+enum
+{
+  PROP_0,
+  PROP_MOSAIC
+};
+
+enum
+{
+  SIGNAL_PLAYER_CREATED,
+  SIGNAL_LAST
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static guint gst_player_wall_signals[SIGNAL_LAST] = { 0 };
+
+static void gst_player_wall_finalize (GObject * obj);
+static void gst_player_wall_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_player_wall_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+
+G_DEFINE_TYPE (GstPlayerWall, gst_player_wall, G_TYPE_OBJECT);
+
+static void
+gst_player_wall_class_init (GstPlayerWallClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  g_type_class_add_private (klass, sizeof (GstPlayerWallPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_player_wall_finalize;
+  gobject_class->get_property = gst_player_wall_get_property;
+  gobject_class->set_property = gst_player_wall_set_property;
+
+  g_object_class_install_property (gobject_class, PROP_MOSAIC,
+      g_param_spec_object ("mosaic", "Mosaic",
+          "Mosaic the players render into", GST_TYPE_MOSAIC_RENDERER,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  gst_player_wall_signals[SIGNAL_PLAYER_CREATED] =
+      g_signal_new ("player-created", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstPlayerWallClass, player_created),
+      NULL, NULL, g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1,
+      GST_TYPE_MEDIA_PLAYER);
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "playerwall", 0, "Player Wall");
+  gst_debug_set_threshold_for_name ("playerwall", GST_LEVEL_DEBUG);
+}
+
+static void
+gst_player_wall_init (GstPlayerWall * self)
+{
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (self);
+
+  priv->cells = g_ptr_array_new ();
+  g_queue_init (&priv->spare);
+}
+
+static GstWallSlot *
+slot_new (GstPlayerWall * wall, guint cell)
+{
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+  GstWallSlot *slot;
+  GObject *viewer;
+  GError *error = NULL;
+
+  slot = g_new0 (GstWallSlot, 1);
+  slot->sink = gst_mosaic_renderer_request_sink (priv->mosaic, cell);
+
+  viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "video-sink", slot->sink,
+      "share-stream", TRUE, NULL);
+  slot->player = gst_media_player_new (GST_RTSP_STREAMER (viewer), NULL);
+  if (!gst_media_player_setup_thread (slot->player, &error)) {
+    GST_ERROR ("Could not configure player: %s",
+        error != NULL ? error->message : "unknown error");
+    g_clear_error (&error);
+  }
+
+  GST_DEBUG ("Created player %p for cell %u", slot->player, cell);
+
+  g_signal_emit (wall, gst_player_wall_signals[SIGNAL_PLAYER_CREATED], 0,
+      slot->player);
+
+  return slot;
+}
+
+static void
+slot_free (GstPlayerWall * wall, GstWallSlot * slot)
+{
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+
+  GST_DEBUG ("Destroying player %p", slot->player);
+
+  /* The sink can only go once the pipeline is shut down */
+  g_object_unref (slot->player);
+  gst_mosaic_renderer_release_sink (priv->mosaic, slot->sink);
+  g_free (slot->uri);
+  g_free (slot->user);
+  g_free (slot->pass);
+  g_free (slot);
+}
+
+static void
+gst_player_wall_finalize (GObject * obj)
+{
+  GstPlayerWall *self = GST_PLAYER_WALL (obj);
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (self);
+  GstWallSlot *slot;
+  guint i;
+
+  GST_DEBUG ("Destroying wall");
+
+  for (i = 0; i < priv->cells->len; i++) {
+    slot = g_ptr_array_index (priv->cells, i);
+    if (slot != NULL)
+      slot_free (self, slot);
+  }
+  g_ptr_array_free (priv->cells, TRUE);
+
+  while ((slot = g_queue_pop_head (&priv->spare)) != NULL)
+    slot_free (self, slot);
+
+  if (priv->mosaic != NULL)
+    g_object_unref (priv->mosaic);
+
+  G_OBJECT_CLASS (gst_player_wall_parent_class)->finalize (obj);
+}
+
+static void
+gst_player_wall_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (object);
+
+  switch (property_id) {
+    case PROP_MOSAIC:
+      g_value_set_object (value, priv->mosaic);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_player_wall_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstPlayerWallPrivate *priv = GST_PLAYER_WALL_GET_PRIVATE (object);
+
+  switch (property_id) {
+    case PROP_MOSAIC:
+      priv->mosaic = g_value_dup_object (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+GstPlayerWall *
+gst_player_wall_new (GstMosaicRenderer * mosaic)
+{
+  return g_object_new (GST_TYPE_PLAYER_WALL, "mosaic", mosaic, NULL);
+}
+
+/**
+ * gst_player_wall_set_layout:
+ * @wall: a #GstPlayerWall
+ * @columns: number of cells per row
+ * @rows: number of cells per column
+ *
+ * Changes the layout of the mosaic, creating players for the new cells and
+ * stopping the ones of the cells removed. Players of the remaining cells are
+ * not touched.
+ */
+void
+gst_player_wall_set_layout (GstPlayerWall * wall, guint columns, guint rows)
+{
+  GstPlayerWallPrivate *priv;
+  GstWallSlot *slot;
+  guint count;
+  guint i;
+
+  g_return_if_fail (GST_IS_PLAYER_WALL (wall));
+  g_return_if_fail (columns > 0 && rows > 0);
+
+  priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+  count = columns * rows;
+
+  GST_DEBUG ("Layout %ux%u, %u cells, had %u", columns, rows, count,
+      priv->cells->len);
+
+  gst_mosaic_renderer_set_layout (priv->mosaic, columns, rows);
+
+  for (i = count; i < priv->cells->len; i++) {
+    slot = g_ptr_array_index (priv->cells, i);
+    if (slot == NULL)
+      continue;
+
+    GST_DEBUG ("Parking player %p of cell %u", slot->player, i);
+    gst_media_player_set_state (slot->player, GST_STATE_READY);
+    gst_mosaic_renderer_move_sink (priv->mosaic, slot->sink, PARKED_CELL);
+    /* Whatever cell gets it next has to configure it again, even for the
+     * same camera */
+    g_free (slot->uri);
+    g_free (slot->user);
+    g_free (slot->pass);
+    slot->uri = slot->user = slot->pass = NULL;
+    slot->parked = TRUE;
+    g_queue_push_tail (&priv->spare, slot);
+  }
+  g_ptr_array_set_size (priv->cells, count);
+
+  while (g_queue_get_length (&priv->spare) > MAX_SPARE_PLAYERS)
+    slot_free (wall, g_queue_pop_head (&priv->spare));
+
+  for (i = 0; i < count; i++) {
+    if (g_ptr_array_index (priv->cells, i) != NULL)
+      continue;
+
+    slot = g_queue_pop_tail (&priv->spare);
+    if (slot != NULL) {
+      GST_DEBUG ("Reusing player %p for cell %u", slot->player, i);
+      gst_mosaic_renderer_move_sink (priv->mosaic, slot->sink, i);
+    } else {
+      slot = slot_new (wall, i);
+    }
+    g_ptr_array_index (priv->cells, i) = slot;
+  }
+}
+
+/**
+ * gst_player_wall_get_player:
+ * @wall: a #GstPlayerWall
+ * @cell: cell index, row major
+ *
+ * Returns: (transfer none): the player of @cell, NULL if @cell is not part
+ * of the layout.
+ */
+GstMediaPlayer *
+gst_player_wall_get_player (GstPlayerWall * wall, guint cell)
+{
+  GstPlayerWallPrivate *priv;
+  GstWallSlot *slot;
+
+  g_return_val_if_fail (GST_IS_PLAYER_WALL (wall), NULL);
+
+  priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+
+  if (cell >= priv->cells->len)
+    return NULL;
+
+  slot = g_ptr_array_index (priv->cells, cell);
+
+  return slot != NULL ? slot->player : NULL;
+}
+
+/**
+ * gst_player_wall_set_uri:
+ * @wall: a #GstPlayerWall
+ * @cell: cell index, row major
+ * @uri: uri
+ * @user: user id for the RTSP authentication
+ * @pass: password for the RTSP authentication
+ *
+ * Sets the source Uri of the player of @cell, unless it already plays it.
+ * A player parked by a previous layout starts playing again.
+ */
+void
+gst_player_wall_set_uri (GstPlayerWall * wall, guint cell, const gchar * uri,
+    const gchar * user, const gchar * pass)
+{
+  GstPlayerWallPrivate *priv;
+  GstWallSlot *slot;
+
+  g_return_if_fail (GST_IS_PLAYER_WALL (wall));
+
+  priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+
+  g_return_if_fail (cell < priv->cells->len);
+
+  slot = g_ptr_array_index (priv->cells, cell);
+
+  if (g_strcmp0 (slot->uri, uri) == 0 && g_strcmp0 (slot->user, user) == 0 &&
+      g_strcmp0 (slot->pass, pass) == 0) {
+    GST_DEBUG ("Cell %u already plays %s", cell, uri);
+    return;
+  }
+
+  g_free (slot->uri);
+  g_free (slot->user);
+  g_free (slot->pass);
+  slot->uri = g_strdup (uri);
+  slot->user = g_strdup (user);
+  slot->pass = g_strdup (pass);
+
+  GST_DEBUG ("Setting URI of cell %u to %s", cell, uri);
+  gst_media_player_set_uri (slot->player, uri, user, pass);
+
+  if (slot->parked) {
+    GST_DEBUG ("Restarting reused player %p", slot->player);
+    slot->parked = FALSE;
+    gst_media_player_set_state (slot->player, GST_STATE_PLAYING);
+  }
+}
+
+/**
+ * gst_player_wall_swap:
+ * @wall: a #GstPlayerWall
+ * @cell: cell index, row major
+ * @other: cell index, row major
+ *
+ * Exchanges the players of two cells without interrupting them.
+ */
+void
+gst_player_wall_swap (GstPlayerWall * wall, guint cell, guint other)
+{
+  GstPlayerWallPrivate *priv;
+  GstWallSlot *slot;
+  GstWallSlot *other_slot;
+
+  g_return_if_fail (GST_IS_PLAYER_WALL (wall));
+
+  priv = GST_PLAYER_WALL_GET_PRIVATE (wall);
+
+  g_return_if_fail (cell < priv->cells->len && other < priv->cells->len);
+
+  slot = g_ptr_array_index (priv->cells, cell);
+  other_slot = g_ptr_array_index (priv->cells, other);
+
+  g_ptr_array_index (priv->cells, cell) = other_slot;
+  g_ptr_array_index (priv->cells, other) = slot;
+
+  gst_mosaic_renderer_move_sink (priv->mosaic, slot->sink, other);
+  gst_mosaic_renderer_move_sink (priv->mosaic, other_slot->sink, cell);
+}
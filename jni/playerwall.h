@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstPlayerWall: Keeps one player per cell of a mosaic, adding and removing
+ * players as the layout changes.
+ */
+#ifndef __GST_PLAYER_WALL_H__
+#define __GST_PLAYER_WALL_H__
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+
+#include "mediaplayer.h"
+#include "mosaicrenderer.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PLAYER_WALL (gst_player_wall_get_type ())
+#define GST_PLAYER_WALL(object) (G_TYPE_CHECK_INSTANCE_CAST ((object), GST_TYPE_PLAYER_WALL, GstPlayerWall))
+#define GST_PLAYER_WALL_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_PLAYER_WALL, GstPlayerWallClass))
+#define GST_IS_PLAYER_WALL(object) (G_TYPE_CHECK_INSTANCE_TYPE ((object), GST_TYPE_PLAYER_WALL))
+#define GST_IS_PLAYER_WALL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_PLAYER_WALL))
+#define GST_PLAYER_WALL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_PLAYER_WALL, GstPlayerWallClass))
+
+typedef struct _GstPlayerWall GstPlayerWall;
+typedef struct _GstPlayerWallClass GstPlayerWallClass;
+typedef struct _GstPlayerWallPrivate GstPlayerWallPrivate;
+
+struct _GstPlayerWall {
+  GObject parent;
+
+  /*< protected >*/
+
+  /*< private >*/
+};
+
+struct _GstPlayerWallClass {
+  GObjectClass parent_class;
+
+  /* signals */
+  void (*player_created) (GstPlayerWall * wall, GstMediaPlayer * player);
+
+  /*< private >*/
+};
+
+GType gst_player_wall_get_type (void);
+
+GstPlayerWall * gst_player_wall_new (GstMosaicRenderer * mosaic);
+void gst_player_wall_set_layout (GstPlayerWall * wall, guint columns,
+    guint rows);
+GstMediaPlayer * gst_player_wall_get_player (GstPlayerWall * wall,
+    guint cell);
+void gst_player_wall_set_uri (GstPlayerWall * wall, guint cell,
+    const gchar * uri, const gchar * user, const gchar * pass);
+void gst_player_wall_swap (GstPlayerWall * wall, guint cell, guint other);
+
+G_END_DECLS
+
+#endif /* __GST_PLAYER_WALL_H__ */
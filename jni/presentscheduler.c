@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstPresentScheduler: Presents the frames of all players together, aligned
+ * to the display refresh.
+ *
+ * Sinks submit their frames once they are due instead of posting them to the
+ * window right away. Only the latest frame of every tile is kept, frames
+ * replaced before the next refresh are dropped without ever being rendered.
+ * On every vsync, reported by the application through
+ * gst_present_scheduler_vsync(), the pending frames of all tiles are handed
+ * to a thread pool, one task per tile. Posting a window may block, e.g.
+ * while its surface is being resized, so a tile still busy with its previous
+ * frame keeps its pending one for the next vsync instead of holding up the
+ * others. Without vsync reports the scheduler times itself using the last
+ * known refresh period.
+ *
+ * Every tile keeps track of how far the presentation intervals are from the
+ * intervals between the frame timestamps, i.e. of the judder it shows.
+ */
+#include <pthread.h>
+
+#include "presentscheduler.h"
+
+/* Refresh period used until vsyncs are reported, in microseconds */
+#define DEFAULT_PERIOD 16667
+#define MIN_PERIOD 4000
+#define MAX_PERIOD 50000
+
+struct _GstPresentTile
+{
+  gchar *name;
+  GstPresentFunc func;
+  gpointer user_data;
+  GstBuffer *pending;           /* Latest frame, not presented yet */
+  gboolean busy;                /* A frame is being presented */
+
+  /* Statistics */
+  guint64 presented;
+  guint64 dropped;              /* Superseded before being presented */
+  gint64 last_present_time;     /* Monotonic time, microseconds */
+  GstClockTime last_pts;
+  gdouble judder_avg;           /* Moving average, milliseconds */
+  gdouble judder_max;
+};
+
+struct _GstPresentScheduler
+{
+  GMutex lock;                  /* Protects everything below and the
+                                 * tiles */
+  GCond cond;
+  GCond idle_cond;              /* Signalled when a tile is not busy anymore */
+  GList *tiles;                 /* List of GstPresentTile */
+  gboolean vsync_pending;
+  gint64 vsync_time;            /* Monotonic time of the last refresh */
+  gint64 period;                /* Estimated refresh period */
+
+  GThreadPool *pool;            /* Presents the frames */
+  pthread_t thread;
+};
+
+typedef struct
+{
+  GstPresentTile *tile;
+  GstBuffer *buffer;
+  gint64 vsync_time;
+} GstPresentTask;
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Runs on the pool, at most one task per tile at a time */
+static void
+present_tile (gpointer data, gpointer user_data)
+{
+  GstPresentScheduler *scheduler = (GstPresentScheduler *) user_data;
+  GstPresentTask *task = (GstPresentTask *) data;
+  GstPresentTile *tile = task->tile;
+  GstClockTime pts;
+
+  tile->func (task->buffer, tile->user_data);
+
+  g_mutex_lock (&scheduler->lock);
+
+  /* Judder is the difference between how long the previous frame was on
+   * screen and how long it was meant to be */
+  pts = GST_BUFFER_PTS (task->buffer);
+  if (tile->presented > 0 && GST_CLOCK_TIME_IS_VALID (pts) &&
+      GST_CLOCK_TIME_IS_VALID (tile->last_pts) && pts > tile->last_pts) {
+    gdouble shown = (task->vsync_time - tile->last_present_time) / 1000.0;
+    gdouble meant = (gdouble) (pts - tile->last_pts) / GST_MSECOND;
+    gdouble judder = ABS (shown - meant);
+
+    tile->judder_avg = 0.95 * tile->judder_avg + 0.05 * judder;
+    tile->judder_max = MAX (tile->judder_max, judder);
+  }
+  tile->last_pts = pts;
+  tile->last_present_time = task->vsync_time;
+  tile->presented++;
+
+  tile->busy = FALSE;
+  g_cond_broadcast (&scheduler->idle_cond);
+
+  g_mutex_unlock (&scheduler->lock);
+
+  gst_buffer_unref (task->buffer);
+  g_free (task);
+}
+
+static void
+present (GstPresentScheduler * scheduler, gint64 vsync_time)
+{
+  GList *walk;
+
+  g_mutex_lock (&scheduler->lock);
+  for (walk = scheduler->tiles; walk != NULL; walk = walk->next) {
+    GstPresentTile *tile = walk->data;
+    GstPresentTask *task;
+
+    if (tile->pending == NULL)
+      continue;
+
+    /* Its window is still blocked, try again on the next refresh */
+    if (tile->busy) {
+      GST_LOG ("Tile %s: still presenting the previous frame", tile->name);
+      continue;
+    }
+
+    task = g_new0 (GstPresentTask, 1);
+    task->tile = tile;
+    task->buffer = tile->pending;
+    task->vsync_time = vsync_time;
+    tile->pending = NULL;
+    tile->busy = TRUE;
+    g_thread_pool_push (scheduler->pool, task, NULL);
+  }
+  g_mutex_unlock (&scheduler->lock);
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstPresentScheduler *scheduler = (GstPresentScheduler *) user_data;
+  gint64 vsync_time;
+
+  while (TRUE) {
+    g_mutex_lock (&scheduler->lock);
+    while (!scheduler->vsync_pending) {
+      gint64 end_time;
+
+      /* Give the application half a period of slack before timing the
+       * refresh ourselves */
+      end_time = scheduler->vsync_time + scheduler->period +
+          scheduler->period / 2;
+      if (!g_cond_wait_until (&scheduler->cond, &scheduler->lock, end_time)) {
+        gint64 now = g_get_monotonic_time ();
+
+        scheduler->vsync_time += scheduler->period;
+        if (scheduler->vsync_time + scheduler->period < now)
+          scheduler->vsync_time = now;
+        break;
+      }
+    }
+    scheduler->vsync_pending = FALSE;
+    vsync_time = scheduler->vsync_time;
+    g_mutex_unlock (&scheduler->lock);
+
+    present (scheduler, vsync_time);
+  }
+
+  return NULL;
+}
+
+/**
+ * gst_present_scheduler_get_default:
+ *
+ * Returns: (transfer none): the scheduler shared by all players.
+ */
+GstPresentScheduler *
+gst_present_scheduler_get_default (void)
+{
+  static gsize initialized = 0;
+  static GstPresentScheduler *scheduler;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "presentscheduler", 0,
+        "Present Scheduler");
+    gst_debug_set_threshold_for_name ("presentscheduler", GST_LEVEL_DEBUG);
+
+    scheduler = g_new0 (GstPresentScheduler, 1);
+    g_mutex_init (&scheduler->lock);
+    g_cond_init (&scheduler->cond);
+    g_cond_init (&scheduler->idle_cond);
+    /* Not exclusive, a blocked window only takes one thread */
+    scheduler->pool = g_thread_pool_new (present_tile, scheduler, -1, FALSE,
+        NULL);
+    scheduler->period = DEFAULT_PERIOD;
+    scheduler->vsync_time = g_get_monotonic_time ();
+    pthread_create (&scheduler->thread, NULL, &thread_function, scheduler);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return scheduler;
+}
+
+/**
+ * gst_present_scheduler_vsync:
+ * @scheduler: a #GstPresentScheduler
+ * @frame_time: time of the refresh, CLOCK_MONOTONIC in microseconds
+ *
+ * Reports a display refresh, pending frames are presented right away.
+ */
+void
+gst_present_scheduler_vsync (GstPresentScheduler * scheduler,
+    gint64 frame_time)
+{
+  gint64 interval;
+
+  g_mutex_lock (&scheduler->lock);
+
+  interval = frame_time - scheduler->vsync_time;
+  if (interval >= MIN_PERIOD && interval <= MAX_PERIOD)
+    scheduler->period = (7 * scheduler->period + interval) / 8;
+
+  scheduler->vsync_time = frame_time;
+  scheduler->vsync_pending = TRUE;
+  g_cond_signal (&scheduler->cond);
+
+  g_mutex_unlock (&scheduler->lock);
+}
+
+/**
+ * gst_present_scheduler_add_tile:
+ * @scheduler: a #GstPresentScheduler
+ * @name: name used in the statistics
+ * @func: renders a frame of the tile
+ * @user_data: passed to @func
+ *
+ * Returns: the new tile, to be removed with
+ * gst_present_scheduler_remove_tile().
+ */
+GstPresentTile *
+gst_present_scheduler_add_tile (GstPresentScheduler * scheduler,
+    const gchar * name, GstPresentFunc func, gpointer user_data)
+{
+  GstPresentTile *tile;
+
+  tile = g_new0 (GstPresentTile, 1);
+  tile->name = g_strdup (name);
+  tile->func = func;
+  tile->user_data = user_data;
+  tile->last_pts = GST_CLOCK_TIME_NONE;
+
+  GST_DEBUG ("Adding tile %s", name);
+
+  g_mutex_lock (&scheduler->lock);
+  scheduler->tiles = g_list_append (scheduler->tiles, tile);
+  g_mutex_unlock (&scheduler->lock);
+
+  return tile;
+}
+
+/**
+ * gst_present_scheduler_remove_tile:
+ * @scheduler: a #GstPresentScheduler
+ * @tile: a #GstPresentTile
+ *
+ * Removes @tile, dropping its pending frame. Waits for a presentation of
+ * @tile in progress, so it must not be called from its #GstPresentFunc or
+ * with locks held that it takes.
+ */
+void
+gst_present_scheduler_remove_tile (GstPresentScheduler * scheduler,
+    GstPresentTile * tile)
+{
+  GST_DEBUG ("Removing tile %s: %" G_GUINT64_FORMAT " presented, %"
+      G_GUINT64_FORMAT " dropped", tile->name, tile->presented,
+      tile->dropped);
+
+  g_mutex_lock (&scheduler->lock);
+  scheduler->tiles = g_list_remove (scheduler->tiles, tile);
+  while (tile->busy)
+    g_cond_wait (&scheduler->idle_cond, &scheduler->lock);
+  g_mutex_unlock (&scheduler->lock);
+
+  if (tile->pending != NULL)
+    gst_buffer_unref (tile->pending);
+  g_free (tile->name);
+  g_free (tile);
+}
+
+/**
+ * gst_present_scheduler_submit:
+ * @scheduler: a #GstPresentScheduler
+ * @tile: a #GstPresentTile
+ * @buffer: a frame that is due
+ *
+ * Queues @buffer for the next refresh, replacing the pending frame of @tile.
+ */
+void
+gst_present_scheduler_submit (GstPresentScheduler * scheduler,
+    GstPresentTile * tile, GstBuffer * buffer)
+{
+  g_mutex_lock (&scheduler->lock);
+  if (tile->pending != NULL) {
+    GST_LOG ("Tile %s: frame superseded before vsync", tile->name);
+    gst_buffer_unref (tile->pending);
+    tile->dropped++;
+  }
+  tile->pending = gst_buffer_ref (buffer);
+  g_mutex_unlock (&scheduler->lock);
+}
+
+/**
+ * gst_present_scheduler_get_stats:
+ * @scheduler: a #GstPresentScheduler
+ *
+ * Describes the presentation of every tile, one line each.
+ *
+ * Returns: (transfer full): the statistics, free with g_free().
+ */
+gchar *
+gst_present_scheduler_get_stats (GstPresentScheduler * scheduler)
+{
+  GString *stats;
+  GList *walk;
+
+  stats = g_string_new (NULL);
+
+  g_mutex_lock (&scheduler->lock);
+  g_string_append_printf (stats, "refresh period %.2f ms\n",
+      scheduler->period / 1000.0);
+  for (walk = scheduler->tiles; walk != NULL; walk = walk->next) {
+    GstPresentTile *tile = walk->data;
+
+    g_string_append_printf (stats, "%s: %" G_GUINT64_FORMAT " presented, %"
+        G_GUINT64_FORMAT " dropped, judder %.1f ms avg %.1f ms max\n",
+        tile->name, tile->presented, tile->dropped, tile->judder_avg,
+        tile->judder_max);
+  }
+  g_mutex_unlock (&scheduler->lock);
+
+  return g_string_free (stats, FALSE);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstPresentScheduler: Presents the frames of all players together, aligned
+ * to the display refresh.
+ */
+#ifndef __GST_PRESENT_SCHEDULER_H__
+#define __GST_PRESENT_SCHEDULER_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstPresentScheduler GstPresentScheduler;
+typedef struct _GstPresentTile GstPresentTile;
+
+/* Renders @buffer, called from a thread of the scheduler pool. Never
+ * called for the same tile from two threads at once. */
+typedef void (*GstPresentFunc) (GstBuffer * buffer, gpointer user_data);
+
+GstPresentScheduler * gst_present_scheduler_get_default (void);
+void gst_present_scheduler_vsync (GstPresentScheduler * scheduler,
+    gint64 frame_time);
+GstPresentTile * gst_present_scheduler_add_tile (
+    GstPresentScheduler * scheduler, const gchar * name, GstPresentFunc func,
+    gpointer user_data);
+void gst_present_scheduler_remove_tile (GstPresentScheduler * scheduler,
+    GstPresentTile * tile);
+void gst_present_scheduler_submit (GstPresentScheduler * scheduler,
+    GstPresentTile * tile, GstBuffer * buffer);
+gchar * gst_present_scheduler_get_stats (GstPresentScheduler * scheduler);
+
+G_END_DECLS
+
+#endif /* __GST_PRESENT_SCHEDULER_H__ */
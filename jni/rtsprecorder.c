@@ -0,0 +1,896 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstRTSPRecorder: GstRTSPStreamer and GstDiskWriter creating a RTSP
+ * pipeline which writes the compressed video to disk.
+ *
+ * The recorder never connects to the camera itself. It takes the compressed
+ * frames of the camera's shared stream, tapped after the parser of the
+ * viewers' pipeline (see streamregistry.c), so recording a camera that is
+ * being watched costs no extra bandwidth and no decoding.
+ *
+ * The frames are written as fragmented MP4: the header goes first and every
+ * fragment is complete on its own, so whatever made it to disk stays
+ * playable if the application dies in the middle of a recording.
+ *
+ * Given a "storage", the recording is split into segments on keyframes by
+ * splitmuxsink and written into the storage area instead of a single file,
+ * see segmentstorage.c.
+ *
+ * With a "pre-event-time" the recorder only keeps the last seconds of the
+ * stream in memory while it runs, starting at a keyframe, and holds the muxer
+ * and sink back. Once gst_rtsp_recorder_trigger() is called they start, the
+ * buffered frames are written first and the live stream follows, into the
+ * same file.
+ *
+ * Next to every file or segment the recorder writes its keyframe index (see
+ * keyframeindex.c), so that playback can seek without searching the file.
+ */
+#include <string.h>
+
+#include <gst/app/gstappsrc.h>
+
+#include "rtsprecorder.h"
+#include "rtspstreamer.h"
+#include "diskwriter.h"
+#include "streamregistry.h"
+#include "segmentstorage.h"
+#include "keyframeindex.h"
+
+#define GST_RTSP_RECORDER_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_RECORDER, GstRTSPRecorderPrivate))
+
+struct _GstRTSPRecorderPrivate
+{
+  GstElement *pipeline;
+  GstElement *appsrc;           /* Fed by the shared stream */
+  GstElement *mux;              /* Takes the parsed frames */
+  const gchar *mux_pad;         /* Name of its request pads */
+  GstElement *filesink;         /* Unless recording into a storage */
+  GstElement *storage;
+  GstSharedStream *shared;
+  gchar *location;
+
+  GstClockTime pre_event_time;  /* 0 records right away */
+  GMutex lock;                  /* Protects the ring and the indexing */
+  gboolean triggered;
+  GQueue ring;                  /* Frames before the trigger, oldest first */
+  gsize ring_bytes;
+
+  GstKeyframeIndexWriter *index;        /* Of the file being written */
+  gboolean new_file;            /* The muxer started over */
+  GstSegment segment;           /* Of the frames going into the muxer */
+  GstClockTime index_base;      /* Running time of the first frame of the
+                                 * file, where mp4mux starts its timeline */
+  GQueue pending;               /* Frames in the muxer, not in a fragment yet */
+  guint64 muxed_bytes;          /* Muxer output of the file so far */
+};
+
+/* A frame waiting for the muxer to write its fragment */
+typedef struct
+{
+  GstClockTime timestamp;
+  gboolean keyframe;
+} GstPendingFrame;
+
+/* object properties */
+enum
+{
+  PROP_0,
+  PROP_STORAGE,
+  PROP_PRE_EVENT_TIME
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Duration of the MP4 fragments, at most this much is lost on a crash */
+#define FRAGMENT_DURATION_MS 1000
+
+/* Upper limit of the frames kept before a trigger, whatever their duration */
+#define MAX_RING_BYTES (16 * 1024 * 1024)
+
+static void gst_rtsp_recorder_finalize (GObject * obj);
+static void gst_rtsp_recorder_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec);
+static void gst_rtsp_recorder_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec);
+static void gst_rtsp_recorder_streamer_interface_init (GstRTSPStreamerInterface *
+    iface);
+static GstElement * gst_rtsp_recorder_create_pipeline (GstRTSPStreamer *
+    streamer, GMainContext * context, GError ** error);
+static void gst_rtsp_recorder_set_uri (GstRTSPStreamer * streamer,
+    const gchar * uri, const gchar * user, const gchar * pass);
+static void gst_rtsp_recorder_disk_writer_interface_init (GstDiskWriterInterface *
+    iface);
+static void gst_rtsp_recorder_set_location (GstDiskWriter * writer,
+    const gchar * location);
+
+G_DEFINE_TYPE_WITH_CODE (GstRTSPRecorder, gst_rtsp_recorder, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_RTSP_STREAMER,
+        gst_rtsp_recorder_streamer_interface_init)
+    G_IMPLEMENT_INTERFACE (GST_TYPE_DISK_WRITER,
+        gst_rtsp_recorder_disk_writer_interface_init));
+
+static void
+gst_rtsp_recorder_class_init (GstRTSPRecorderClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  g_type_class_add_private (klass, sizeof (GstRTSPRecorderPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_rtsp_recorder_finalize;
+  gobject_class->get_property = gst_rtsp_recorder_get_property;
+  gobject_class->set_property = gst_rtsp_recorder_set_property;
+
+  g_object_class_install_property (gobject_class,
+      PROP_STORAGE, g_param_spec_object ("storage", "Storage",
+      "GstSegmentStorage to record into in segments instead of a single file",
+      GST_TYPE_SEGMENT_STORAGE, G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class,
+      PROP_PRE_EVENT_TIME, g_param_spec_uint64 ("pre-event-time",
+      "PreEventTime", "Keep this much of the stream in memory and only "
+      "record once triggered, 0 to record right away", 0, G_MAXUINT64, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "rtsprecorder", 0,
+      "RTSP Recorder");
+  gst_debug_set_threshold_for_name ("rtsprecorder", GST_LEVEL_DEBUG);
+}
+
+static void
+gst_rtsp_recorder_init (GstRTSPRecorder * self)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (self);
+
+  g_mutex_init (&priv->lock);
+  g_queue_init (&priv->ring);
+  g_queue_init (&priv->pending);
+  gst_segment_init (&priv->segment, GST_FORMAT_UNDEFINED);
+}
+
+static void
+gst_rtsp_recorder_finalize (GObject * obj)
+{
+  GstRTSPRecorder *recorder;
+  GstRTSPRecorderPrivate *priv;
+
+  recorder = GST_RTSP_RECORDER (obj);
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (recorder);
+
+  if (priv->shared != NULL) {
+    gst_stream_registry_release (priv->shared, recorder);
+    priv->shared = NULL;
+  }
+
+  if (priv->pipeline != NULL) {
+    gst_object_unref (priv->pipeline);
+    priv->pipeline = NULL;
+  }
+
+  if (priv->storage != NULL) {
+    gst_object_unref (priv->storage);
+    priv->storage = NULL;
+  }
+
+  g_free (priv->location);
+  priv->location = NULL;
+
+  g_queue_foreach (&priv->ring, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&priv->ring);
+  g_queue_foreach (&priv->pending, (GFunc) g_free, NULL);
+  g_queue_clear (&priv->pending);
+  if (priv->index != NULL) {
+    gst_keyframe_index_writer_free (priv->index);
+    priv->index = NULL;
+  }
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_recorder_parent_class)->finalize (obj);
+}
+
+static void
+gst_rtsp_recorder_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (object);
+
+  switch (property_id)
+  {
+    case PROP_STORAGE:
+      g_value_set_object (value, priv->storage);
+      break;
+    case PROP_PRE_EVENT_TIME:
+      g_value_set_uint64 (value, priv->pre_event_time);
+      break;
+  }
+}
+
+static void
+gst_rtsp_recorder_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (object);
+
+  switch (property_id)
+  {
+    case PROP_STORAGE:
+      priv->storage = g_value_get_object (value);
+      if (priv->storage != NULL)
+        gst_object_ref_sink (priv->storage);
+      break;
+    case PROP_PRE_EVENT_TIME:
+      priv->pre_event_time = g_value_get_uint64 (value);
+      break;
+  }
+}
+
+static void
+gst_rtsp_recorder_streamer_interface_init (GstRTSPStreamerInterface * iface)
+{
+  iface->create_pipeline = gst_rtsp_recorder_create_pipeline;
+  iface->set_uri = gst_rtsp_recorder_set_uri;
+}
+
+static void
+gst_rtsp_recorder_disk_writer_interface_init (GstDiskWriterInterface * iface)
+{
+  iface->set_location = gst_rtsp_recorder_set_location;
+}
+
+/* The parser of the recorder converts the frames into what the muxer takes,
+ * e.g. H.264 byte-stream into avc */
+static void
+pad_added_cb (GstElement * parsebin, GstPad * pad, gpointer user_data)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (user_data);
+  GstPad *muxpad;
+
+  muxpad = gst_element_get_request_pad (priv->mux, priv->mux_pad);
+  if (muxpad == NULL) {
+    GST_WARNING ("Could not get muxer pad for %s", GST_PAD_NAME (pad));
+    return;
+  }
+
+  if (gst_pad_link (pad, muxpad) != GST_PAD_LINK_OK) {
+    GST_WARNING ("Could not link %s to the muxer", GST_PAD_NAME (pad));
+    gst_element_release_request_pad (priv->mux, muxpad);
+  }
+  gst_object_unref (muxpad);
+}
+
+/* The parser pads go away every time the pipeline stops */
+static void
+pad_removed_cb (GstElement * parsebin, GstPad * pad, gpointer user_data)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (user_data);
+  GstPad *muxpad;
+
+  muxpad = gst_pad_get_peer (pad);
+  if (muxpad == NULL)
+    return;
+
+  gst_pad_unlink (pad, muxpad);
+  gst_element_release_request_pad (priv->mux, muxpad);
+  gst_object_unref (muxpad);
+}
+
+static GstClockTime
+get_timestamp (GstBuffer * buffer)
+{
+  return GST_BUFFER_DTS_IS_VALID (buffer) ? GST_BUFFER_DTS (buffer) :
+      GST_BUFFER_PTS (buffer);
+}
+
+/* Must be called with the lock held */
+static void
+clear_ring_unlocked (GstRTSPRecorderPrivate * priv)
+{
+  g_queue_foreach (&priv->ring, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&priv->ring);
+  priv->ring_bytes = 0;
+}
+
+/* Drops the oldest GOP as long as the rest still covers the pre-event time,
+ * or takes too much memory. Must be called with the lock held. */
+static void
+trim_ring_unlocked (GstRTSPRecorderPrivate * priv)
+{
+  GstClockTime newest;
+
+  newest = get_timestamp (g_queue_peek_tail (&priv->ring));
+
+  while (TRUE) {
+    GstBuffer *next_keyframe = NULL;
+    GstClockTime next;
+    GList *walk;
+
+    for (walk = priv->ring.head->next; walk != NULL; walk = walk->next) {
+      if (!GST_BUFFER_FLAG_IS_SET (walk->data, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        next_keyframe = walk->data;
+        break;
+      }
+    }
+    if (next_keyframe == NULL)
+      return;
+
+    next = get_timestamp (next_keyframe);
+    if (priv->ring_bytes <= MAX_RING_BYTES &&
+        (!GST_CLOCK_TIME_IS_VALID (next) || !GST_CLOCK_TIME_IS_VALID (newest)
+            || newest < next + priv->pre_event_time))
+      return;
+
+    while (g_queue_peek_head (&priv->ring) != next_keyframe) {
+      GstBuffer *oldest = g_queue_pop_head (&priv->ring);
+
+      priv->ring_bytes -= gst_buffer_get_size (oldest);
+      gst_buffer_unref (oldest);
+    }
+  }
+}
+
+/* Keeps the frames in the ring until triggered, then hands the ring over
+ * ahead of the live frames */
+static GstPadProbeReturn
+ring_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GQueue ring = G_QUEUE_INIT;
+  GstBuffer *frame;
+
+  g_mutex_lock (&priv->lock);
+
+  if (!priv->triggered) {
+    /* The ring always starts with a keyframe */
+    if (!g_queue_is_empty (&priv->ring) ||
+        !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      g_queue_push_tail (&priv->ring, gst_buffer_ref (buffer));
+      priv->ring_bytes += gst_buffer_get_size (buffer);
+      trim_ring_unlocked (priv);
+    }
+    g_mutex_unlock (&priv->lock);
+    return GST_PAD_PROBE_DROP;
+  }
+
+  ring = priv->ring;
+  g_queue_init (&priv->ring);
+  priv->ring_bytes = 0;
+  g_mutex_unlock (&priv->lock);
+
+  if (!g_queue_is_empty (&ring))
+    GST_DEBUG ("Writing %u frames from before the trigger", ring.length);
+
+  /* Passes this probe again, now with an empty ring */
+  while ((frame = g_queue_pop_head (&ring)) != NULL) {
+    if (gst_pad_push (pad, frame) != GST_FLOW_OK) {
+      g_queue_foreach (&ring, (GFunc) gst_buffer_unref, NULL);
+      g_queue_clear (&ring);
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* The file the muxer writes to, a new one for every segment */
+static gchar *
+get_current_location (GstRTSPRecorderPrivate * priv)
+{
+  gchar *location = NULL;
+
+  if (priv->storage != NULL)
+    return gst_segment_storage_get_current_location (GST_SEGMENT_STORAGE
+        (priv->storage));
+
+  g_object_get (priv->filesink, "location", &location, NULL);
+
+  return location;
+}
+
+/* Writes the oldest @count pending frames to the index, in the fragment at
+ * @offset. Called with the lock held. */
+static void
+index_pending_frames (GstRTSPRecorderPrivate * priv, guint count,
+    guint64 offset)
+{
+  GstPendingFrame *frame;
+
+  while (count-- > 0 && (frame = g_queue_pop_head (&priv->pending)) != NULL) {
+    if (priv->index != NULL)
+      gst_keyframe_index_writer_add (priv->index, frame->timestamp, offset,
+          frame->keyframe);
+    g_free (frame);
+  }
+}
+
+/* Number of samples in the first track fragment of the moof atom in @data,
+ * or -1 if @data does not start with one. Only the video is recorded, so that
+ * is every frame of the fragment. */
+static gint
+parse_moof_samples (const guint8 * data, gsize size)
+{
+  gsize moof_size, offset, traf_offset, traf_end;
+  guint32 atom_size;
+  gint samples = 0;
+
+  if (size < 8 || memcmp (data + 4, "moof", 4) != 0)
+    return -1;
+
+  moof_size = MIN (GST_READ_UINT32_BE (data), size);
+  for (offset = 8; offset + 8 <= moof_size; offset += atom_size) {
+    atom_size = GST_READ_UINT32_BE (data + offset);
+    if (atom_size < 8 || offset + atom_size > moof_size)
+      break;
+    if (memcmp (data + offset + 4, "traf", 4) != 0)
+      continue;
+
+    traf_end = offset + atom_size;
+    for (traf_offset = offset + 8; traf_offset + 8 <= traf_end;
+        traf_offset += atom_size) {
+      atom_size = GST_READ_UINT32_BE (data + traf_offset);
+      if (atom_size < 8 || traf_offset + atom_size > traf_end)
+        break;
+      /* Size, type, version and flags, then the sample count */
+      if (atom_size >= 16 && memcmp (data + traf_offset + 4, "trun", 4) == 0)
+        samples += GST_READ_UINT32_BE (data + traf_offset + 12);
+    }
+    break;
+  }
+
+  return samples;
+}
+
+/* Queues the frames going into the muxer for the index of the current file,
+ * timed on the running time the muxer bases the file's timeline on. The
+ * muxer gets new events whenever it starts over with a file. */
+static GstPadProbeReturn
+index_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (user_data);
+  GstPendingFrame *frame;
+  GstBuffer *buffer;
+  GstClockTime timestamp;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+      g_mutex_lock (&priv->lock);
+      gst_event_copy_segment (event, &priv->segment);
+      priv->new_file = TRUE;
+      g_mutex_unlock (&priv->lock);
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  timestamp = GST_BUFFER_PTS_IS_VALID (buffer) ? GST_BUFFER_PTS (buffer) :
+      GST_BUFFER_DTS (buffer);
+
+  g_mutex_lock (&priv->lock);
+
+  if (priv->segment.format == GST_FORMAT_TIME)
+    timestamp = gst_segment_to_running_time (&priv->segment, GST_FORMAT_TIME,
+        timestamp);
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp)) {
+    g_mutex_unlock (&priv->lock);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (priv->new_file) {
+    gchar *location = get_current_location (priv);
+
+    /* Whatever the muxer did not write is lost with the last file */
+    index_pending_frames (priv, G_MAXUINT, priv->muxed_bytes);
+    if (priv->index != NULL)
+      gst_keyframe_index_writer_free (priv->index);
+    priv->index = NULL;
+    if (location != NULL)
+      priv->index = gst_keyframe_index_writer_new (location);
+    g_free (location);
+
+    priv->new_file = FALSE;
+    priv->index_base = timestamp;
+    priv->muxed_bytes = 0;
+  }
+
+  if (priv->index != NULL) {
+    frame = g_new (GstPendingFrame, 1);
+    frame->timestamp =
+        timestamp > priv->index_base ? timestamp - priv->index_base : 0;
+    frame->keyframe =
+        !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    g_queue_push_tail (&priv->pending, frame);
+  }
+
+  g_mutex_unlock (&priv->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Tracks the offset in the file the muxer is at. Every fragment it writes
+ * starts with a moof atom telling how many of the pending frames it holds,
+ * those are indexed at its offset. */
+static GstPadProbeReturn
+muxed_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPRecorderPrivate *priv = GST_RTSP_RECORDER_GET_PRIVATE (user_data);
+
+  g_mutex_lock (&priv->lock);
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    const GstSegment *segment;
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+      gst_event_parse_segment (event, &segment);
+      if (segment->format == GST_FORMAT_BYTES)
+        priv->muxed_bytes = segment->start;
+    }
+  } else {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstMapInfo map;
+    gint samples;
+
+    if (gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+      samples = parse_moof_samples (map.data, map.size);
+      if (samples > 0)
+        index_pending_frames (priv, samples, priv->muxed_bytes);
+      gst_buffer_unmap (buffer, &map);
+    }
+    priv->muxed_bytes += gst_buffer_get_size (buffer);
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+muxer_pad_added_cb (GstElement * muxer, GstPad * pad, gpointer user_data)
+{
+  if (GST_PAD_IS_SINK (pad))
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, index_probe_cb, user_data, NULL);
+}
+
+/* Holds the muxer and sink back until the next trigger. They do not follow
+ * the pipeline while locked. */
+static void
+arm (GstRTSPRecorderPrivate * priv)
+{
+  GstElement *output[] = { priv->filesink, priv->mux };
+  guint i;
+
+  g_mutex_lock (&priv->lock);
+  priv->triggered = FALSE;
+  clear_ring_unlocked (priv);
+  g_mutex_unlock (&priv->lock);
+
+  for (i = 0; i < G_N_ELEMENTS (output); i++) {
+    if (output[i] == NULL)
+      continue;
+    gst_element_set_locked_state (output[i], TRUE);
+    gst_element_set_state (output[i], GST_STATE_READY);
+  }
+}
+
+static void
+state_changed_cb (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstState old_state;
+  GstState new_state;
+  GstRTSPRecorderPrivate *priv;
+  GstRTSPRecorder *recorder = (GstRTSPRecorder *) user_data;
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (recorder);
+
+  if (GST_MESSAGE_SRC (msg) != GST_OBJECT (priv->pipeline))
+    return;
+
+  gst_message_parse_state_changed (msg, &old_state, &new_state, NULL);
+
+  /* Wait for the next trigger */
+  if (old_state > new_state && new_state == GST_STATE_READY &&
+      priv->pre_event_time > 0)
+    arm (priv);
+
+  /* A location set while recording applies to the next recording */
+  if (old_state > new_state && new_state == GST_STATE_READY &&
+      priv->filesink != NULL)
+    g_object_set (priv->filesink, "location", priv->location, NULL);
+
+  if (priv->shared == NULL)
+    return;
+
+  /* Take the frames only while recording, so that the shared stream stops
+   * when nobody needs it */
+  if (old_state == GST_STATE_READY && new_state == GST_STATE_PAUSED)
+    gst_stream_registry_attach_encoded (priv->shared, recorder, priv->appsrc);
+  else if (old_state > new_state && new_state == GST_STATE_READY)
+    gst_stream_registry_attach_encoded (priv->shared, recorder, NULL);
+}
+
+static GstElement *
+gst_rtsp_recorder_create_pipeline (GstRTSPStreamer * streamer,
+    GMainContext * context, GError ** error)
+{
+  GstRTSPRecorderPrivate *priv;
+  GstElement *parsebin;
+  GstElement *mp4mux;
+  GstPad *muxpad;
+  GstBus *bus;
+  GSource *bus_source;
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (streamer);
+
+  priv->pipeline = gst_pipeline_new (NULL);
+  gst_object_ref_sink (priv->pipeline);
+
+  priv->appsrc = gst_element_factory_make ("appsrc", NULL);
+  parsebin = gst_element_factory_make ("parsebin", NULL);
+  mp4mux = gst_element_factory_make ("mp4mux", NULL);
+  if (priv->storage != NULL) {
+    priv->mux = gst_element_factory_make ("splitmuxsink", NULL);
+    priv->mux_pad = "video";
+  } else {
+    priv->mux = mp4mux;
+    priv->mux_pad = "video_%u";
+    priv->filesink = gst_element_factory_make ("filesink", NULL);
+  }
+  if (priv->appsrc == NULL || parsebin == NULL || mp4mux == NULL ||
+      priv->mux == NULL || (priv->storage == NULL && priv->filesink == NULL)) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "Could not create recording pipeline");
+    if (priv->appsrc != NULL)
+      gst_object_unref (priv->appsrc);
+    if (parsebin != NULL)
+      gst_object_unref (parsebin);
+    if (mp4mux != NULL)
+      gst_object_unref (mp4mux);
+    if (priv->mux != NULL && priv->mux != mp4mux)
+      gst_object_unref (priv->mux);
+    if (priv->filesink != NULL)
+      gst_object_unref (priv->filesink);
+    priv->appsrc = priv->mux = priv->filesink = NULL;
+    gst_object_unref (priv->pipeline);
+    priv->pipeline = NULL;
+    return NULL;
+  }
+
+  /* Write the header first, then self-contained fragments */
+  g_object_set (mp4mux, "fragment-duration", FRAGMENT_DURATION_MS,
+      "streamable", TRUE, NULL);
+
+  /* Index what goes into the muxer and comes out of it, also when it is
+   * splitmuxsink's */
+  g_signal_connect (mp4mux, "pad-added", G_CALLBACK (muxer_pad_added_cb),
+      streamer);
+  muxpad = gst_element_get_static_pad (mp4mux, "src");
+  gst_pad_add_probe (muxpad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, muxed_probe_cb, streamer, NULL);
+  gst_object_unref (muxpad);
+
+  gst_bin_add_many (GST_BIN (priv->pipeline), priv->appsrc, parsebin,
+      priv->mux, NULL);
+  gst_element_link (priv->appsrc, parsebin);
+
+  if (priv->storage != NULL) {
+    GstClockTime segment_duration;
+
+    /* Segments end on the first keyframe after their duration, the
+     * recording is never transcoded to get one earlier */
+    g_object_get (priv->storage, "segment-duration", &segment_duration, NULL);
+    g_object_set (priv->mux, "muxer", mp4mux, "sink", priv->storage,
+        "max-size-time", segment_duration, "send-keyframe-requests", FALSE,
+        NULL);
+  } else {
+    g_object_set (priv->filesink, "location", priv->location, "async", FALSE,
+        NULL);
+    gst_bin_add (GST_BIN (priv->pipeline), priv->filesink);
+    gst_element_link (priv->mux, priv->filesink);
+  }
+
+  if (priv->pre_event_time > 0) {
+    GstPad *srcpad = gst_element_get_static_pad (priv->appsrc, "src");
+
+    gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_BUFFER, ring_probe_cb,
+        streamer, NULL);
+    gst_object_unref (srcpad);
+    arm (priv);
+  }
+
+  g_signal_connect (parsebin, "pad-added", G_CALLBACK (pad_added_cb),
+      streamer);
+  g_signal_connect (parsebin, "pad-removed", G_CALLBACK (pad_removed_cb),
+      streamer);
+
+  bus = gst_element_get_bus (priv->pipeline);
+  bus_source = gst_bus_create_watch (bus);
+  g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func,
+      NULL, NULL);
+  g_source_attach (bus_source, context);
+  g_source_unref (bus_source);
+  g_signal_connect (G_OBJECT (bus), "message::state-changed",
+      (GCallback) state_changed_cb, streamer);
+  gst_object_unref (bus);
+
+  return gst_object_ref (priv->pipeline);
+}
+
+static void
+gst_rtsp_recorder_set_uri (GstRTSPStreamer * streamer, const gchar * uri,
+    const gchar * user, const gchar * pass)
+{
+  GstRTSPRecorderPrivate *priv;
+  GError *error = NULL;
+  GstState state;
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (streamer);
+
+  g_return_if_fail (priv->pipeline != NULL);
+
+  GST_DEBUG ("Setting URI to %s(%s,%s) for recorder %p", uri, user, pass,
+      streamer);
+
+  if (priv->shared != NULL) {
+    gst_stream_registry_release (priv->shared, streamer);
+    priv->shared = NULL;
+  }
+
+  if (!gst_stream_registry_is_shareable (uri)) {
+    GST_ELEMENT_ERROR (priv->appsrc, RESOURCE, NOT_FOUND,
+        ("Can only record RTSP cameras, not %s", uri), (NULL));
+    return;
+  }
+
+  priv->shared = gst_stream_registry_acquire (uri, user, pass, &error);
+  if (priv->shared == NULL) {
+    GST_ELEMENT_ERROR (priv->appsrc, RESOURCE, OPEN_READ, ("%s",
+            error ? error->message : "Could not open stream"), (NULL));
+    g_clear_error (&error);
+    return;
+  }
+
+  /* Already recording, see state_changed_cb () */
+  gst_element_get_state (priv->pipeline, &state, NULL, 0);
+  if (state >= GST_STATE_PAUSED)
+    gst_stream_registry_attach_encoded (priv->shared, streamer, priv->appsrc);
+}
+
+static void
+gst_rtsp_recorder_set_location (GstDiskWriter * writer,
+    const gchar * location)
+{
+  GstRTSPRecorderPrivate *priv;
+  GstState state = GST_STATE_NULL;
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (writer);
+
+  GST_DEBUG ("Recording to %s", location);
+
+  g_free (priv->location);
+  priv->location = g_strdup (location);
+
+  /* The storage area rather than a file */
+  if (priv->storage != NULL) {
+    gst_disk_writer_set_location (GST_DISK_WRITER (priv->storage), location);
+    return;
+  }
+
+  if (priv->filesink == NULL)
+    return;
+
+  /* The file is opened when the pipeline starts */
+  gst_element_get_state (priv->filesink, &state, NULL, 0);
+  if (state <= GST_STATE_READY)
+    g_object_set (priv->filesink, "location", location, NULL);
+  else
+    GST_WARNING ("Recording in progress, %s is used from the next start",
+        location);
+}
+
+/**
+ * gst_rtsp_recorder_trigger:
+ * @recorder: a #GstRTSPRecorder with a "pre-event-time"
+ *
+ * Starts writing, beginning with the frames kept from before the trigger.
+ * The recording goes on until the pipeline stops, which waits for the next
+ * trigger again.
+ */
+void
+gst_rtsp_recorder_trigger (GstRTSPRecorder * recorder)
+{
+  GstRTSPRecorderPrivate *priv;
+  GstElement *output[2];
+  guint i;
+
+  g_return_if_fail (GST_IS_RTSP_RECORDER (recorder));
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (recorder);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->pre_event_time == 0 || priv->triggered) {
+    g_mutex_unlock (&priv->lock);
+    return;
+  }
+  priv->triggered = TRUE;
+  GST_DEBUG ("Triggered with %u frames, %" G_GSIZE_FORMAT " bytes in the "
+      "ring", priv->ring.length, priv->ring_bytes);
+  g_mutex_unlock (&priv->lock);
+
+  /* Sink first, so that it is ready for the muxer's data */
+  output[0] = priv->filesink;
+  output[1] = priv->mux;
+  for (i = 0; i < G_N_ELEMENTS (output); i++) {
+    if (output[i] == NULL)
+      continue;
+    gst_element_set_locked_state (output[i], FALSE);
+    gst_element_sync_state_with_parent (output[i]);
+  }
+}
+
+/**
+ * gst_rtsp_recorder_get_stats:
+ * @recorder: a #GstRTSPRecorder
+ *
+ * Describes the memory the recorder holds and, if it has one, the usage of
+ * its storage area.
+ *
+ * Returns: (transfer full): the statistics, free with g_free().
+ */
+gchar *
+gst_rtsp_recorder_get_stats (GstRTSPRecorder * recorder)
+{
+  GstRTSPRecorderPrivate *priv;
+  GString *stats;
+  guint64 queued = 0;
+
+  g_return_val_if_fail (GST_IS_RTSP_RECORDER (recorder), NULL);
+
+  priv = GST_RTSP_RECORDER_GET_PRIVATE (recorder);
+
+  stats = g_string_new (NULL);
+
+  if (priv->appsrc != NULL)
+    queued = gst_app_src_get_current_level_bytes (GST_APP_SRC (priv->appsrc));
+
+  g_mutex_lock (&priv->lock);
+  g_string_append_printf (stats, "memory %" G_GUINT64_FORMAT " bytes: %"
+      G_GUINT64_FORMAT " queued, %" G_GSIZE_FORMAT " in %u pre-event frames",
+      queued + priv->ring_bytes, queued, priv->ring_bytes, priv->ring.length);
+  if (priv->pre_event_time > 0)
+    g_string_append (stats, priv->triggered ? ", triggered" : ", armed");
+  g_string_append_c (stats, '\n');
+  g_mutex_unlock (&priv->lock);
+
+  if (priv->storage != NULL) {
+    gchar *storage_stats;
+
+    storage_stats =
+        gst_segment_storage_get_stats (GST_SEGMENT_STORAGE (priv->storage));
+    g_string_append (stats, storage_stats);
+    g_free (storage_stats);
+  }
+
+  return g_string_free (stats, FALSE);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstRTSPRecorder: GstRTSPStreamer and GstDiskWriter creating a RTSP
+ * pipeline which writes the compressed video to disk.
+ */
+#ifndef _GST_RTSP_RECORDER_H_
+#define _GST_RTSP_RECORDER_H_
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RTSP_RECORDER (gst_rtsp_recorder_get_type ())
+#define GST_RTSP_RECORDER(object) (G_TYPE_CHECK_INSTANCE_CAST ((object), GST_TYPE_RTSP_RECORDER, GstRTSPRecorder))
+#define GST_RTSP_RECORDER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_RECORDER, GstRTSPRecorderClass))
+#define GST_IS_RTSP_RECORDER(object) (G_TYPE_CHECK_INSTANCE_TYPE ((object), GST_TYPE_RTSP_RECORDER))
+#define GST_IS_RTSP_RECORDER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_RECORDER))
+#define GST_RTSP_RECORDER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_RECORDER, GstRTSPRecorderClass))
+
+typedef struct _GstRTSPRecorder GstRTSPRecorder;
+typedef struct _GstRTSPRecorderClass GstRTSPRecorderClass;
+typedef struct _GstRTSPRecorderPrivate GstRTSPRecorderPrivate;
+
+struct _GstRTSPRecorder {
+  GObject parent;
+
+  /*< protected >*/
+
+  /*< private >*/
+};
+
+struct _GstRTSPRecorderClass {
+  GObjectClass parent_class;
+
+  /*< private >*/
+};
+
+GType gst_rtsp_recorder_get_type (void);
+
+void gst_rtsp_recorder_trigger (GstRTSPRecorder * recorder);
+gchar * gst_rtsp_recorder_get_stats (GstRTSPRecorder * recorder);
+
+G_END_DECLS
+
+#endif /* _GST_RTSP_RECORDER_H_ */
@@ -42,6 +42,11 @@ struct _GstRTSPStreamerInterface {
   void (*set_uri) (GstRTSPStreamer * streamer, const gchar * uri, const gchar * user, const gchar * pass);
 };
 
+/* Element message a streamer posts on its pipeline when the player has to
+ * set its uri again, e.g. to move over to a shared stream. Its "uri" field
+ * is the uri it was posted for. */
+#define GST_RTSP_STREAMER_RESTART_MESSAGE "rtsp-streamer-restart"
+
 extern GQuark gst_rtsp_streamer_error_quark (void);
 
 GType         gst_rtsp_streamer_get_type   (void);
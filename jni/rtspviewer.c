@@ -21,14 +21,25 @@
  * GstRTSPViewer: GstRTSPStreamer and GstWindowRenderer creating a RTSP
  * pipeline which displays the video content on the screen.
  */
+#include <string.h>
 #include <gst/video/video.h>
 #include <gst/video/videooverlay.h>
+#include <gst/sdp/gstsdpmessage.h>
 #include <android/native_window.h>
 #include <android/native_window_jni.h>
 
 #include "rtspviewer.h"
 #include "rtspstreamer.h"
 #include "windowrenderer.h"
+#include "streamregistry.h"
+#include "sharedbufferpool.h"
+#include "nativewindowsink.h"
+#include "transportpolicy.h"
+#include "tlssessioncache.h"
+#include "admissionscheduler.h"
+#include "batchudpsrc.h"
+#include "segmentsrc.h"
+#include "sharedsrc.h"
 #include "media-player-marshal.h"
 
 #define GST_RTSP_VIEWER_GET_PRIVATE(obj)  \
@@ -37,20 +48,54 @@
 struct _GstRTSPViewerPrivate
 {
   GstElement *pipeline;
+  GSource *bus_source;
+  GstElement *video_sink;
+  gboolean share_stream;
+  gboolean ntp_sync;
+  gboolean playback;
+  GstSharedStream *shared;
   ANativeWindow *native_window;
+  gchar *uri;
   gchar *user;
   gchar *pass;
+  GstRTSPLowerTrans transports; /* Tried by the current rtspsrc, until it
+                                 * streams */
+  gboolean fell_back;           /* rtspsrc gave up on UDP */
+  GTlsDatabase *tls_database;   /* Counts the handshakes of this viewer */
+  gchar *tls_host;              /* rtsps:// host being connected to */
+  guint tls_handshakes;         /* Full handshakes before connecting */
+  gint64 tls_start;
+};
+
+/* object properties */
+enum
+{
+  PROP_0,
+  PROP_VIDEO_SINK,
+  PROP_SHARE_STREAM,
+  PROP_NTP_SYNC,
+  PROP_PLAYBACK
 };
 
 GST_DEBUG_CATEGORY_STATIC (debug_category);
 #define GST_CAT_DEFAULT debug_category
 
+/* UDP socket buffers hold this much of the stream, within these bounds */
+#define UDP_BUFFER_TIME_MS 500
+#define MIN_UDP_BUFFER_SIZE (256 * 1024)
+#define MAX_UDP_BUFFER_SIZE (4 * 1024 * 1024)
+
 /* playbin flags */
 typedef enum {
-  GST_PLAY_FLAG_TEXT = (1 << 2)  /* We want subtitle output */
+  GST_PLAY_FLAG_TEXT = (1 << 2),        /* We want subtitle output */
+  GST_PLAY_FLAG_NATIVE_VIDEO = (1 << 6) /* No videoconvert/videoscale */
 } GstPlayFlags;
 
 static void gst_rtsp_viewer_finalize (GObject * obj);
+static void gst_rtsp_viewer_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec);
+static void gst_rtsp_viewer_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec);
 static void gst_rtsp_viewer_streamer_interface_init (GstRTSPStreamerInterface *
     iface);
 static GstElement * gst_rtsp_viewer_create_pipeline (GstRTSPStreamer * streamer,
@@ -79,6 +124,30 @@ gst_rtsp_viewer_class_init (GstRTSPViewerClass * klass)
   gobject_class = G_OBJECT_CLASS (klass);
 
   gobject_class->finalize = gst_rtsp_viewer_finalize;
+  gobject_class->get_property = gst_rtsp_viewer_get_property;
+  gobject_class->set_property = gst_rtsp_viewer_set_property;
+
+  g_object_class_install_property (gobject_class,
+      PROP_VIDEO_SINK, g_param_spec_object ("video-sink", "VideoSink",
+      "Video sink to render with instead of the playbin default",
+      GST_TYPE_ELEMENT, G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class,
+      PROP_SHARE_STREAM, g_param_spec_boolean ("share-stream", "ShareStream",
+      "Share the connection and decoder with other viewers of the same camera",
+      FALSE, G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class,
+      PROP_NTP_SYNC, g_param_spec_boolean ("ntp-sync", "NTPSync",
+      "Timestamp frames with the time the camera captured them, as reported "
+      "in its RTCP sender reports. Applies from the next URI, the stream is "
+      "not shared then", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+      PROP_PLAYBACK, g_param_spec_boolean ("playback", "Playback",
+      "Play recordings served by a NVR, seeks and rate changes are sent to "
+      "it as PLAY requests with Range and Scale. Applies from the next URI, "
+      "the stream is not shared then", FALSE, G_PARAM_READWRITE));
 
   GST_DEBUG_CATEGORY_INIT (debug_category, "rtspviewer", 0, "RTSP Viewer");
   gst_debug_set_threshold_for_name ("rtspviewer", GST_LEVEL_DEBUG);
@@ -100,11 +169,36 @@ gst_rtsp_viewer_finalize (GObject * obj)
 
   gst_rtsp_viewer_release_window (GST_WINDOW_RENDERER (viewer));
 
+  gst_stream_registry_unwatch (viewer);
+
+  /* No bus callback may run on the viewer anymore */
+  if (priv->bus_source != NULL) {
+    GstBus *bus;
+
+    g_source_destroy (priv->bus_source);
+    g_source_unref (priv->bus_source);
+    priv->bus_source = NULL;
+
+    bus = gst_element_get_bus (priv->pipeline);
+    g_signal_handlers_disconnect_by_data (bus, viewer);
+    gst_object_unref (bus);
+  }
+
+  if (priv->shared != NULL) {
+    gst_stream_registry_release (priv->shared, viewer);
+    priv->shared = NULL;
+  }
+
   if (priv->pipeline != NULL) {
     gst_object_unref (priv->pipeline);
     priv->pipeline = NULL;
   }
 
+  if (priv->video_sink != NULL) {
+    gst_object_unref (priv->video_sink);
+    priv->video_sink = NULL;
+  }
+
   if (priv->user != NULL) {
     g_free (priv->user);
     priv->user = NULL;
@@ -115,9 +209,67 @@ gst_rtsp_viewer_finalize (GObject * obj)
     priv->pass = NULL;
   }
 
+  g_free (priv->uri);
+  priv->uri = NULL;
+  g_free (priv->tls_host);
+  priv->tls_host = NULL;
+  if (priv->tls_database != NULL) {
+    g_object_unref (priv->tls_database);
+    priv->tls_database = NULL;
+  }
+  gst_tls_session_cache_remove (gst_tls_session_cache_get_default (), viewer);
+
   G_OBJECT_CLASS (gst_rtsp_viewer_parent_class)->finalize (obj);
 }
 
+static void
+gst_rtsp_viewer_get_property (GObject *object, guint property_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstRTSPViewerPrivate *priv = GST_RTSP_VIEWER_GET_PRIVATE (object);
+
+  switch (property_id)
+  {
+    case PROP_VIDEO_SINK:
+      g_value_set_object (value, priv->video_sink);
+      break;
+    case PROP_SHARE_STREAM:
+      g_value_set_boolean (value, priv->share_stream);
+      break;
+    case PROP_NTP_SYNC:
+      g_value_set_boolean (value, priv->ntp_sync);
+      break;
+    case PROP_PLAYBACK:
+      g_value_set_boolean (value, priv->playback);
+      break;
+  }
+}
+
+static void
+gst_rtsp_viewer_set_property (GObject *object, guint property_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstRTSPViewerPrivate *priv = GST_RTSP_VIEWER_GET_PRIVATE (object);
+
+  switch (property_id)
+  {
+    case PROP_VIDEO_SINK:
+      priv->video_sink = g_value_get_object (value);
+      if (priv->video_sink != NULL)
+        gst_object_ref_sink (priv->video_sink);
+      break;
+    case PROP_SHARE_STREAM:
+      priv->share_stream = g_value_get_boolean (value);
+      break;
+    case PROP_NTP_SYNC:
+      priv->ntp_sync = g_value_get_boolean (value);
+      break;
+    case PROP_PLAYBACK:
+      priv->playback = g_value_get_boolean (value);
+      break;
+  }
+}
+
 static void
 gst_rtsp_viewer_streamer_interface_init (GstRTSPStreamerInterface * iface)
 {
@@ -197,7 +349,144 @@ state_changed_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
       /* By now the sink already knows the media size */
       check_media_size (viewer);
     }
+
+    /* A live pipeline only gets to PLAYING once data flows, so the
+     * transport rtspsrc ended up with is the one to try first next time. It
+     * is TCP if UDP was given up, or if only TCP was tried because that is
+     * what worked before. */
+    if (new_state == GST_STATE_PLAYING && priv->transports != 0) {
+      GstRTSPLowerTrans transport =
+          priv->transports & ~GST_RTSP_LOWER_TRANS_TCP;
+
+      if (priv->fell_back || transport == 0)
+        transport = GST_RTSP_LOWER_TRANS_TCP;
+      gst_transport_policy_succeeded (gst_transport_policy_get_default (),
+          priv->uri, transport);
+      priv->transports = 0;
+    }
+
+    /* Once the appsrc is gone, let the shared stream stop if nobody else
+     * watches it. The pipeline might already be running again with a new
+     * source by the time this message is handled. */
+    if (old_state > new_state && new_state <= GST_STATE_READY &&
+        priv->shared != NULL) {
+      GstElement *source = NULL;
+
+      g_object_get (priv->pipeline, "source", &source, NULL);
+      if (source == NULL)
+        gst_stream_registry_attach (priv->shared, viewer, NULL);
+      else
+        gst_object_unref (source);
+    }
+  }
+}
+
+static gboolean
+is_rtspsrc (GstObject * object)
+{
+  GstElementFactory *factory;
+
+  if (!GST_IS_ELEMENT (object))
+    return FALSE;
+
+  factory = gst_element_get_factory (GST_ELEMENT (object));
+
+  return factory != NULL &&
+      g_strcmp0 (GST_OBJECT_NAME (factory), "rtspsrc") == 0;
+}
+
+/* rtspsrc warns when no UDP packets arrived in time and it retries over TCP */
+static void
+warning_cb (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstRTSPViewerPrivate *priv;
+  GError *err;
+
+  priv = GST_RTSP_VIEWER_GET_PRIVATE (user_data);
+
+  if (!is_rtspsrc (GST_MESSAGE_SRC (msg)))
+    return;
+
+  gst_message_parse_warning (msg, &err, NULL);
+  if (g_error_matches (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_READ) &&
+      (priv->transports & GST_RTSP_LOWER_TRANS_TCP)) {
+    GST_DEBUG ("%s: UDP blocked, falling back to TCP", priv->uri);
+    priv->fell_back = TRUE;
+  }
+  g_error_free (err);
+}
+
+static void
+error_cb (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstRTSPViewerPrivate *priv;
+
+  priv = GST_RTSP_VIEWER_GET_PRIVATE (user_data);
+
+  if (priv->uri != NULL && is_rtspsrc (GST_MESSAGE_SRC (msg)))
+    gst_transport_policy_failed (gst_transport_policy_get_default (),
+        priv->uri);
+}
+
+/* Bitrate announced in the SDP, in kbit/s, 0 if unknown */
+static guint
+get_sdp_bitrate (GstSDPMessage * sdp)
+{
+  guint i, j;
+  guint total = 0;
+
+  for (i = 0; i < gst_sdp_message_medias_len (sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media (sdp, i);
+
+    for (j = 0; j < gst_sdp_media_bandwidths_len (media); j++) {
+      const GstSDPBandwidth *bw = gst_sdp_media_get_bandwidth (media, j);
+
+      if (g_strcmp0 (bw->bwtype, "AS") == 0)
+        total += bw->bandwidth;
+    }
+  }
+
+  if (total == 0) {
+    for (i = 0; i < gst_sdp_message_bandwidths_len (sdp); i++) {
+      const GstSDPBandwidth *bw = gst_sdp_message_get_bandwidth (sdp, i);
+
+      if (g_strcmp0 (bw->bwtype, "AS") == 0)
+        total += bw->bandwidth;
+    }
+  }
+
+  return total;
+}
+
+/* The session is described, the streams are not set up yet */
+static void
+on_sdp_cb (GstElement * rtspsrc, GstSDPMessage * sdp, gpointer user_data)
+{
+  GstRTSPViewerPrivate *priv;
+  guint bitrate;
+
+  priv = GST_RTSP_VIEWER_GET_PRIVATE (user_data);
+
+  /* Size the socket buffers for bursts like key frames at the bitrate of
+   * the stream, rather than one size for all */
+  bitrate = get_sdp_bitrate (sdp);
+  if (bitrate > 0) {
+    guint size = CLAMP ((guint64) bitrate * 1000 / 8 * UDP_BUFFER_TIME_MS /
+        1000, MIN_UDP_BUFFER_SIZE, MAX_UDP_BUFFER_SIZE);
+
+    GST_DEBUG ("%u kbit/s, UDP buffers of %u bytes", bitrate, size);
+    g_object_set (rtspsrc, "udp-buffer-size", size, NULL);
   }
+
+  /* By now the TLS handshake is over */
+  if (priv->tls_host == NULL)
+    return;
+
+  gst_tls_session_cache_connected (gst_tls_session_cache_get_default (),
+      user_data, priv->tls_handshakes,
+      g_get_monotonic_time () - priv->tls_start);
+  g_free (priv->tls_host);
+  priv->tls_host = NULL;
 }
 
 static void
@@ -210,8 +499,100 @@ need_data_cb (GstElement *playbin, GstElement *rtspsrc, gpointer user_data)
 
   priv = GST_RTSP_VIEWER_GET_PRIVATE (viewer);
 
-  g_object_set (G_OBJECT (rtspsrc), "user-id", priv->user, NULL);
-  g_object_set (G_OBJECT (rtspsrc), "user-pw", priv->pass, NULL);
+  if (GST_IS_SHARED_SRC (rtspsrc)) {
+    /* Not a rtspsrc but the source fed by the shared stream */
+    if (priv->shared != NULL)
+      gst_stream_registry_attach (priv->shared, viewer, rtspsrc);
+    return;
+  }
+
+  if (is_rtspsrc (GST_OBJECT (rtspsrc)) && priv->uri != NULL) {
+    guint64 timeout;
+
+    g_object_set (G_OBJECT (rtspsrc), "user-id", priv->user, NULL);
+    g_object_set (G_OBJECT (rtspsrc), "user-pw", priv->pass, NULL);
+
+    priv->transports =
+        gst_transport_policy_select (gst_transport_policy_get_default (),
+        priv->uri, &timeout);
+    priv->fell_back = FALSE;
+    g_object_set (G_OBJECT (rtspsrc), "protocols", priv->transports,
+        "timeout", timeout, NULL);
+    if (priv->ntp_sync)
+      g_object_set (G_OBJECT (rtspsrc), "ntp-sync", TRUE, NULL);
+    /* ONVIF replay addresses recordings by Range: clock=, older rtspsrc
+     * still send npt ranges and Scale */
+    if (priv->playback &&
+        g_object_class_find_property (G_OBJECT_GET_CLASS (rtspsrc),
+            "onvif-mode") != NULL)
+      g_object_set (G_OBJECT (rtspsrc), "onvif-mode", TRUE, NULL);
+    g_signal_connect (rtspsrc, "on-sdp", G_CALLBACK (on_sdp_cb), user_data);
+  }
+
+  /* The rtsps:// connections of the viewer verify with a database of its
+   * own, counting its full handshakes, see tlssessioncache.c */
+  if (is_rtspsrc (GST_OBJECT (rtspsrc)) && priv->uri != NULL &&
+      g_str_has_prefix (priv->uri, "rtsps")) {
+    GstTlsSessionCache *cache = gst_tls_session_cache_get_default ();
+
+    if (priv->tls_database == NULL)
+      priv->tls_database = gst_tls_session_cache_new_database (cache, viewer);
+    if (priv->tls_database != NULL)
+      g_object_set (G_OBJECT (rtspsrc), "tls-database", priv->tls_database,
+          NULL);
+
+    g_free (priv->tls_host);
+    priv->tls_host = gst_admission_scheduler_get_host (priv->uri);
+    if (priv->tls_host != NULL) {
+      priv->tls_handshakes =
+          gst_tls_session_cache_connecting (cache, viewer, priv->tls_host);
+      priv->tls_start = g_get_monotonic_time ();
+    }
+  }
+}
+
+/* Answered allocation query of a decoder or converter, let it allocate
+ * from the pools shared by all pipelines */
+static GstPadProbeReturn
+allocation_query_cb (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_ALLOCATION &&
+      gst_shared_buffer_pool_propose (query))
+    GST_DEBUG_OBJECT (pad, "Proposed shared buffer pool");
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+element_added_cb (GstBin * playbin, GstBin * bin, GstElement * element,
+    gpointer user_data)
+{
+  const gchar *klass;
+  GstPad *srcpad;
+
+  /* rtspsrc made its udpsrc from the replaced factory */
+  if (GST_IS_BATCH_UDP_SRC (element)) {
+    GST_DEBUG ("Receiving RTP in batches with %s", GST_ELEMENT_NAME (element));
+    return;
+  }
+
+  klass = gst_element_class_get_metadata (GST_ELEMENT_GET_CLASS (element),
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL || strstr (klass, "Video") == NULL ||
+      (strstr (klass, "Decoder") == NULL && strstr (klass, "Converter") == NULL))
+    return;
+
+  srcpad = gst_element_get_static_pad (element, "src");
+  if (srcpad == NULL)
+    return;
+
+  GST_DEBUG ("Sharing buffer pools of %s", GST_ELEMENT_NAME (element));
+  gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM |
+      GST_PAD_PROBE_TYPE_PULL, allocation_query_cb, NULL, NULL);
+  gst_object_unref (srcpad);
 }
 
 static GstElement *
@@ -226,34 +607,82 @@ gst_rtsp_viewer_create_pipeline (GstRTSPStreamer * streamer,
 
   priv = GST_RTSP_VIEWER_GET_PRIVATE (streamer);
 
+  /* RTP over UDP is received in batches, see batchudpsrc.c */
+  gst_batch_udp_src_register ();
+  /* Recordings in a storage area are played from segments:// URIs */
+  gst_segment_src_register ();
+  /* Cameras watched by several viewers are played from shared:// URIs */
+  gst_shared_src_register ();
+
   priv->pipeline = gst_parse_launch ("playbin", error);
 
   g_signal_connect (priv->pipeline, "source-setup", G_CALLBACK (need_data_cb),
       streamer);
 
-  /* Disable subtitles */
   g_object_get (priv->pipeline, "flags", &flags, NULL);
+
+  /* Unless told otherwise, render straight into the window. The sink takes
+   * the decoder's format and converts itself if needed, so playbin does not
+   * have to plug videoconvert/videoscale. Frames are posted on vsync,
+   * together with the ones of the other players. */
+  if (priv->video_sink == NULL) {
+    priv->video_sink = gst_native_window_sink_new ();
+    gst_object_ref_sink (priv->video_sink);
+    g_object_set (priv->video_sink, "scheduled", TRUE, NULL);
+  }
+  if (GST_IS_NATIVE_WINDOW_SINK (priv->video_sink))
+    flags |= GST_PLAY_FLAG_NATIVE_VIDEO;
+  g_object_set (priv->pipeline, "video-sink", priv->video_sink, NULL);
+
+  g_signal_connect (priv->pipeline, "deep-element-added",
+      G_CALLBACK (element_added_cb), streamer);
+
+  /* Disable subtitles */
   flags &= ~GST_PLAY_FLAG_TEXT;
   g_object_set (priv->pipeline, "flags", flags, NULL);
 
+  /* Kept to be removed again in finalize */
   bus = gst_element_get_bus (priv->pipeline);
   bus_source = gst_bus_create_watch (bus);
   g_source_set_callback (bus_source, (GSourceFunc) gst_bus_async_signal_func,
       NULL, NULL);
   g_source_attach (bus_source, context);
-  g_source_unref (bus_source);
+  priv->bus_source = bus_source;
   g_signal_connect (G_OBJECT (bus), "message::state-changed",
       (GCallback)state_changed_cb, streamer);
+  g_signal_connect (G_OBJECT (bus), "message::warning",
+      (GCallback)warning_cb, streamer);
+  g_signal_connect (G_OBJECT (bus), "message::error",
+      (GCallback)error_cb, streamer);
   gst_object_unref (bus);
 
   return priv->pipeline;
 }
 
+/* Somebody else acquired the camera this viewer plays by itself, called
+ * from that thread with the registry locked. The player moves the viewer to
+ * the shared stream from its own thread, see gst_media_player_set_uri(). */
+static void
+share_cb (gpointer owner)
+{
+  GstRTSPViewerPrivate *priv;
+
+  priv = GST_RTSP_VIEWER_GET_PRIVATE (owner);
+
+  GST_DEBUG ("Moving viewer %p to the shared stream of %s", owner, priv->uri);
+
+  gst_element_post_message (priv->pipeline,
+      gst_message_new_element (GST_OBJECT (priv->pipeline),
+          gst_structure_new (GST_RTSP_STREAMER_RESTART_MESSAGE, "uri",
+              G_TYPE_STRING, priv->uri, NULL)));
+}
+
 static void
 gst_rtsp_viewer_set_uri (GstRTSPStreamer * streamer, const gchar * uri,
     const gchar * user, const gchar * pass)
 {
   GstRTSPViewerPrivate *priv;
+  GError *error = NULL;
 
   priv = GST_RTSP_VIEWER_GET_PRIVATE (streamer);
 
@@ -262,6 +691,13 @@ gst_rtsp_viewer_set_uri (GstRTSPStreamer * streamer, const gchar * uri,
   GST_DEBUG ("Setting URI to %s(%s,%s) for viewer %p", uri, user, pass,
       streamer);
 
+  gst_stream_registry_unwatch (streamer);
+
+  if (priv->shared != NULL) {
+    gst_stream_registry_release (priv->shared, streamer);
+    priv->shared = NULL;
+  }
+
   if (user != NULL && pass != NULL) {
     if (priv->user != NULL)
       g_free (priv->user);
@@ -271,6 +707,35 @@ gst_rtsp_viewer_set_uri (GstRTSPStreamer * streamer, const gchar * uri,
     priv->pass = g_strdup (pass);
   }
 
+  if (uri != priv->uri) {
+    g_free (priv->uri);
+    priv->uri = g_strdup (uri);
+  }
+  priv->transports = 0;
+
+  /* The shared streams restamp the frames, losing the capture time, and
+   * can not seek. The only viewer of a camera connects by itself, until
+   * somebody else wants the camera too, see share_cb (). */
+  if (priv->share_stream && !priv->ntp_sync && !priv->playback &&
+      gst_stream_registry_is_shareable (uri)) {
+    priv->shared = gst_stream_registry_lookup (uri, user, pass);
+    if (priv->shared == NULL &&
+        !gst_stream_registry_watch (uri, user, pass, streamer, share_cb))
+      priv->shared = gst_stream_registry_acquire (uri, user, pass, &error);
+
+    if (priv->shared != NULL) {
+      /* Frames are pushed by the shared stream, see need_data_cb () */
+      g_object_set (priv->pipeline, "uri", "shared://", NULL);
+      return;
+    }
+
+    if (error != NULL) {
+      GST_WARNING ("Could not share stream, using own connection: %s",
+          error->message);
+      g_clear_error (&error);
+    }
+  }
+
   g_object_set (priv->pipeline, "uri", uri, NULL);
 }
 
@@ -296,6 +761,10 @@ gst_rtsp_viewer_set_window (GstWindowRenderer * renderer,
   priv->native_window = native_window;
   gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (priv->pipeline),
       (guintptr)priv->native_window);
+
+  /* The pipeline kept running without a window, show its last frame right
+   * away instead of waiting for the next one */
+  gst_video_overlay_expose (GST_VIDEO_OVERLAY (priv->pipeline));
 }
 
 static void
@@ -308,7 +777,11 @@ gst_rtsp_viewer_release_window (GstWindowRenderer * renderer)
   if (priv->pipeline != NULL) {
     gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (priv->pipeline),
         (guintptr)NULL);
-    gst_element_set_state (priv->pipeline, GST_STATE_READY);
+
+    /* The native window sink drops frames until it gets a new window, so
+     * the stream keeps playing. Other sinks can not render without one. */
+    if (!GST_IS_NATIVE_WINDOW_SINK (priv->video_sink))
+      gst_element_set_state (priv->pipeline, GST_STATE_READY);
   }
 
   if (priv->native_window != NULL) {
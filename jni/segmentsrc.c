@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSegmentSrc: Source playing the segments of a storage area recorded in
+ * a time range as a single timeline.
+ *
+ * The element handles URIs of the form
+ *
+ *   segments:///path/to/storage?start=<ms>&end=<ms>
+ *
+ * with wall clock times in milliseconds since the epoch, so playbin plays a
+ * range of a recording like any other URI. The segments recorded in the
+ * range (see gst_segment_storage_find_segments()) are handed to splitmuxsrc,
+ * which prerolls every segment up front and presents them back to back as
+ * one seekable timeline: playback goes from one segment into the next
+ * without draining the pipeline, and whatever was not recorded between two
+ * segments is skipped. The timeline starts at the beginning of the first
+ * segment, see gst_segment_src_get_start_offset().
+ *
+ * Before playback gets to a segment the element asks the kernel to read it
+ * ahead, so that crossing into it does not wait for flash. Reading ahead
+ * needs API 21, builds for older devices (the app goes down to API 16) skip
+ * it. Where segments begin on the timeline is known from their keyframe
+ * indexes, see gst_segment_storage_get_timeline().
+ */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "segmentsrc.h"
+#include "segmentstorage.h"
+
+#define SEGMENTS_SCHEME "segments"
+
+/* Read the next segment ahead this long before playback gets to it */
+#define PREFETCH_TIME (10 * GST_SECOND)
+
+struct _GstSegmentSrc
+{
+  GstBin parent;
+
+  GstElement *splitmuxsrc;
+
+  GMutex lock;                  /* Protects everything below */
+  gchar *uri;
+  gchar *directory;
+  gint64 start;                 /* Wall clock time, milliseconds */
+  gint64 end;
+  gchar **segments;             /* Played, oldest first */
+  GstClockTime *offsets;        /* Where they begin on the timeline */
+  guint n_segments;
+  guint prefetched;             /* Segments before this one were read ahead */
+  guint n_pads;
+};
+
+struct _GstSegmentSrcClass
+{
+  GstBinClass parent_class;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_segment_src_finalize (GObject * obj);
+static GstStateChangeReturn gst_segment_src_change_state (GstElement *
+    element, GstStateChange transition);
+static void gst_segment_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstSegmentSrc, gst_segment_src, GST_TYPE_BIN,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        gst_segment_src_uri_handler_init));
+
+static void
+gst_segment_src_class_init (GstSegmentSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_segment_src_finalize;
+  element_class->change_state = gst_segment_src_change_state;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_set_static_metadata (element_class,
+      "Segment source", "Source/File",
+      "Plays the segments of a storage area recorded in a time range",
+      "Ognyan Tonchev <otonchev at gmail.com>");
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "segmentsrc", 0,
+      "Segment Source");
+  gst_debug_set_threshold_for_name ("segmentsrc", GST_LEVEL_DEBUG);
+}
+
+/* Takes the segments from the range instead of a location pattern */
+static gchar **
+format_location_cb (GstElement * splitmuxsrc, gpointer user_data)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (user_data);
+  gchar **segments;
+
+  g_mutex_lock (&self->lock);
+  segments = g_strdupv (self->segments);
+  g_mutex_unlock (&self->lock);
+
+  return segments;
+}
+
+/* Must be called with the lock held */
+static guint
+find_segment_unlocked (GstSegmentSrc * self, GstClockTime position)
+{
+  guint i;
+
+  for (i = 0; i + 1 < self->n_segments; i++) {
+    if (position < self->offsets[i + 1])
+      break;
+  }
+
+  return i;
+}
+
+/* Pulls the start of @path into the page cache without waiting for it.
+ * bionic only has posix_fadvise() from API 21, older devices do without. */
+static void
+prefetch (const gchar * path)
+{
+  gint fd;
+
+  GST_DEBUG ("Reading %s ahead", path);
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+#if defined (__ANDROID_API__) && __ANDROID_API__ >= 21
+  posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+  close (fd);
+}
+
+/* Follows playback through the timeline, reading the next segment ahead */
+static GstPadProbeReturn
+timeline_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (user_data);
+  GstClockTime position;
+  gchar *next = NULL;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    const GstSegment *segment;
+
+    /* Seeked, start over from the segment played now */
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+      gst_event_parse_segment (event, &segment);
+      if (segment->format == GST_FORMAT_TIME) {
+        g_mutex_lock (&self->lock);
+        self->prefetched = find_segment_unlocked (self, segment->start) + 1;
+        g_mutex_unlock (&self->lock);
+      }
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  position = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (!GST_CLOCK_TIME_IS_VALID (position))
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&self->lock);
+  if (self->prefetched < self->n_segments &&
+      position + PREFETCH_TIME >= self->offsets[self->prefetched]) {
+    next = g_strdup (self->segments[self->prefetched]);
+    self->prefetched++;
+  }
+  g_mutex_unlock (&self->lock);
+
+  if (next != NULL) {
+    prefetch (next);
+    g_free (next);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pad_added_cb (GstElement * splitmuxsrc, GstPad * pad, gpointer user_data)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (user_data);
+  GstPad *ghost;
+  gchar *name;
+
+  g_mutex_lock (&self->lock);
+  name = g_strdup_printf ("src_%u", self->n_pads++);
+  g_mutex_unlock (&self->lock);
+
+  ghost = gst_ghost_pad_new_from_template (name, pad,
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self),
+          "src_%u"));
+  g_free (name);
+  g_object_set_data (G_OBJECT (pad), "segmentsrc-ghost", ghost);
+  gst_pad_set_active (ghost, TRUE);
+  gst_element_add_pad (GST_ELEMENT (self), ghost);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, timeline_probe_cb, self, NULL);
+}
+
+static void
+pad_removed_cb (GstElement * splitmuxsrc, GstPad * pad, gpointer user_data)
+{
+  GstElement *self = GST_ELEMENT (user_data);
+  GstPad *ghost;
+
+  ghost = g_object_get_data (G_OBJECT (pad), "segmentsrc-ghost");
+  if (ghost == NULL)
+    return;
+
+  g_object_set_data (G_OBJECT (pad), "segmentsrc-ghost", NULL);
+  gst_pad_set_active (ghost, FALSE);
+  gst_element_remove_pad (self, ghost);
+}
+
+static void
+no_more_pads_cb (GstElement * splitmuxsrc, gpointer user_data)
+{
+  gst_element_no_more_pads (GST_ELEMENT (user_data));
+}
+
+static void
+gst_segment_src_init (GstSegmentSrc * self)
+{
+  g_mutex_init (&self->lock);
+  self->end = G_MAXINT64;
+
+  self->splitmuxsrc = gst_element_factory_make ("splitmuxsrc", NULL);
+  if (self->splitmuxsrc == NULL) {
+    GST_WARNING ("splitmuxsrc not available");
+    return;
+  }
+
+  g_signal_connect (self->splitmuxsrc, "format-location",
+      G_CALLBACK (format_location_cb), self);
+  g_signal_connect (self->splitmuxsrc, "pad-added",
+      G_CALLBACK (pad_added_cb), self);
+  g_signal_connect (self->splitmuxsrc, "pad-removed",
+      G_CALLBACK (pad_removed_cb), self);
+  g_signal_connect (self->splitmuxsrc, "no-more-pads",
+      G_CALLBACK (no_more_pads_cb), self);
+  gst_bin_add (GST_BIN (self), self->splitmuxsrc);
+}
+
+static void
+gst_segment_src_finalize (GObject * obj)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (obj);
+
+  g_free (self->uri);
+  g_free (self->directory);
+  g_strfreev (self->segments);
+  g_free (self->offsets);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_segment_src_parent_class)->finalize (obj);
+}
+
+/* Looks the segments up again on every start, the recording may have gone
+ * on in the meantime */
+static gboolean
+find_segments (GstSegmentSrc * self)
+{
+  gint64 *starts = NULL;
+
+  g_mutex_lock (&self->lock);
+
+  g_strfreev (self->segments);
+  g_free (self->offsets);
+  self->segments = NULL;
+  self->offsets = NULL;
+  self->n_segments = 0;
+
+  if (self->directory != NULL)
+    self->segments = gst_segment_storage_find_segments (self->directory,
+        self->start, self->end, &starts);
+  if (self->segments == NULL || self->segments[0] == NULL) {
+    g_mutex_unlock (&self->lock);
+    g_free (starts);
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("Nothing recorded in %s", self->uri), (NULL));
+    return FALSE;
+  }
+
+  self->n_segments = g_strv_length (self->segments);
+  self->offsets = gst_segment_storage_get_timeline (self->segments, starts);
+  self->prefetched = 1;
+  g_free (starts);
+
+  GST_DEBUG_OBJECT (self, "Playing %u segments of %s", self->n_segments,
+      self->uri);
+
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static GstStateChangeReturn
+gst_segment_src_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY) {
+    if (self->splitmuxsrc == NULL) {
+      GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN,
+          ("splitmuxsrc not available"), (NULL));
+      return GST_STATE_CHANGE_FAILURE;
+    }
+    if (!find_segments (self))
+      return GST_STATE_CHANGE_FAILURE;
+  }
+
+  return GST_ELEMENT_CLASS (gst_segment_src_parent_class)->change_state
+      (element, transition);
+}
+
+/* Splits segments:///path?start=<ms>&end=<ms> */
+static gboolean
+parse_uri (const gchar * uri, gchar ** directory, gint64 * start,
+    gint64 * end)
+{
+  gchar **parts;
+  gchar **params;
+  guint i;
+
+  if (!g_str_has_prefix (uri, SEGMENTS_SCHEME "://"))
+    return FALSE;
+
+  parts = g_strsplit (uri + strlen (SEGMENTS_SCHEME "://"), "?", 2);
+  *directory = g_uri_unescape_string (parts[0], NULL);
+  *start = 0;
+  *end = G_MAXINT64;
+
+  params = g_strsplit (parts[1] != NULL ? parts[1] : "", "&", -1);
+  for (i = 0; params[i] != NULL; i++) {
+    if (g_str_has_prefix (params[i], "start="))
+      *start = g_ascii_strtoll (params[i] + strlen ("start="), NULL, 10);
+    else if (g_str_has_prefix (params[i], "end="))
+      *end = g_ascii_strtoll (params[i] + strlen ("end="), NULL, 10);
+  }
+  g_strfreev (params);
+  g_strfreev (parts);
+
+  if (*directory == NULL || **directory == '\0') {
+    g_free (*directory);
+    *directory = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static GstURIType
+gst_segment_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+gst_segment_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { SEGMENTS_SCHEME, NULL };
+
+  return protocols;
+}
+
+static gchar *
+gst_segment_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (handler);
+  gchar *uri;
+
+  g_mutex_lock (&self->lock);
+  uri = g_strdup (self->uri);
+  g_mutex_unlock (&self->lock);
+
+  return uri;
+}
+
+static gboolean
+gst_segment_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstSegmentSrc *self = GST_SEGMENT_SRC (handler);
+  gchar *directory;
+  gint64 start;
+  gint64 end;
+
+  if (!parse_uri (uri, &directory, &start, &end)) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid segments URI %s", uri);
+    return FALSE;
+  }
+
+  g_mutex_lock (&self->lock);
+  g_free (self->uri);
+  self->uri = g_strdup (uri);
+  g_free (self->directory);
+  self->directory = directory;
+  self->start = start;
+  self->end = end;
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static void
+gst_segment_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = gst_segment_src_uri_get_type;
+  iface->get_protocols = gst_segment_src_uri_get_protocols;
+  iface->get_uri = gst_segment_src_uri_get_uri;
+  iface->set_uri = gst_segment_src_uri_set_uri;
+}
+
+/**
+ * gst_segment_src_register:
+ *
+ * Registers the element, so that playbin plays segments:// URIs.
+ *
+ * Returns: TRUE on success.
+ */
+gboolean
+gst_segment_src_register (void)
+{
+  static gsize registered = 0;
+
+  if (g_once_init_enter (&registered)) {
+    gboolean ok;
+
+    ok = gst_element_register (NULL, "segmentsrc", GST_RANK_PRIMARY,
+        GST_TYPE_SEGMENT_SRC);
+
+    g_once_init_leave (&registered, ok ? 1 : 2);
+  }
+
+  return registered == 1;
+}
+
+/**
+ * gst_segment_src_get_start_offset:
+ * @uri: a segments:// URI
+ *
+ * The timeline of @uri begins with the first segment recorded in its range,
+ * which may have started before the range.
+ *
+ * Returns: the position of the start of the range on the timeline, 0 if it
+ * is not known.
+ */
+GstClockTime
+gst_segment_src_get_start_offset (const gchar * uri)
+{
+  gchar *directory;
+  gchar **segments;
+  gint64 *starts = NULL;
+  gint64 start;
+  gint64 end;
+  GstClockTime offset = 0;
+
+  if (!parse_uri (uri, &directory, &start, &end))
+    return 0;
+
+  segments = gst_segment_storage_find_segments (directory, start, end,
+      &starts);
+  if (segments[0] != NULL && start > starts[0])
+    offset = (start - starts[0]) * GST_MSECOND;
+  g_strfreev (segments);
+  g_free (starts);
+  g_free (directory);
+
+  return offset;
+}
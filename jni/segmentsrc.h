@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSegmentSrc: Source playing the segments of a storage area recorded in
+ * a time range as a single timeline.
+ */
+#ifndef __GST_SEGMENT_SRC_H__
+#define __GST_SEGMENT_SRC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SEGMENT_SRC (gst_segment_src_get_type ())
+#define GST_SEGMENT_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_SEGMENT_SRC, GstSegmentSrc))
+#define GST_IS_SEGMENT_SRC(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_SEGMENT_SRC))
+
+typedef struct _GstSegmentSrc GstSegmentSrc;
+typedef struct _GstSegmentSrcClass GstSegmentSrcClass;
+
+GType gst_segment_src_get_type (void);
+
+gboolean gst_segment_src_register (void);
+GstClockTime gst_segment_src_get_start_offset (const gchar * uri);
+
+G_END_DECLS
+
+#endif /* __GST_SEGMENT_SRC_H__ */
@@ -0,0 +1,1070 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSegmentStorage: Sink writing a recording as fixed duration segment files
+ * into a storage area with a quota, evicting the oldest segments.
+ *
+ * The storage area is the directory set with gst_disk_writer_set_location().
+ * Every start of the sink opens a new segment named after the wall clock time
+ * it starts at, splitmuxsink restarts it on the keyframe ending each segment.
+ * Before a segment is opened the oldest segments are deleted until the area
+ * is within its size quota, counting the space the new segment is expected
+ * to take, and no segment is older than the age quota.
+ *
+ * The streaming thread only copies the data into large aligned blocks. The
+ * blocks are written by a thread of the sink, which also opens, preallocates
+ * and closes the files, so that neither flash latency spikes nor segment
+ * rotation hold the stream up. The data is synced at most every
+ * "sync-interval" and when a segment is closed, bounding what a power loss
+ * can take while keeping the number of flushes to flash low.
+ *
+ * The keyframe index and thumbnail cache of a segment (see keyframeindex.c
+ * and thumbnailcache.c) are written by others, the storage only deletes
+ * them together with the segment.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#include <glib/gstdio.h>
+
+#include "segmentstorage.h"
+#include "diskwriter.h"
+#include "keyframeindex.h"
+#include "thumbnailcache.h"
+
+/* Writes are batched into blocks of this size, at offsets aligned to it. A
+ * block starting off a boundary, after a seek or a partial flush, only
+ * takes the data up to the next one. */
+#define BLOCK_SIZE (256 * 1024)
+#define BLOCK_ALIGN 4096
+/* Blocks queued for the I/O thread before the streaming thread waits */
+#define MAX_QUEUED_BLOCKS 16
+/* Preallocated for the first segment, later ones take the size of the
+ * previous one */
+#define DEFAULT_PREALLOCATE (8 * 1024 * 1024)
+
+#define DEFAULT_SEGMENT_DURATION (60 * GST_SECOND)
+#define DEFAULT_MAX_SIZE (G_GUINT64_CONSTANT (1024) * 1024 * 1024)
+#define DEFAULT_MAX_AGE 0
+#define DEFAULT_SYNC_INTERVAL (5 * GST_SECOND)
+
+#define SEGMENT_PREFIX "segment-"
+#define SEGMENT_SUFFIX ".mp4"
+
+typedef enum
+{
+  COMMAND_OPEN,
+  COMMAND_WRITE,
+  COMMAND_CLOSE
+} GstStorageCommandType;
+
+typedef struct
+{
+  GstStorageCommandType type;
+  gchar *path;                  /* COMMAND_OPEN */
+  guint8 *data;                 /* COMMAND_WRITE, a block */
+  gsize size;
+  guint64 offset;
+} GstStorageCommand;
+
+typedef struct
+{
+  gchar *path;
+  guint64 size;
+  gint64 time;                  /* Wall clock time it started, milliseconds,
+                                 * as in its name */
+} GstStorageSegment;
+
+struct _GstSegmentStorage
+{
+  GstBaseSink parent;
+
+  GMutex lock;                  /* Protects everything but the streaming
+                                 * and I/O thread state */
+  GCond cond;
+  gchar *directory;
+  gchar *current;               /* Segment opened last */
+  GstClockTime segment_duration;
+  guint64 max_size;
+  guint64 max_age;
+  GstClockTime sync_interval;
+  GQueue commands;              /* Of GstStorageCommand, for the I/O thread */
+  guint queued_blocks;
+  GSList *free_blocks;          /* Written blocks, to be filled again */
+  gboolean flushing;
+  gboolean running;
+  pthread_t thread;
+  GQueue segments;              /* Of GstStorageSegment, oldest first */
+  guint64 used;                 /* Size of the segments */
+  guint64 preallocate;
+
+  /* Streaming thread */
+  guint8 *block;                /* Being filled */
+  gsize filled;
+  guint64 block_offset;         /* File offset of the block */
+  guint64 position;             /* File offset the next data goes to */
+
+  /* I/O thread */
+  gint fd;
+  gchar *path;
+  gint64 start_time;
+  guint64 size;
+  gint64 last_sync;
+
+  /* Statistics, protected by the lock */
+  guint64 written;
+  guint64 syncs;
+  guint64 evicted;
+  gdouble write_max;            /* Slowest write, milliseconds */
+};
+
+struct _GstSegmentStorageClass
+{
+  GstBaseSinkClass parent_class;
+};
+
+enum
+{
+  PROP_0,
+  PROP_SEGMENT_DURATION,
+  PROP_MAX_SIZE,
+  PROP_MAX_AGE,
+  PROP_SYNC_INTERVAL
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Segments open on the I/O threads of all storages, by path */
+static GMutex open_lock;
+static GHashTable *open_segments;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_segment_storage_finalize (GObject * obj);
+static void gst_segment_storage_get_property (GObject * object,
+    guint propid, GValue * value, GParamSpec * pspec);
+static void gst_segment_storage_set_property (GObject * object,
+    guint propid, const GValue * value, GParamSpec * pspec);
+static gboolean gst_segment_storage_start (GstBaseSink * bsink);
+static gboolean gst_segment_storage_stop (GstBaseSink * bsink);
+static gboolean gst_segment_storage_unlock (GstBaseSink * bsink);
+static gboolean gst_segment_storage_unlock_stop (GstBaseSink * bsink);
+static gboolean gst_segment_storage_event (GstBaseSink * bsink,
+    GstEvent * event);
+static GstFlowReturn gst_segment_storage_render (GstBaseSink * bsink,
+    GstBuffer * buffer);
+static void gst_segment_storage_disk_writer_init (GstDiskWriterInterface *
+    iface);
+static void *thread_function (void *user_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstSegmentStorage, gst_segment_storage,
+    GST_TYPE_BASE_SINK,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_DISK_WRITER,
+        gst_segment_storage_disk_writer_init));
+
+static void
+gst_segment_storage_class_init (GstSegmentStorageClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseSinkClass *basesink_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+  basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->finalize = gst_segment_storage_finalize;
+  gobject_class->get_property = gst_segment_storage_get_property;
+  gobject_class->set_property = gst_segment_storage_set_property;
+
+  g_object_class_install_property (gobject_class, PROP_SEGMENT_DURATION,
+      g_param_spec_uint64 ("segment-duration", "SegmentDuration",
+          "Duration of a segment in nanoseconds, segments end on the first "
+          "keyframe after it", GST_SECOND, G_MAXUINT64,
+          DEFAULT_SEGMENT_DURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE,
+      g_param_spec_uint64 ("max-size", "MaxSize",
+          "Bytes the segments may take, 0 for no limit", 0, G_MAXUINT64,
+          DEFAULT_MAX_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_AGE,
+      g_param_spec_uint64 ("max-age", "MaxAge",
+          "Seconds segments are kept, 0 for no limit", 0, G_MAXUINT64,
+          DEFAULT_MAX_AGE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SYNC_INTERVAL,
+      g_param_spec_uint64 ("sync-interval", "SyncInterval",
+          "Longest time written data stays unsynced, in nanoseconds", 0,
+          G_MAXUINT64, DEFAULT_SYNC_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  basesink_class->start = gst_segment_storage_start;
+  basesink_class->stop = gst_segment_storage_stop;
+  basesink_class->unlock = gst_segment_storage_unlock;
+  basesink_class->unlock_stop = gst_segment_storage_unlock_stop;
+  basesink_class->event = gst_segment_storage_event;
+  basesink_class->render = gst_segment_storage_render;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_set_static_metadata (element_class,
+      "Segment storage", "Sink/File",
+      "Writes fixed duration segments into a storage area with a quota",
+      "Ognyan Tonchev <otonchev at gmail.com>");
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "segmentstorage", 0,
+      "Segment Storage");
+  gst_debug_set_threshold_for_name ("segmentstorage", GST_LEVEL_DEBUG);
+}
+
+static void
+gst_segment_storage_init (GstSegmentStorage * self)
+{
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->commands);
+  g_queue_init (&self->segments);
+  self->segment_duration = DEFAULT_SEGMENT_DURATION;
+  self->max_size = DEFAULT_MAX_SIZE;
+  self->max_age = DEFAULT_MAX_AGE;
+  self->sync_interval = DEFAULT_SYNC_INTERVAL;
+  self->preallocate = DEFAULT_PREALLOCATE;
+  self->fd = -1;
+
+  /* Nothing to sync with, segments are written as the data comes */
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+  gst_base_sink_set_async_enabled (GST_BASE_SINK (self), FALSE);
+
+  self->running = TRUE;
+  pthread_create (&self->thread, NULL, &thread_function, self);
+}
+
+static void
+segment_free (GstStorageSegment * segment)
+{
+  g_free (segment->path);
+  g_free (segment);
+}
+
+static void
+gst_segment_storage_finalize (GObject * obj)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (obj);
+  GstStorageSegment *segment;
+
+  /* The thread finishes the queued commands first */
+  g_mutex_lock (&self->lock);
+  self->running = FALSE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+  pthread_join (self->thread, NULL);
+
+  g_slist_free_full (self->free_blocks, free);
+  free (self->block);
+  while ((segment = g_queue_pop_head (&self->segments)) != NULL)
+    segment_free (segment);
+  g_free (self->directory);
+  g_free (self->current);
+  g_cond_clear (&self->cond);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_segment_storage_parent_class)->finalize (obj);
+}
+
+static void
+gst_segment_storage_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (object);
+
+  g_mutex_lock (&self->lock);
+  switch (propid) {
+    case PROP_SEGMENT_DURATION:
+      g_value_set_uint64 (value, self->segment_duration);
+      break;
+    case PROP_MAX_SIZE:
+      g_value_set_uint64 (value, self->max_size);
+      break;
+    case PROP_MAX_AGE:
+      g_value_set_uint64 (value, self->max_age);
+      break;
+    case PROP_SYNC_INTERVAL:
+      g_value_set_uint64 (value, self->sync_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_segment_storage_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (object);
+
+  g_mutex_lock (&self->lock);
+  switch (propid) {
+    case PROP_SEGMENT_DURATION:
+      /* Read by the recorder when it builds its pipeline */
+      self->segment_duration = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_SIZE:
+      self->max_size = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_AGE:
+      self->max_age = g_value_get_uint64 (value);
+      break;
+    case PROP_SYNC_INTERVAL:
+      self->sync_interval = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+/* Must be called with the lock held */
+static void
+push_command_unlocked (GstSegmentStorage * self, GstStorageCommandType type,
+    gchar * path, guint8 * data, gsize size, guint64 offset)
+{
+  GstStorageCommand *command;
+
+  command = g_new0 (GstStorageCommand, 1);
+  command->type = type;
+  command->path = path;
+  command->data = data;
+  command->size = size;
+  command->offset = offset;
+
+  g_queue_push_tail (&self->commands, command);
+  if (type == COMMAND_WRITE)
+    self->queued_blocks++;
+  g_cond_broadcast (&self->cond);
+}
+
+/* Hands the block being filled to the I/O thread, called from the streaming
+ * thread */
+static void
+flush_block (GstSegmentStorage * self)
+{
+  if (self->block == NULL || self->filled == 0)
+    return;
+
+  g_mutex_lock (&self->lock);
+  push_command_unlocked (self, COMMAND_WRITE, NULL, self->block, self->filled,
+      self->block_offset);
+  g_mutex_unlock (&self->lock);
+
+  self->block = NULL;
+  self->filled = 0;
+}
+
+/* Bytes the block being filled takes, up to the next boundary */
+static gsize
+block_capacity (GstSegmentStorage * self)
+{
+  return BLOCK_SIZE - self->block_offset % BLOCK_SIZE;
+}
+
+/* Waits until the I/O thread catches up, called from the streaming thread */
+static guint8 *
+get_block (GstSegmentStorage * self)
+{
+  guint8 *block = NULL;
+
+  g_mutex_lock (&self->lock);
+  while (self->queued_blocks >= MAX_QUEUED_BLOCKS && !self->flushing)
+    g_cond_wait (&self->cond, &self->lock);
+  if (self->flushing) {
+    g_mutex_unlock (&self->lock);
+    return NULL;
+  }
+  if (self->free_blocks != NULL) {
+    block = self->free_blocks->data;
+    self->free_blocks = g_slist_delete_link (self->free_blocks,
+        self->free_blocks);
+  }
+  g_mutex_unlock (&self->lock);
+
+  if (block == NULL && posix_memalign ((void **) &block, BLOCK_ALIGN,
+          BLOCK_SIZE) != 0)
+    block = NULL;
+
+  return block;
+}
+
+/* @time is the wall clock time the segment started at, in milliseconds */
+static gboolean
+is_segment (const gchar * name, gint64 * time)
+{
+  gchar *end;
+
+  if (!g_str_has_prefix (name, SEGMENT_PREFIX) ||
+      !g_str_has_suffix (name, SEGMENT_SUFFIX))
+    return FALSE;
+
+  *time = g_ascii_strtoll (name + strlen (SEGMENT_PREFIX), &end, 10);
+
+  return end != name + strlen (SEGMENT_PREFIX);
+}
+
+static gint
+compare_segments (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return strcmp (((GstStorageSegment *) a)->path,
+      ((GstStorageSegment *) b)->path);
+}
+
+/* Deletes the oldest segments until @reserve more bytes fit in the quota.
+ * Called from the I/O thread. */
+static void
+evict (GstSegmentStorage * self, guint64 reserve)
+{
+  GList *victims = NULL;
+  GList *walk;
+  gint64 now = g_get_real_time () / 1000;
+
+  g_mutex_lock (&self->lock);
+  while (!g_queue_is_empty (&self->segments)) {
+    GstStorageSegment *oldest = g_queue_peek_head (&self->segments);
+
+    if ((self->max_size == 0 || self->used + reserve <= self->max_size) &&
+        (self->max_age == 0 ||
+            now - oldest->time <= (gint64) self->max_age * 1000))
+      break;
+
+    g_queue_pop_head (&self->segments);
+    self->used -= oldest->size;
+    self->evicted++;
+    victims = g_list_prepend (victims, oldest);
+  }
+  g_mutex_unlock (&self->lock);
+
+  for (walk = victims; walk != NULL; walk = walk->next) {
+    GstStorageSegment *segment = walk->data;
+    gchar *sidecar;
+
+    GST_DEBUG_OBJECT (self, "Evicting %s", segment->path);
+    if (g_unlink (segment->path) != 0)
+      GST_WARNING_OBJECT (self, "Could not delete %s: %s", segment->path,
+          g_strerror (errno));
+    sidecar = gst_keyframe_index_get_path (segment->path);
+    g_unlink (sidecar);
+    g_free (sidecar);
+    sidecar = gst_thumbnail_cache_get_path (segment->path);
+    g_unlink (sidecar);
+    g_free (sidecar);
+    segment_free (segment);
+  }
+  g_list_free (victims);
+}
+
+/* Reserves the blocks of the file without changing its size, so that the
+ * file system does not have to find room on every write. bionic only has
+ * fallocate() from API 21, 32 bit devices do without. */
+static void
+preallocate (gint fd, guint64 size)
+{
+#if defined (__LP64__) && defined (__NR_fallocate)
+  if (syscall (__NR_fallocate, fd, FALLOC_FL_KEEP_SIZE, (off_t) 0,
+          (off_t) size) != 0)
+    GST_DEBUG ("Could not preallocate: %s", g_strerror (errno));
+#endif
+}
+
+static void
+set_open (const gchar * path, gboolean open)
+{
+  g_mutex_lock (&open_lock);
+  if (open_segments == NULL)
+    open_segments = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+  if (open)
+    g_hash_table_add (open_segments, g_strdup (path));
+  else
+    g_hash_table_remove (open_segments, path);
+  g_mutex_unlock (&open_lock);
+}
+
+static void
+do_open (GstSegmentStorage * self, gchar * path)
+{
+  guint64 reserve;
+
+  g_mutex_lock (&self->lock);
+  reserve = self->preallocate;
+  g_mutex_unlock (&self->lock);
+
+  evict (self, reserve);
+
+  self->fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (self->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open segment %s", path), ("%s", g_strerror (errno)));
+    g_free (path);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (self, "Opened %s, preallocating %" G_GUINT64_FORMAT,
+      path, reserve);
+  preallocate (self->fd, reserve);
+  set_open (path, TRUE);
+
+  self->path = path;
+  self->start_time = g_get_real_time () / 1000;
+  self->size = 0;
+  self->last_sync = g_get_monotonic_time ();
+}
+
+static void
+do_write (GstSegmentStorage * self, GstStorageCommand * command)
+{
+  gsize done = 0;
+  gint64 start;
+  gint64 now;
+  GstClockTime sync_interval;
+  gboolean synced = FALSE;
+
+  if (self->fd < 0)
+    return;
+
+  start = g_get_monotonic_time ();
+  while (done < command->size) {
+    gssize ret = pwrite (self->fd, command->data + done,
+        command->size - done, command->offset + done);
+
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+          ("Could not write segment %s", self->path),
+          ("%s", g_strerror (errno)));
+      close (self->fd);
+      self->fd = -1;
+      set_open (self->path, FALSE);
+      return;
+    }
+    done += ret;
+  }
+  self->size = MAX (self->size, command->offset + command->size);
+
+  g_mutex_lock (&self->lock);
+  sync_interval = self->sync_interval;
+  g_mutex_unlock (&self->lock);
+
+  now = g_get_monotonic_time ();
+  if ((now - self->last_sync) * GST_USECOND >= sync_interval) {
+    fdatasync (self->fd);
+    self->last_sync = now = g_get_monotonic_time ();
+    synced = TRUE;
+  }
+
+  g_mutex_lock (&self->lock);
+  self->written += command->size;
+  if (synced)
+    self->syncs++;
+  self->write_max = MAX (self->write_max, (now - start) / 1000.0);
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+do_close (GstSegmentStorage * self)
+{
+  GstStorageSegment *segment;
+
+  if (self->fd < 0)
+    return;
+
+  /* Give back what was preallocated but not used */
+  if (ftruncate (self->fd, self->size) != 0)
+    GST_WARNING_OBJECT (self, "Could not truncate %s", self->path);
+  fdatasync (self->fd);
+  close (self->fd);
+  self->fd = -1;
+  set_open (self->path, FALSE);
+
+  GST_DEBUG_OBJECT (self, "Closed %s, %" G_GUINT64_FORMAT " bytes",
+      self->path, self->size);
+
+  segment = g_new0 (GstStorageSegment, 1);
+  segment->path = self->path;
+  segment->size = self->size;
+  segment->time = self->start_time;
+  self->path = NULL;
+
+  g_mutex_lock (&self->lock);
+  g_queue_push_tail (&self->segments, segment);
+  self->used += segment->size;
+  self->syncs++;
+  if (segment->size > 0)
+    self->preallocate = segment->size;
+  g_mutex_unlock (&self->lock);
+
+  evict (self, 0);
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstSegmentStorage *self = (GstSegmentStorage *) user_data;
+
+  while (TRUE) {
+    GstStorageCommand *command;
+
+    g_mutex_lock (&self->lock);
+    while (g_queue_is_empty (&self->commands) && self->running)
+      g_cond_wait (&self->cond, &self->lock);
+    command = g_queue_pop_head (&self->commands);
+    g_mutex_unlock (&self->lock);
+
+    if (command == NULL)
+      break;
+
+    switch (command->type) {
+      case COMMAND_OPEN:
+        do_open (self, command->path);
+        break;
+      case COMMAND_WRITE:
+        do_write (self, command);
+        g_mutex_lock (&self->lock);
+        self->free_blocks = g_slist_prepend (self->free_blocks,
+            command->data);
+        self->queued_blocks--;
+        g_cond_broadcast (&self->cond);
+        g_mutex_unlock (&self->lock);
+        break;
+      case COMMAND_CLOSE:
+        do_close (self);
+        break;
+    }
+    g_free (command);
+  }
+
+  /* Stopped while a segment was open */
+  do_close (self);
+
+  return NULL;
+}
+
+static gboolean
+gst_segment_storage_start (GstBaseSink * bsink)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+  gchar *path;
+
+  g_mutex_lock (&self->lock);
+  if (self->directory == NULL) {
+    g_mutex_unlock (&self->lock);
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No storage directory set"), (NULL));
+    return FALSE;
+  }
+
+  path = g_strdup_printf ("%s/" SEGMENT_PREFIX "%013" G_GINT64_FORMAT
+      SEGMENT_SUFFIX, self->directory, g_get_real_time () / 1000);
+  g_free (self->current);
+  self->current = g_strdup (path);
+  push_command_unlocked (self, COMMAND_OPEN, path, NULL, 0, 0);
+  g_mutex_unlock (&self->lock);
+
+  self->filled = 0;
+  self->block_offset = 0;
+  self->position = 0;
+
+  return TRUE;
+}
+
+/* Closing happens on the I/O thread, the next segment can start right away */
+static gboolean
+gst_segment_storage_stop (GstBaseSink * bsink)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+
+  flush_block (self);
+
+  g_mutex_lock (&self->lock);
+  push_command_unlocked (self, COMMAND_CLOSE, NULL, NULL, 0, 0);
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_segment_storage_unlock (GstBaseSink * bsink)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_segment_storage_unlock_stop (GstBaseSink * bsink)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = FALSE;
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+/* The muxer seeks back to rewrite headers with byte segments */
+static gboolean
+gst_segment_storage_event (GstBaseSink * bsink, GstEvent * event)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+    const GstSegment *segment;
+
+    gst_event_parse_segment (event, &segment);
+    if (segment->format == GST_FORMAT_BYTES &&
+        segment->start != self->position) {
+      GST_DEBUG_OBJECT (self, "Seeking to %" G_GUINT64_FORMAT,
+          segment->start);
+      flush_block (self);
+      self->position = segment->start;
+    }
+  }
+
+  return GST_BASE_SINK_CLASS (gst_segment_storage_parent_class)->event (bsink,
+      event);
+}
+
+static GstFlowReturn
+gst_segment_storage_render (GstBaseSink * bsink, GstBuffer * buffer)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (bsink);
+  GstMapInfo map;
+  gsize done = 0;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  while (done < map.size) {
+    gsize size;
+
+    if (self->block == NULL) {
+      self->block = get_block (self);
+      if (self->block == NULL) {
+        gst_buffer_unmap (buffer, &map);
+        return GST_FLOW_FLUSHING;
+      }
+      self->filled = 0;
+      self->block_offset = self->position;
+    }
+
+    size = MIN (map.size - done, block_capacity (self) - self->filled);
+    memcpy (self->block + self->filled, map.data + done, size);
+    self->filled += size;
+    self->position += size;
+    done += size;
+
+    /* From here on the blocks are aligned again */
+    if (self->filled == block_capacity (self))
+      flush_block (self);
+  }
+
+  gst_buffer_unmap (buffer, &map);
+
+  return GST_FLOW_OK;
+}
+
+/* Picks up the segments a previous run left in @location */
+static void
+gst_segment_storage_set_location (GstDiskWriter * writer,
+    const gchar * location)
+{
+  GstSegmentStorage *self = GST_SEGMENT_STORAGE (writer);
+  GstStorageSegment *segment;
+  const gchar *name;
+  GDir *dir;
+
+  GST_DEBUG_OBJECT (self, "Storing segments in %s", location);
+
+  if (g_mkdir_with_parents (location, 0755) != 0)
+    GST_WARNING_OBJECT (self, "Could not create %s: %s", location,
+        g_strerror (errno));
+
+  g_mutex_lock (&self->lock);
+
+  g_free (self->directory);
+  self->directory = g_strdup (location);
+  while ((segment = g_queue_pop_head (&self->segments)) != NULL)
+    segment_free (segment);
+  self->used = 0;
+
+  dir = g_dir_open (location, 0, NULL);
+  while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+    GStatBuf st;
+    gint64 time;
+
+    if (!is_segment (name, &time))
+      continue;
+
+    segment = g_new0 (GstStorageSegment, 1);
+    segment->path = g_build_filename (location, name, NULL);
+    segment->time = time;
+    if (g_stat (segment->path, &st) == 0)
+      segment->size = st.st_size;
+    self->used += segment->size;
+    g_queue_insert_sorted (&self->segments, segment, compare_segments, NULL);
+  }
+  if (dir != NULL)
+    g_dir_close (dir);
+
+  GST_DEBUG_OBJECT (self, "Found %u segments, %" G_GUINT64_FORMAT " bytes",
+      g_queue_get_length (&self->segments), self->used);
+
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_segment_storage_disk_writer_init (GstDiskWriterInterface * iface)
+{
+  iface->set_location = gst_segment_storage_set_location;
+}
+
+/**
+ * gst_segment_storage_new:
+ * @segment_duration: duration of the segments
+ * @max_size: bytes the segments may take, 0 for no limit
+ * @max_age: seconds segments are kept, 0 for no limit
+ *
+ * Returns: (transfer floating): a new storage, set the directory with
+ * gst_disk_writer_set_location().
+ */
+GstElement *
+gst_segment_storage_new (GstClockTime segment_duration, guint64 max_size,
+    guint64 max_age)
+{
+  return g_object_new (GST_TYPE_SEGMENT_STORAGE, "segment-duration",
+      segment_duration, "max-size", max_size, "max-age", max_age, NULL);
+}
+
+/**
+ * gst_segment_storage_find_segments:
+ * @directory: a storage area
+ * @start: wall clock time, milliseconds since the epoch
+ * @end: wall clock time, milliseconds since the epoch
+ * @starts: (out) (transfer full) (allow-none): wall clock times the segments
+ * found start at in milliseconds, free with g_free()
+ *
+ * Finds the segments recorded between @start and @end. A segment lasts until
+ * the last frame in its keyframe index, or without an index until the next
+ * segment starts.
+ *
+ * Returns: (transfer full): the paths of the segments, oldest first, in a
+ * NULL terminated array which is empty if there are none. Free with
+ * g_strfreev().
+ */
+gchar **
+gst_segment_storage_find_segments (const gchar * directory, gint64 start,
+    gint64 end, gint64 ** starts)
+{
+  GPtrArray *paths;
+  GArray *times;
+  GList *segments = NULL;
+  GList *walk;
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (directory, 0, NULL);
+  while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+    GstStorageSegment *segment;
+    gint64 time;
+
+    if (!is_segment (name, &time))
+      continue;
+
+    segment = g_new0 (GstStorageSegment, 1);
+    segment->path = g_build_filename (directory, name, NULL);
+    segment->time = time;
+    segments = g_list_insert_sorted_with_data (segments, segment,
+        compare_segments, NULL);
+  }
+  if (dir != NULL)
+    g_dir_close (dir);
+
+  paths = g_ptr_array_new ();
+  times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  for (walk = segments; walk != NULL; walk = walk->next) {
+    GstStorageSegment *segment = walk->data;
+    GstStorageSegment *next = walk->next ? walk->next->data : NULL;
+    GstKeyframeIndex *index;
+    gint64 segment_end = G_MAXINT64;
+
+    if (segment->time > end)
+      break;
+    if (next != NULL) {
+      if (next->time <= start)
+        continue;
+      segment_end = next->time;
+    }
+
+    /* Recording may have stopped before the next segment */
+    index = gst_keyframe_index_open (segment->path);
+    if (index != NULL) {
+      GstClockTime duration = gst_keyframe_index_get_duration (index);
+
+      if (GST_CLOCK_TIME_IS_VALID (duration))
+        segment_end = MIN (segment_end,
+            segment->time + (gint64) (duration / GST_MSECOND));
+      gst_keyframe_index_free (index);
+    }
+    if (segment_end < start)
+      continue;
+
+    g_ptr_array_add (paths, g_strdup (segment->path));
+    g_array_append_val (times, segment->time);
+  }
+  g_ptr_array_add (paths, NULL);
+
+  if (starts != NULL)
+    *starts = (gint64 *) g_array_free (times, FALSE);
+  else
+    g_array_free (times, TRUE);
+
+  g_list_free_full (segments, (GDestroyNotify) segment_free);
+
+  return (gchar **) g_ptr_array_free (paths, FALSE);
+}
+
+/**
+ * gst_segment_storage_get_timeline:
+ * @segments: segments found with gst_segment_storage_find_segments()
+ * @starts: the times they start at
+ *
+ * Played back to back, e.g. by splitmuxsrc, the segments form a timeline
+ * without the gaps between them. A segment takes as long as its keyframe
+ * index says, or without an index until the next one starts.
+ *
+ * Returns: (transfer full): the positions the segments start at on the
+ * timeline, free with g_free().
+ */
+GstClockTime *
+gst_segment_storage_get_timeline (gchar ** segments, const gint64 * starts)
+{
+  GstClockTime *offsets;
+  guint n = g_strv_length (segments);
+  guint i;
+
+  offsets = g_new0 (GstClockTime, MAX (n, 1));
+  for (i = 1; i < n; i++) {
+    GstKeyframeIndex *index;
+    GstClockTime duration = GST_CLOCK_TIME_NONE;
+
+    index = gst_keyframe_index_open (segments[i - 1]);
+    if (index != NULL) {
+      duration = gst_keyframe_index_get_duration (index);
+      gst_keyframe_index_free (index);
+    }
+    if (!GST_CLOCK_TIME_IS_VALID (duration))
+      duration = MAX (starts[i] - starts[i - 1], 0) * GST_MSECOND;
+
+    offsets[i] = offsets[i - 1] + duration;
+  }
+
+  return offsets;
+}
+
+/**
+ * gst_segment_storage_get_current_location:
+ * @storage: a #GstSegmentStorage
+ *
+ * Returns: (transfer full): the path of the segment being written, or of the
+ * last one if the sink is stopped, NULL before the first. Free with g_free().
+ */
+gchar *
+gst_segment_storage_get_current_location (GstSegmentStorage * storage)
+{
+  gchar *location;
+
+  g_mutex_lock (&storage->lock);
+  location = g_strdup (storage->current);
+  g_mutex_unlock (&storage->lock);
+
+  return location;
+}
+
+/**
+ * gst_segment_storage_is_writing:
+ * @location: a segment
+ *
+ * Returns: TRUE if a storage still writes @location, so that what was read
+ * of it so far is not all of it.
+ */
+gboolean
+gst_segment_storage_is_writing (const gchar * location)
+{
+  gboolean writing;
+
+  g_mutex_lock (&open_lock);
+  writing = open_segments != NULL &&
+      g_hash_table_contains (open_segments, location);
+  g_mutex_unlock (&open_lock);
+
+  return writing;
+}
+
+/**
+ * gst_segment_storage_get_stats:
+ * @storage: a #GstSegmentStorage
+ *
+ * Returns: (transfer full): the usage of the storage area and the cost of
+ * writing it, free with g_free().
+ */
+gchar *
+gst_segment_storage_get_stats (GstSegmentStorage * storage)
+{
+  gchar *stats;
+
+  g_mutex_lock (&storage->lock);
+  stats = g_strdup_printf ("%u segments, %" G_GUINT64_FORMAT " of %"
+      G_GUINT64_FORMAT " bytes used, %" G_GUINT64_FORMAT " evicted\n%"
+      G_GUINT64_FORMAT " bytes written, %" G_GUINT64_FORMAT
+      " syncs, slowest write %.1f ms\n",
+      g_queue_get_length (&storage->segments), storage->used,
+      storage->max_size, storage->evicted, storage->written, storage->syncs,
+      storage->write_max);
+  g_mutex_unlock (&storage->lock);
+
+  return stats;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSegmentStorage: Sink writing a recording as fixed duration segment files
+ * into a storage area with a quota, evicting the oldest segments.
+ */
+#ifndef __GST_SEGMENT_STORAGE_H__
+#define __GST_SEGMENT_STORAGE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SEGMENT_STORAGE (gst_segment_storage_get_type ())
+#define GST_SEGMENT_STORAGE(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_SEGMENT_STORAGE, GstSegmentStorage))
+#define GST_IS_SEGMENT_STORAGE(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_SEGMENT_STORAGE))
+
+typedef struct _GstSegmentStorage GstSegmentStorage;
+typedef struct _GstSegmentStorageClass GstSegmentStorageClass;
+
+GType gst_segment_storage_get_type (void);
+
+GstElement * gst_segment_storage_new (GstClockTime segment_duration,
+    guint64 max_size, guint64 max_age);
+gchar ** gst_segment_storage_find_segments (const gchar * directory,
+    gint64 start, gint64 end, gint64 ** starts);
+GstClockTime * gst_segment_storage_get_timeline (gchar ** segments,
+    const gint64 * starts);
+gchar * gst_segment_storage_get_current_location (
+    GstSegmentStorage * storage);
+gboolean gst_segment_storage_is_writing (const gchar * location);
+gchar * gst_segment_storage_get_stats (GstSegmentStorage * storage);
+
+G_END_DECLS
+
+#endif /* __GST_SEGMENT_STORAGE_H__ */
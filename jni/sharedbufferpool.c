@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSharedBufferPool: Video buffer pool allocating from process wide pools
+ * shared by all pipelines producing the same kind of frames.
+ *
+ * A buffer pool can only be activated and deactivated by a single user, so
+ * every element gets a GstSharedBufferPool of its own. Once configured, it
+ * hands out buffers from a backing GstVideoBufferPool looked up by format,
+ * size and buffer size in a process wide registry. Backing pools are bounded,
+ * when one is exhausted the buffer is allocated locally instead of blocking
+ * the streaming thread. Configurations the backing pools can not serve (e.g.
+ * padded frames) are allocated locally as well.
+ */
+#include <string.h>
+#include <gst/video/video.h>
+
+#include "sharedbufferpool.h"
+
+/* Upper limit of the memory held by a single backing pool */
+#define DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+#define MIN_BUFFERS 4
+#define MAX_BUFFERS 64
+
+typedef struct
+{
+  gchar *key;
+  GstBufferPool *pool;          /* Backing pool, always active */
+  gint users;                   /* Number of GstSharedBufferPool using it */
+  GHashTable *allocated;        /* Buffers ever handed out by the pool */
+  guint max_buffers;
+  guint64 acquired;             /* Buffers acquired from the pool */
+  guint64 fallbacks;            /* Allocated locally, pool was exhausted */
+} GstSharedPoolEntry;
+
+struct _GstSharedBufferPool
+{
+  GstVideoBufferPool parent;
+
+  GstSharedPoolEntry *entry;    /* NULL when allocating locally */
+};
+
+struct _GstSharedBufferPoolClass
+{
+  GstVideoBufferPoolClass parent_class;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GMutex registry_lock;
+static GHashTable *entries;     /* Key -> GstSharedPoolEntry */
+static guint64 max_bytes = DEFAULT_MAX_BYTES;
+static GQuark backing_quark;
+
+static void gst_shared_buffer_pool_finalize (GObject * obj);
+static gboolean gst_shared_buffer_pool_set_config (GstBufferPool * pool,
+    GstStructure * config);
+static gboolean gst_shared_buffer_pool_start (GstBufferPool * pool);
+static GstFlowReturn gst_shared_buffer_pool_acquire_buffer (
+    GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params);
+static void gst_shared_buffer_pool_release_buffer (GstBufferPool * pool,
+    GstBuffer * buffer);
+
+G_DEFINE_TYPE (GstSharedBufferPool, gst_shared_buffer_pool,
+    GST_TYPE_VIDEO_BUFFER_POOL);
+
+static void
+gst_shared_buffer_pool_class_init (GstSharedBufferPoolClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstBufferPoolClass *pool_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+  gobject_class->finalize = gst_shared_buffer_pool_finalize;
+
+  pool_class->set_config = gst_shared_buffer_pool_set_config;
+  pool_class->start = gst_shared_buffer_pool_start;
+  pool_class->acquire_buffer = gst_shared_buffer_pool_acquire_buffer;
+  pool_class->release_buffer = gst_shared_buffer_pool_release_buffer;
+
+  backing_quark = g_quark_from_static_string ("GstSharedBufferPoolBacking");
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "sharedbufferpool", 0,
+      "Shared Buffer Pool");
+  gst_debug_set_threshold_for_name ("sharedbufferpool", GST_LEVEL_DEBUG);
+}
+
+static void
+gst_shared_buffer_pool_init (GstSharedBufferPool * self)
+{
+}
+
+static GstSharedPoolEntry *
+entry_acquire (GstCaps * caps, guint size)
+{
+  GstSharedPoolEntry *entry;
+  GstVideoInfo vinfo;
+  GstStructure *config;
+  gchar *key;
+
+  if (!gst_video_info_from_caps (&vinfo, caps))
+    return NULL;
+
+  key = g_strdup_printf ("%s %dx%d %u",
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&vinfo)),
+      GST_VIDEO_INFO_WIDTH (&vinfo), GST_VIDEO_INFO_HEIGHT (&vinfo), size);
+
+  g_mutex_lock (&registry_lock);
+
+  if (entries == NULL)
+    entries = g_hash_table_new (g_str_hash, g_str_equal);
+
+  entry = g_hash_table_lookup (entries, key);
+  if (entry != NULL) {
+    entry->users++;
+    g_mutex_unlock (&registry_lock);
+    g_free (key);
+    return entry;
+  }
+
+  entry = g_new0 (GstSharedPoolEntry, 1);
+  entry->key = key;
+  entry->users = 1;
+  entry->allocated = g_hash_table_new (g_direct_hash, g_direct_equal);
+  entry->max_buffers = CLAMP (max_bytes / size, MIN_BUFFERS, MAX_BUFFERS);
+
+  entry->pool = gst_video_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (entry->pool);
+  gst_buffer_pool_config_set_params (config, caps, size, 0,
+      entry->max_buffers);
+  gst_buffer_pool_config_add_option (config,
+      GST_BUFFER_POOL_OPTION_VIDEO_META);
+  if (!gst_buffer_pool_set_config (entry->pool, config) ||
+      !gst_buffer_pool_set_active (entry->pool, TRUE)) {
+    GST_WARNING ("Could not configure backing pool for %s", key);
+    gst_object_unref (entry->pool);
+    g_hash_table_destroy (entry->allocated);
+    g_free (entry->key);
+    g_free (entry);
+    g_mutex_unlock (&registry_lock);
+    return NULL;
+  }
+
+  GST_DEBUG ("New backing pool for %s, at most %u buffers", key,
+      entry->max_buffers);
+  g_hash_table_insert (entries, entry->key, entry);
+
+  g_mutex_unlock (&registry_lock);
+
+  return entry;
+}
+
+static void
+entry_release (GstSharedPoolEntry * entry)
+{
+  g_mutex_lock (&registry_lock);
+  if (--entry->users > 0) {
+    g_mutex_unlock (&registry_lock);
+    return;
+  }
+  g_hash_table_remove (entries, entry->key);
+  g_mutex_unlock (&registry_lock);
+
+  GST_DEBUG ("Freeing backing pool for %s: %u buffers, %" G_GUINT64_FORMAT
+      " acquired, %" G_GUINT64_FORMAT " fallbacks", entry->key,
+      g_hash_table_size (entry->allocated), entry->acquired,
+      entry->fallbacks);
+
+  /* Buffers still in use are freed when they come back */
+  gst_buffer_pool_set_active (entry->pool, FALSE);
+  gst_object_unref (entry->pool);
+  g_hash_table_destroy (entry->allocated);
+  g_free (entry->key);
+  g_free (entry);
+}
+
+static void
+gst_shared_buffer_pool_finalize (GObject * obj)
+{
+  GstSharedBufferPool *self = GST_SHARED_BUFFER_POOL (obj);
+
+  if (self->entry != NULL) {
+    entry_release (self->entry);
+    self->entry = NULL;
+  }
+
+  G_OBJECT_CLASS (gst_shared_buffer_pool_parent_class)->finalize (obj);
+}
+
+static gboolean
+gst_shared_buffer_pool_set_config (GstBufferPool * pool,
+    GstStructure * config)
+{
+  GstSharedBufferPool *self = GST_SHARED_BUFFER_POOL (pool);
+  GstCaps *caps;
+  guint size;
+  guint min;
+  guint max;
+
+  if (!gst_buffer_pool_config_get_params (config, &caps, &size, &min, &max))
+    return FALSE;
+
+  if (self->entry != NULL) {
+    entry_release (self->entry);
+    self->entry = NULL;
+  }
+
+  /* Backing pools only have plain frames, padded or aligned frames are
+   * allocated by the parent class */
+  if (caps != NULL && !gst_buffer_pool_config_has_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT))
+    self->entry = entry_acquire (caps, size);
+
+  return GST_BUFFER_POOL_CLASS (gst_shared_buffer_pool_parent_class)->set_config
+      (pool, config);
+}
+
+static gboolean
+gst_shared_buffer_pool_start (GstBufferPool * pool)
+{
+  GstSharedBufferPool *self = GST_SHARED_BUFFER_POOL (pool);
+
+  /* Do not preallocate anything, the backing pool already has buffers */
+  if (self->entry != NULL)
+    return TRUE;
+
+  return GST_BUFFER_POOL_CLASS (gst_shared_buffer_pool_parent_class)->start
+      (pool);
+}
+
+static GstFlowReturn
+gst_shared_buffer_pool_acquire_buffer (GstBufferPool * pool,
+    GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
+{
+  GstSharedBufferPool *self = GST_SHARED_BUFFER_POOL (pool);
+  GstSharedPoolEntry *entry = self->entry;
+  GstBufferPoolAcquireParams shared_params = { 0, };
+  GstFlowReturn ret;
+
+  if (entry == NULL)
+    goto local;
+
+  if (GST_BUFFER_POOL_IS_FLUSHING (pool))
+    return GST_FLOW_FLUSHING;
+
+  if (params != NULL)
+    shared_params = *params;
+  shared_params.flags |= GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+  ret = gst_buffer_pool_acquire_buffer (entry->pool, buffer, &shared_params);
+  if (ret != GST_FLOW_OK) {
+    g_mutex_lock (&registry_lock);
+    entry->fallbacks++;
+    g_mutex_unlock (&registry_lock);
+    GST_LOG ("Backing pool for %s exhausted, allocating locally", entry->key);
+    goto local;
+  }
+
+  g_mutex_lock (&registry_lock);
+  entry->acquired++;
+  g_hash_table_add (entry->allocated, *buffer);
+  g_mutex_unlock (&registry_lock);
+
+  /* The buffer is handed out as ours, gst_buffer_pool_acquire_buffer() sets
+   * the pool field. Remember where it has to go back, see
+   * gst_shared_buffer_pool_release_buffer(). */
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (*buffer), backing_quark,
+      entry->pool, NULL);
+  gst_object_unref ((*buffer)->pool);
+  (*buffer)->pool = NULL;
+
+  return GST_FLOW_OK;
+
+local:
+  return GST_BUFFER_POOL_CLASS (gst_shared_buffer_pool_parent_class)->
+      acquire_buffer (pool, buffer, params);
+}
+
+static void
+gst_shared_buffer_pool_release_buffer (GstBufferPool * pool,
+    GstBuffer * buffer)
+{
+  GstBufferPool *backing;
+
+  backing = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+      backing_quark);
+  if (backing != NULL) {
+    buffer->pool = gst_object_ref (backing);
+    gst_buffer_pool_release_buffer (backing, buffer);
+    return;
+  }
+
+  GST_BUFFER_POOL_CLASS (gst_shared_buffer_pool_parent_class)->release_buffer
+      (pool, buffer);
+}
+
+GstBufferPool *
+gst_shared_buffer_pool_new (void)
+{
+  return g_object_new (GST_TYPE_SHARED_BUFFER_POOL, NULL);
+}
+
+/**
+ * gst_shared_buffer_pool_propose:
+ * @query: an answered allocation #GstQuery
+ *
+ * Makes a #GstSharedBufferPool the preferred pool of @query, if the caps are
+ * plain system memory video frames.
+ *
+ * Returns: TRUE if the query was changed.
+ */
+gboolean
+gst_shared_buffer_pool_propose (GstQuery * query)
+{
+  GstBufferPool *pool;
+  GstCapsFeatures *features;
+  GstVideoInfo vinfo;
+  GstCaps *caps;
+  gboolean need_pool;
+  guint size;
+  guint min = 0;
+  guint max = 0;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (caps == NULL || !gst_video_info_from_caps (&vinfo, caps))
+    return FALSE;
+
+  /* Leave GL and other special memory alone */
+  features = gst_caps_get_features (caps, 0);
+  if (features != NULL && !gst_caps_features_is_equal (features,
+          GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))
+    return FALSE;
+
+  size = GST_VIDEO_INFO_SIZE (&vinfo);
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, NULL, &size, &min, &max);
+    size = MAX (size, GST_VIDEO_INFO_SIZE (&vinfo));
+  }
+
+  pool = gst_shared_buffer_pool_new ();
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+  gst_object_unref (pool);
+
+  return TRUE;
+}
+
+/**
+ * gst_shared_buffer_pool_set_max_bytes:
+ * @bytes: memory limit
+ *
+ * Limits the memory each backing pool created from now on may hold.
+ */
+void
+gst_shared_buffer_pool_set_max_bytes (guint64 bytes)
+{
+  g_mutex_lock (&registry_lock);
+  max_bytes = bytes;
+  g_mutex_unlock (&registry_lock);
+}
+
+/**
+ * gst_shared_buffer_pool_get_stats:
+ *
+ * Describes the usage of every backing pool, one line each.
+ *
+ * Returns: (transfer full): the statistics, free with g_free().
+ */
+gchar *
+gst_shared_buffer_pool_get_stats (void)
+{
+  GString *stats;
+  GHashTableIter iter;
+  gpointer value;
+
+  stats = g_string_new (NULL);
+
+  g_mutex_lock (&registry_lock);
+  if (entries != NULL) {
+    g_hash_table_iter_init (&iter, entries);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      GstSharedPoolEntry *entry = value;
+      guint allocated = g_hash_table_size (entry->allocated);
+      guint64 total = entry->acquired + entry->fallbacks;
+      gdouble reuse = 0.0;
+
+      if (total > 0)
+        reuse = 100.0 * (entry->acquired - allocated) / total;
+
+      g_string_append_printf (stats, "%s: %d users, %u/%u buffers, "
+          "%.1f%% reused, %" G_GUINT64_FORMAT " fallbacks\n", entry->key,
+          entry->users, allocated, entry->max_buffers, reuse,
+          entry->fallbacks);
+    }
+  }
+  g_mutex_unlock (&registry_lock);
+
+  return g_string_free (stats, FALSE);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSharedBufferPool: Video buffer pool allocating from process wide pools
+ * shared by all pipelines producing the same kind of frames.
+ */
+#ifndef __GST_SHARED_BUFFER_POOL_H__
+#define __GST_SHARED_BUFFER_POOL_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideopool.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SHARED_BUFFER_POOL (gst_shared_buffer_pool_get_type ())
+#define GST_SHARED_BUFFER_POOL(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_SHARED_BUFFER_POOL, GstSharedBufferPool))
+#define GST_IS_SHARED_BUFFER_POOL(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_SHARED_BUFFER_POOL))
+
+typedef struct _GstSharedBufferPool GstSharedBufferPool;
+typedef struct _GstSharedBufferPoolClass GstSharedBufferPoolClass;
+
+GType gst_shared_buffer_pool_get_type (void);
+
+GstBufferPool * gst_shared_buffer_pool_new (void);
+gboolean gst_shared_buffer_pool_propose (GstQuery * query);
+void gst_shared_buffer_pool_set_max_bytes (guint64 max_bytes);
+gchar * gst_shared_buffer_pool_get_stats (void);
+
+G_END_DECLS
+
+#endif /* __GST_SHARED_BUFFER_POOL_H__ */
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSharedSrc: Source of a viewer watching a camera through a shared
+ * stream, see streamregistry.c.
+ *
+ * The element handles "shared://" URIs. It is a bin with one appsrc for the
+ * decoded video and one for the decoded audio of the camera, both fed by the
+ * producer of the shared stream. Which of them get a pad is only known once
+ * the producer has seen the streams of the camera, so the pads appear then,
+ * see gst_shared_src_set_streams().
+ */
+#include <gst/app/gstappsrc.h>
+
+#include "sharedsrc.h"
+
+#define SHARED_SCHEME "shared"
+
+struct _GstSharedSrc
+{
+  GstBin parent;
+
+  GstElement *video;
+  GstElement *audio;
+
+  GMutex lock;                  /* Protects everything below */
+  gboolean known;               /* The streams of the camera are known */
+  gboolean has_audio;
+  gboolean started;             /* Got to PAUSED */
+  gboolean exposed;             /* The pads were added */
+};
+
+struct _GstSharedSrcClass
+{
+  GstBinClass parent_class;
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static GstStaticPadTemplate video_template = GST_STATIC_PAD_TEMPLATE ("video",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS ("video/x-raw"));
+
+static GstStaticPadTemplate audio_template = GST_STATIC_PAD_TEMPLATE ("audio",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS ("audio/x-raw"));
+
+static void gst_shared_src_finalize (GObject * obj);
+static GstStateChangeReturn gst_shared_src_change_state (GstElement *
+    element, GstStateChange transition);
+static void gst_shared_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstSharedSrc, gst_shared_src, GST_TYPE_BIN,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        gst_shared_src_uri_handler_init));
+
+static void
+gst_shared_src_class_init (GstSharedSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_shared_src_finalize;
+  element_class->change_state = gst_shared_src_change_state;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&video_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&audio_template));
+  gst_element_class_set_static_metadata (element_class,
+      "Shared source", "Source/Video",
+      "Plays the decoded frames of a camera shared with other viewers",
+      "Ognyan Tonchev <otonchev at gmail.com>");
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "sharedsrc", 0, "Shared Source");
+  gst_debug_set_threshold_for_name ("sharedsrc", GST_LEVEL_DEBUG);
+}
+
+static GstElement *
+make_appsrc (GstSharedSrc * self, const gchar * name)
+{
+  GstElement *appsrc;
+
+  /* The frames are restamped with the running time of the viewer */
+  appsrc = gst_element_factory_make ("appsrc", name);
+  g_object_set (appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME,
+      "do-timestamp", TRUE, NULL);
+  gst_bin_add (GST_BIN (self), appsrc);
+
+  return appsrc;
+}
+
+static void
+gst_shared_src_init (GstSharedSrc * self)
+{
+  g_mutex_init (&self->lock);
+
+  self->video = make_appsrc (self, "video");
+  self->audio = make_appsrc (self, "audio");
+}
+
+static void
+gst_shared_src_finalize (GObject * obj)
+{
+  GstSharedSrc *self = GST_SHARED_SRC (obj);
+
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_shared_src_parent_class)->finalize (obj);
+}
+
+static void
+add_pad (GstSharedSrc * self, GstElement * appsrc, const gchar * name)
+{
+  GstPad *pad;
+  GstPad *ghost;
+
+  pad = gst_element_get_static_pad (appsrc, "src");
+  ghost = gst_ghost_pad_new_from_template (name, pad,
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self),
+          name));
+  gst_object_unref (pad);
+
+  gst_pad_set_active (ghost, TRUE);
+  gst_element_add_pad (GST_ELEMENT (self), ghost);
+}
+
+/* Adds the pads once the element runs and the streams are known. Adding
+ * them from the source-setup of uridecodebin already would make it miss
+ * no-more-pads. */
+static void
+expose (GstSharedSrc * self)
+{
+  gboolean audio;
+
+  g_mutex_lock (&self->lock);
+  if (!self->known || !self->started || self->exposed) {
+    g_mutex_unlock (&self->lock);
+    return;
+  }
+  self->exposed = TRUE;
+  audio = self->has_audio;
+  g_mutex_unlock (&self->lock);
+
+  GST_DEBUG_OBJECT (self, "Exposing video%s", audio ? " and audio" : "");
+
+  add_pad (self, self->video, "video");
+  if (audio)
+    add_pad (self, self->audio, "audio");
+  gst_element_no_more_pads (GST_ELEMENT (self));
+}
+
+static void
+remove_pads (GstSharedSrc * self)
+{
+  GList *pads;
+  GList *walk;
+
+  GST_OBJECT_LOCK (self);
+  pads = g_list_copy_deep (GST_ELEMENT (self)->srcpads,
+      (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  for (walk = pads; walk != NULL; walk = walk->next) {
+    gst_pad_set_active (walk->data, FALSE);
+    gst_element_remove_pad (GST_ELEMENT (self), walk->data);
+  }
+  g_list_free_full (pads, gst_object_unref);
+}
+
+static GstStateChangeReturn
+gst_shared_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstSharedSrc *self = GST_SHARED_SRC (element);
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (gst_shared_src_parent_class)->change_state
+      (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      g_mutex_lock (&self->lock);
+      self->started = TRUE;
+      g_mutex_unlock (&self->lock);
+      expose (self);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      g_mutex_lock (&self->lock);
+      self->started = FALSE;
+      self->exposed = FALSE;
+      g_mutex_unlock (&self->lock);
+      remove_pads (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static GstURIType
+gst_shared_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+gst_shared_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { SHARED_SCHEME, NULL };
+
+  return protocols;
+}
+
+static gchar *
+gst_shared_src_uri_get_uri (GstURIHandler * handler)
+{
+  return g_strdup (SHARED_SCHEME "://");
+}
+
+/* The stream is picked by the viewer, see gst_stream_registry_attach() */
+static gboolean
+gst_shared_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  if (!g_str_has_prefix (uri, SHARED_SCHEME "://")) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid shared URI %s", uri);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_shared_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = gst_shared_src_uri_get_type;
+  iface->get_protocols = gst_shared_src_uri_get_protocols;
+  iface->get_uri = gst_shared_src_uri_get_uri;
+  iface->set_uri = gst_shared_src_uri_set_uri;
+}
+
+/**
+ * gst_shared_src_register:
+ *
+ * Registers the element, so that playbin plays shared:// URIs.
+ *
+ * Returns: TRUE on success.
+ */
+gboolean
+gst_shared_src_register (void)
+{
+  static gsize registered = 0;
+
+  if (g_once_init_enter (&registered)) {
+    gboolean ok;
+
+    ok = gst_element_register (NULL, "sharedsrc", GST_RANK_PRIMARY,
+        GST_TYPE_SHARED_SRC);
+
+    g_once_init_leave (&registered, ok ? 1 : 2);
+  }
+
+  return registered == 1;
+}
+
+/**
+ * gst_shared_src_get_video:
+ * @src: a #GstSharedSrc
+ *
+ * Returns: (transfer none): the appsrc taking the decoded video frames.
+ */
+GstElement *
+gst_shared_src_get_video (GstSharedSrc * src)
+{
+  g_return_val_if_fail (GST_IS_SHARED_SRC (src), NULL);
+
+  return src->video;
+}
+
+/**
+ * gst_shared_src_get_audio:
+ * @src: a #GstSharedSrc
+ *
+ * Returns: (transfer none): the appsrc taking the decoded audio.
+ */
+GstElement *
+gst_shared_src_get_audio (GstSharedSrc * src)
+{
+  g_return_val_if_fail (GST_IS_SHARED_SRC (src), NULL);
+
+  return src->audio;
+}
+
+/**
+ * gst_shared_src_set_streams:
+ * @src: a #GstSharedSrc
+ * @audio: the camera sends audio too
+ *
+ * Tells @src which streams the camera sends. Its pads are added right away
+ * if it runs already, or else once it gets to PAUSED.
+ */
+void
+gst_shared_src_set_streams (GstSharedSrc * src, gboolean audio)
+{
+  g_return_if_fail (GST_IS_SHARED_SRC (src));
+
+  g_mutex_lock (&src->lock);
+  src->known = TRUE;
+  src->has_audio = audio;
+  g_mutex_unlock (&src->lock);
+
+  expose (src);
+}
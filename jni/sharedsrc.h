@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSharedSrc: Source of a viewer watching a camera through a shared
+ * stream, see streamregistry.c.
+ */
+#ifndef __GST_SHARED_SRC_H__
+#define __GST_SHARED_SRC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SHARED_SRC (gst_shared_src_get_type ())
+#define GST_SHARED_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_SHARED_SRC, GstSharedSrc))
+#define GST_IS_SHARED_SRC(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_SHARED_SRC))
+
+typedef struct _GstSharedSrc GstSharedSrc;
+typedef struct _GstSharedSrcClass GstSharedSrcClass;
+
+GType gst_shared_src_get_type (void);
+
+gboolean gst_shared_src_register (void);
+GstElement * gst_shared_src_get_video (GstSharedSrc * src);
+GstElement * gst_shared_src_get_audio (GstSharedSrc * src);
+void gst_shared_src_set_streams (GstSharedSrc * src, gboolean audio);
+
+G_END_DECLS
+
+#endif /* __GST_SHARED_SRC_H__ */
@@ -0,0 +1,916 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstStreamRegistry: Process wide registry of decoded RTSP streams, letting
+ * several viewers and recorders of the same camera share one connection and
+ * one decoder.
+ *
+ * A shared stream is a producer GstRTSPViewer whose video and audio sinks
+ * are appsinks. Every consumer viewer plays "shared://" instead of the camera
+ * URI (see sharedsrc.c) and the decoded frames and audio are fanned out to
+ * the appsrcs of each consumer, so only the rendering is done per viewer.
+ * Streams are looked up by URI and credentials and reference counted, the
+ * producer pipeline is shut down together with the last consumer, from the
+ * registry thread that watches its bus.
+ *
+ * The first viewer of a camera connects by itself, a producer would only add
+ * a pipeline. It announces that with gst_stream_registry_watch(). Once a
+ * second viewer or a recorder acquires the camera, the viewers playing it
+ * directly are asked to move over to the shared stream.
+ *
+ * Recorders consume the compressed stream instead. It is tapped right after
+ * the parser inside the producer, before the decoder, and the frames are
+ * pushed to the recorder's appsrc starting at a keyframe, so recording a
+ * camera that is being watched costs neither a second connection nor a
+ * second decoder. While nobody watches, the frames are not handed to the
+ * decoder at all.
+ */
+#include <string.h>
+#include <pthread.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+#include "streamregistry.h"
+#include "rtspstreamer.h"
+#include "rtspviewer.h"
+#include "sharedsrc.h"
+
+typedef struct
+{
+  gpointer owner;               /* Viewer the consumer belongs to */
+  GstElement *appsrc;           /* Current source of the viewer, or NULL */
+  GstElement *audio;            /* Its audio source, NULL for recorders */
+  GstSharedSrc *src;            /* Holding both, NULL for recorders */
+  gboolean encoded;             /* Takes the compressed frames */
+  gboolean started;             /* Got its first keyframe */
+  GstClockTime base;            /* Timestamp of that keyframe */
+} GstSharedConsumer;
+
+struct _GstSharedStream
+{
+  gint ref_count;               /* Number of viewers holding the stream */
+  gchar *key;
+  GObject *viewer;              /* Producer, owns the pipeline */
+  GstElement *pipeline;
+  GstElement *appsink;
+  GstElement *audio_appsink;
+  GMutex lock;                  /* Protects consumers and caps */
+  GList *consumers;             /* List of GstSharedConsumer */
+  gboolean streams_known;       /* The producer linked all streams */
+  gboolean has_audio;
+  GstCaps *caps;                /* Caps of the decoded frames */
+  GstCaps *audio_caps;
+  GstCaps *encoded_caps;        /* Caps of the compressed frames */
+  gboolean need_keyframe;       /* Decoder skipped frames */
+  GstState state;               /* State requested for the producer */
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Compressed frames queued for a recorder before it has to resync */
+#define MAX_ENCODED_LEVEL (4 * 1024 * 1024)
+/* Audio queued for a viewer before it is dropped */
+#define MAX_AUDIO_LEVEL (64 * 1024)
+
+typedef struct
+{
+  gpointer owner;               /* Viewer playing the camera directly */
+  GstStreamRegistryFunc func;   /* Moves it to the shared stream */
+} GstStreamWatcher;
+
+static GMutex registry_lock;
+static GHashTable *streams;     /* Key -> GstSharedStream */
+static GMainContext *context;   /* Runs the bus watches of all producers */
+static GMainLoop *main_loop;
+static pthread_t registry_thread;
+static GRecMutex watch_lock;    /* Held while watchers are moved */
+static GHashTable *watchers;    /* Key -> GstStreamWatcher */
+
+static void shared_stream_unref (GstSharedStream * stream);
+
+static void *
+thread_function (void *user_data)
+{
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (main_loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+/* Must be called with the registry lock held */
+static void
+ensure_registry_unlocked (void)
+{
+  if (streams != NULL)
+    return;
+
+  GST_DEBUG_CATEGORY_INIT (debug_category, "streamregistry", 0,
+      "Stream Registry");
+  gst_debug_set_threshold_for_name ("streamregistry", GST_LEVEL_DEBUG);
+
+  streams = g_hash_table_new (g_str_hash, g_str_equal);
+  watchers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  context = g_main_context_new ();
+  main_loop = g_main_loop_new (context, FALSE);
+  pthread_create (&registry_thread, NULL, &thread_function, NULL);
+}
+
+static gchar *
+make_key (const gchar * uri, const gchar * user, const gchar * pass)
+{
+  return g_strdup_printf ("%s\n%s\n%s", uri, user ? user : "",
+      pass ? pass : "");
+}
+
+/* Forward the error to every consumer so that each player reports it and
+ * stops, just like it would with a pipeline of its own */
+static void
+error_cb (GstBus * bus, GstMessage * msg, gpointer user_data)
+{
+  GstSharedStream *stream = (GstSharedStream *) user_data;
+  GError *err;
+  gchar *debug_info;
+  GList *walk;
+
+  gst_message_parse_error (msg, &err, &debug_info);
+
+  GST_WARNING ("Shared stream failed: %s", err->message);
+
+  /* Do not hand out the broken stream to new viewers anymore, and keep it
+   * alive while the consumers are notified */
+  g_mutex_lock (&registry_lock);
+  if (g_hash_table_lookup (streams, stream->key) == stream)
+    g_hash_table_remove (streams, stream->key);
+  stream->ref_count++;
+  g_mutex_unlock (&registry_lock);
+
+  g_mutex_lock (&stream->lock);
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    GstSharedConsumer *consumer = walk->data;
+
+    if (consumer->appsrc != NULL)
+      GST_ELEMENT_ERROR (consumer->appsrc, RESOURCE, READ, ("%s",
+              err->message), ("%s", debug_info));
+  }
+  g_mutex_unlock (&stream->lock);
+
+  g_clear_error (&err);
+  g_free (debug_info);
+
+  shared_stream_unref (stream);
+}
+
+/* Called from the streaming thread of the producer */
+static GstFlowReturn
+new_sample_cb (GstAppSink * appsink, gpointer user_data)
+{
+  GstSharedStream *stream = (GstSharedStream *) user_data;
+  GstSample *sample;
+  GstCaps *caps;
+  GstBuffer *buffer;
+  gboolean new_caps = FALSE;
+  GList *expose = NULL;
+  GList *walk;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL)
+    return GST_FLOW_EOS;
+
+  /* Consumers restamp the frames with their own running time, the buffer is
+   * pushed to every one of them without copying the data */
+  buffer = gst_buffer_make_writable (gst_buffer_ref (gst_sample_get_buffer
+          (sample)));
+  GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+
+  g_mutex_lock (&stream->lock);
+
+  caps = gst_sample_get_caps (sample);
+  if (caps != NULL && (stream->caps == NULL ||
+      !gst_caps_is_equal (caps, stream->caps))) {
+    GST_DEBUG ("New caps %" GST_PTR_FORMAT, caps);
+    gst_caps_replace (&stream->caps, caps);
+    new_caps = TRUE;
+  }
+
+  /* By the first frame playbin has linked every stream of the camera. The
+   * consumers get their pads once the lock is released, linking them may
+   * call back into the registry. */
+  if (!stream->streams_known) {
+    gint n_audio = 0;
+
+    g_object_get (stream->pipeline, "n-audio", &n_audio, NULL);
+    GST_DEBUG ("Stream %p has %d audio streams", stream, n_audio);
+    stream->streams_known = TRUE;
+    stream->has_audio = n_audio > 0;
+    for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+      GstSharedConsumer *consumer = walk->data;
+
+      if (consumer->src != NULL)
+        expose = g_list_prepend (expose, gst_object_ref (consumer->src));
+    }
+  }
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    GstSharedConsumer *consumer = walk->data;
+    GstAppSrc *appsrc;
+
+    if (consumer->appsrc == NULL || consumer->encoded)
+      continue;
+
+    appsrc = GST_APP_SRC (consumer->appsrc);
+
+    if (new_caps)
+      gst_app_src_set_caps (appsrc, stream->caps);
+
+    /* A paused or slow consumer must not hold frames back */
+    if (gst_app_src_get_current_level_bytes (appsrc) >
+        gst_buffer_get_size (buffer))
+      continue;
+
+    gst_app_src_push_buffer (appsrc, gst_buffer_ref (buffer));
+  }
+
+  g_mutex_unlock (&stream->lock);
+
+  for (walk = expose; walk != NULL; walk = walk->next)
+    gst_shared_src_set_streams (walk->data, stream->has_audio);
+  g_list_free_full (expose, gst_object_unref);
+
+  gst_buffer_unref (buffer);
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+/* Called from the streaming thread of the producer */
+static GstFlowReturn
+new_audio_sample_cb (GstAppSink * appsink, gpointer user_data)
+{
+  GstSharedStream *stream = (GstSharedStream *) user_data;
+  GstSample *sample;
+  GstCaps *caps;
+  GstBuffer *buffer;
+  gboolean new_caps = FALSE;
+  GList *walk;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL)
+    return GST_FLOW_EOS;
+
+  buffer = gst_buffer_make_writable (gst_buffer_ref (gst_sample_get_buffer
+          (sample)));
+  GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+
+  g_mutex_lock (&stream->lock);
+
+  caps = gst_sample_get_caps (sample);
+  if (caps != NULL && (stream->audio_caps == NULL ||
+      !gst_caps_is_equal (caps, stream->audio_caps))) {
+    GST_DEBUG ("New audio caps %" GST_PTR_FORMAT, caps);
+    gst_caps_replace (&stream->audio_caps, caps);
+    new_caps = TRUE;
+  }
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    GstSharedConsumer *consumer = walk->data;
+    GstAppSrc *appsrc;
+
+    if (consumer->audio == NULL)
+      continue;
+
+    appsrc = GST_APP_SRC (consumer->audio);
+
+    if (new_caps)
+      gst_app_src_set_caps (appsrc, stream->audio_caps);
+
+    if (gst_app_src_get_current_level_bytes (appsrc) > MAX_AUDIO_LEVEL)
+      continue;
+
+    gst_app_src_push_buffer (appsrc, gst_buffer_ref (buffer));
+  }
+
+  g_mutex_unlock (&stream->lock);
+
+  gst_buffer_unref (buffer);
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstClockTime
+retime (GstClockTime timestamp, GstClockTime base)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp) || !GST_CLOCK_TIME_IS_VALID (base))
+    return timestamp;
+
+  return timestamp > base ? timestamp - base : 0;
+}
+
+/* Called from the streaming thread of the producer for every compressed
+ * frame, on its way from the parser to the decoder */
+static GstPadProbeReturn
+tap_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstSharedStream *stream = (GstSharedStream *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gboolean keyframe;
+  gboolean decode = FALSE;
+  gboolean new_caps = FALSE;
+  GstCaps *caps;
+  GList *walk;
+
+  keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  caps = gst_pad_get_current_caps (pad);
+
+  g_mutex_lock (&stream->lock);
+
+  if (caps != NULL && (stream->encoded_caps == NULL ||
+      !gst_caps_is_equal (caps, stream->encoded_caps))) {
+    GST_DEBUG ("New compressed caps %" GST_PTR_FORMAT, caps);
+    gst_caps_replace (&stream->encoded_caps, caps);
+    new_caps = TRUE;
+  }
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    GstSharedConsumer *consumer = walk->data;
+    GstAppSrc *appsrc;
+    GstBuffer *copy;
+
+    if (consumer->appsrc == NULL)
+      continue;
+
+    if (!consumer->encoded) {
+      decode = TRUE;
+      continue;
+    }
+
+    appsrc = GST_APP_SRC (consumer->appsrc);
+
+    if (new_caps)
+      gst_app_src_set_caps (appsrc, stream->encoded_caps);
+
+    if (!consumer->started) {
+      if (!keyframe)
+        continue;
+      consumer->started = TRUE;
+      consumer->base = GST_BUFFER_DTS_IS_VALID (buffer) ?
+          GST_BUFFER_DTS (buffer) : GST_BUFFER_PTS (buffer);
+    }
+
+    /* Dropping a single frame would break the recording until the next
+     * keyframe anyway */
+    if (gst_app_src_get_current_level_bytes (appsrc) > MAX_ENCODED_LEVEL) {
+      GST_WARNING ("Recorder %p is too slow, waiting for the next keyframe",
+          consumer->owner);
+      consumer->started = FALSE;
+      continue;
+    }
+
+    /* Shares the memory of the frame */
+    copy = gst_buffer_copy (buffer);
+    GST_BUFFER_PTS (copy) = retime (GST_BUFFER_PTS (buffer), consumer->base);
+    GST_BUFFER_DTS (copy) = retime (GST_BUFFER_DTS (buffer), consumer->base);
+    gst_app_src_push_buffer (appsrc, copy);
+  }
+
+  /* Nobody watches, spare the decoder. Once somebody does again it has to
+   * start with a keyframe. */
+  if (!decode)
+    stream->need_keyframe = TRUE;
+  else if (stream->need_keyframe && keyframe)
+    stream->need_keyframe = FALSE;
+  decode = decode && !stream->need_keyframe;
+
+  g_mutex_unlock (&stream->lock);
+
+  if (caps != NULL)
+    gst_caps_unref (caps);
+
+  return decode ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+static void
+element_added_cb (GstBin * playbin, GstBin * bin, GstElement * element,
+    gpointer user_data)
+{
+  const gchar *klass;
+  GstPad *srcpad;
+
+  klass = gst_element_class_get_metadata (GST_ELEMENT_GET_CLASS (element),
+      GST_ELEMENT_METADATA_KLASS);
+  if (klass == NULL || strstr (klass, "Video") == NULL ||
+      strstr (klass, "Parser") == NULL)
+    return;
+
+  srcpad = gst_element_get_static_pad (element, "src");
+  if (srcpad == NULL)
+    return;
+
+  GST_DEBUG ("Tapping compressed frames after %s", GST_ELEMENT_NAME (element));
+  gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_BUFFER, tap_cb, user_data,
+      NULL);
+  gst_object_unref (srcpad);
+}
+
+static GstSharedStream *
+shared_stream_new (const gchar * key, const gchar * uri, const gchar * user,
+    const gchar * pass, GError ** error)
+{
+  GstSharedStream *stream;
+  GstAppSinkCallbacks callbacks = { NULL, };
+  GstCaps *caps;
+  GstBus *bus;
+
+  stream = g_new0 (GstSharedStream, 1);
+  stream->ref_count = 1;
+  stream->key = g_strdup (key);
+  stream->state = GST_STATE_READY;
+  g_mutex_init (&stream->lock);
+
+  stream->appsink = gst_element_factory_make ("appsink", NULL);
+  caps = gst_caps_new_empty_simple ("video/x-raw");
+  g_object_set (stream->appsink, "caps", caps, "max-buffers", 1, "drop", TRUE,
+      NULL);
+  gst_caps_unref (caps);
+  callbacks.new_sample = new_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (stream->appsink), &callbacks,
+      stream, NULL);
+
+  stream->audio_appsink = gst_element_factory_make ("appsink", NULL);
+  caps = gst_caps_new_empty_simple ("audio/x-raw");
+  g_object_set (stream->audio_appsink, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  callbacks.new_sample = new_audio_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (stream->audio_appsink),
+      &callbacks, stream, NULL);
+
+  stream->viewer = g_object_new (GST_TYPE_RTSP_VIEWER, "video-sink",
+      stream->appsink, NULL);
+  stream->pipeline =
+      gst_rtsp_streamer_create_pipeline (GST_RTSP_STREAMER (stream->viewer),
+      context, error);
+  if (stream->pipeline == NULL) {
+    g_object_unref (stream->viewer);
+    gst_object_unref (stream->audio_appsink);
+    g_mutex_clear (&stream->lock);
+    g_free (stream->key);
+    g_free (stream);
+    return NULL;
+  }
+
+  g_signal_connect (stream->pipeline, "deep-element-added",
+      G_CALLBACK (element_added_cb), stream);
+  /* The audio goes to the consumers as well */
+  g_object_set (stream->pipeline, "audio-sink", stream->audio_appsink, NULL);
+
+  /* The viewer already watches the bus on our context */
+  bus = gst_element_get_bus (stream->pipeline);
+  g_signal_connect (G_OBJECT (bus), "message::error", (GCallback) error_cb,
+      stream);
+  gst_object_unref (bus);
+
+  gst_element_set_state (stream->pipeline, GST_STATE_READY);
+  gst_rtsp_streamer_set_uri (GST_RTSP_STREAMER (stream->viewer), uri, user,
+      pass);
+
+  return stream;
+}
+
+static void
+consumer_clear (GstSharedConsumer * consumer)
+{
+  if (consumer->appsrc != NULL)
+    gst_object_unref (consumer->appsrc);
+  if (consumer->audio != NULL)
+    gst_object_unref (consumer->audio);
+  if (consumer->src != NULL)
+    gst_object_unref (consumer->src);
+  consumer->appsrc = NULL;
+  consumer->audio = NULL;
+  consumer->src = NULL;
+}
+
+/* Runs on the registry thread, so that no bus message of the producer is
+ * being dispatched meanwhile */
+static gboolean
+shared_stream_free (gpointer user_data)
+{
+  GstSharedStream *stream = (GstSharedStream *) user_data;
+  GstBus *bus;
+  GList *walk;
+
+  GST_DEBUG ("Freeing shared stream %p", stream);
+
+  /* Nothing queued during the shutdown may reach the callbacks, the viewer
+   * removes its own bus watch when finalized */
+  bus = gst_element_get_bus (stream->pipeline);
+  g_signal_handlers_disconnect_by_data (bus, stream);
+  gst_bus_set_flushing (bus, TRUE);
+  gst_object_unref (bus);
+
+  gst_element_set_state (stream->pipeline, GST_STATE_NULL);
+  g_object_unref (stream->viewer);
+  gst_object_unref (stream->audio_appsink);
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    consumer_clear (walk->data);
+    g_free (walk->data);
+  }
+  g_list_free (stream->consumers);
+
+  if (stream->caps != NULL)
+    gst_caps_unref (stream->caps);
+  if (stream->audio_caps != NULL)
+    gst_caps_unref (stream->audio_caps);
+  if (stream->encoded_caps != NULL)
+    gst_caps_unref (stream->encoded_caps);
+
+  g_mutex_clear (&stream->lock);
+  g_free (stream->key);
+  g_free (stream);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+shared_stream_unref (GstSharedStream * stream)
+{
+  GSource *source;
+
+  g_mutex_lock (&registry_lock);
+  if (--stream->ref_count > 0) {
+    g_mutex_unlock (&registry_lock);
+    return;
+  }
+  if (g_hash_table_lookup (streams, stream->key) == stream)
+    g_hash_table_remove (streams, stream->key);
+  g_mutex_unlock (&registry_lock);
+
+  /* Also when called from a bus callback, the message being dispatched
+   * still uses the pipeline */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, shared_stream_free, stream, NULL);
+  g_source_attach (source, context);
+  g_source_unref (source);
+}
+
+/* Run the producer only while somebody is actually watching. Must be called
+ * with the stream lock held. */
+static void
+update_state_unlocked (GstSharedStream * stream)
+{
+  GstState state = GST_STATE_READY;
+  GList *walk;
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    if (((GstSharedConsumer *) walk->data)->appsrc != NULL) {
+      state = GST_STATE_PLAYING;
+      break;
+    }
+  }
+
+  if (state != stream->state) {
+    GST_DEBUG ("Setting shared stream %p to %s", stream,
+        gst_element_state_get_name (state));
+    stream->state = state;
+    gst_element_set_state (stream->pipeline, state);
+  }
+}
+
+/**
+ * gst_stream_registry_is_shareable:
+ * @uri: uri
+ *
+ * Live RTSP streams can be shared, anything seekable needs a pipeline of its
+ * own.
+ */
+gboolean
+gst_stream_registry_is_shareable (const gchar * uri)
+{
+  return uri != NULL && (g_str_has_prefix (uri, "rtsp://") ||
+      g_str_has_prefix (uri, "rtspt://") || g_str_has_prefix (uri, "rtsph://")
+      || g_str_has_prefix (uri, "rtsps://"));
+}
+
+/**
+ * gst_stream_registry_acquire:
+ * @uri: uri
+ * @user: user id for the RTSP authentication
+ * @pass: password for the RTSP authentication
+ * @error: #GError or NULL
+ *
+ * Looks up the stream for the given URI and credentials, creating it if
+ * nobody is watching it yet. Must be released with
+ * gst_stream_registry_release().
+ */
+GstSharedStream *
+gst_stream_registry_acquire (const gchar * uri, const gchar * user,
+    const gchar * pass, GError ** error)
+{
+  GstSharedStream *stream;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  key = make_key (uri, user, pass);
+
+  g_rec_mutex_lock (&watch_lock);
+  g_mutex_lock (&registry_lock);
+  ensure_registry_unlocked ();
+
+  stream = g_hash_table_lookup (streams, key);
+  if (stream != NULL) {
+    stream->ref_count++;
+    GST_DEBUG ("Sharing stream %p for %s, %d viewers", stream, uri,
+        stream->ref_count);
+  } else {
+    stream = shared_stream_new (key, uri, user, pass, error);
+    if (stream != NULL) {
+      GST_DEBUG ("New shared stream %p for %s", stream, uri);
+      g_hash_table_insert (streams, stream->key, stream);
+    }
+  }
+
+  g_mutex_unlock (&registry_lock);
+
+  /* The viewer connected by itself moves over to the new stream, it finds
+   * it with gst_stream_registry_lookup() */
+  if (stream != NULL) {
+    GstStreamWatcher *watcher;
+    gchar *watched;
+
+    if (g_hash_table_lookup_extended (watchers, key, (gpointer *) & watched,
+            (gpointer *) & watcher)) {
+      g_hash_table_steal (watchers, key);
+      GST_DEBUG ("Moving %p to shared stream %p", watcher->owner, stream);
+      watcher->func (watcher->owner);
+      g_free (watcher);
+      g_free (watched);
+    }
+  }
+
+  g_rec_mutex_unlock (&watch_lock);
+  g_free (key);
+
+  return stream;
+}
+
+/**
+ * gst_stream_registry_lookup:
+ * @uri: uri
+ * @user: user id for the RTSP authentication
+ * @pass: password for the RTSP authentication
+ *
+ * Like gst_stream_registry_acquire(), but does not create the stream.
+ *
+ * Returns: the stream or NULL if nobody shares it yet.
+ */
+GstSharedStream *
+gst_stream_registry_lookup (const gchar * uri, const gchar * user,
+    const gchar * pass)
+{
+  GstSharedStream *stream;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  key = make_key (uri, user, pass);
+
+  g_mutex_lock (&registry_lock);
+  ensure_registry_unlocked ();
+  stream = g_hash_table_lookup (streams, key);
+  if (stream != NULL)
+    stream->ref_count++;
+  g_mutex_unlock (&registry_lock);
+
+  g_free (key);
+
+  return stream;
+}
+
+/**
+ * gst_stream_registry_watch:
+ * @uri: uri
+ * @user: user id for the RTSP authentication
+ * @pass: password for the RTSP authentication
+ * @owner: viewer playing the camera by itself
+ * @func: called with @owner once the camera is shared
+ *
+ * Announces that @owner connects to the camera directly. The next one to
+ * acquire the camera creates the shared stream and @func is called, from
+ * that thread, for @owner to move over to it. Returns FALSE without
+ * watching if somebody else plays the camera directly already, @owner
+ * should then share it right away.
+ *
+ * Returns: TRUE if @owner may play the camera by itself.
+ */
+gboolean
+gst_stream_registry_watch (const gchar * uri, const gchar * user,
+    const gchar * pass, gpointer owner, GstStreamRegistryFunc func)
+{
+  GstStreamWatcher *watcher;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  key = make_key (uri, user, pass);
+
+  g_rec_mutex_lock (&watch_lock);
+  g_mutex_lock (&registry_lock);
+  ensure_registry_unlocked ();
+  g_mutex_unlock (&registry_lock);
+
+  if (g_hash_table_contains (watchers, key)) {
+    g_rec_mutex_unlock (&watch_lock);
+    g_free (key);
+    return FALSE;
+  }
+
+  watcher = g_new0 (GstStreamWatcher, 1);
+  watcher->owner = owner;
+  watcher->func = func;
+  g_hash_table_insert (watchers, key, watcher);
+
+  g_rec_mutex_unlock (&watch_lock);
+
+  return TRUE;
+}
+
+static gboolean
+is_watcher_of (gpointer key, gpointer value, gpointer user_data)
+{
+  return ((GstStreamWatcher *) value)->owner == user_data;
+}
+
+/**
+ * gst_stream_registry_unwatch:
+ * @owner: viewer passed to gst_stream_registry_watch()
+ *
+ * Stops watching, @owner is not playing the camera directly anymore. Blocks
+ * while @owner is being moved to a shared stream.
+ */
+void
+gst_stream_registry_unwatch (gpointer owner)
+{
+  g_rec_mutex_lock (&watch_lock);
+  if (watchers != NULL)
+    g_hash_table_foreach_remove (watchers, is_watcher_of, owner);
+  g_rec_mutex_unlock (&watch_lock);
+}
+
+static void
+attach_consumer (GstSharedStream * stream, gpointer consumer,
+    GstSharedSrc * src, GstElement * appsrc, gboolean encoded)
+{
+  GstSharedConsumer *found = NULL;
+  GstSharedSrc *expose = NULL;
+  gboolean has_audio;
+  GstCaps *caps;
+  GList *walk;
+
+  g_mutex_lock (&stream->lock);
+
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    if (((GstSharedConsumer *) walk->data)->owner == consumer) {
+      found = walk->data;
+      break;
+    }
+  }
+
+  if (found == NULL) {
+    found = g_new0 (GstSharedConsumer, 1);
+    found->owner = consumer;
+    stream->consumers = g_list_prepend (stream->consumers, found);
+  }
+
+  consumer_clear (found);
+  if (src != NULL) {
+    found->src = gst_object_ref (src);
+    found->audio = gst_object_ref (gst_shared_src_get_audio (src));
+  }
+  found->appsrc = appsrc ? gst_object_ref (appsrc) : NULL;
+  found->encoded = encoded;
+  found->started = FALSE;
+
+  caps = encoded ? stream->encoded_caps : stream->caps;
+  if (appsrc != NULL && caps != NULL)
+    gst_app_src_set_caps (GST_APP_SRC (appsrc), caps);
+  if (found->audio != NULL && stream->audio_caps != NULL)
+    gst_app_src_set_caps (GST_APP_SRC (found->audio), stream->audio_caps);
+  if (src != NULL && stream->streams_known)
+    expose = gst_object_ref (src);
+  has_audio = stream->has_audio;
+
+  update_state_unlocked (stream);
+
+  g_mutex_unlock (&stream->lock);
+
+  /* Adds the pads, the consumer links them right away */
+  if (expose != NULL) {
+    gst_shared_src_set_streams (expose, has_audio);
+    gst_object_unref (expose);
+  }
+}
+
+/**
+ * gst_stream_registry_attach:
+ * @stream: a #GstSharedStream
+ * @consumer: viewer the source belongs to
+ * @src: the "shared://" source of the viewer's pipeline or NULL
+ *
+ * Starts feeding the video and audio of @src, replacing any previous source
+ * of @consumer. Pass NULL once the consumer pipeline stops.
+ */
+void
+gst_stream_registry_attach (GstSharedStream * stream, gpointer consumer,
+    GstElement * src)
+{
+  g_return_if_fail (stream != NULL);
+  g_return_if_fail (src == NULL || GST_IS_SHARED_SRC (src));
+
+  if (src == NULL) {
+    attach_consumer (stream, consumer, NULL, NULL, FALSE);
+    return;
+  }
+
+  attach_consumer (stream, consumer, GST_SHARED_SRC (src),
+      gst_shared_src_get_video (GST_SHARED_SRC (src)), FALSE);
+}
+
+/**
+ * gst_stream_registry_attach_encoded:
+ * @stream: a #GstSharedStream
+ * @consumer: recorder the source belongs to
+ * @appsrc: the appsrc of the recorder's pipeline or NULL
+ *
+ * Like gst_stream_registry_attach(), but feeds @appsrc with the compressed
+ * frames as they come out of the parser, starting at the next keyframe and
+ * timestamped from there.
+ */
+void
+gst_stream_registry_attach_encoded (GstSharedStream * stream,
+    gpointer consumer, GstElement * appsrc)
+{
+  g_return_if_fail (stream != NULL);
+
+  if (appsrc != NULL) {
+    g_object_set (appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME,
+        "do-timestamp", FALSE, NULL);
+  }
+
+  attach_consumer (stream, consumer, NULL, appsrc, TRUE);
+}
+
+/**
+ * gst_stream_registry_release:
+ * @stream: a #GstSharedStream
+ * @consumer: viewer or recorder releasing the stream
+ *
+ * Detaches @consumer and drops its reference. The producer pipeline is shut
+ * down together with the last consumer.
+ */
+void
+gst_stream_registry_release (GstSharedStream * stream, gpointer consumer)
+{
+  GList *walk;
+
+  g_return_if_fail (stream != NULL);
+
+  g_mutex_lock (&stream->lock);
+  for (walk = stream->consumers; walk != NULL; walk = walk->next) {
+    GstSharedConsumer *found = walk->data;
+
+    if (found->owner == consumer) {
+      consumer_clear (found);
+      g_free (found);
+      stream->consumers = g_list_delete_link (stream->consumers, walk);
+      break;
+    }
+  }
+  update_state_unlocked (stream);
+  g_mutex_unlock (&stream->lock);
+
+  shared_stream_unref (stream);
+}
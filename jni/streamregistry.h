@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstStreamRegistry: Process wide registry of decoded RTSP streams, letting
+ * several viewers and recorders of the same camera share one connection and
+ * one decoder.
+ */
+#ifndef __GST_STREAM_REGISTRY_H__
+#define __GST_STREAM_REGISTRY_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstSharedStream GstSharedStream;
+
+typedef void (*GstStreamRegistryFunc) (gpointer owner);
+
+gboolean gst_stream_registry_is_shareable (const gchar * uri);
+GstSharedStream * gst_stream_registry_acquire (const gchar * uri,
+    const gchar * user, const gchar * pass, GError ** error);
+GstSharedStream * gst_stream_registry_lookup (const gchar * uri,
+    const gchar * user, const gchar * pass);
+gboolean gst_stream_registry_watch (const gchar * uri, const gchar * user,
+    const gchar * pass, gpointer owner, GstStreamRegistryFunc func);
+void gst_stream_registry_unwatch (gpointer owner);
+void gst_stream_registry_attach (GstSharedStream * stream, gpointer consumer,
+    GstElement * src);
+void gst_stream_registry_attach_encoded (GstSharedStream * stream,
+    gpointer consumer, GstElement * appsrc);
+void gst_stream_registry_release (GstSharedStream * stream,
+    gpointer consumer);
+
+G_END_DECLS
+
+#endif /* __GST_STREAM_REGISTRY_H__ */
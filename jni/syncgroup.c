@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSyncGroup: Presents the frames of several live pipelines aligned to the
+ * time the cameras captured them.
+ *
+ * Every pipeline of the group runs on the same realtime clock with the same
+ * base time, so a running time means the same instant in all of them. Their
+ * rtspsrc map the RTP timestamps to the NTP capture time the cameras report
+ * in their RTCP sender reports (see the "ntp-sync" property of
+ * GstRTSPViewer), and all of them render with the same fixed latency, the
+ * bound of the group: a frame captured at some instant is presented at that
+ * instant plus the bound in every tile.
+ *
+ * Frames arriving later than that can not be aligned anymore. How late the
+ * frames of each pipeline arrive is measured at its video sink, the spread
+ * between the pipelines is the residual skew of the group.
+ */
+#include "syncgroup.h"
+
+typedef struct
+{
+  GstElement *pipeline;
+  GstPad *pad;                  /* Sink pad of the video sink */
+  gulong probe;
+
+  /* Statistics */
+  guint64 frames;
+  guint64 late;                 /* Arrived after their presentation time */
+  gdouble lateness_avg;         /* Moving average, milliseconds */
+  gdouble lateness_max;
+} GstSyncMember;
+
+struct _GstSyncGroup
+{
+  gint ref_count;
+  GMutex lock;                  /* Protects members */
+  GstClock *clock;
+  GstClockTime base_time;
+  GstClockTime bound;
+  GList *members;               /* List of GstSyncMember */
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Must be called with the lock held */
+static GstSyncMember *
+find_member_unlocked (GstSyncGroup * group, GstElement * pipeline,
+    GstPad * pad)
+{
+  GList *walk;
+
+  for (walk = group->members; walk != NULL; walk = walk->next) {
+    GstSyncMember *member = walk->data;
+
+    if (member->pipeline == pipeline || (pad != NULL && member->pad == pad))
+      return member;
+  }
+
+  return NULL;
+}
+
+static GstPadProbeReturn
+buffer_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstSyncGroup *group = (GstSyncGroup *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstSyncMember *member;
+  GstClockTime running_time;
+  gdouble lateness = 0.0;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  running_time = gst_clock_get_time (group->clock) - group->base_time;
+  if (running_time > GST_BUFFER_PTS (buffer) + group->bound)
+    lateness = (gdouble) (running_time - GST_BUFFER_PTS (buffer) -
+        group->bound) / GST_MSECOND;
+
+  g_mutex_lock (&group->lock);
+  member = find_member_unlocked (group, NULL, pad);
+  if (member != NULL) {
+    member->frames++;
+    if (lateness > 0.0)
+      member->late++;
+    member->lateness_avg = 0.95 * member->lateness_avg + 0.05 * lateness;
+    member->lateness_max = MAX (member->lateness_max, lateness);
+  }
+  g_mutex_unlock (&group->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/**
+ * gst_sync_group_new:
+ * @bound: how long after their capture frames are presented
+ *
+ * Returns: (transfer full): a new group, unref with gst_sync_group_unref().
+ */
+GstSyncGroup *
+gst_sync_group_new (GstClockTime bound)
+{
+  static gsize initialized = 0;
+  GstSyncGroup *group;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "syncgroup", 0, "Sync Group");
+    gst_debug_set_threshold_for_name ("syncgroup", GST_LEVEL_DEBUG);
+    g_once_init_leave (&initialized, 1);
+  }
+
+  group = g_new0 (GstSyncGroup, 1);
+  group->ref_count = 1;
+  g_mutex_init (&group->lock);
+  group->bound = bound;
+
+  /* The cameras report wall clock time, see the "ntp-time-source" property
+   * of rtspsrc */
+  group->clock = g_object_new (GST_TYPE_SYSTEM_CLOCK, "clock-type",
+      GST_CLOCK_TYPE_REALTIME, NULL);
+  group->base_time = gst_clock_get_time (group->clock);
+
+  GST_DEBUG ("New group %p, bound %" GST_TIME_FORMAT, group,
+      GST_TIME_ARGS (bound));
+
+  return group;
+}
+
+/**
+ * gst_sync_group_ref:
+ * @group: a #GstSyncGroup
+ *
+ * Returns: @group
+ */
+GstSyncGroup *
+gst_sync_group_ref (GstSyncGroup * group)
+{
+  g_atomic_int_inc (&group->ref_count);
+
+  return group;
+}
+
+/**
+ * gst_sync_group_unref:
+ * @group: a #GstSyncGroup
+ *
+ * The pipelines must have left the group before the last reference goes.
+ */
+void
+gst_sync_group_unref (GstSyncGroup * group)
+{
+  if (!g_atomic_int_dec_and_test (&group->ref_count))
+    return;
+
+  g_warn_if_fail (group->members == NULL);
+
+  gst_object_unref (group->clock);
+  g_mutex_clear (&group->lock);
+  g_free (group);
+}
+
+/**
+ * gst_sync_group_join:
+ * @group: a #GstSyncGroup
+ * @pipeline: a playbin
+ *
+ * Makes @pipeline run on the clock and base time of @group, presenting its
+ * frames with the latency of the group. Takes effect the next time it goes to
+ * PLAYING.
+ */
+void
+gst_sync_group_join (GstSyncGroup * group, GstElement * pipeline)
+{
+  GstSyncMember *member;
+  GstElement *sink = NULL;
+
+  g_mutex_lock (&group->lock);
+  if (find_member_unlocked (group, pipeline, NULL) != NULL) {
+    g_mutex_unlock (&group->lock);
+    return;
+  }
+  member = g_new0 (GstSyncMember, 1);
+  member->pipeline = gst_object_ref (pipeline);
+  group->members = g_list_append (group->members, member);
+  g_mutex_unlock (&group->lock);
+
+  GST_DEBUG ("%s joins group %p", GST_ELEMENT_NAME (pipeline), group);
+
+  /* Keep the base time when going to PLAYING, instead of taking the current
+   * clock time */
+  gst_pipeline_use_clock (GST_PIPELINE (pipeline), group->clock);
+  gst_element_set_start_time (pipeline, GST_CLOCK_TIME_NONE);
+  gst_element_set_base_time (pipeline, group->base_time);
+  gst_pipeline_set_latency (GST_PIPELINE (pipeline), group->bound);
+
+  g_object_get (pipeline, "video-sink", &sink, NULL);
+  if (sink != NULL) {
+    GstPad *pad = gst_element_get_static_pad (sink, "sink");
+
+    if (pad != NULL) {
+      g_mutex_lock (&group->lock);
+      member->pad = pad;
+      member->probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+          buffer_probe_cb, gst_sync_group_ref (group),
+          (GDestroyNotify) gst_sync_group_unref);
+      g_mutex_unlock (&group->lock);
+    }
+    gst_object_unref (sink);
+  }
+}
+
+/**
+ * gst_sync_group_leave:
+ * @group: a #GstSyncGroup
+ * @pipeline: a playbin that joined @group
+ *
+ * Lets @pipeline pick its own clock and base time again.
+ */
+void
+gst_sync_group_leave (GstSyncGroup * group, GstElement * pipeline)
+{
+  GstSyncMember *member;
+
+  g_mutex_lock (&group->lock);
+  member = find_member_unlocked (group, pipeline, NULL);
+  if (member != NULL)
+    group->members = g_list_remove (group->members, member);
+  g_mutex_unlock (&group->lock);
+
+  if (member == NULL)
+    return;
+
+  GST_DEBUG ("%s leaves group %p", GST_ELEMENT_NAME (pipeline), group);
+
+  if (member->pad != NULL) {
+    gst_pad_remove_probe (member->pad, member->probe);
+    gst_object_unref (member->pad);
+  }
+
+  gst_pipeline_auto_clock (GST_PIPELINE (pipeline));
+  gst_element_set_start_time (pipeline, 0);
+  gst_pipeline_set_latency (GST_PIPELINE (pipeline), GST_CLOCK_TIME_NONE);
+
+  gst_object_unref (member->pipeline);
+  g_free (member);
+}
+
+/**
+ * gst_sync_group_get_stats:
+ * @group: a #GstSyncGroup
+ *
+ * Describes how late the frames of every pipeline arrive, one line each,
+ * followed by the residual skew of the group.
+ *
+ * Returns: (transfer full): the statistics, free with g_free().
+ */
+gchar *
+gst_sync_group_get_stats (GstSyncGroup * group)
+{
+  GString *stats;
+  GList *walk;
+  gdouble min = G_MAXDOUBLE;
+  gdouble max = 0.0;
+
+  stats = g_string_new (NULL);
+
+  g_mutex_lock (&group->lock);
+  g_string_append_printf (stats, "bound %" G_GUINT64_FORMAT " ms\n",
+      group->bound / GST_MSECOND);
+  for (walk = group->members; walk != NULL; walk = walk->next) {
+    GstSyncMember *member = walk->data;
+
+    g_string_append_printf (stats, "%s: %" G_GUINT64_FORMAT " frames, %"
+        G_GUINT64_FORMAT " late, lateness %.1f ms avg %.1f ms max\n",
+        GST_ELEMENT_NAME (member->pipeline), member->frames, member->late,
+        member->lateness_avg, member->lateness_max);
+
+    if (member->frames == 0)
+      continue;
+    min = MIN (min, member->lateness_avg);
+    max = MAX (max, member->lateness_avg);
+  }
+  if (max >= min)
+    g_string_append_printf (stats, "residual skew %.1f ms\n", max - min);
+  g_mutex_unlock (&group->lock);
+
+  return g_string_free (stats, FALSE);
+}
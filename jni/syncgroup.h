@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstSyncGroup: Presents the frames of several live pipelines aligned to the
+ * time the cameras captured them.
+ */
+#ifndef __GST_SYNC_GROUP_H__
+#define __GST_SYNC_GROUP_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstSyncGroup GstSyncGroup;
+
+GstSyncGroup * gst_sync_group_new (GstClockTime bound);
+GstSyncGroup * gst_sync_group_ref (GstSyncGroup * group);
+void gst_sync_group_unref (GstSyncGroup * group);
+void gst_sync_group_join (GstSyncGroup * group, GstElement * pipeline);
+void gst_sync_group_leave (GstSyncGroup * group, GstElement * pipeline);
+gchar * gst_sync_group_get_stats (GstSyncGroup * group);
+
+G_END_DECLS
+
+#endif /* __GST_SYNC_GROUP_H__ */
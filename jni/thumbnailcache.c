@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstThumbnailCache: Thumbnails of the keyframes of a recording, kept on disk
+ * next to it.
+ *
+ * The cache of "<file>" is "<file>.thm": a header followed by one fixed size
+ * record per thumbnail, holding its timestamp and its pixels, in timestamp
+ * order. Readers map the file and find the thumbnail nearest to a position
+ * with a binary search, so a seek bar can show one under the finger for
+ * every position without touching the decoder.
+ *
+ * Caches are generated by a single background thread, one recording at a
+ * time. It plays the recording with a key unit trick mode seek, so the
+ * demuxer only hands keyframes to the decoder and nothing else is decoded,
+ * as fast as it goes, and keeps at most one thumbnail per
+ * THUMBNAIL_INTERVAL. Records are only appended and the header is marked
+ * complete at the end, a cache can be used while it is being generated and
+ * one left incomplete is generated again. Generating starts a new file that
+ * replaces the old one, which stays intact for whoever still maps it. A
+ * segment still being recorded (see segmentstorage.c) gets the thumbnails of
+ * what was recorded so far and is left incomplete.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <glib/gstdio.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+#include "thumbnailcache.h"
+#include "segmentstorage.h"
+
+#define CACHE_SUFFIX ".thm"
+#define TMP_SUFFIX ".tmp"
+#define CACHE_MAGIC "THMB"
+#define CACHE_VERSION 1
+
+/* Keyframes closer to the previous thumbnail than this are skipped */
+#define THUMBNAIL_INTERVAL (1 * GST_SECOND)
+/* How often the generator checks for errors while waiting for frames */
+#define PULL_TIMEOUT (500 * GST_MSECOND)
+
+typedef struct
+{
+  gchar magic[4];
+  guint32 version;              /* Little endian, like the records */
+  guint32 width;
+  guint32 height;
+  guint32 complete;
+  guint32 reserved;
+} GstThumbnailCacheHeader;
+
+typedef struct
+{
+  guint64 timestamp;
+  guint8 pixels[GST_THUMBNAIL_SIZE];
+} GstThumbnailRecord;
+
+struct _GstThumbnailCache
+{
+  GMappedFile *mapped;
+  const GstThumbnailRecord *records;
+  guint size;
+  gboolean complete;
+};
+
+/* The generator thread and the recordings waiting for it */
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  GQueue queue;                 /* Of locations */
+  pthread_t thread;
+} GstThumbnailGenerator;
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static void *thread_function (void *user_data);
+
+static void
+init_debug (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "thumbnailcache", 0,
+        "Thumbnail Cache");
+    gst_debug_set_threshold_for_name ("thumbnailcache", GST_LEVEL_DEBUG);
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+static GstThumbnailGenerator *
+get_generator (void)
+{
+  static gsize initialized = 0;
+  static GstThumbnailGenerator *generator;
+
+  if (g_once_init_enter (&initialized)) {
+    generator = g_new0 (GstThumbnailGenerator, 1);
+    g_mutex_init (&generator->lock);
+    g_cond_init (&generator->cond);
+    g_queue_init (&generator->queue);
+    pthread_create (&generator->thread, NULL, &thread_function, generator);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return generator;
+}
+
+/**
+ * gst_thumbnail_cache_get_path:
+ * @location: a recording
+ *
+ * Returns: (transfer full): the path of the thumbnail cache of @location,
+ * free with g_free().
+ */
+gchar *
+gst_thumbnail_cache_get_path (const gchar * location)
+{
+  return g_strconcat (location, CACHE_SUFFIX, NULL);
+}
+
+static void
+write_header (FILE * file, gboolean complete)
+{
+  GstThumbnailCacheHeader header = { CACHE_MAGIC, };
+
+  header.version = GUINT32_TO_LE (CACHE_VERSION);
+  header.width = GUINT32_TO_LE (GST_THUMBNAIL_WIDTH);
+  header.height = GUINT32_TO_LE (GST_THUMBNAIL_HEIGHT);
+  header.complete = GUINT32_TO_LE (complete ? 1 : 0);
+
+  fseek (file, 0, SEEK_SET);
+  fwrite (&header, sizeof (header), 1, file);
+}
+
+/* Appends the thumbnail of @sample */
+static void
+write_thumbnail (FILE * file, GstSample * sample)
+{
+  /* Only ever used by the generator thread */
+  static GstThumbnailRecord record;
+  GstBuffer *buffer = gst_sample_get_buffer (sample);
+  GstVideoInfo info;
+  GstMapInfo map;
+  guint row;
+
+  if (!gst_video_info_from_caps (&info, gst_sample_get_caps (sample)) ||
+      GST_VIDEO_INFO_WIDTH (&info) != GST_THUMBNAIL_WIDTH ||
+      GST_VIDEO_INFO_HEIGHT (&info) != GST_THUMBNAIL_HEIGHT ||
+      !gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return;
+
+  record.timestamp = GUINT64_TO_LE (GST_BUFFER_PTS (buffer));
+  for (row = 0; row < GST_THUMBNAIL_HEIGHT; row++)
+    memcpy (record.pixels + row * GST_THUMBNAIL_WIDTH * 2,
+        map.data + GST_VIDEO_INFO_PLANE_OFFSET (&info, 0) +
+        row * GST_VIDEO_INFO_PLANE_STRIDE (&info, 0),
+        GST_THUMBNAIL_WIDTH * 2);
+  gst_buffer_unmap (buffer, &map);
+
+  fwrite (&record, sizeof (record), 1, file);
+}
+
+static gboolean
+is_complete (const gchar * location)
+{
+  GstThumbnailCache *cache;
+  gboolean complete;
+
+  cache = gst_thumbnail_cache_open (location);
+  if (cache == NULL)
+    return FALSE;
+
+  complete = cache->complete;
+  gst_thumbnail_cache_free (cache);
+
+  return complete;
+}
+
+static void
+generate (const gchar * location)
+{
+  GstElement *pipeline;
+  GstElement *appsink;
+  GstMessage *msg = NULL;
+  GstBus *bus;
+  GError *error = NULL;
+  GstClockTime last = GST_CLOCK_TIME_NONE;
+  gchar *uri;
+  gchar *description;
+  gchar *path;
+  gchar *tmp_path;
+  FILE *file;
+  gboolean writing;
+  guint count = 0;
+  gint64 start_time = g_get_monotonic_time ();
+
+  if (is_complete (location))
+    return;
+
+  uri = g_filename_to_uri (location, NULL, NULL);
+  if (uri == NULL)
+    return;
+
+  description = g_strdup_printf ("uridecodebin uri=\"%s\" ! videoconvert ! "
+      "videoscale ! video/x-raw,format=RGB16,width=%d,height=%d,"
+      "pixel-aspect-ratio=1/1 ! appsink name=sink sync=false", uri,
+      GST_THUMBNAIL_WIDTH, GST_THUMBNAIL_HEIGHT);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  g_free (uri);
+  if (pipeline == NULL) {
+    GST_WARNING ("Could not create thumbnail pipeline: %s",
+        error ? error->message : "unknown error");
+    g_clear_error (&error);
+    return;
+  }
+
+  writing = gst_segment_storage_is_writing (location);
+
+  /* Truncating the old cache would pull the pages from under its readers */
+  path = gst_thumbnail_cache_get_path (location);
+  tmp_path = g_strconcat (path, TMP_SUFFIX, NULL);
+  file = g_fopen (tmp_path, "wb");
+  if (file == NULL) {
+    GST_WARNING ("Could not create %s", tmp_path);
+    g_free (tmp_path);
+    g_free (path);
+    gst_object_unref (pipeline);
+    return;
+  }
+  write_header (file, FALSE);
+  fflush (file);
+  if (g_rename (tmp_path, path) != 0) {
+    GST_WARNING ("Could not replace %s", path);
+    fclose (file);
+    g_unlink (tmp_path);
+    g_free (tmp_path);
+    g_free (path);
+    gst_object_unref (pipeline);
+    return;
+  }
+  g_free (tmp_path);
+
+  /* Only keyframes from the start on */
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+  gst_element_seek (pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH |
+      GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS,
+      GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  appsink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  bus = gst_element_get_bus (pipeline);
+  while (msg == NULL) {
+    GstSample *sample;
+    GstClockTime timestamp;
+
+    sample = gst_app_sink_try_pull_sample (GST_APP_SINK (appsink),
+        PULL_TIMEOUT);
+    if (sample == NULL) {
+      if (gst_app_sink_is_eos (GST_APP_SINK (appsink)))
+        break;
+      msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+      continue;
+    }
+
+    timestamp = GST_BUFFER_PTS (gst_sample_get_buffer (sample));
+
+    if (GST_CLOCK_TIME_IS_VALID (timestamp) &&
+        (!GST_CLOCK_TIME_IS_VALID (last) ||
+            timestamp >= last + THUMBNAIL_INTERVAL)) {
+      write_thumbnail (file, sample);
+      last = timestamp;
+      count++;
+      if (count % 16 == 0)
+        fflush (file);
+    }
+    gst_sample_unref (sample);
+  }
+  gst_object_unref (appsink);
+
+  if (msg != NULL) {
+    gst_message_parse_error (msg, &error, NULL);
+    GST_WARNING ("Could not generate thumbnails of %s: %s", location,
+        error ? error->message : "unknown error");
+    g_clear_error (&error);
+    gst_message_unref (msg);
+  } else {
+    if (!writing)
+      write_header (file, TRUE);
+    GST_DEBUG ("Generated %u thumbnails of %s%s in %" G_GINT64_FORMAT " ms",
+        count, location, writing ? " so far" : "",
+        (g_get_monotonic_time () - start_time) / 1000);
+  }
+  gst_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  fclose (file);
+  g_free (path);
+}
+
+static void *
+thread_function (void *user_data)
+{
+  GstThumbnailGenerator *generator = (GstThumbnailGenerator *) user_data;
+
+  while (TRUE) {
+    gchar *location;
+
+    g_mutex_lock (&generator->lock);
+    while (g_queue_is_empty (&generator->queue))
+      g_cond_wait (&generator->cond, &generator->lock);
+    location = g_queue_pop_head (&generator->queue);
+    g_mutex_unlock (&generator->lock);
+
+    generate (location);
+    g_free (location);
+  }
+
+  return NULL;
+}
+
+/**
+ * gst_thumbnail_cache_generate:
+ * @location: a recording
+ *
+ * Queues @location for the generator thread, unless it is already queued.
+ * Recordings with a complete cache are skipped.
+ */
+void
+gst_thumbnail_cache_generate (const gchar * location)
+{
+  GstThumbnailGenerator *generator;
+
+  init_debug ();
+  generator = get_generator ();
+
+  g_mutex_lock (&generator->lock);
+  if (g_queue_find_custom (&generator->queue, location,
+          (GCompareFunc) strcmp) == NULL) {
+    GST_DEBUG ("Queueing %s", location);
+    g_queue_push_tail (&generator->queue, g_strdup (location));
+    g_cond_signal (&generator->cond);
+  }
+  g_mutex_unlock (&generator->lock);
+}
+
+/**
+ * gst_thumbnail_cache_open:
+ * @location: a recording
+ *
+ * Maps the thumbnail cache of @location, which may still be generated.
+ * Thumbnails added afterwards are not seen.
+ *
+ * Returns: (transfer full): the cache, or NULL if @location has none. Free
+ * with gst_thumbnail_cache_free().
+ */
+GstThumbnailCache *
+gst_thumbnail_cache_open (const gchar * location)
+{
+  GstThumbnailCache *cache;
+  const GstThumbnailCacheHeader *header;
+  GMappedFile *mapped;
+  gchar *path;
+  gsize length;
+
+  init_debug ();
+
+  path = gst_thumbnail_cache_get_path (location);
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  g_free (path);
+  if (mapped == NULL)
+    return NULL;
+
+  length = g_mapped_file_get_length (mapped);
+  header = (const GstThumbnailCacheHeader *)
+      g_mapped_file_get_contents (mapped);
+  if (length < sizeof (GstThumbnailCacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, 4) != 0 ||
+      GUINT32_FROM_LE (header->version) != CACHE_VERSION ||
+      GUINT32_FROM_LE (header->width) != GST_THUMBNAIL_WIDTH ||
+      GUINT32_FROM_LE (header->height) != GST_THUMBNAIL_HEIGHT) {
+    GST_WARNING ("Ignoring invalid thumbnail cache of %s", location);
+    g_mapped_file_unref (mapped);
+    return NULL;
+  }
+
+  cache = g_new0 (GstThumbnailCache, 1);
+  cache->mapped = mapped;
+  cache->records = (const GstThumbnailRecord *) (header + 1);
+  cache->size = (length - sizeof (GstThumbnailCacheHeader)) /
+      sizeof (GstThumbnailRecord);
+  cache->complete = GUINT32_FROM_LE (header->complete) != 0;
+
+  return cache;
+}
+
+/**
+ * gst_thumbnail_cache_free:
+ * @cache: a #GstThumbnailCache
+ *
+ * Unmaps the cache.
+ */
+void
+gst_thumbnail_cache_free (GstThumbnailCache * cache)
+{
+  g_mapped_file_unref (cache->mapped);
+  g_free (cache);
+}
+
+/**
+ * gst_thumbnail_cache_is_complete:
+ * @cache: a #GstThumbnailCache
+ *
+ * Returns: TRUE if all thumbnails were generated when @cache was opened.
+ */
+gboolean
+gst_thumbnail_cache_is_complete (GstThumbnailCache * cache)
+{
+  return cache->complete;
+}
+
+/**
+ * gst_thumbnail_cache_lookup:
+ * @cache: a #GstThumbnailCache
+ * @position: time in the recording
+ * @timestamp: (out) (allow-none): time of the thumbnail
+ *
+ * Returns: (transfer none): the pixels of the thumbnail nearest to
+ * @position, valid until @cache is freed, or NULL if it has none.
+ */
+const guint8 *
+gst_thumbnail_cache_lookup (GstThumbnailCache * cache, GstClockTime position,
+    GstClockTime * timestamp)
+{
+  guint low = 0;
+  guint high = cache->size;
+  guint i;
+
+  if (cache->size == 0)
+    return NULL;
+
+  /* First thumbnail after position */
+  while (low < high) {
+    guint middle = low + (high - low) / 2;
+
+    if (GUINT64_FROM_LE (cache->records[middle].timestamp) <= position)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  /* Or the one before, whichever is nearer */
+  if (low == cache->size)
+    i = low - 1;
+  else if (low == 0)
+    i = 0;
+  else if (position - GUINT64_FROM_LE (cache->records[low - 1].timestamp) <=
+      GUINT64_FROM_LE (cache->records[low].timestamp) - position)
+    i = low - 1;
+  else
+    i = low;
+
+  if (timestamp != NULL)
+    *timestamp = GUINT64_FROM_LE (cache->records[i].timestamp);
+
+  return cache->records[i].pixels;
+}
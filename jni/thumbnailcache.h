@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstThumbnailCache: Thumbnails of the keyframes of a recording, kept on disk
+ * next to it.
+ */
+#ifndef __GST_THUMBNAIL_CACHE_H__
+#define __GST_THUMBNAIL_CACHE_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Thumbnails are RGB565, without padding */
+#define GST_THUMBNAIL_WIDTH 160
+#define GST_THUMBNAIL_HEIGHT 90
+#define GST_THUMBNAIL_SIZE (GST_THUMBNAIL_WIDTH * GST_THUMBNAIL_HEIGHT * 2)
+
+typedef struct _GstThumbnailCache GstThumbnailCache;
+
+gchar * gst_thumbnail_cache_get_path (const gchar * location);
+void gst_thumbnail_cache_generate (const gchar * location);
+
+GstThumbnailCache * gst_thumbnail_cache_open (const gchar * location);
+void gst_thumbnail_cache_free (GstThumbnailCache * cache);
+gboolean gst_thumbnail_cache_is_complete (GstThumbnailCache * cache);
+const guint8 * gst_thumbnail_cache_lookup (GstThumbnailCache * cache,
+    GstClockTime position, GstClockTime * timestamp);
+
+G_END_DECLS
+
+#endif /* __GST_THUMBNAIL_CACHE_H__ */
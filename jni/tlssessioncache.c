@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstTlsSessionCache: Keeps TLS handshake statistics of the rtsps://
+ * connections, per player.
+ *
+ * Every player verifies the certificates of its connections with a database
+ * of its own, wrapping the default one. A certificate chain is only verified
+ * on a full handshake, a resumed session comes without one, so counting the
+ * verifications of a player during a connection tells which of the two it
+ * was. Whether a session is resumed at all is up to the TLS backend, the
+ * statistics only show what happened. A player has one connection at a
+ * time, so its verifications can not be mixed up with the ones of other
+ * connections to the same camera.
+ */
+#include <string.h>
+
+#include "tlssessioncache.h"
+
+typedef struct
+{
+  gchar *host;                  /* Of the last connection */
+  guint connections;
+  guint handshakes;             /* Full handshakes, certificate verified */
+  gint64 verify_time;           /* Spent verifying certificates, total */
+  guint full_setups;            /* Connections timed, with a full handshake */
+  gint64 full_setup_time;
+  guint resumed_setups;         /* Connections timed, with a resumed session */
+  gint64 resumed_setup_time;
+} GstTlsPlayerStats;
+
+struct _GstTlsSessionCache
+{
+  GMutex lock;                  /* Protects players */
+  GHashTable *players;          /* Player -> GstTlsPlayerStats */
+  GTlsDatabase *wrapped;        /* Default database, NULL without TLS */
+};
+
+/* Database counting the verifications of a player, see above */
+typedef struct
+{
+  GTlsDatabase parent;
+  GTlsDatabase *wrapped;
+  GstTlsSessionCache *cache;
+  gpointer player;
+} GstCountingDatabase;
+
+typedef struct
+{
+  GTlsDatabaseClass parent_class;
+} GstCountingDatabaseClass;
+
+static GType gst_counting_database_get_type (void);
+
+G_DEFINE_TYPE (GstCountingDatabase, gst_counting_database,
+    G_TYPE_TLS_DATABASE);
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+static void
+player_stats_free (gpointer data)
+{
+  GstTlsPlayerStats *stats = data;
+
+  g_free (stats->host);
+  g_free (stats);
+}
+
+/* Must be called with the lock held */
+static GstTlsPlayerStats *
+get_player_unlocked (GstTlsSessionCache * cache, gpointer player)
+{
+  GstTlsPlayerStats *stats;
+
+  stats = g_hash_table_lookup (cache->players, player);
+  if (stats == NULL) {
+    stats = g_new0 (GstTlsPlayerStats, 1);
+    g_hash_table_insert (cache->players, player, stats);
+  }
+
+  return stats;
+}
+
+static GTlsCertificateFlags
+gst_counting_database_verify_chain (GTlsDatabase * database,
+    GTlsCertificate * chain, const gchar * purpose,
+    GSocketConnectable * identity, GTlsInteraction * interaction,
+    GTlsDatabaseVerifyFlags flags, GCancellable * cancellable,
+    GError ** error)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) database;
+  GstTlsPlayerStats *stats;
+  GTlsCertificateFlags result;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  result = g_tls_database_verify_chain (self->wrapped, chain, purpose,
+      identity, interaction, flags, cancellable, error);
+
+  g_mutex_lock (&self->cache->lock);
+  stats = get_player_unlocked (self->cache, self->player);
+  stats->handshakes++;
+  stats->verify_time += g_get_monotonic_time () - start;
+  g_mutex_unlock (&self->cache->lock);
+
+  GST_DEBUG ("Full handshake of player %p", self->player);
+
+  return result;
+}
+
+/* Everything else is answered by the wrapped database */
+static gchar *
+gst_counting_database_create_certificate_handle (GTlsDatabase * database,
+    GTlsCertificate * certificate)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) database;
+
+  return g_tls_database_create_certificate_handle (self->wrapped,
+      certificate);
+}
+
+static GTlsCertificate *
+gst_counting_database_lookup_certificate_for_handle (GTlsDatabase * database,
+    const gchar * handle, GTlsInteraction * interaction,
+    GTlsDatabaseLookupFlags flags, GCancellable * cancellable,
+    GError ** error)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) database;
+
+  return g_tls_database_lookup_certificate_for_handle (self->wrapped, handle,
+      interaction, flags, cancellable, error);
+}
+
+static GTlsCertificate *
+gst_counting_database_lookup_certificate_issuer (GTlsDatabase * database,
+    GTlsCertificate * certificate, GTlsInteraction * interaction,
+    GTlsDatabaseLookupFlags flags, GCancellable * cancellable,
+    GError ** error)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) database;
+
+  return g_tls_database_lookup_certificate_issuer (self->wrapped,
+      certificate, interaction, flags, cancellable, error);
+}
+
+static GList *
+gst_counting_database_lookup_certificates_issued_by (GTlsDatabase *
+    database, GByteArray * issuer_raw_dn, GTlsInteraction * interaction,
+    GTlsDatabaseLookupFlags flags, GCancellable * cancellable,
+    GError ** error)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) database;
+
+  return g_tls_database_lookup_certificates_issued_by (self->wrapped,
+      issuer_raw_dn, interaction, flags, cancellable, error);
+}
+
+static void
+gst_counting_database_finalize (GObject * obj)
+{
+  GstCountingDatabase *self = (GstCountingDatabase *) obj;
+
+  g_object_unref (self->wrapped);
+
+  G_OBJECT_CLASS (gst_counting_database_parent_class)->finalize (obj);
+}
+
+static void
+gst_counting_database_class_init (GstCountingDatabaseClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GTlsDatabaseClass *database_class = G_TLS_DATABASE_CLASS (klass);
+
+  gobject_class->finalize = gst_counting_database_finalize;
+  database_class->verify_chain = gst_counting_database_verify_chain;
+  database_class->create_certificate_handle =
+      gst_counting_database_create_certificate_handle;
+  database_class->lookup_certificate_for_handle =
+      gst_counting_database_lookup_certificate_for_handle;
+  database_class->lookup_certificate_issuer =
+      gst_counting_database_lookup_certificate_issuer;
+  database_class->lookup_certificates_issued_by =
+      gst_counting_database_lookup_certificates_issued_by;
+}
+
+static void
+gst_counting_database_init (GstCountingDatabase * self)
+{
+}
+
+/**
+ * gst_tls_session_cache_get_default:
+ *
+ * Returns: (transfer none): the cache shared by all viewers.
+ */
+GstTlsSessionCache *
+gst_tls_session_cache_get_default (void)
+{
+  static gsize initialized = 0;
+  static GstTlsSessionCache *cache;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "tlssessioncache", 0,
+        "TLS Session Cache");
+    gst_debug_set_threshold_for_name ("tlssessioncache", GST_LEVEL_DEBUG);
+
+    cache = g_new0 (GstTlsSessionCache, 1);
+    g_mutex_init (&cache->lock);
+    cache->players = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+        NULL, player_stats_free);
+
+    /* Without a TLS backend rtspsrc can not do rtsps:// either */
+    cache->wrapped =
+        g_tls_backend_get_default_database (g_tls_backend_get_default ());
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return cache;
+}
+
+/**
+ * gst_tls_session_cache_new_database:
+ * @cache: a #GstTlsSessionCache
+ * @player: player the connections belong to
+ *
+ * Returns: (transfer full): the database the rtsps:// connections of
+ * @player must verify with, or NULL if TLS is not supported.
+ */
+GTlsDatabase *
+gst_tls_session_cache_new_database (GstTlsSessionCache * cache,
+    gpointer player)
+{
+  GstCountingDatabase *database;
+
+  if (cache->wrapped == NULL)
+    return NULL;
+
+  database = g_object_new (gst_counting_database_get_type (), NULL);
+  database->wrapped = g_object_ref (cache->wrapped);
+  database->cache = cache;
+  database->player = player;
+
+  return G_TLS_DATABASE (database);
+}
+
+/**
+ * gst_tls_session_cache_connecting:
+ * @cache: a #GstTlsSessionCache
+ * @player: player connecting
+ * @host: host being connected to
+ *
+ * Returns: the number of full handshakes of @player so far, to be passed to
+ * gst_tls_session_cache_connected().
+ */
+guint
+gst_tls_session_cache_connecting (GstTlsSessionCache * cache,
+    gpointer player, const gchar * host)
+{
+  GstTlsPlayerStats *stats;
+  guint handshakes;
+
+  g_mutex_lock (&cache->lock);
+  stats = get_player_unlocked (cache, player);
+  if (g_strcmp0 (stats->host, host) != 0) {
+    g_free (stats->host);
+    stats->host = g_strdup (host);
+  }
+  stats->connections++;
+  handshakes = stats->handshakes;
+  g_mutex_unlock (&cache->lock);
+
+  return handshakes;
+}
+
+/**
+ * gst_tls_session_cache_connected:
+ * @cache: a #GstTlsSessionCache
+ * @player: player connected
+ * @handshakes: returned by gst_tls_session_cache_connecting()
+ * @setup_time: from connecting until the session was described, in
+ * microseconds
+ *
+ * Accounts @setup_time to a full handshake if @player verified a
+ * certificate in the meantime, to a resumed session otherwise.
+ */
+void
+gst_tls_session_cache_connected (GstTlsSessionCache * cache,
+    gpointer player, guint handshakes, gint64 setup_time)
+{
+  GstTlsPlayerStats *stats;
+
+  g_mutex_lock (&cache->lock);
+  stats = get_player_unlocked (cache, player);
+  if (stats->handshakes != handshakes) {
+    stats->full_setups++;
+    stats->full_setup_time += setup_time;
+  } else {
+    stats->resumed_setups++;
+    stats->resumed_setup_time += setup_time;
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+/**
+ * gst_tls_session_cache_remove:
+ * @cache: a #GstTlsSessionCache
+ * @player: player going away
+ *
+ * Drops the statistics of @player.
+ */
+void
+gst_tls_session_cache_remove (GstTlsSessionCache * cache, gpointer player)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove (cache->players, player);
+  g_mutex_unlock (&cache->lock);
+}
+
+/**
+ * gst_tls_session_cache_get_stats:
+ * @cache: a #GstTlsSessionCache
+ *
+ * Describes the handshakes of every player, one line each.
+ *
+ * Returns: (transfer full): the statistics, free with g_free().
+ */
+gchar *
+gst_tls_session_cache_get_stats (GstTlsSessionCache * cache)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GString *str;
+
+  str = g_string_new (NULL);
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_iter_init (&iter, cache->players);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    GstTlsPlayerStats *stats = value;
+    guint resumed;
+
+    resumed = stats->connections > stats->handshakes ?
+        stats->connections - stats->handshakes : 0;
+
+    g_string_append_printf (str, "player %p (%s): %u connections, %u full "
+        "handshakes (verify %.1f ms avg), %.0f%% resumed, setup %.1f ms full "
+        "/ %.1f ms resumed\n", key, stats->host ? stats->host : "?",
+        stats->connections, stats->handshakes,
+        stats->handshakes ? stats->verify_time / 1000.0 / stats->handshakes :
+        0.0, stats->connections ? 100.0 * resumed / stats->connections : 0.0,
+        stats->full_setups ? stats->full_setup_time / 1000.0 /
+        stats->full_setups : 0.0,
+        stats->resumed_setups ? stats->resumed_setup_time / 1000.0 /
+        stats->resumed_setups : 0.0);
+  }
+  g_mutex_unlock (&cache->lock);
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstTlsSessionCache: Keeps TLS handshake statistics of the rtsps://
+ * connections, per player.
+ */
+#ifndef __GST_TLS_SESSION_CACHE_H__
+#define __GST_TLS_SESSION_CACHE_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstTlsSessionCache GstTlsSessionCache;
+
+GstTlsSessionCache * gst_tls_session_cache_get_default (void);
+GTlsDatabase * gst_tls_session_cache_new_database (
+    GstTlsSessionCache * cache, gpointer player);
+guint gst_tls_session_cache_connecting (GstTlsSessionCache * cache,
+    gpointer player, const gchar * host);
+void gst_tls_session_cache_connected (GstTlsSessionCache * cache,
+    gpointer player, guint handshakes, gint64 setup_time);
+void gst_tls_session_cache_remove (GstTlsSessionCache * cache,
+    gpointer player);
+gchar * gst_tls_session_cache_get_stats (GstTlsSessionCache * cache);
+
+G_END_DECLS
+
+#endif /* __GST_TLS_SESSION_CACHE_H__ */
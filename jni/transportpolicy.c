@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstTransportPolicy: Picks the RTSP lower transports to try for a camera,
+ * remembering what worked on the current network.
+ *
+ * rtspsrc tries UDP first and only falls back to TCP interleaved once no UDP
+ * packet arrived for its timeout, which is several seconds by default. For a
+ * camera not seen yet on the current network UDP is probed with the short
+ * PROBE_TIMEOUT. Once a transport is known to work it is tried first: TCP
+ * only when UDP had to be given up, otherwise UDP with the regular timeout.
+ * What worked is remembered per camera and per network, so moving between
+ * networks probes again while coming back to a known one does not. A failed
+ * connection forgets the camera, the next attempt probes again.
+ */
+#include <string.h>
+
+#include "transportpolicy.h"
+
+#define PROBE_TIMEOUT (1500 * G_TIME_SPAN_MILLISECOND)
+#define UDP_TIMEOUT (5000 * G_TIME_SPAN_MILLISECOND)
+
+#define ALL_TRANSPORTS (GST_RTSP_LOWER_TRANS_UDP | \
+    GST_RTSP_LOWER_TRANS_UDP_MCAST | GST_RTSP_LOWER_TRANS_TCP)
+
+struct _GstTransportPolicy
+{
+  GMutex lock;                  /* Protects everything below */
+  gchar *network;               /* Identifies the current network */
+  GHashTable *known;            /* Network and URI -> GstRTSPLowerTrans */
+};
+
+GST_DEBUG_CATEGORY_STATIC (debug_category);
+#define GST_CAT_DEFAULT debug_category
+
+/* Must be called with the lock held */
+static gchar *
+make_key_unlocked (GstTransportPolicy * policy, const gchar * uri)
+{
+  return g_strdup_printf ("%s\n%s", policy->network ? policy->network : "",
+      uri);
+}
+
+/**
+ * gst_transport_policy_get_default:
+ *
+ * Returns: (transfer none): the policy shared by all viewers.
+ */
+GstTransportPolicy *
+gst_transport_policy_get_default (void)
+{
+  static gsize initialized = 0;
+  static GstTransportPolicy *policy;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (debug_category, "transportpolicy", 0,
+        "Transport Policy");
+    gst_debug_set_threshold_for_name ("transportpolicy", GST_LEVEL_DEBUG);
+
+    policy = g_new0 (GstTransportPolicy, 1);
+    g_mutex_init (&policy->lock);
+    policy->known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return policy;
+}
+
+/**
+ * gst_transport_policy_set_network:
+ * @policy: a #GstTransportPolicy
+ * @network: identifies the network the device is on now, or NULL
+ *
+ * Cameras are probed again unless they are known on @network already.
+ */
+void
+gst_transport_policy_set_network (GstTransportPolicy * policy,
+    const gchar * network)
+{
+  g_mutex_lock (&policy->lock);
+  if (g_strcmp0 (policy->network, network) != 0) {
+    GST_DEBUG ("Network changed from %s to %s", policy->network, network);
+    g_free (policy->network);
+    policy->network = g_strdup (network);
+  }
+  g_mutex_unlock (&policy->lock);
+}
+
+/**
+ * gst_transport_policy_select:
+ * @policy: a #GstTransportPolicy
+ * @uri: URI of the camera
+ * @timeout: (out): how long rtspsrc should wait for UDP packets before
+ * falling back to TCP, in microseconds
+ *
+ * Returns: the transports rtspsrc should try.
+ */
+GstRTSPLowerTrans
+gst_transport_policy_select (GstTransportPolicy * policy, const gchar * uri,
+    guint64 * timeout)
+{
+  GstRTSPLowerTrans transport;
+  gpointer value;
+  gchar *key;
+
+  g_mutex_lock (&policy->lock);
+  key = make_key_unlocked (policy, uri);
+  value = g_hash_table_lookup (policy->known, key);
+  g_mutex_unlock (&policy->lock);
+  g_free (key);
+
+  transport = GPOINTER_TO_UINT (value);
+  if (transport == GST_RTSP_LOWER_TRANS_TCP) {
+    GST_DEBUG ("%s: going straight to TCP", uri);
+    *timeout = UDP_TIMEOUT;
+    return GST_RTSP_LOWER_TRANS_TCP;
+  }
+
+  if (transport != GST_RTSP_LOWER_TRANS_UNKNOWN) {
+    GST_DEBUG ("%s: UDP known to work", uri);
+    *timeout = UDP_TIMEOUT;
+  } else {
+    GST_DEBUG ("%s: probing UDP", uri);
+    *timeout = PROBE_TIMEOUT;
+  }
+
+  return ALL_TRANSPORTS;
+}
+
+/**
+ * gst_transport_policy_succeeded:
+ * @policy: a #GstTransportPolicy
+ * @uri: URI of the camera
+ * @transport: the transport the stream is flowing over
+ *
+ * Remembers @transport for @uri on the current network. A camera known to
+ * need TCP stays so, as long as @transport is TCP again.
+ */
+void
+gst_transport_policy_succeeded (GstTransportPolicy * policy,
+    const gchar * uri, GstRTSPLowerTrans transport)
+{
+  /* Nothing would be remembered, the camera would be probed again */
+  g_return_if_fail (transport != GST_RTSP_LOWER_TRANS_UNKNOWN);
+
+  g_mutex_lock (&policy->lock);
+  GST_DEBUG ("%s: streaming over %s on network %s", uri,
+      transport == GST_RTSP_LOWER_TRANS_TCP ? "TCP" : "UDP", policy->network);
+  g_hash_table_insert (policy->known, make_key_unlocked (policy, uri),
+      GUINT_TO_POINTER (transport));
+  g_mutex_unlock (&policy->lock);
+}
+
+/**
+ * gst_transport_policy_failed:
+ * @policy: a #GstTransportPolicy
+ * @uri: URI of the camera
+ *
+ * Forgets what worked for @uri on the current network.
+ */
+void
+gst_transport_policy_failed (GstTransportPolicy * policy, const gchar * uri)
+{
+  gchar *key;
+
+  g_mutex_lock (&policy->lock);
+  key = make_key_unlocked (policy, uri);
+  if (g_hash_table_remove (policy->known, key))
+    GST_DEBUG ("%s: failed, probing again next time", uri);
+  g_mutex_unlock (&policy->lock);
+  g_free (key);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Ognyan Tonchev <otonchev at gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * GstTransportPolicy: Picks the RTSP lower transports to try for a camera,
+ * remembering what worked on the current network.
+ */
+#ifndef __GST_TRANSPORT_POLICY_H__
+#define __GST_TRANSPORT_POLICY_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/rtsp/gstrtsptransport.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstTransportPolicy GstTransportPolicy;
+
+GstTransportPolicy * gst_transport_policy_get_default (void);
+void gst_transport_policy_set_network (GstTransportPolicy * policy,
+    const gchar * network);
+GstRTSPLowerTrans gst_transport_policy_select (GstTransportPolicy * policy,
+    const gchar * uri, guint64 * timeout);
+void gst_transport_policy_succeeded (GstTransportPolicy * policy,
+    const gchar * uri, GstRTSPLowerTrans transport);
+void gst_transport_policy_failed (GstTransportPolicy * policy,
+    const gchar * uri);
+
+G_END_DECLS
+
+#endif /* __GST_TRANSPORT_POLICY_H__ */
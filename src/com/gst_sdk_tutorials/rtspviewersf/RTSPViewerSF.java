@@ -20,11 +20,14 @@ package com.gst_sdk_tutorials.rtspviewersf;
 
 import java.text.SimpleDateFormat;
 import java.util.Date;
+import java.util.HashMap;
 import java.util.TimeZone;
 
 import android.app.Activity;
+import android.content.BroadcastReceiver;
 import android.content.Context;
 import android.content.Intent;
+import android.content.IntentFilter;
 import android.content.SharedPreferences;
 import android.os.Bundle;
 import android.os.PowerManager;
@@ -45,6 +48,8 @@ import android.text.InputType;
 import android.text.method.PasswordTransformationMethod;
 import android.content.DialogInterface;
 import android.content.res.Configuration;
+import android.net.ConnectivityManager;
+import android.net.NetworkInfo;
 import android.view.*;
 
 import com.gst_sdk_tutorials.rtspviewersf.R;
@@ -53,6 +58,7 @@ import org.freedesktop.gstreamer.GStreamer;
 public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, OnSeekBarChangeListener {
 
     private static final int numPlayers = 2;
+    private static final int maxWallCells = 16;
 
     /* default for Axis cameras */
     private static final String defaultMediaUri = "rtsp://192.168.0.90/axis-media/media.amp";
@@ -62,15 +68,62 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     private static final String mediaRTSPUriFormat = "rtsp[t|h]://IP/path[?options]";
 
     private native long nativePlayerCreate();        // Initialize native code, build pipeline, etc
+    private native void nativePlayerCreateAsync(int player_id); // Same, on a worker thread: nativePlayerCreated follows
     private native void nativePlayerFinalize(long data);   // Destroy pipeline and shutdown native code
+    private native int nativePlayerGetSession(long data); // Id to reattach to the player after a configuration change
+    private native void nativePlayerDetach(long data);     // Keep the player running without this activity
+    private native long nativePlayerAttach(int session);   // Take over a detached player, 0 if it is gone
+    private native String nativePlayerGetState(long data); // Last state reported by the player
     private native void nativeSetUri(long data, String uri, String user, String pass); // Set the URI of the media to play
+    private native long nativeRecorderCreate(int preEventSeconds); // Player recording a camera to disk, sharing its connection
+    private native long nativeStorageRecorderCreate(int segmentSeconds, long maxBytes, int maxAgeSeconds, int preEventSeconds); // Recorder writing segments into a storage area
+    private native void nativeSetLocation(long data, String location); // File a recorder writes to, or its storage directory
+    private native void nativeRecorderTrigger(long data); // Write the pre-event seconds and go on recording
+    private native String nativeRecorderStats(long data); // Memory held by a recorder and usage of its storage area
     private native void nativePlay(long data);       // Set pipeline to PLAYING
     private native void nativeSetPosition(long data, int milliseconds); // Seek to the indicated position, in milliseconds
+    private native boolean nativeSetRate(long data, double rate); // Playback rate of recordings, negative for reverse
+    private native void nativeSetPlayback(long data, boolean playback); // RTSP URIs are recordings served by a NVR
     private native void nativePause(long data);      // Set pipeline to PAUSED
     private native void nativeReady(long data);      // Set pipeline to READY
+    private native void nativeSetPriority(long data, int priority); // Players with higher priority connect first
     private static native boolean nativeLayerInit(); // Initialize native class: cache Method IDs for callbacks
     private native void nativeSurfaceInit(long data, Object surface); // A new surface is available
     private native void nativeSurfaceFinalize(long data); // Surface about to be destroyed
+    private native void nativeMosaicInit(int columns, int rows); // Create or re-arrange the mosaic renderer
+    private native void nativeMosaicFinalize();      // Destroy the mosaic renderer
+    private native long nativeMosaicPlayerCreate(int cell); // Like nativePlayerCreate, but rendering into a mosaic cell
+    private native void nativeMosaicSurfaceInit(Object surface); // A new surface is available for the mosaic
+    private native void nativeMosaicSurfaceFinalize(); // Mosaic surface about to be destroyed
+    private native String nativeBufferPoolStats();   // Usage of the buffer pools shared by all players
+    private native void nativeVsync(long frameTimeNanos); // Display refresh, frames are presented on it
+    private native String nativePresentStats();      // Presented and dropped frames, judder of all players
+    private native void nativeStartupPhase(String phase); // Record the time a startup phase is reached at
+    private native String nativeStartupStats();      // Startup phases, timed from the loading of the native library
+    private native void nativeSetNetwork(String network); // Transports are remembered per camera and network
+    private native String nativeTlsStats();          // TLS handshake times and resumed sessions per player
+    private native void nativeWallSetLayout(int columns, int rows); // Add or remove mosaic players to fill the grid
+    private native long nativeWallGetPlayer(int cell); // Player of a cell, owned by the wall: never finalize it
+    private native void nativeWallSetUri(int cell, String uri, String user, String pass); // No-op if already playing it
+    private native void nativeWallSwap(int cell, int other); // Exchange the players of two cells
+    private native void nativeWallFinalize();        // Destroy all players of the wall
+    private native long nativeTourCreate(int dwellSeconds, int keepWarm); // Tour cycling through cameras in one surface
+    private native void nativeTourAddCamera(long tour, String uri, String user, String pass); // Append a camera to the tour
+    private native void nativeTourStart(long tour);  // Show the first camera and start cycling
+    private native void nativeTourSurfaceInit(long tour, Object surface); // A new surface is available for the tour
+    private native void nativeTourSurfaceFinalize(long tour); // Tour surface about to be destroyed
+    private native void nativeTourFinalize(long tour); // Stop and destroy the tour
+    private native long nativeSyncGroupCreate(int boundMs); // Group presenting its cameras aligned to their capture time
+    private native void nativeSyncGroupAdd(long group, long data); // Sync the player with the group, from its next uri
+    private native void nativeSyncGroupRemove(long data); // Let the player present on its own again
+    private native String nativeSyncGroupStats(long group); // Lateness of every player and residual skew
+    private native void nativeSyncGroupFinalize(long group); // Drop the group, players keep it until removed
+    private native long nativeExportClip(String directory, long startMs, long endMs, String location); // Copy a range of a storage area into a clip, in the background
+    private native void nativeExportCancel(long export); // Stop an export, deleting the partial clip
+    private native void nativeExportFinalize(long export); // Wait for an export and free it
+    private native void nativeThumbnailGenerate(String location); // Decode the keyframes of a recording into its thumbnail cache, in the background
+    private native byte[] nativeThumbnailGet(String location, int milliseconds); // RGB565 160x90 thumbnail nearest to the position, null if none yet
+    private native void nativeThumbnailRelease(String location); // Unmap the thumbnails of a recording
 
     private long native_custom_data[];      // Native code will store the player here
 
@@ -80,12 +133,33 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     private int desired_position[];         // Position where the users wants to seek to
     private PlayerConfiguration playerConfigs[];              // URI of the clip being played
     private String state[];
+    private boolean configured[];           // Player already streaming its URI, new surfaces only attach to it
+    private Surface pending_surface[];      // Surface that arrived before its player was created
+    private HashMap<Long, String> pending_errors = new HashMap<Long, String>(); // Errors of players not handed over yet, UI thread only
+    private boolean is_destroyed;           // Players created after onDestroy are finalized right away
+    private static boolean startup_reported; // Startup timing is logged once, when the first player plays
     private boolean is_full_screen;
+    private boolean is_wall_shown;          // All cameras of the configuration manager on one surface
 
     private int active_player;
 
     private PowerManager.WakeLock wake_lock;
 
+    // Tell the native layer which network we are on, cameras are probed again on a new one
+    private final BroadcastReceiver network_receiver = new BroadcastReceiver() {
+        public void onReceive(Context context, Intent intent) {
+            ConnectivityManager cm = (ConnectivityManager) getSystemService(Context.CONNECTIVITY_SERVICE);
+            NetworkInfo info = cm.getActiveNetworkInfo();
+
+            if (info == null || !info.isConnected()) {
+                nativeSetNetwork(null);
+                return;
+            }
+            Log.d ("GStreamer", "Network: " + info.getTypeName() + " " + info.getExtraInfo());
+            nativeSetNetwork(info.getTypeName() + ":" + info.getExtraInfo());
+        }
+    };
+
     private Boolean isOrientationLandscape() {
         return (getResources().getConfiguration().orientation == Configuration.ORIENTATION_LANDSCAPE);
     }
@@ -98,6 +172,8 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     	duration = new int[numPlayers];
     	desired_position = new int[numPlayers];
     	state = new String[numPlayers];
+    	configured = new boolean[numPlayers];
+    	pending_surface = new Surface[numPlayers];
 
     	for (int i = 0; i < numPlayers; i++) {
     	    playerConfigs[i] = new PlayerConfiguration();
@@ -124,6 +200,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         // Initialize GStreamer and warn if it fails
         try {
             GStreamer.init(this);
+            nativeStartupPhase("gstreamer initialized");
         } catch (Exception e) {
             Toast.makeText(this, e.getMessage(), Toast.LENGTH_LONG).show();
             finish(); 
@@ -131,6 +208,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         }
 
         setContentView(R.layout.main);
+        nativeStartupPhase("content view set");
 
         PowerManager pm = (PowerManager) getSystemService(Context.POWER_SERVICE);
         wake_lock = pm.newWakeLock(PowerManager.FULL_WAKE_LOCK, "RTSP Viewer");
@@ -172,6 +250,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
             	for (int i = 0; i < numPlayers; i++) {
             	    setState(i);
             	}
+            	updatePriorities();
 	        if (!isOrientationLandscape()) {
 	            for (int i = 0; i < numPlayers; i++) {
                         SurfaceView sv = findSurfaceViewByPlayerId(i);
@@ -248,8 +327,23 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
                         startUriAlertDialog();
                 }
             });
+
+            sv.setOnLongClickListener(new View.OnLongClickListener() {
+                public boolean onLongClick(View v) {
+                    showWall();
+                    return true;
+                }
+            });
         }
 
+        SurfaceView wall_sv = (SurfaceView) this.findViewById(R.id.surface_wall);
+        wall_sv.getHolder().addCallback(this);
+        wall_sv.setOnClickListener(new OnClickListener() {
+            public void onClick(View v) {
+                hideWall();
+            }
+        });
+
         // Retrieve our previous state, or initialize it to default values
         if (savedInstanceState != null) {
             for (int i = 0; i < numPlayers; i++) {
@@ -299,10 +393,99 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         this.findViewById(R.id.button_stop).setEnabled(false);
         
         for (int i = 0; i < numPlayers; i++) {
-            native_custom_data[i] = nativePlayerCreate ();
+            int session = 0;
+
+            // Players survive configuration changes, only new surfaces are handed over to them
+            if (savedInstanceState != null)
+                session = savedInstanceState.getInt("session" + i);
+            if (session != 0)
+                native_custom_data[i] = nativePlayerAttach (session);
+            configured[i] = native_custom_data[i] != 0;
+            if (configured[i]) {
+                state[i] = nativePlayerGetState (native_custom_data[i]);
+                Log.i ("GStreamer", "Reattached to session " + session + " in state " + state[i]);
+            } else {
+                // All players are built in parallel, each tile starts as soon as its player is ready
+                nativePlayerCreateAsync (i);
+            }
         }
+        updatePriorities();
+
+        if (savedInstanceState != null && savedInstanceState.getBoolean("wall"))
+            showWall();
+
+        // Report every display refresh, all players present their frames on it
+        Choreographer.getInstance().postFrameCallback(vsync_callback);
+
+        // Delivered right away with the current network, then on every change
+        registerReceiver(network_receiver, new IntentFilter(ConnectivityManager.CONNECTIVITY_ACTION));
     }
+
+    private final Choreographer.FrameCallback vsync_callback = new Choreographer.FrameCallback() {
+        public void doFrame(long frameTimeNanos) {
+            nativeVsync(frameTimeNanos);
+            Choreographer.getInstance().postFrameCallback(this);
+        }
+    };
     
+    // The active player connects first, then the visible ones
+    private void updatePriorities () {
+        for (int i = 0; i < numPlayers; i++) {
+            if (i == active_player)
+                nativeSetPriority(native_custom_data[i], 2);
+            else if (isOrientationLandscape())
+                nativeSetPriority(native_custom_data[i], 1);
+            else
+                nativeSetPriority(native_custom_data[i], 0);
+        }
+    }
+
+    // Called from native code, on a worker thread, once a player requested with
+    // nativePlayerCreateAsync is ready
+    private void nativePlayerCreated(final int player_id, final long data) {
+        runOnUiThread (new Runnable() {
+            public void run() {
+                String error = pending_errors.remove(data);
+
+                if (is_destroyed) {
+                    nativePlayerFinalize(data);
+                    return;
+                }
+
+                Log.i ("GStreamer", "Player " + player_id + " created");
+                native_custom_data[player_id] = data;
+                state[player_id] = nativePlayerGetState(data);
+                setState(player_id);
+                updatePriorities();
+
+                if (error != null)
+                    showError(player_id, error);
+
+                if (pending_surface[player_id] != null) {
+                    nativeSurfaceInit (data, pending_surface[player_id]);
+                    pending_surface[player_id] = null;
+                    reConfigureGstreamer (data);
+                }
+            }
+        });
+    }
+
+    // Called from native code, on the worker thread of an export
+    private void nativeExportProgress(final long export, final int percent, final boolean done, final String error) {
+        if (!done)
+            return;
+
+        runOnUiThread (new Runnable() {
+            public void run() {
+                if (error != null)
+                    Toast.makeText(RTSPViewerSF.this, "Export failed: " + error, Toast.LENGTH_SHORT).show();
+                else
+                    Log.i ("GStreamer", "Clip exported");
+                nativeExportFinalize(export);
+            }
+        });
+    }
+
     private int findPlayerIdByPlayerData (long data) {
     	for (int i = 0; i < numPlayers; i++)
     	    if (native_custom_data[i] == data)
@@ -378,6 +561,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     }
 
     protected void onSaveInstanceState (Bundle outState) {
+        outState.putBoolean("wall", is_wall_shown);
         for (int i = 0; i < numPlayers; i++) {
             outState.putInt("position" + i, position[i]);
             outState.putInt("duration" + i, duration[i]);
@@ -386,6 +570,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
             outState.putString("mediaUser" + i, playerConfigs[i].getUser());
             outState.putString("mediaPass" + i, playerConfigs[i].getPass());
             outState.putString("mediaName" + i, playerConfigs[i].getName());
+            outState.putInt("session" + i, nativePlayerGetSession(native_custom_data[i]));
             
             Log.d ("GStreamer", "Saving state, playing:" + is_playing_desired[i] + " position:" + position[i] +
                     " duration: " + duration[i] + " uri: " + playerConfigs[i].getUri());
@@ -394,6 +579,13 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
 
     protected void onDestroy() {
     	
+        is_destroyed = true;
+        Choreographer.getInstance().removeFrameCallback(vsync_callback);
+        unregisterReceiver(network_receiver);
+        Log.i ("GStreamer", "Shared buffer pools:\n" + nativeBufferPoolStats());
+        Log.i ("GStreamer", "Presentation:\n" + nativePresentStats());
+        Log.i ("GStreamer", "TLS sessions:\n" + nativeTlsStats());
+
         SharedPreferences sharedPreferences = getPreferences(Context.MODE_PRIVATE);
         SharedPreferences.Editor editor = sharedPreferences.edit();
         
@@ -407,9 +599,17 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         editor.commit();
         
     	for (int i = 0; i < numPlayers; i++) {
-	    nativePlayerFinalize(native_custom_data[i]);
+    	    if (native_custom_data[i] == 0)
+    	        continue;
+    	    // The next activity reattaches to the running players
+    	    if (isChangingConfigurations())
+    	        nativePlayerDetach(native_custom_data[i]);
+    	    else
+	        nativePlayerFinalize(native_custom_data[i]);
     	    native_custom_data[i] = 0x0;
     	}
+        nativeWallFinalize();
+        nativeMosaicFinalize();
         if (wake_lock.isHeld())
             wake_lock.release();
         super.onDestroy();
@@ -455,7 +655,16 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         final String message;
         int player_id = findPlayerIdByPlayerData(data);
         
+        // Not handed over yet, nativePlayerCreated picks the state up
+        if (player_id < 0)
+            return;
+
         this.state[player_id] = state;
+
+        if (!startup_reported && state.equals("PLAYING")) {
+            startup_reported = true;
+            Log.i ("GStreamer", "Startup:\n" + nativeStartupStats());
+        }
         
         tv = findTextViewByPlayerId(player_id);
 
@@ -468,16 +677,24 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         });
     }
     
-    // Called from native code.
-    private void nativeErrorOccured(long data, String message) {
-    	final String ui_message;
-    	int player_id = findPlayerIdByPlayerData(data);
-    	
-    	ui_message = "Player " + player_id + ":" + message;
-    	
+    private void showError(int player_id, String message) {
+        Toast.makeText(this, "Player " + player_id + ":" + message, Toast.LENGTH_SHORT).show();
+    }
+
+    // Called from native code. Looked up on the UI thread, where players are
+    // handed over: errors of a player still being created are kept for
+    // nativePlayerCreated.
+    private void nativeErrorOccured(final long data, final String message) {
         runOnUiThread (new Runnable() {
             public void run() {
-                Toast.makeText(RTSPViewerSF.this, ui_message, Toast.LENGTH_SHORT).show();
+                int player_id = findPlayerIdByPlayerData(data);
+
+                if (player_id < 0) {
+                    pending_errors.put(data, message);
+                    return;
+                }
+
+                showError(player_id, message);
             }
         });
     }
@@ -494,9 +711,13 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         Log.i ("GStreamer", "  playing:" + is_playing_desired[player_id] + " position:" + position[player_id] +
         		" uri: " + playerConfigs[player_id].getUri() + " player id: " + player_id);
 
-        // Restore previous playing state
-        setMediaUri (player_id, playerConfigs[player_id]);
-        nativeSetPosition (native_custom_data[player_id], position[player_id]);
+        // Restore previous playing state. Once configured the player keeps streaming while
+        // surfaces come and go, so it is only handed the new surface.
+        if (!configured[player_id]) {
+            configured[player_id] = true;
+            setMediaUri (player_id, playerConfigs[player_id]);
+            nativeSetPosition (native_custom_data[player_id], position[player_id]);
+        }
         if (is_playing_desired[player_id]) {
             nativePlay(native_custom_data[player_id]);
             wake_lock.acquire();
@@ -532,6 +753,8 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     // Called from native code
     private void nativePositionUpdated(long data, final int position, final int duration) {
         final int player_id = findPlayerIdByPlayerData (data);
+        if (player_id < 0)
+            return;
         final SeekBar sb = findSeekBarByPlayerId (player_id);
 
         // Ignore position messages from the pipeline if the seek bar is being dragged
@@ -558,6 +781,11 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
             int height) {
         Log.d("GStreamer", "Surface changed to format " + format + " width "
                 + width + " height " + height);
+
+        if (holder == ((SurfaceView) this.findViewById(R.id.surface_wall)).getHolder()) {
+            nativeMosaicSurfaceInit (holder.getSurface());
+            return;
+        }
         
         for (int i = 0; i < numPlayers; i++) {
             String surfaceID = "surface_video_" + i;
@@ -570,6 +798,11 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
 
             sh = sv.getHolder();
             if (sh == holder) {
+                if (native_custom_data[i] == 0) {
+                    // Handed over once the player is created
+                    pending_surface[i] = holder.getSurface();
+                    continue;
+                }
                 nativeSurfaceInit (native_custom_data[i], holder.getSurface());
                 reConfigureGstreamer (native_custom_data[i]);
             }
@@ -582,6 +815,11 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
 
     public void surfaceDestroyed(SurfaceHolder holder) {
         Log.d("GStreamer", "Surface destroyed");
+
+        if (holder == ((SurfaceView) this.findViewById(R.id.surface_wall)).getHolder()) {
+            nativeMosaicSurfaceFinalize ();
+            return;
+        }
         
         for (int i = 0; i < numPlayers; i++) {
             String surfaceID = "surface_video_" + i;
@@ -594,6 +832,7 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
 
             sh = sv.getHolder();
             if (sh == holder) {
+                pending_surface[i] = null;
                 nativeSurfaceFinalize (native_custom_data[i]);
             }
         }
@@ -604,6 +843,9 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
     private void nativeMediaSizeChanged (long data, int width, int height) {
     	int player_id = findPlayerIdByPlayerData (data);
     	
+    	if (player_id < 0)
+    	    return;
+
         Log.i ("GStreamer", "Media size changed to " + width + "x" + height);
         
         final GStreamerSurfaceView gsv = (GStreamerSurfaceView) findSurfaceViewByPlayerId (player_id);
@@ -703,6 +945,68 @@ public class RTSPViewerSF extends Activity implements SurfaceHolder.Callback, On
         this.getWindow().addFlags(WindowManager.LayoutParams.FLAG_FORCE_NOT_FULLSCREEN);
     }
     
+    // Show every camera of the configuration manager, up to maxWallCells, in
+    // a grid on a single surface. The players of the wall render into cells of
+    // one mosaic instead of a surface and a video sink each.
+    private void showWall()
+    {
+        // Written by the configuration manager, see ConfigurationManager.onPause()
+        SharedPreferences cameras = getSharedPreferences("ConfigurationManager", Context.MODE_PRIVATE);
+        int cells = Math.min(cameras.getInt("entriesSize", 0), maxWallCells);
+        int columns;
+        int rows;
+
+        if (cells == 0) {
+            Toast.makeText(this, "No cameras in the list", Toast.LENGTH_SHORT).show();
+            return;
+        }
+        columns = (int) Math.ceil(Math.sqrt(cells));
+        rows = (cells + columns - 1) / columns;
+
+        nativeWallSetLayout(columns, rows);
+        for (int cell = 0; cell < cells; cell++) {
+            String uri = cameras.getString("uri" + cell, null);
+
+            if (uri == null)
+                continue;
+            nativeWallSetUri(cell, uri, cameras.getString("user" + cell, null), cameras.getString("pass" + cell, null));
+            nativePlay(nativeWallGetPlayer(cell));
+        }
+
+        // The tiles stop streaming while the wall covers them
+        for (int i = 0; i < numPlayers; i++) {
+            SurfaceView sv = findSurfaceViewByPlayerId(i);
+
+            if (native_custom_data[i] != 0)
+                nativeReady(native_custom_data[i]);
+            if (sv != null)
+                sv.setVisibility(View.INVISIBLE);
+        }
+        this.findViewById(R.id.surface_wall).setVisibility(View.VISIBLE);
+        is_wall_shown = true;
+        wake_lock.acquire();
+        Log.i ("GStreamer", "Wall of " + cells + " cameras, " + columns + "x" + rows);
+    }
+
+    private void hideWall()
+    {
+        // Its surface goes away with it, releasing the window of the mosaic
+        this.findViewById(R.id.surface_wall).setVisibility(View.GONE);
+        nativeWallFinalize();
+        is_wall_shown = false;
+
+        for (int i = 0; i < numPlayers; i++) {
+            SurfaceView sv = findSurfaceViewByPlayerId(i);
+
+            if (sv != null && (i == active_player || isOrientationLandscape()))
+                sv.setVisibility(View.VISIBLE);
+            if (native_custom_data[i] != 0 && is_playing_desired[i])
+                nativePlay(native_custom_data[i]);
+        }
+        if (!is_playing_desired[active_player])
+            wake_lock.release();
+    }
+
     private void startUriAlertDialog()
     {
         AlertDialog.Builder builder = new AlertDialog.Builder(this);